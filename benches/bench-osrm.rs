@@ -239,6 +239,45 @@ fn calculate_multiple_routes_around_paris_100km_ch(c: &mut Criterion) {
     });
 }
 
+fn report_allocations_per_request(c: &mut Criterion) {
+    use rand::Rng;
+    dotenv().expect(".env file could not be read");
+
+    let path = env::var("OSRM_TEST_DATA_PATH_MLD")
+        .expect("Environment variable OSRM_TEST_DATA_PATH_MLD must be defined with a French map");
+    let engine = OsrmEngine::new(&*path, Algorithm::MLD, None)
+        .expect("Failed to initialize OSRM engine");
+
+    let base_lat = 48.8566;
+    let base_lon = 2.3522;
+    let mut rng = rand::rng();
+    let mut requests = 0u64;
+    let before = OsrmEngine::thread_allocations();
+
+    c.bench_function("route_with_annotations_allocations_mld", |b| {
+        b.iter(|| {
+            let request = RouteRequestBuilder::default()
+                .points(vec![
+                    Point { longitude: base_lon + rng.random_range(-0.1..0.1), latitude: base_lat + rng.random_range(-0.1..0.1) },
+                    Point { longitude: base_lon + rng.random_range(-0.1..0.1), latitude: base_lat + rng.random_range(-0.1..0.1) },
+                ])
+                .overview("full")
+                .annotations(vec!["duration".to_string(), "distance".to_string()])
+                .build()
+                .expect("Failed to build RouteRequest");
+            requests += 1;
+            let _response = engine.route(request).ok();
+        });
+    });
+
+    let allocations = OsrmEngine::thread_allocations() - before;
+    if allocations > 0 {
+        println!("allocations per request: {:.1}", allocations as f64 / requests as f64);
+    } else {
+        println!("allocations per request: build with --features alloc-stats to count");
+    }
+}
+
 // Define the benchmark group
 criterion_group!(benches,
     calculate_table_successfully,
@@ -249,7 +288,8 @@ criterion_group!(benches,
     calculate_multiple_routes_around_paris_10km_mld,
     calculate_multiple_routes_around_paris_100km_mld,
     calculate_multiple_routes_around_paris_10km_ch,
-    calculate_multiple_routes_around_paris_100km_ch);
+    calculate_multiple_routes_around_paris_100km_ch,
+    report_allocations_per_request);
 
 // Set the main function to run the benchmarks
 criterion_main!(benches);
@@ -92,6 +92,16 @@ fn main() {
         .define("FMT_HEADER_ONLY", None)
         .define("OSRM_PROJECT_DIR", format!("\"{}\"", osrm_source_path.to_str().unwrap()).as_str());
 
+    // Controlled preprocessing runs OSRM's own tools, installed next to the libraries.
+    // This is only a default for the machine that built the crate: deployed
+    // binaries find the tools through OSRM_TOOLS_DIR or run the stages in process.
+    build.define("OSRM_BINDING_TOOLS_DIR", format!("\"{}\"", dst.join("bin").to_str().unwrap()).as_str());
+
+    // Count C++ allocations per thread for the benchmarks
+    if std::env::var("CARGO_FEATURE_ALLOC_STATS").is_ok() {
+        build.define("OSRM_BINDING_ALLOC_STATS", None);
+    }
+
     if target_os == "macos" {
         build
             .include("/opt/homebrew/opt/boost@1.85/include")
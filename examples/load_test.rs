@@ -0,0 +1,181 @@
+// examples/load_test.rs
+//
+// Replays a JSONL request log against an OsrmEngine and reports throughput and
+// latency percentiles per service.
+//
+//   cargo run --release --example load_test -- <dataset.osrm> <log.jsonl> \
+//       [--algorithm MLD|CH] [--concurrency N] [--rate REQUESTS_PER_SECOND] [--duration SECONDS]
+//
+// The log format is described in src/request_log.rs; every line is one
+// route, table, nearest or match request, e.g.
+//
+//   {"service": "route", "coordinates": [[2.3522, 48.8566], [5.3698, 43.2965]]}
+//
+// OsrmEngine::dump_slow_queries writes its slow-query log in this format.
+//
+// Without --rate the replay is closed-loop: every worker sends its next request as
+// soon as the previous one returns. With --rate requests are scheduled at a fixed
+// rate and latency is measured from the scheduled time, so queueing delay caused
+// by a slow engine is counted instead of hidden. The log is replayed once, or in
+// a loop until --duration has passed.
+
+use std::collections::BTreeMap;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::time::{Duration, Instant};
+
+use osrm_binding::algorithm::Algorithm;
+use osrm_binding::osrm_engine::OsrmEngine;
+use osrm_binding::request_log::parse_request;
+
+struct Options {
+    dataset: String,
+    log: String,
+    algorithm: Algorithm,
+    concurrency: usize,
+    rate: Option<f64>,
+    duration: Option<Duration>,
+}
+
+fn parse_options() -> Result<Options, String> {
+    let mut args = std::env::args().skip(1);
+    let mut positional = Vec::new();
+    let mut algorithm = Algorithm::MLD;
+    let mut concurrency = std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1);
+    let mut rate = None;
+    let mut duration = None;
+
+    while let Some(arg) = args.next() {
+        let mut value = |name: &str| args.next().ok_or(format!("{} needs a value", name));
+        match arg.as_str() {
+            "--algorithm" => {
+                algorithm = match value("--algorithm")?.as_str() {
+                    "CH" => Algorithm::CH,
+                    "MLD" => Algorithm::MLD,
+                    other => return Err(format!("Unknown algorithm {}", other)),
+                }
+            }
+            "--concurrency" => concurrency = value("--concurrency")?.parse().map_err(|e| format!("--concurrency: {}", e))?,
+            "--rate" => rate = Some(value("--rate")?.parse().map_err(|e| format!("--rate: {}", e))?),
+            "--duration" => {
+                let seconds: f64 = value("--duration")?.parse().map_err(|e| format!("--duration: {}", e))?;
+                duration = Some(Duration::from_secs_f64(seconds));
+            }
+            _ => positional.push(arg),
+        }
+    }
+
+    if positional.len() != 2 {
+        return Err("usage: load_test <dataset.osrm> <log.jsonl> [--algorithm MLD|CH] [--concurrency N] [--rate RPS] [--duration SECONDS]".to_string());
+    }
+    Ok(Options {
+        dataset: positional[0].clone(),
+        log: positional[1].clone(),
+        algorithm,
+        concurrency: concurrency.max(1),
+        rate,
+        duration,
+    })
+}
+
+#[derive(Default)]
+struct ServiceStats {
+    latencies: Vec<Duration>,
+    errors: usize,
+}
+
+fn percentile(sorted: &[Duration], p: f64) -> Duration {
+    if sorted.is_empty() {
+        return Duration::ZERO;
+    }
+    let rank = ((p / 100.0) * (sorted.len() - 1) as f64).round() as usize;
+    sorted[rank.min(sorted.len() - 1)]
+}
+
+fn main() {
+    let options = match parse_options() {
+        Ok(options) => options,
+        Err(e) => {
+            eprintln!("{}", e);
+            std::process::exit(2);
+        }
+    };
+
+    let log = std::fs::read_to_string(&options.log).expect("request log could not be read");
+    let mut requests = Vec::new();
+    for (number, line) in log.lines().enumerate().filter(|(_, line)| !line.trim().is_empty()) {
+        match parse_request(line) {
+            Ok(request) => requests.push(request),
+            Err(e) => eprintln!("Skipping line {}: {}", number + 1, e),
+        }
+    }
+    if requests.is_empty() {
+        eprintln!("No requests to replay");
+        std::process::exit(1);
+    }
+
+    let engine = OsrmEngine::new(&options.dataset, options.algorithm, None).expect("Failed to initialize OSRM engine");
+
+    let next = AtomicUsize::new(0);
+    let stats: Mutex<BTreeMap<&'static str, ServiceStats>> = Mutex::new(BTreeMap::new());
+    let start = Instant::now();
+
+    std::thread::scope(|scope| {
+        for _ in 0..options.concurrency {
+            scope.spawn(|| {
+                let mut local: BTreeMap<&'static str, ServiceStats> = BTreeMap::new();
+                loop {
+                    let i = next.fetch_add(1, Ordering::Relaxed);
+                    let scheduled = match options.rate {
+                        Some(rate) => start + Duration::from_secs_f64(i as f64 / rate),
+                        None => Instant::now(),
+                    };
+                    let finished = match options.duration {
+                        Some(duration) => scheduled.duration_since(start) >= duration,
+                        None => i >= requests.len(),
+                    };
+                    if finished {
+                        break;
+                    }
+                    if let Some(wait) = scheduled.checked_duration_since(Instant::now()) {
+                        std::thread::sleep(wait);
+                    }
+
+                    let request = &requests[i % requests.len()];
+                    let ok = request.send(&engine).is_ok();
+                    let service = local.entry(request.service()).or_default();
+                    service.latencies.push(scheduled.elapsed());
+                    if !ok {
+                        service.errors += 1;
+                    }
+                }
+
+                let mut stats = stats.lock().unwrap();
+                for (name, service) in local {
+                    let merged = stats.entry(name).or_default();
+                    merged.latencies.extend(service.latencies);
+                    merged.errors += service.errors;
+                }
+            });
+        }
+    });
+
+    let elapsed = start.elapsed();
+    let mut stats = stats.into_inner().unwrap();
+    println!("{:<8} {:>8} {:>7} {:>10} {:>10} {:>10} {:>10} {:>10}",
+             "service", "requests", "errors", "req/s", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    for (name, service) in stats.iter_mut() {
+        service.latencies.sort();
+        let ms = |d: Duration| d.as_secs_f64() * 1000.0;
+        println!("{:<8} {:>8} {:>7} {:>10.1} {:>10.2} {:>10.2} {:>10.2} {:>10.2}",
+                 name,
+                 service.latencies.len(),
+                 service.errors,
+                 service.latencies.len() as f64 / elapsed.as_secs_f64(),
+                 ms(percentile(&service.latencies, 50.0)),
+                 ms(percentile(&service.latencies, 90.0)),
+                 ms(percentile(&service.latencies, 99.0)),
+                 ms(service.latencies.last().copied().unwrap_or_default()));
+    }
+    println!("{} requests in {:.2}s", stats.values().map(|s| s.latencies.len()).sum::<usize>(), elapsed.as_secs_f64());
+}
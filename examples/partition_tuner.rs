@@ -0,0 +1,133 @@
+// examples/partition_tuner.rs
+//
+// Partitions and customizes an extracted dataset with every combination of the
+// given osrm-partition settings, benchmarks the route and table requests of a
+// JSONL request log against each result and prints the customize time / query
+// latency / memory trade-off.
+//
+//   cargo run --release --example partition_tuner -- <extract.osrm> <work_dir> <log.jsonl> \
+//       [--balance 1.2,1.5] [--boundary-factor 0.25,0.5] [--cuts 10,20] [--small-component-size 1000] \
+//       [--cell-sizes 128:4096:65536:2097152,64:2048:65536:2097152] [--repetitions N] [--threads N] \
+//       [--keep] [--json report.json]
+//
+// The log has the format of src/request_log.rs, as replayed by
+// examples/load_test.rs; lines of other services are skipped. Every list is comma-separated, an omitted parameter keeps OSRM's
+// default. Candidates are built one after another in <work_dir>, each from a
+// fresh copy of the extract, and deleted once measured unless --keep is given.
+// Rows marked with * are not beaten by any other candidate on customize time,
+// workload time and graph size at once.
+
+use osrm_binding::partition_tuning::{PartitionGrid, PartitionTuner, Workload};
+use osrm_binding::request_log::{parse_request, Request};
+
+struct Options {
+    extract: String,
+    work_dir: String,
+    log: String,
+    grid: PartitionGrid,
+    repetitions: usize,
+    threads: Option<i32>,
+    keep: bool,
+    json: Option<String>,
+}
+
+fn list<T: std::str::FromStr>(name: &str, value: &str) -> Result<Vec<T>, String>
+where
+    T::Err: std::fmt::Display,
+{
+    value.split(',')
+        .map(|item| item.trim().parse().map_err(|e| format!("{}: {}", name, e)))
+        .collect()
+}
+
+fn parse_options() -> Result<Options, String> {
+    let mut args = std::env::args().skip(1);
+    let mut positional = Vec::new();
+    let mut grid = PartitionGrid::default();
+    let mut repetitions = 5;
+    let mut threads = None;
+    let mut keep = false;
+    let mut json = None;
+
+    while let Some(arg) = args.next() {
+        let mut value = |name: &str| args.next().ok_or(format!("{} needs a value", name));
+        match arg.as_str() {
+            "--balance" => grid.balance = list("--balance", &value("--balance")?)?,
+            "--boundary-factor" => grid.boundary_factor = list("--boundary-factor", &value("--boundary-factor")?)?,
+            "--cuts" => grid.num_optimizing_cuts = list("--cuts", &value("--cuts")?)?,
+            "--small-component-size" => {
+                grid.small_component_size = list("--small-component-size", &value("--small-component-size")?)?
+            }
+            "--cell-sizes" => {
+                grid.max_cell_sizes = value("--cell-sizes")?
+                    .split(',')
+                    .map(|sizes| list("--cell-sizes", &sizes.replace(':', ",")))
+                    .collect::<Result<_, _>>()?
+            }
+            "--repetitions" => repetitions = value("--repetitions")?.parse().map_err(|e| format!("--repetitions: {}", e))?,
+            "--threads" => threads = Some(value("--threads")?.parse().map_err(|e| format!("--threads: {}", e))?),
+            "--keep" => keep = true,
+            "--json" => json = Some(value("--json")?),
+            _ => positional.push(arg),
+        }
+    }
+
+    if positional.len() != 3 {
+        return Err("usage: partition_tuner <extract.osrm> <work_dir> <log.jsonl> [--balance B,..] [--boundary-factor F,..] \
+                    [--cuts N,..] [--small-component-size N,..] [--cell-sizes S:S:S:S,..] [--repetitions N] [--threads N] \
+                    [--keep] [--json PATH]".to_string());
+    }
+    Ok(Options {
+        extract: positional[0].clone(),
+        work_dir: positional[1].clone(),
+        log: positional[2].clone(),
+        grid,
+        repetitions: repetitions.max(1),
+        threads,
+        keep,
+        json,
+    })
+}
+
+fn main() {
+    let options = match parse_options() {
+        Ok(options) => options,
+        Err(e) => {
+            eprintln!("{}", e);
+            std::process::exit(2);
+        }
+    };
+
+    let log = std::fs::read_to_string(&options.log).expect("request log could not be read");
+    let mut workload = Workload { repetitions: options.repetitions, ..Default::default() };
+    for (number, line) in log.lines().enumerate().filter(|(_, line)| !line.trim().is_empty()) {
+        match parse_request(line) {
+            Ok(Request::Route(request)) => workload.routes.push(request),
+            Ok(Request::Table(request)) => workload.tables.push(request),
+            Ok(_) => {}
+            Err(e) => eprintln!("Skipping line {}: {}", number + 1, e),
+        }
+    }
+    println!("Workload: {} routes, {} tables, {} repetitions",
+             workload.routes.len(), workload.tables.len(), workload.repetitions);
+
+    let mut tuner = PartitionTuner::new(&options.extract, &options.work_dir);
+    tuner.threads = options.threads;
+    tuner.keep_candidates = options.keep;
+
+    let report = tuner
+        .run(&options.grid, &workload, |done, total, candidate| {
+            match &candidate.error {
+                Some(error) => eprintln!("[{}/{}] {} failed: {}", done, total, candidate.settings.label(), error),
+                None => eprintln!("[{}/{}] {}: customize {:.0} ms, workload {:.2} ms",
+                                  done, total, candidate.settings.label(), candidate.customize_ms, candidate.workload_ms),
+            }
+        })
+        .expect("Tuning failed");
+
+    print!("{}", report.to_table());
+    if let Some(path) = options.json {
+        let json = serde_json::to_string_pretty(&report).expect("report could not be serialized");
+        std::fs::write(&path, json).expect("report could not be written");
+    }
+}
@@ -0,0 +1,45 @@
+// geometry.rs
+use serde::{Deserialize, Serialize};
+
+/// Geometry and annotations of one route, trip or matching as typed arrays.
+/// Returned when a request sets `geometries` to `"binary"`.
+#[derive(Debug, Clone, Default, Deserialize, Serialize)]
+pub struct RouteGeometry {
+    /// Route coordinates as `[longitude, latitude]`, empty when overview is disabled
+    pub coordinates: Vec<[f64; 2]>,
+    /// Per-leg annotations, empty arrays when the annotation was not requested
+    pub legs: Vec<LegAnnotation>,
+    /// With `simplify_tolerance`, the largest tolerance in meters at which each
+    /// coordinate would still be kept; empty otherwise
+    #[serde(default)]
+    pub significance: Vec<f64>,
+}
+
+impl RouteGeometry {
+    /// Coordinates of the geometry simplified to `tolerance` meters. Only coarser
+    /// tolerances than the request's `simplify_tolerance` remove points, and no
+    /// geometry is walked again: the points are filtered by their significance.
+    pub fn coarsened(&self, tolerance: f64) -> Vec<[f64; 2]> {
+        if self.significance.len() != self.coordinates.len() {
+            return self.coordinates.clone();
+        }
+        self.coordinates.iter()
+            .zip(&self.significance)
+            .filter(|&(_, &significance)| significance > tolerance)
+            .map(|(&coordinate, _)| coordinate)
+            .collect()
+    }
+}
+
+/// Segment annotations of a single leg
+#[derive(Debug, Clone, Default, Deserialize, Serialize)]
+pub struct LegAnnotation {
+    /// Duration of each segment in seconds
+    pub durations: Vec<f64>,
+    /// Distance of each segment in meters
+    pub distances: Vec<f64>,
+    /// Speed of each segment in meters per second
+    pub speeds: Vec<f64>,
+    /// OSM node ids along the leg
+    pub nodes: Vec<u64>,
+}
@@ -8,9 +8,25 @@ pub mod waypoints;
 pub mod osrm_engine;
 pub mod r#match;
 pub mod nearest;
+pub mod geometry;
+pub mod pipeline;
+pub mod time_dependent;
+pub mod numa;
+pub mod prefork;
+pub mod one_to_all;
+pub mod partition_tuning;
+pub mod request_log;
 // src/lib.rs
 use std::ffi::{c_void, CStr, CString};
 use std::os::raw::c_char;
+use serde::{Deserialize, Serialize};
+use crate::point::FixedPoint;
+use crate::route::{LegSummary, PairRoute, RouteSummary};
+use crate::trip::TripSolution;
+use crate::prefork::PageReport;
+use crate::tables::{LocationTable, SparseTableResponse, SparsityPattern};
+use crate::geometry::{LegAnnotation, RouteGeometry};
+use crate::pipeline::{ContractUpdateStats, PipelineConfig, PipelineReport, ProfileMemoStats, RunControl, StageProgress, StageReport};
 
 #[repr(C)]
 struct OsrmResult {
@@ -36,6 +52,200 @@ pub struct OsrmConfig {
     default_radius: f64,
 }
 
+#[repr(C)]
+struct OsrmRouteSummary {
+    duration: f64,
+    distance: f64,
+    weight: f64,
+    num_legs: usize,
+    leg_durations: *mut f64,
+    leg_distances: *mut f64,
+}
+
+#[repr(C)]
+struct OsrmSparseMatrix {
+    num_rows: usize,
+    num_cells: usize,
+    row_offsets: *mut usize,
+    column_indices: *mut usize,
+    durations: *mut f64,
+    distances: *mut f64,
+    estimated: *mut u8,
+}
+
+#[repr(C)]
+struct OsrmRouteMatrix {
+    num_pairs: usize,
+    durations: *mut f64,
+    distances: *mut f64,
+}
+
+#[repr(C)]
+struct OsrmTripSolution {
+    num_stops: usize,
+    order: *mut usize,
+    num_legs: usize,
+    leg_durations: *mut f64,
+    leg_distances: *mut f64,
+    duration: f64,
+    distance: f64,
+}
+
+#[repr(C)]
+struct OsrmGeometry {
+    num_routes: usize,
+    coordinate_offsets: *mut usize,
+    coordinates: *mut f64,
+    leg_offsets: *mut usize,
+    num_legs: usize,
+    annotation_offsets: *mut usize,
+    durations: *mut f64,
+    distances: *mut f64,
+    speeds: *mut f64,
+    node_offsets: *mut usize,
+    nodes: *mut u64,
+    significance: *mut f64,
+}
+
+impl OsrmGeometry {
+    fn empty() -> Self {
+        OsrmGeometry {
+            num_routes: 0,
+            coordinate_offsets: std::ptr::null_mut(),
+            coordinates: std::ptr::null_mut(),
+            leg_offsets: std::ptr::null_mut(),
+            num_legs: 0,
+            annotation_offsets: std::ptr::null_mut(),
+            durations: std::ptr::null_mut(),
+            distances: std::ptr::null_mut(),
+            speeds: std::ptr::null_mut(),
+            node_offsets: std::ptr::null_mut(),
+            nodes: std::ptr::null_mut(),
+            significance: std::ptr::null_mut(),
+        }
+    }
+
+    /// Copies the typed arrays into per-route values and releases the C++ buffers.
+    fn take(&mut self) -> Vec<RouteGeometry> {
+        // A null array means the wrapper produced no values for it
+        fn slice<'a, T>(ptr: *const T, start: usize, end: usize) -> &'a [T] {
+            if ptr.is_null() || end <= start {
+                &[]
+            } else {
+                unsafe { std::slice::from_raw_parts(ptr.add(start), end - start) }
+            }
+        }
+
+        let mut routes = Vec::with_capacity(self.num_routes);
+        if self.num_routes > 0 {
+            let coordinate_offsets = slice(self.coordinate_offsets, 0, self.num_routes + 1);
+            let leg_offsets = slice(self.leg_offsets, 0, self.num_routes + 1);
+            let annotation_offsets = slice(self.annotation_offsets, 0, self.num_legs + 1);
+            let node_offsets = slice(self.node_offsets, 0, self.num_legs + 1);
+
+            for route in 0..self.num_routes {
+                let coordinates = slice(self.coordinates, coordinate_offsets[route] * 2, coordinate_offsets[route + 1] * 2)
+                    .chunks_exact(2)
+                    .map(|c| [c[0], c[1]])
+                    .collect();
+                let legs = (leg_offsets[route]..leg_offsets[route + 1]).map(|leg| {
+                    let (start, end) = (annotation_offsets[leg], annotation_offsets[leg + 1]);
+                    LegAnnotation {
+                        durations: slice(self.durations, start, end).to_vec(),
+                        distances: slice(self.distances, start, end).to_vec(),
+                        speeds: slice(self.speeds, start, end).to_vec(),
+                        nodes: slice(self.nodes, node_offsets[leg], node_offsets[leg + 1]).to_vec(),
+                    }
+                }).collect();
+                let significance = slice(self.significance, coordinate_offsets[route], coordinate_offsets[route + 1]).to_vec();
+                routes.push(RouteGeometry { coordinates, legs, significance });
+            }
+        }
+
+        unsafe {
+            osrm_free_geometry(self);
+        }
+        routes
+    }
+}
+
+type OsrmProgressCallback = extern "C" fn(stage: *const c_char, percent: f64, elapsed_seconds: f64, user_data: *mut c_void);
+
+#[repr(C)]
+struct OsrmPipelineConfig {
+    input_path: *const c_char,
+    profile_path: *const c_char,
+    threads: i32,
+    build_ch: bool,
+    build_mld: bool,
+    parse_conditionals: bool,
+    use_metadata: bool,
+    use_locations_cache: bool,
+    balance: f64,
+    boundary_factor: f64,
+    num_optimizing_cuts: i32,
+    small_component_size: i32,
+    max_cell_sizes: *const i32,
+    num_max_cell_sizes: usize,
+}
+
+#[repr(C)]
+struct OsrmRunControl {
+    progress: Option<OsrmProgressCallback>,
+    user_data: *mut c_void,
+    cancel_requested: *const bool,
+    memory_limit_bytes: usize,
+    log_path: *const c_char,
+    tools_dir: *const c_char,
+}
+
+impl OsrmRunControl {
+    /// Borrows the pointers of `control`; the returned CStrings back `log_path` and
+    /// `tools_dir` and must outlive the call.
+    fn from_control(control: &mut RunControl) -> Result<(Self, [Option<CString>; 2]), String> {
+        let c_log_path = control.log_path.as_ref()
+            .map(|s| CString::new(s.as_str()).map_err(|e| e.to_string()))
+            .transpose()?;
+        let c_tools_dir = control.tools_dir.as_ref()
+            .map(|s| CString::new(s.as_str()).map_err(|e| e.to_string()))
+            .transpose()?;
+        let (progress, user_data): (Option<OsrmProgressCallback>, *mut c_void) = match control.progress.as_mut() {
+            Some(callback) => (Some(progress_trampoline), callback as *mut &mut (dyn FnMut(&StageProgress) + Send) as *mut c_void),
+            None => (None, std::ptr::null_mut()),
+        };
+        Ok((OsrmRunControl {
+            progress,
+            user_data,
+            // AtomicBool has the same in-memory representation as bool
+            cancel_requested: control.cancel.map_or(std::ptr::null(), |c| c.as_ptr() as *const bool),
+            memory_limit_bytes: control.memory_limit_bytes.unwrap_or(0),
+            log_path: c_log_path.as_ref().map_or(std::ptr::null(), |s| s.as_ptr()),
+            tools_dir: c_tools_dir.as_ref().map_or(std::ptr::null(), |s| s.as_ptr()),
+        }, [c_log_path, c_tools_dir]))
+    }
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct OsrmStageReport {
+    stage: *const c_char,
+    seconds: f64,
+    peak_rss_bytes: usize,
+}
+
+#[repr(C)]
+struct OsrmPipelineReport {
+    num_stages: usize,
+    stages: [OsrmStageReport; 4],
+}
+
+/// Forwards progress notifications from the wrapper to a Rust closure passed as `user_data`.
+extern "C" fn progress_trampoline(stage: *const c_char, percent: f64, elapsed_seconds: f64, user_data: *mut c_void) {
+    let callback = unsafe { &mut *(user_data as *mut &mut (dyn FnMut(&StageProgress) + Send)) };
+    let stage = unsafe { CStr::from_ptr(stage) }.to_string_lossy().into_owned();
+    callback(&StageProgress { stage, percent, elapsed_seconds });
+}
+
 #[link(name = "osrm_wrapper", kind = "static")]
 unsafe extern "C" {
     fn osrm_create(base_path: *const c_char, algorithm : *const c_char, max_table_size: i32) -> *mut c_void;
@@ -88,8 +298,10 @@ unsafe extern "C" {
         num_annotations: usize,
         geometries: *const c_char,
         overview: *const c_char,
+        simplify_tolerance: f64,
         exclude: *const *const c_char,
         num_exclude: usize,
+        geometry: *mut OsrmGeometry,
     ) -> OsrmResult;
 
     fn osrm_route(
@@ -112,12 +324,229 @@ unsafe extern "C" {
         num_annotations: usize,
         geometries: *const c_char,
         overview: *const c_char,
+        simplify_tolerance: f64,
         continue_straight: bool,
         exclude: *const *const c_char,
         num_exclude: usize,
         waypoints: *const usize,
         num_waypoints: usize,
         skip_waypoints: bool,
+        geometry: *mut OsrmGeometry,
+    ) -> OsrmResult;
+
+    fn osrm_route_summary(
+        osrm_instance: *mut c_void,
+        coordinates: *const f64,
+        num_coordinates: usize,
+        include_legs: bool,
+        summary: *mut OsrmRouteSummary,
+    ) -> OsrmResult;
+
+    fn osrm_free_route_summary(summary: *mut OsrmRouteSummary);
+
+    fn osrm_table_sparse(
+        osrm_instance: *mut c_void,
+        coordinates: *const f64,
+        num_coordinates: usize,
+        row_offsets: *const usize,
+        column_indices: *const usize,
+        k_nearest: usize,
+        fallback_speed: f64,
+        threads: i32,
+        matrix: *mut OsrmSparseMatrix,
+    ) -> OsrmResult;
+
+    fn osrm_free_sparse_matrix(matrix: *mut OsrmSparseMatrix);
+
+    fn osrm_thread_allocations() -> u64;
+
+    fn osrm_prepare_time_bucket(
+        base_path: *const c_char,
+        bucket_path: *const c_char,
+        segment_speed_files: *const *const c_char,
+        num_segment_speed_files: usize,
+        threads: i32,
+    ) -> OsrmResult;
+
+    fn osrm_warm_thread(
+        osrm_instance: *mut c_void,
+        coordinates: *const f64,
+        num_coordinates: usize,
+    ) -> OsrmResult;
+
+    fn osrm_release_thread_heaps();
+
+    fn osrm_reserve_thread_heaps(algorithm: *const c_char, node_count: usize) -> OsrmResult;
+
+    fn osrm_set_coalescing(osrm_instance: *mut c_void, enabled: bool);
+
+    fn osrm_coalescing_stats(osrm_instance: *mut c_void, stats: *mut CoalescingStats);
+
+    fn osrm_set_slow_query_log(osrm_instance: *mut c_void, threshold_ms: f64, capacity: usize);
+
+    fn osrm_slow_query_log_drain(osrm_instance: *mut c_void) -> OsrmResult;
+
+    fn osrm_slow_query_log_dump(osrm_instance: *mut c_void, path: *const c_char, count: *mut usize) -> OsrmResult;
+
+    fn osrm_slow_query_log_dropped(osrm_instance: *mut c_void) -> u64;
+
+    fn osrm_numa_nodes(nodes: *mut usize, capacity: usize) -> usize;
+
+    fn osrm_numa_current_node() -> usize;
+
+    fn osrm_numa_pin_thread(node: usize) -> OsrmResult;
+
+    fn osrm_page_report(report: *mut PageReport) -> OsrmResult;
+
+    fn osrm_fork_worker(pid: *mut i32) -> OsrmResult;
+
+    fn osrm_wait_worker(pid: i32, exit_code: *mut i32) -> OsrmResult;
+
+    fn osrm_kill_worker(pid: i32) -> OsrmResult;
+
+    fn osrm_exit_worker(code: i32) -> !;
+
+    fn osrm_prefork_check(
+        osrm_instance: *mut c_void,
+        coordinates: *const f64,
+        num_coordinates: usize,
+        before: *mut PageReport,
+        after: *mut PageReport,
+    ) -> OsrmResult;
+
+    fn osrm_memory_report(
+        base_path: *const c_char,
+        algorithm: *const c_char,
+        disable_feature_dataset_flags: i32,
+        report: *mut OsrmMemoryReport,
+    ) -> OsrmResult;
+
+    fn osrm_table_fixed(
+        osrm_instance: *mut c_void,
+        coordinates: *const FixedPoint,
+        num_coordinates: usize,
+        sources: *const usize,
+        num_sources: usize,
+        destinations: *const usize,
+        num_destinations: usize,
+        include_duration: bool,
+        include_distance: bool,
+        fallback_speed: f64,
+    ) -> OsrmResult;
+
+    fn osrm_route_summary_fixed(
+        osrm_instance: *mut c_void,
+        coordinates: *const FixedPoint,
+        num_coordinates: usize,
+        include_legs: bool,
+        summary: *mut OsrmRouteSummary,
+    ) -> OsrmResult;
+
+    fn osrm_free_geometry(geometry: *mut OsrmGeometry);
+
+    fn osrm_route_matrix(
+        osrm_instance: *mut c_void,
+        coordinates: *const f64,
+        num_coordinates: usize,
+        pair_sources: *const usize,
+        pair_destinations: *const usize,
+        num_pairs: usize,
+        annotations: *const *const c_char,
+        num_annotations: usize,
+        threads: i32,
+        matrix: *mut OsrmRouteMatrix,
+        geometry: *mut OsrmGeometry,
+    ) -> OsrmResult;
+
+    fn osrm_free_route_matrix(matrix: *mut OsrmRouteMatrix);
+
+    fn osrm_trip_solve(
+        osrm_instance: *mut c_void,
+        coordinates: *const f64,
+        num_coordinates: usize,
+        roundtrip: bool,
+        time_budget_ms: f64,
+        threads: i32,
+        solution: *mut OsrmTripSolution,
+    ) -> OsrmResult;
+
+    fn osrm_free_trip_solution(solution: *mut OsrmTripSolution);
+
+    fn osrm_location_set_create(
+        osrm_instance: *mut c_void,
+        coordinates: *const f64,
+        num_coordinates: usize,
+        precompute_table: bool,
+        threads: i32,
+        location_set: *mut *mut c_void,
+    ) -> OsrmResult;
+
+    fn osrm_location_set_destroy(location_set: *mut c_void);
+
+    fn osrm_location_set_table(
+        location_set: *mut c_void,
+        sources: *const usize,
+        num_sources: usize,
+        destinations: *const usize,
+        num_destinations: usize,
+        durations: *mut f64,
+        distances: *mut f64,
+    ) -> OsrmResult;
+
+    fn osrm_location_set_table_from(
+        location_set: *mut c_void,
+        coordinates: *const f64,
+        num_coordinates: usize,
+        destinations: *const usize,
+        num_destinations: usize,
+        durations: *mut f64,
+        distances: *mut f64,
+    ) -> OsrmResult;
+
+    fn osrm_location_set_route_summary(
+        location_set: *mut c_void,
+        ids: *const usize,
+        num_ids: usize,
+        include_legs: bool,
+        summary: *mut OsrmRouteSummary,
+    ) -> OsrmResult;
+
+    fn osrm_ch_sweep_create(
+        osrm_instance: *mut c_void,
+        base_path: *const c_char,
+        sweep: *mut *mut c_void,
+    ) -> OsrmResult;
+
+    fn osrm_ch_sweep_destroy(sweep: *mut c_void);
+
+    fn osrm_ch_sweep_node_count(sweep: *mut c_void) -> usize;
+
+    fn osrm_ch_sweep_one_to_all(
+        sweep: *mut c_void,
+        sources: *const f64,
+        num_sources: usize,
+        threads: i32,
+        durations: *mut f64,
+    ) -> OsrmResult;
+
+    fn osrm_ch_sweep_table(
+        sweep: *mut c_void,
+        sources: *const f64,
+        num_sources: usize,
+        targets: *const f64,
+        num_targets: usize,
+        threads: i32,
+        durations: *mut f64,
+    ) -> OsrmResult;
+
+    fn osrm_route_alternatives(
+        osrm_instance: *mut c_void,
+        coordinates: *const f64,
+        max_alternatives: usize,
+        max_stretch: f64,
+        max_overlap: f64,
+        time_budget_ms: f64,
+        threads: i32,
     ) -> OsrmResult;
     
     fn osrm_match(
@@ -145,8 +574,10 @@ unsafe extern "C" {
         num_annotations: usize,
         geometries: *const c_char,
         overview: *const c_char,
+        simplify_tolerance: f64,
         exclude: *const *const c_char,
         num_exclude: usize,
+        geometry: *mut OsrmGeometry,
     ) -> OsrmResult;
 
     fn osrm_nearest(
@@ -172,6 +603,26 @@ unsafe extern "C" {
         base_path: *const c_char,
         threads: i32
     ) -> OsrmResult;
+
+    fn osrm_run_contract_with_updates(
+        base_path: *const c_char,
+        segment_speed_files: *const *const c_char,
+        num_segment_speed_files: usize,
+        turn_penalty_files: *const *const c_char,
+        num_turn_penalty_files: usize,
+        threads: i32,
+    ) -> OsrmResult;
+
+    fn osrm_run_contract_update(
+        base_path: *const c_char,
+        segment_speed_files: *const *const c_char,
+        num_segment_speed_files: usize,
+        turn_penalty_files: *const *const c_char,
+        num_turn_penalty_files: usize,
+        check_all_nodes: bool,
+        threads: i32,
+        stats: *mut ContractUpdateStats,
+    ) -> OsrmResult;
     
     fn osrm_run_extract(
         input_path: *const c_char,
@@ -184,6 +635,16 @@ unsafe extern "C" {
         use_locations_cache: bool,
     ) -> OsrmResult;
     
+    fn osrm_run_extract_memoized(
+        input_path: *const c_char,
+        profile_path: *const c_char,
+        threads: i32,
+        parse_conditionals: bool,
+        use_metadata: bool,
+        use_locations_cache: bool,
+        stats: *mut ProfileMemoStats,
+    ) -> OsrmResult;
+
     fn osrm_run_partition(
         base_path: *const c_char,
         threads: i32,
@@ -199,6 +660,46 @@ unsafe extern "C" {
         base_path: *const c_char,
         threads: i32
     ) -> OsrmResult;
+
+    fn osrm_run_pipeline(
+        config: *const OsrmPipelineConfig,
+        control: *const OsrmRunControl,
+        report: *mut OsrmPipelineReport,
+    ) -> OsrmResult;
+
+    fn osrm_run_extract_controlled(
+        input_path: *const c_char,
+        profile_path: *const c_char,
+        threads: i32,
+        parse_conditionals: bool,
+        use_metadata: bool,
+        use_locations_cache: bool,
+        control: *const OsrmRunControl,
+    ) -> OsrmResult;
+
+    fn osrm_run_partition_controlled(
+        base_path: *const c_char,
+        threads: i32,
+        balance: f64,
+        boundary_factor: f64,
+        num_optimizing_cuts: i32,
+        small_component_size: i32,
+        max_cell_sizes: *const i32,
+        num_max_cell_sizes: usize,
+        control: *const OsrmRunControl,
+    ) -> OsrmResult;
+
+    fn osrm_run_customize_controlled(
+        base_path: *const c_char,
+        threads: i32,
+        control: *const OsrmRunControl,
+    ) -> OsrmResult;
+
+    fn osrm_run_contract_controlled(
+        base_path: *const c_char,
+        threads: i32,
+        control: *const OsrmRunControl,
+    ) -> OsrmResult;
 }
 
 /// Configuration options for creating an OSRM engine instance
@@ -255,6 +756,85 @@ impl Default for EngineConfig {
     }
 }
 
+/// Route and table requests of an engine with coalescing enabled
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, Deserialize, Serialize)]
+pub struct CoalescingStats {
+    /// Requests that ran a query
+    pub computed: u64,
+    /// Requests answered with the result of an identical request already running
+    pub coalesced: u64,
+}
+
+/// A request caught by the slow-query log
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct SlowQuery {
+    pub service: String,
+    pub num_coordinates: usize,
+    /// Unix time the request finished, in milliseconds
+    pub timestamp_ms: u64,
+    pub total_ms: f64,
+    /// Building OSRM's parameters, before the query
+    pub setup_ms: f64,
+    /// The OSRM query itself: snapping and search. 0 for a request that got the
+    /// result of a coalesced identical request.
+    pub query_ms: f64,
+    /// Rendering the response after the query
+    pub render_ms: f64,
+    /// The log line as written, which also holds the request's parameters and
+    /// can be replayed with `examples/load_test.rs`
+    #[serde(skip)]
+    pub line: String,
+}
+
+/// Bytes of the datasets an engine loads, by component
+#[derive(Debug, Clone, Default, Deserialize, Serialize)]
+pub struct MemoryReport {
+    /// In-memory levels of the static R-tree (`.ramIndex`)
+    pub rtree_bytes: usize,
+    /// Routing graph: `.hsgr` for CH, `.mldgr`, `.cells` and `.partition` for MLD
+    pub graph_bytes: usize,
+    /// MLD cell metrics
+    pub cell_metrics_bytes: usize,
+    /// Street names
+    pub names_bytes: usize,
+    /// Segment geometry, 0 when ROUTE_GEOMETRY is disabled
+    pub geometry_bytes: usize,
+    /// Every other dataset storage loads for the enabled features
+    pub other_bytes: usize,
+    /// Sum of the loaded datasets, an upper bound on what the engine holds
+    pub total_bytes: usize,
+    /// R-tree leaves (`.fileIndex`), memory-mapped and paged in on demand, so
+    /// not part of `total_bytes`
+    pub file_index_bytes: usize,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct OsrmMemoryReport {
+    rtree_bytes: usize,
+    graph_bytes: usize,
+    cell_metrics_bytes: usize,
+    names_bytes: usize,
+    geometry_bytes: usize,
+    other_bytes: usize,
+    total_bytes: usize,
+    file_index_bytes: usize,
+}
+
+/// Bitfield of `OSRM_Config.disable_feature_dataset_flags`
+fn feature_dataset_flags(features: &[String]) -> i32 {
+    let mut flags = 0i32;
+    for feature in features {
+        match feature.as_str() {
+            "ROUTE_STEPS" => flags |= 1,
+            "ROUTE_GEOMETRY" => flags |= 2,
+            _ => {}
+        }
+    }
+    flags
+}
+
 pub(crate) struct Osrm {
     instance: *mut c_void,
     _algorithm: Option<CString>,
@@ -299,15 +879,7 @@ impl Osrm {
             .map(|s| CString::new(s.as_str()).map_err(|e| e.to_string()))
             .transpose()?;
 
-        // Calculate disable_feature_dataset_flags bitfield
-        let mut disable_flags = 0i32;
-        for feature in &config.disable_feature_dataset {
-            match feature.as_str() {
-                "ROUTE_STEPS" => disable_flags |= 1,
-                "ROUTE_GEOMETRY" => disable_flags |= 2,
-                _ => {}
-            }
-        }
+        let disable_flags = feature_dataset_flags(&config.disable_feature_dataset);
 
         let ffi_config = OsrmConfig {
             algorithm: c_algorithm.as_ref().map_or(std::ptr::null(), |s| s.as_ptr()),
@@ -356,8 +928,9 @@ impl Osrm {
         annotations: Option<&[String]>,
         geometries: Option<&str>,
         overview: Option<&str>,
+        simplify_tolerance: Option<f64>,
         exclude: Option<&[String]>,
-    ) -> Result<String, String> {
+    ) -> Result<(String, Option<Vec<RouteGeometry>>), String> {
         let coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| vec![lon, lat]).collect();
         
         // Prepare bearings
@@ -441,6 +1014,11 @@ impl Osrm {
         let exclude_ptr = exclude_ptrs.as_ref().map(|p| p.as_ptr()).unwrap_or(std::ptr::null());
         let num_exclude = exclude.map(|e| e.len()).unwrap_or(0);
 
+        // Binary geometry is returned through typed arrays instead of the JSON text
+        let binary_geometry = geometries == Some("binary");
+        let mut geometry = OsrmGeometry::empty();
+        let geometry_ptr: *mut OsrmGeometry = if binary_geometry { &mut geometry } else { std::ptr::null_mut() };
+
         let result = unsafe {
             osrm_trip(
                 self.instance,
@@ -464,10 +1042,13 @@ impl Osrm {
                 num_annotations,
                 geometries_ptr,
                 overview_ptr,
+                simplify_tolerance.unwrap_or(-1.0),
                 exclude_ptr,
                 num_exclude,
+                geometry_ptr,
             )
         };
+        let route_geometry = if binary_geometry { Some(geometry.take()) } else { None };
 
         let message_ptr = result.message;
         if message_ptr.is_null() {
@@ -485,7 +1066,7 @@ impl Osrm {
             return Err(format!("OSRM error: {}", rust_str));
         }
 
-        Ok(rust_str)
+        Ok((rust_str, route_geometry))
     }
 
     pub(crate) fn route(
@@ -502,11 +1083,12 @@ impl Osrm {
         annotations: Option<&[String]>,
         geometries: Option<&str>,
         overview: Option<&str>,
+        simplify_tolerance: Option<f64>,
         continue_straight: bool,
         exclude: Option<&[String]>,
         waypoints: Option<&[usize]>,
         skip_waypoints: bool,
-    ) -> Result<String, String> {
+    ) -> Result<(String, Option<Vec<RouteGeometry>>), String> {
         let coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| vec![lon, lat]).collect();
         
         // Prepare bearings
@@ -586,6 +1168,11 @@ impl Osrm {
         let waypoints_ptr = waypoints.map(|w| w.as_ptr()).unwrap_or(std::ptr::null());
         let num_waypoints = waypoints.map(|w| w.len()).unwrap_or(0);
 
+        // Binary geometry is returned through typed arrays instead of the JSON text
+        let binary_geometry = geometries == Some("binary");
+        let mut geometry = OsrmGeometry::empty();
+        let geometry_ptr: *mut OsrmGeometry = if binary_geometry { &mut geometry } else { std::ptr::null_mut() };
+
         let result = unsafe {
             osrm_route(
                 self.instance,
@@ -607,14 +1194,17 @@ impl Osrm {
                 num_annotations,
                 geometries_ptr,
                 overview_ptr,
+                simplify_tolerance.unwrap_or(-1.0),
                 continue_straight,
                 exclude_ptr,
                 num_exclude,
                 waypoints_ptr,
                 num_waypoints,
                 skip_waypoints,
+                geometry_ptr,
             )
         };
+        let route_geometry = if binary_geometry { Some(geometry.take()) } else { None };
 
         let message_ptr = result.message;
         if message_ptr.is_null() {
@@ -632,28 +1222,653 @@ impl Osrm {
             return Err(format!("OSRM error: {}", rust_str));
         }
 
-        Ok(rust_str)
+        Ok((rust_str, route_geometry))
     }
 
-    pub(crate) fn table(
+    pub(crate) fn route_alternatives(
         &self,
-        coordinates: &[(f64, f64)],
-        sources: Option<&[usize]>,
-        destinations: Option<&[usize]>,
-        include_duration: bool,
-        include_distance: bool,
-        bearings: Option<&[(f64, f64)]>,
-        radiuses: Option<&[f64]>,
-        hints: Option<&[Option<String>]>,
-        generate_hints: bool,
-        approaches: Option<&[Option<String>]>,
-        fallback_speed: Option<f64>,
-        fallback_coordinate: Option<&str>,
-        scale_factor: Option<f64>,
-        snapping: Option<&str>,
+        from: (f64, f64),
+        to: (f64, f64),
+        max_alternatives: usize,
+        max_stretch: f64,
+        max_overlap: f64,
+        time_budget_ms: Option<f64>,
+        threads: Option<i32>,
     ) -> Result<String, String> {
+        let coords = [from.0, from.1, to.0, to.1];
 
-        let flat_coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| vec![lon, lat]).collect();
+        let result = unsafe {
+            osrm_route_alternatives(
+                self.instance,
+                coords.as_ptr(),
+                max_alternatives,
+                max_stretch,
+                max_overlap,
+                time_budget_ms.unwrap_or(0.0),
+                threads.unwrap_or(0),
+            )
+        };
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM error: {}", rust_str));
+        }
+
+        Ok(rust_str)
+    }
+
+    pub(crate) fn trip_solve(
+        &self,
+        coordinates: &[(f64, f64)],
+        roundtrip: bool,
+        time_budget_ms: Option<f64>,
+        threads: Option<i32>,
+    ) -> Result<TripSolution, String> {
+        let coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| [lon, lat]).collect();
+
+        let mut solution = OsrmTripSolution {
+            num_stops: 0,
+            order: std::ptr::null_mut(),
+            num_legs: 0,
+            leg_durations: std::ptr::null_mut(),
+            leg_distances: std::ptr::null_mut(),
+            duration: 0.0,
+            distance: 0.0,
+        };
+
+        let result = unsafe {
+            osrm_trip_solve(
+                self.instance,
+                coords.as_ptr(),
+                coordinates.len(),
+                roundtrip,
+                time_budget_ms.unwrap_or(0.0),
+                threads.unwrap_or(0),
+                &mut solution,
+            )
+        };
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM error: {}", rust_str));
+        }
+
+        let order = unsafe { std::slice::from_raw_parts(solution.order, solution.num_stops) }.to_vec();
+        let durations = unsafe { std::slice::from_raw_parts(solution.leg_durations, solution.num_legs) };
+        let distances = unsafe { std::slice::from_raw_parts(solution.leg_distances, solution.num_legs) };
+        let legs = durations.iter().zip(distances)
+            .map(|(&duration, &distance)| LegSummary { duration, distance })
+            .collect();
+        let trip = TripSolution {
+            order,
+            legs,
+            duration: solution.duration,
+            distance: solution.distance,
+        };
+
+        unsafe {
+            osrm_free_trip_solution(&mut solution);
+        }
+
+        Ok(trip)
+    }
+
+    pub(crate) fn register_locations(
+        &self,
+        coordinates: &[(f64, f64)],
+        precompute_table: bool,
+        threads: Option<i32>,
+    ) -> Result<OsrmLocationSet, String> {
+        let coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| [lon, lat]).collect();
+        let mut handle: *mut c_void = std::ptr::null_mut();
+
+        let result = unsafe {
+            osrm_location_set_create(
+                self.instance,
+                coords.as_ptr(),
+                coordinates.len(),
+                precompute_table,
+                threads.unwrap_or(0),
+                &mut handle,
+            )
+        };
+        take_message(result)?;
+
+        Ok(OsrmLocationSet { handle, len: coordinates.len() })
+    }
+
+    pub(crate) fn ch_sweep(&self, base_path: &str) -> Result<OsrmChSweep, String> {
+        let c_path = CString::new(base_path).map_err(|e| e.to_string())?;
+        let mut handle: *mut c_void = std::ptr::null_mut();
+        take_message(unsafe { osrm_ch_sweep_create(self.instance, c_path.as_ptr(), &mut handle) })?;
+
+        let num_nodes = unsafe { osrm_ch_sweep_node_count(handle) };
+        Ok(OsrmChSweep { handle, num_nodes })
+    }
+
+    pub(crate) fn route_matrix(
+        &self,
+        coordinates: &[(f64, f64)],
+        pairs: &[(usize, usize)],
+        annotations: Option<&[String]>,
+        threads: Option<i32>,
+    ) -> Result<Vec<Option<PairRoute>>, String> {
+        let coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| [lon, lat]).collect();
+        let sources: Vec<usize> = pairs.iter().map(|&(from, _)| from).collect();
+        let destinations: Vec<usize> = pairs.iter().map(|&(_, to)| to).collect();
+
+        let annotations_c: Vec<CString> = annotations
+            .unwrap_or(&[])
+            .iter()
+            .map(|a| CString::new(a.as_str()).map_err(|e| e.to_string()))
+            .collect::<Result<_, _>>()?;
+        let annotations_ptrs: Vec<*const c_char> = annotations_c.iter().map(|a| a.as_ptr()).collect();
+
+        let mut matrix = OsrmRouteMatrix {
+            num_pairs: 0,
+            durations: std::ptr::null_mut(),
+            distances: std::ptr::null_mut(),
+        };
+        let mut geometry = OsrmGeometry::empty();
+
+        let result = unsafe {
+            osrm_route_matrix(
+                self.instance,
+                coords.as_ptr(),
+                coordinates.len(),
+                sources.as_ptr(),
+                destinations.as_ptr(),
+                pairs.len(),
+                if annotations_ptrs.is_empty() { std::ptr::null() } else { annotations_ptrs.as_ptr() },
+                annotations_ptrs.len(),
+                threads.unwrap_or(0),
+                &mut matrix,
+                &mut geometry,
+            )
+        };
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM error: {}", rust_str));
+        }
+
+        let geometries = geometry.take();
+        let routes = if matrix.num_pairs > 0 {
+            let durations = unsafe { std::slice::from_raw_parts(matrix.durations, matrix.num_pairs) };
+            let distances = unsafe { std::slice::from_raw_parts(matrix.distances, matrix.num_pairs) };
+            durations.iter().zip(distances).zip(geometries)
+                .map(|((&duration, &distance), geometry)| {
+                    (duration >= 0.0).then(|| PairRoute { duration, distance, geometry })
+                })
+                .collect()
+        } else {
+            Vec::new()
+        };
+
+        unsafe {
+            osrm_free_route_matrix(&mut matrix);
+        }
+
+        Ok(routes)
+    }
+
+    pub(crate) fn route_summary(
+        &self,
+        coordinates: &[(f64, f64)],
+        include_legs: bool,
+    ) -> Result<RouteSummary, String> {
+        let coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| [lon, lat]).collect();
+
+        Self::read_route_summary(|summary| unsafe {
+            osrm_route_summary(self.instance, coords.as_ptr(), coordinates.len(), include_legs, summary)
+        })
+    }
+
+    pub(crate) fn route_summary_fixed(
+        &self,
+        coordinates: &[FixedPoint],
+        include_legs: bool,
+    ) -> Result<RouteSummary, String> {
+        Self::read_route_summary(|summary| unsafe {
+            osrm_route_summary_fixed(self.instance, coordinates.as_ptr(), coordinates.len(), include_legs, summary)
+        })
+    }
+
+    fn read_route_summary(call: impl FnOnce(*mut OsrmRouteSummary) -> OsrmResult) -> Result<RouteSummary, String> {
+        let mut summary = OsrmRouteSummary {
+            duration: 0.0,
+            distance: 0.0,
+            weight: 0.0,
+            num_legs: 0,
+            leg_durations: std::ptr::null_mut(),
+            leg_distances: std::ptr::null_mut(),
+        };
+
+        let result = call(&mut summary);
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM error: {}", rust_str));
+        }
+
+        let legs = if summary.num_legs > 0 {
+            let durations = unsafe { std::slice::from_raw_parts(summary.leg_durations, summary.num_legs) };
+            let distances = unsafe { std::slice::from_raw_parts(summary.leg_distances, summary.num_legs) };
+            durations.iter().zip(distances)
+                .map(|(&duration, &distance)| LegSummary { duration, distance })
+                .collect()
+        } else {
+            Vec::new()
+        };
+
+        unsafe {
+            osrm_free_route_summary(&mut summary);
+        }
+
+        Ok(RouteSummary {
+            duration: summary.duration,
+            distance: summary.distance,
+            weight: summary.weight,
+            legs,
+        })
+    }
+
+    pub(crate) fn memory_report(
+        base_path: &str,
+        algorithm: &str,
+        disable_feature_dataset: &[String],
+    ) -> Result<MemoryReport, String> {
+        let c_path = CString::new(base_path).map_err(|e| e.to_string())?;
+        let c_algorithm = CString::new(algorithm).map_err(|e| e.to_string())?;
+        let mut report = OsrmMemoryReport::default();
+
+        let result = unsafe {
+            osrm_memory_report(
+                c_path.as_ptr(),
+                c_algorithm.as_ptr(),
+                feature_dataset_flags(disable_feature_dataset),
+                &mut report,
+            )
+        };
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM error: {}", rust_str));
+        }
+
+        Ok(MemoryReport {
+            rtree_bytes: report.rtree_bytes,
+            graph_bytes: report.graph_bytes,
+            cell_metrics_bytes: report.cell_metrics_bytes,
+            names_bytes: report.names_bytes,
+            geometry_bytes: report.geometry_bytes,
+            other_bytes: report.other_bytes,
+            total_bytes: report.total_bytes,
+            file_index_bytes: report.file_index_bytes,
+        })
+    }
+
+    pub(crate) fn warm_thread(&self, coordinates: &[(f64, f64)]) -> Result<(), String> {
+        let coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| [lon, lat]).collect();
+
+        let result = unsafe { osrm_warm_thread(self.instance, coords.as_ptr(), coordinates.len()) };
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM error: {}", rust_str));
+        }
+
+        Ok(())
+    }
+
+    /// Whether the instance was started on a CH dataset
+    pub(crate) fn is_ch(&self) -> bool {
+        self._algorithm.as_ref().is_some_and(|a| a.as_bytes() == b"CH")
+    }
+
+    pub(crate) fn release_thread_heaps() {
+        unsafe { osrm_release_thread_heaps() }
+    }
+
+    pub(crate) fn reserve_thread_heaps(&self, node_count: usize) -> Result<(), String> {
+        let algorithm = self._algorithm.as_ref().map_or(std::ptr::null(), |s| s.as_ptr());
+        let result = unsafe { osrm_reserve_thread_heaps(algorithm, node_count) };
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM error: {}", rust_str));
+        }
+        Ok(())
+    }
+
+    pub(crate) fn thread_allocations() -> u64 {
+        unsafe { osrm_thread_allocations() }
+    }
+
+    pub(crate) fn set_coalescing(&self, enabled: bool) {
+        unsafe { osrm_set_coalescing(self.instance, enabled) }
+    }
+
+    pub(crate) fn coalescing_stats(&self) -> CoalescingStats {
+        let mut stats = CoalescingStats::default();
+        unsafe { osrm_coalescing_stats(self.instance, &mut stats) };
+        stats
+    }
+
+    pub(crate) fn set_slow_query_log(&self, threshold_ms: f64, capacity: usize) {
+        unsafe { osrm_set_slow_query_log(self.instance, threshold_ms, capacity) }
+    }
+
+    pub(crate) fn drain_slow_queries(&self) -> Result<String, String> {
+        take_message(unsafe { osrm_slow_query_log_drain(self.instance) })
+    }
+
+    pub(crate) fn dump_slow_queries(&self, path: &str) -> Result<usize, String> {
+        let c_path = CString::new(path).map_err(|e| e.to_string())?;
+        let mut count = 0;
+        take_message(unsafe { osrm_slow_query_log_dump(self.instance, c_path.as_ptr(), &mut count) })?;
+        Ok(count)
+    }
+
+    pub(crate) fn dropped_slow_queries(&self) -> u64 {
+        unsafe { osrm_slow_query_log_dropped(self.instance) }
+    }
+
+    pub(crate) fn numa_nodes() -> Vec<usize> {
+        let count = unsafe { osrm_numa_nodes(std::ptr::null_mut(), 0) };
+        let mut nodes = vec![0usize; count];
+        let written = unsafe { osrm_numa_nodes(nodes.as_mut_ptr(), nodes.len()) };
+        nodes.truncate(written);
+        nodes
+    }
+
+    pub(crate) fn numa_current_node() -> usize {
+        unsafe { osrm_numa_current_node() }
+    }
+
+    pub(crate) fn numa_pin_thread(node: usize) -> Result<(), String> {
+        take_message(unsafe { osrm_numa_pin_thread(node) }).map(|_| ())
+    }
+
+    pub(crate) fn page_report() -> Result<PageReport, String> {
+        let mut report = PageReport::default();
+        take_message(unsafe { osrm_page_report(&mut report) })?;
+        Ok(report)
+    }
+
+    /// `fork` semantics: the child's pid in the parent, 0 in the child
+    pub(crate) fn fork_worker() -> Result<i32, String> {
+        let mut pid = 0;
+        take_message(unsafe { osrm_fork_worker(&mut pid) })?;
+        Ok(pid)
+    }
+
+    pub(crate) fn wait_worker(pid: i32) -> Result<i32, String> {
+        let mut exit_code = 0;
+        take_message(unsafe { osrm_wait_worker(pid, &mut exit_code) })?;
+        Ok(exit_code)
+    }
+
+    /// Ends a forked worker without running the exit handlers it inherited
+    pub(crate) fn exit_worker(code: i32) -> ! {
+        use std::io::Write;
+        let _ = std::io::stdout().flush();
+        let _ = std::io::stderr().flush();
+        unsafe { osrm_exit_worker(code) }
+    }
+
+    pub(crate) fn kill_worker(pid: i32) -> Result<(), String> {
+        take_message(unsafe { osrm_kill_worker(pid) }).map(|_| ())
+    }
+
+    pub(crate) fn prefork_check(&self, coordinates: &[(f64, f64)]) -> Result<(PageReport, PageReport), String> {
+        let coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| [lon, lat]).collect();
+        let mut before = PageReport::default();
+        let mut after = PageReport::default();
+        take_message(unsafe {
+            osrm_prefork_check(self.instance, coords.as_ptr(), coordinates.len(), &mut before, &mut after)
+        })?;
+        Ok((before, after))
+    }
+
+    pub(crate) fn table_sparse(
+        &self,
+        coordinates: &[(f64, f64)],
+        pattern: &SparsityPattern,
+        fallback_speed: Option<f64>,
+        threads: Option<i32>,
+    ) -> Result<SparseTableResponse, String> {
+        let coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| [lon, lat]).collect();
+
+        let (row_offsets_ptr, column_indices_ptr, k_nearest) = match pattern {
+            SparsityPattern::KNearest(k) => (std::ptr::null(), std::ptr::null(), *k),
+            SparsityPattern::Cells { row_offsets, column_indices } => {
+                if row_offsets.len() != coordinates.len() + 1
+                    || row_offsets.last().copied() != Some(column_indices.len())
+                {
+                    return Err("Sparsity pattern does not match the coordinates".to_string());
+                }
+                (row_offsets.as_ptr(), column_indices.as_ptr(), 0)
+            }
+        };
+
+        let mut matrix = OsrmSparseMatrix {
+            num_rows: 0,
+            num_cells: 0,
+            row_offsets: std::ptr::null_mut(),
+            column_indices: std::ptr::null_mut(),
+            durations: std::ptr::null_mut(),
+            distances: std::ptr::null_mut(),
+            estimated: std::ptr::null_mut(),
+        };
+
+        let result = unsafe {
+            osrm_table_sparse(
+                self.instance,
+                coords.as_ptr(),
+                coordinates.len(),
+                row_offsets_ptr,
+                column_indices_ptr,
+                k_nearest,
+                fallback_speed.unwrap_or(-1.0),
+                threads.unwrap_or(0),
+                &mut matrix,
+            )
+        };
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM error: {}", rust_str));
+        }
+
+        let to_vec = |ptr: *const usize, len: usize| -> Vec<usize> {
+            if len == 0 || ptr.is_null() { Vec::new() } else { unsafe { std::slice::from_raw_parts(ptr, len) }.to_vec() }
+        };
+        let to_values = |ptr: *const f64| -> Vec<Option<f64>> {
+            if matrix.num_cells == 0 || ptr.is_null() {
+                return Vec::new();
+            }
+            unsafe { std::slice::from_raw_parts(ptr, matrix.num_cells) }
+                .iter()
+                .map(|&value| if value < 0.0 { None } else { Some(value) })
+                .collect()
+        };
+
+        let response = SparseTableResponse {
+            row_offsets: to_vec(matrix.row_offsets, matrix.num_rows + 1),
+            column_indices: to_vec(matrix.column_indices, matrix.num_cells),
+            durations: to_values(matrix.durations),
+            distances: to_values(matrix.distances),
+            estimated: if matrix.num_cells == 0 || matrix.estimated.is_null() {
+                Vec::new()
+            } else {
+                unsafe { std::slice::from_raw_parts(matrix.estimated, matrix.num_cells) }
+                    .iter()
+                    .map(|&flag| flag != 0)
+                    .collect()
+            },
+        };
+
+        unsafe {
+            osrm_free_sparse_matrix(&mut matrix);
+        }
+
+        Ok(response)
+    }
+
+    pub(crate) fn table_fixed(
+        &self,
+        coordinates: &[FixedPoint],
+        sources: Option<&[usize]>,
+        destinations: Option<&[usize]>,
+        include_duration: bool,
+        include_distance: bool,
+        fallback_speed: Option<f64>,
+    ) -> Result<String, String> {
+        let (sources_ptr, num_sources) = sources.map_or((std::ptr::null(), 0), |s| (s.as_ptr(), s.len()));
+        let (destinations_ptr, num_destinations) = destinations.map_or((std::ptr::null(), 0), |d| (d.as_ptr(), d.len()));
+
+        let result = unsafe {
+            osrm_table_fixed(
+                self.instance,
+                coordinates.as_ptr(),
+                coordinates.len(),
+                sources_ptr,
+                num_sources,
+                destinations_ptr,
+                num_destinations,
+                include_duration,
+                include_distance,
+                fallback_speed.unwrap_or(-1.0),
+            )
+        };
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM error: {}", rust_str));
+        }
+
+        Ok(rust_str)
+    }
+
+    pub(crate) fn table(
+        &self,
+        coordinates: &[(f64, f64)],
+        sources: Option<&[usize]>,
+        destinations: Option<&[usize]>,
+        include_duration: bool,
+        include_distance: bool,
+        bearings: Option<&[(f64, f64)]>,
+        radiuses: Option<&[f64]>,
+        hints: Option<&[Option<String>]>,
+        generate_hints: bool,
+        approaches: Option<&[Option<String>]>,
+        fallback_speed: Option<f64>,
+        fallback_coordinate: Option<&str>,
+        scale_factor: Option<f64>,
+        snapping: Option<&str>,
+    ) -> Result<String, String> {
+
+        let flat_coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| vec![lon, lat]).collect();
         let sources_vec = sources.unwrap_or(&[]).to_vec();
         let dests_vec = destinations.unwrap_or(&[]).to_vec();
 
@@ -758,8 +1973,9 @@ impl Osrm {
         annotations: Option<&[String]>,
         geometries: Option<&str>,
         overview: Option<&str>,
+        simplify_tolerance: Option<f64>,
         exclude: Option<&[String]>,
-    ) -> Result<String, String> {
+    ) -> Result<(String, Option<Vec<RouteGeometry>>), String> {
 
         let flat_coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| vec![lon, lat]).collect();
 
@@ -835,6 +2051,11 @@ impl Osrm {
         let exclude_ptr = exclude_ptrs.as_ref().map(|p| p.as_ptr()).unwrap_or(std::ptr::null());
         let num_exclude = exclude.map(|e| e.len()).unwrap_or(0);
 
+        // Binary geometry is returned through typed arrays instead of the JSON text
+        let binary_geometry = geometries == Some("binary");
+        let mut geometry = OsrmGeometry::empty();
+        let geometry_ptr: *mut OsrmGeometry = if binary_geometry { &mut geometry } else { std::ptr::null_mut() };
+
         let result = unsafe {
             osrm_match(
                 self.instance,
@@ -861,10 +2082,13 @@ impl Osrm {
                 num_annotations,
                 geometries_ptr,
                 overview_ptr,
+                simplify_tolerance.unwrap_or(-1.0),
                 exclude_ptr,
                 num_exclude,
+                geometry_ptr,
             )
         };
+        let route_geometry = if binary_geometry { Some(geometry.take()) } else { None };
 
         let message_ptr = result.message;
         if message_ptr.is_null() {
@@ -882,7 +2106,7 @@ impl Osrm {
             return Err(format!("OSRM error: {}", rust_str));
         }
 
-        Ok(rust_str)
+        Ok((rust_str, route_geometry))
     }
 
     pub(crate) fn nearest(
@@ -998,6 +2222,74 @@ impl Osrm {
         Ok(rust_str)
     }
 
+    pub fn contract_with_updates(
+        base_path: &str,
+        segment_speed_files: &[String],
+        turn_penalty_files: &[String],
+        threads: Option<i32>,
+    ) -> Result<String, String> {
+        let c_path = CString::new(base_path).map_err(|e| e.to_string())?;
+        let speed_files_c: Vec<CString> = segment_speed_files
+            .iter()
+            .map(|f| CString::new(f.as_str()).map_err(|e| e.to_string()))
+            .collect::<Result<_, _>>()?;
+        let speed_files_ptrs: Vec<*const c_char> = speed_files_c.iter().map(|f| f.as_ptr()).collect();
+        let penalty_files_c: Vec<CString> = turn_penalty_files
+            .iter()
+            .map(|f| CString::new(f.as_str()).map_err(|e| e.to_string()))
+            .collect::<Result<_, _>>()?;
+        let penalty_files_ptrs: Vec<*const c_char> = penalty_files_c.iter().map(|f| f.as_ptr()).collect();
+
+        let result = unsafe {
+            osrm_run_contract_with_updates(
+                c_path.as_ptr(),
+                speed_files_ptrs.as_ptr(),
+                speed_files_ptrs.len(),
+                penalty_files_ptrs.as_ptr(),
+                penalty_files_ptrs.len(),
+                threads.unwrap_or(0),
+            )
+        };
+        take_message(result).map_err(|e| format!("OSRM contraction error: {}", e))
+    }
+
+    pub fn contract_update(
+        base_path: &str,
+        segment_speed_files: &[String],
+        turn_penalty_files: &[String],
+        check_all_nodes: bool,
+        threads: Option<i32>,
+    ) -> Result<ContractUpdateStats, String> {
+        let c_path = CString::new(base_path).map_err(|e| e.to_string())?;
+        let speed_files_c: Vec<CString> = segment_speed_files
+            .iter()
+            .map(|f| CString::new(f.as_str()).map_err(|e| e.to_string()))
+            .collect::<Result<_, _>>()?;
+        let speed_files_ptrs: Vec<*const c_char> = speed_files_c.iter().map(|f| f.as_ptr()).collect();
+        let penalty_files_c: Vec<CString> = turn_penalty_files
+            .iter()
+            .map(|f| CString::new(f.as_str()).map_err(|e| e.to_string()))
+            .collect::<Result<_, _>>()?;
+        let penalty_files_ptrs: Vec<*const c_char> = penalty_files_c.iter().map(|f| f.as_ptr()).collect();
+        let mut stats = ContractUpdateStats::default();
+
+        let result = unsafe {
+            osrm_run_contract_update(
+                c_path.as_ptr(),
+                speed_files_ptrs.as_ptr(),
+                speed_files_ptrs.len(),
+                penalty_files_ptrs.as_ptr(),
+                penalty_files_ptrs.len(),
+                check_all_nodes,
+                threads.unwrap_or(0),
+                &mut stats,
+            )
+        };
+        take_message(result).map_err(|e| format!("OSRM contraction error: {}", e))?;
+
+        Ok(stats)
+    }
+
     pub fn extract(
         input_path: &str,
         profile_path: &str,
@@ -1044,6 +2336,34 @@ impl Osrm {
         Ok(rust_str)
     }
 
+    pub fn extract_memoized(
+        input_path: &str,
+        profile_path: &str,
+        threads: Option<i32>,
+        parse_conditionals: bool,
+        use_metadata: bool,
+        use_locations_cache: bool,
+    ) -> Result<ProfileMemoStats, String> {
+        let c_input = CString::new(input_path).map_err(|e| e.to_string())?;
+        let c_profile = CString::new(profile_path).map_err(|e| e.to_string())?;
+        let mut stats = ProfileMemoStats::default();
+
+        let result = unsafe {
+            osrm_run_extract_memoized(
+                c_input.as_ptr(),
+                c_profile.as_ptr(),
+                threads.unwrap_or(0),
+                parse_conditionals,
+                use_metadata,
+                use_locations_cache,
+                &mut stats,
+            )
+        };
+        take_message(result).map_err(|e| format!("OSRM extraction error: {}", e))?;
+
+        Ok(stats)
+    }
+
     pub fn partition(
         base_path: &str,
         threads: Option<i32>,
@@ -1125,6 +2445,216 @@ impl Osrm {
 
         Ok(rust_str)
     }
+
+    pub fn prepare_time_bucket(
+        base_path: &str,
+        bucket_path: &str,
+        segment_speed_files: &[String],
+        threads: Option<i32>,
+    ) -> Result<String, String> {
+        let c_base = CString::new(base_path).map_err(|e| e.to_string())?;
+        let c_bucket = CString::new(bucket_path).map_err(|e| e.to_string())?;
+        let speed_files_c: Vec<CString> = segment_speed_files
+            .iter()
+            .map(|f| CString::new(f.as_str()).map_err(|e| e.to_string()))
+            .collect::<Result<_, _>>()?;
+        let speed_files_ptrs: Vec<*const c_char> = speed_files_c.iter().map(|f| f.as_ptr()).collect();
+
+        let result = unsafe {
+            osrm_prepare_time_bucket(
+                c_base.as_ptr(),
+                c_bucket.as_ptr(),
+                speed_files_ptrs.as_ptr(),
+                speed_files_ptrs.len(),
+                threads.unwrap_or(0),
+            )
+        };
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM customization error: {}", rust_str));
+        }
+
+        Ok(rust_str)
+    }
+
+    pub fn pipeline(
+        config: &PipelineConfig,
+        control: &mut RunControl,
+    ) -> Result<PipelineReport, String> {
+        let c_input = CString::new(config.input_path.as_str()).map_err(|e| e.to_string())?;
+        let c_profile = CString::new(config.profile_path.as_str()).map_err(|e| e.to_string())?;
+
+        let (cell_sizes_ptr, cell_sizes_len) = if let Some(ref sizes) = config.max_cell_sizes {
+            (sizes.as_ptr(), sizes.len())
+        } else {
+            (std::ptr::null(), 0)
+        };
+
+        let ffi_config = OsrmPipelineConfig {
+            input_path: c_input.as_ptr(),
+            profile_path: c_profile.as_ptr(),
+            threads: config.threads.unwrap_or(0),
+            build_ch: config.build_ch,
+            build_mld: config.build_mld,
+            parse_conditionals: config.parse_conditionals,
+            use_metadata: config.use_metadata,
+            use_locations_cache: config.use_locations_cache,
+            balance: config.balance.unwrap_or(-1.0),
+            boundary_factor: config.boundary_factor.unwrap_or(-1.0),
+            num_optimizing_cuts: config.num_optimizing_cuts.unwrap_or(0),
+            small_component_size: config.small_component_size.unwrap_or(0),
+            max_cell_sizes: cell_sizes_ptr,
+            num_max_cell_sizes: cell_sizes_len,
+        };
+
+        let mut report = OsrmPipelineReport {
+            num_stages: 0,
+            stages: [OsrmStageReport { stage: std::ptr::null(), seconds: 0.0, peak_rss_bytes: 0 }; 4],
+        };
+
+        let (ffi_control, _c_strings) = OsrmRunControl::from_control(control)?;
+
+        let result = unsafe {
+            osrm_run_pipeline(&ffi_config, &ffi_control, &mut report)
+        };
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM pipeline error: {}", rust_str));
+        }
+
+        let stages = report.stages[..report.num_stages.min(4)].iter().map(|stage| StageReport {
+            stage: unsafe { CStr::from_ptr(stage.stage) }.to_string_lossy().into_owned(),
+            seconds: stage.seconds,
+            peak_rss_bytes: stage.peak_rss_bytes,
+        }).collect();
+
+        Ok(PipelineReport {
+            base_path: rust_str,
+            stages,
+        })
+    }
+
+    /// Runs one preprocessing stage through the wrapper's controlled runner, as an OSRM tool in a child process.
+    fn run_controlled(
+        control: &mut RunControl,
+        stage: &str,
+        run: impl FnOnce(*const OsrmRunControl) -> OsrmResult,
+    ) -> Result<String, String> {
+        let (ffi_control, _c_strings) = OsrmRunControl::from_control(control)?;
+
+        let result = run(&ffi_control);
+
+        let message_ptr = result.message;
+        if message_ptr.is_null() {
+            return Err("OSRM returned a null message".to_string());
+        }
+
+        let c_str = unsafe { CStr::from_ptr(message_ptr) };
+        let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+        unsafe {
+            osrm_free_string(message_ptr);
+        }
+
+        if result.code != 0 {
+            return Err(format!("OSRM {} error: {}", stage, rust_str));
+        }
+
+        Ok(rust_str)
+    }
+
+    pub fn extract_controlled(
+        input_path: &str,
+        profile_path: &str,
+        threads: Option<i32>,
+        parse_conditionals: bool,
+        use_metadata: bool,
+        use_locations_cache: bool,
+        control: &mut RunControl,
+    ) -> Result<String, String> {
+        let c_input = CString::new(input_path).map_err(|e| e.to_string())?;
+        let c_profile = CString::new(profile_path).map_err(|e| e.to_string())?;
+        Self::run_controlled(control, "extraction", |ffi_control| unsafe {
+            osrm_run_extract_controlled(
+                c_input.as_ptr(),
+                c_profile.as_ptr(),
+                threads.unwrap_or(0),
+                parse_conditionals,
+                use_metadata,
+                use_locations_cache,
+                ffi_control,
+            )
+        })
+    }
+
+    pub fn partition_controlled(
+        base_path: &str,
+        threads: Option<i32>,
+        balance: Option<f64>,
+        boundary_factor: Option<f64>,
+        num_optimizing_cuts: Option<i32>,
+        small_component_size: Option<i32>,
+        max_cell_sizes: Option<Vec<i32>>,
+        control: &mut RunControl,
+    ) -> Result<String, String> {
+        let c_path = CString::new(base_path).map_err(|e| e.to_string())?;
+        let (cell_sizes_ptr, cell_sizes_len) = if let Some(ref sizes) = max_cell_sizes {
+            (sizes.as_ptr(), sizes.len())
+        } else {
+            (std::ptr::null(), 0)
+        };
+        Self::run_controlled(control, "partitioning", |ffi_control| unsafe {
+            osrm_run_partition_controlled(
+                c_path.as_ptr(),
+                threads.unwrap_or(0),
+                balance.unwrap_or(-1.0),
+                boundary_factor.unwrap_or(-1.0),
+                num_optimizing_cuts.unwrap_or(0),
+                small_component_size.unwrap_or(0),
+                cell_sizes_ptr,
+                cell_sizes_len,
+                ffi_control,
+            )
+        })
+    }
+
+    pub fn customize_controlled(base_path: &str, threads: Option<i32>, control: &mut RunControl) -> Result<String, String> {
+        let c_path = CString::new(base_path).map_err(|e| e.to_string())?;
+        Self::run_controlled(control, "customization", |ffi_control| unsafe {
+            osrm_run_customize_controlled(c_path.as_ptr(), threads.unwrap_or(0), ffi_control)
+        })
+    }
+
+    pub fn contract_controlled(base_path: &str, threads: Option<i32>, control: &mut RunControl) -> Result<String, String> {
+        let c_path = CString::new(base_path).map_err(|e| e.to_string())?;
+        Self::run_controlled(control, "contraction", |ffi_control| unsafe {
+            osrm_run_contract_controlled(c_path.as_ptr(), threads.unwrap_or(0), ffi_control)
+        })
+    }
 }
 
 impl Drop for Osrm {
@@ -1137,3 +2667,156 @@ impl Drop for Osrm {
 
 unsafe impl Send for Osrm {}
 unsafe impl Sync for Osrm {}
+
+/// Reads and frees the message of an FFI call, turning a non-zero code into an error
+fn take_message(result: OsrmResult) -> Result<String, String> {
+    let message_ptr = result.message;
+    if message_ptr.is_null() {
+        return Err("OSRM returned a null message".to_string());
+    }
+
+    let c_str = unsafe { CStr::from_ptr(message_ptr) };
+    let rust_str = c_str.to_str().map_err(|e| e.to_string())?.to_owned();
+
+    unsafe {
+        osrm_free_string(message_ptr);
+    }
+
+    if result.code != 0 {
+        return Err(format!("OSRM error: {}", rust_str));
+    }
+    Ok(rust_str)
+}
+
+/// Location set registered on an engine with `Osrm::register_locations`
+pub(crate) struct OsrmLocationSet {
+    handle: *mut c_void,
+    len: usize,
+}
+
+impl OsrmLocationSet {
+    pub(crate) fn len(&self) -> usize {
+        self.len
+    }
+
+    pub(crate) fn table(&self, sources: &[usize], destinations: &[usize]) -> Result<LocationTable, String> {
+        let mut durations = vec![0.0; sources.len() * destinations.len()];
+        let mut distances = vec![0.0; sources.len() * destinations.len()];
+
+        let result = unsafe {
+            osrm_location_set_table(
+                self.handle,
+                sources.as_ptr(),
+                sources.len(),
+                destinations.as_ptr(),
+                destinations.len(),
+                durations.as_mut_ptr(),
+                distances.as_mut_ptr(),
+            )
+        };
+        take_message(result)?;
+
+        Ok(LocationTable::from_raw(sources.len(), destinations.len(), durations, distances))
+    }
+
+    pub(crate) fn table_from(&self, coordinates: &[(f64, f64)], destinations: &[usize]) -> Result<LocationTable, String> {
+        let coords: Vec<f64> = coordinates.iter().flat_map(|&(lon, lat)| [lon, lat]).collect();
+        let mut durations = vec![0.0; coordinates.len() * destinations.len()];
+        let mut distances = vec![0.0; coordinates.len() * destinations.len()];
+
+        let result = unsafe {
+            osrm_location_set_table_from(
+                self.handle,
+                coords.as_ptr(),
+                coordinates.len(),
+                destinations.as_ptr(),
+                destinations.len(),
+                durations.as_mut_ptr(),
+                distances.as_mut_ptr(),
+            )
+        };
+        take_message(result)?;
+
+        Ok(LocationTable::from_raw(coordinates.len(), destinations.len(), durations, distances))
+    }
+
+    pub(crate) fn route_summary(&self, ids: &[usize], include_legs: bool) -> Result<RouteSummary, String> {
+        Osrm::read_route_summary(|summary| unsafe {
+            osrm_location_set_route_summary(self.handle, ids.as_ptr(), ids.len(), include_legs, summary)
+        })
+    }
+}
+
+impl Drop for OsrmLocationSet {
+    fn drop(&mut self) {
+        unsafe {
+            osrm_location_set_destroy(self.handle);
+        }
+    }
+}
+
+unsafe impl Send for OsrmLocationSet {}
+unsafe impl Sync for OsrmLocationSet {}
+
+/// CH graph loaded for one-to-all sweeps. Snaps through the instance it was
+/// created from and must not outlive it.
+pub(crate) struct OsrmChSweep {
+    handle: *mut c_void,
+    num_nodes: usize,
+}
+
+impl OsrmChSweep {
+    pub(crate) fn num_nodes(&self) -> usize {
+        self.num_nodes
+    }
+
+    pub(crate) fn one_to_all(&self, sources: &[(f64, f64)], threads: Option<i32>) -> Result<Vec<f64>, String> {
+        let coords: Vec<f64> = sources.iter().flat_map(|&(lon, lat)| [lon, lat]).collect();
+        let mut durations = vec![0.0; sources.len() * self.num_nodes];
+
+        let result = unsafe {
+            osrm_ch_sweep_one_to_all(
+                self.handle,
+                coords.as_ptr(),
+                sources.len(),
+                threads.unwrap_or(0),
+                durations.as_mut_ptr(),
+            )
+        };
+        take_message(result)?;
+
+        Ok(durations)
+    }
+
+    pub(crate) fn table(&self, sources: &[(f64, f64)], targets: &[(f64, f64)], threads: Option<i32>) -> Result<Vec<f64>, String> {
+        let source_coords: Vec<f64> = sources.iter().flat_map(|&(lon, lat)| [lon, lat]).collect();
+        let target_coords: Vec<f64> = targets.iter().flat_map(|&(lon, lat)| [lon, lat]).collect();
+        let mut durations = vec![0.0; sources.len() * targets.len()];
+
+        let result = unsafe {
+            osrm_ch_sweep_table(
+                self.handle,
+                source_coords.as_ptr(),
+                sources.len(),
+                target_coords.as_ptr(),
+                targets.len(),
+                threads.unwrap_or(0),
+                durations.as_mut_ptr(),
+            )
+        };
+        take_message(result)?;
+
+        Ok(durations)
+    }
+}
+
+impl Drop for OsrmChSweep {
+    fn drop(&mut self) {
+        unsafe {
+            osrm_ch_sweep_destroy(self.handle);
+        }
+    }
+}
+
+unsafe impl Send for OsrmChSweep {}
+unsafe impl Sync for OsrmChSweep {}
@@ -1,6 +1,7 @@
 // match.rs
 use crate::point::Point;
 use crate::waypoints::Waypoint;
+use crate::geometry::RouteGeometry;
 use serde::{Deserialize, Serialize};
 use serde_json::Value;
 
@@ -33,10 +34,13 @@ pub struct MatchRequest {
     pub steps: bool,
     /// Annotations to include (duration, distance, nodes, datasources, weight, speed)
     pub annotations: Option<Vec<String>>,
-    /// Geometry format: "polyline", "polyline6", or "geojson"
+    /// Geometry format: "polyline", "polyline6", "geojson" or "binary"
     pub geometries: Option<String>,
     /// Overview detail level: "simplified", "full", or "false"
     pub overview: Option<String>,
+    /// Simplifies the overview geometry to this tolerance in meters instead of OSRM's
+    /// zoom-based simplification
+    pub simplify_tolerance: Option<f64>,
     /// Road types to exclude
     pub exclude: Option<Vec<String>>,
 }
@@ -70,4 +74,7 @@ pub struct MatchResponse {
     pub matchings: Vec<Matching>,
     /// Array of tracepoints (matched waypoints, can be null for unmatched points)
     pub tracepoints: Vec<Option<Waypoint>>,
+    /// Typed geometry and annotations per matching when `geometries` is `"binary"`
+    #[serde(skip)]
+    pub binary_geometry: Option<Vec<RouteGeometry>>,
 }
@@ -0,0 +1,154 @@
+// numa.rs
+use std::cell::Cell;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::Instant;
+
+use serde::{Deserialize, Serialize};
+
+use crate::errors::OsrmError;
+use crate::osrm_engine::OsrmEngine;
+use crate::route::{RouteRequest, RouteResponse};
+use crate::tables::{TableRequest, TableResponse};
+use crate::{EngineConfig, Osrm};
+
+thread_local! {
+    /// Node the calling thread was pinned to with `NumaEngine::pin_current_thread`
+    static PINNED_NODE: Cell<Option<usize>> = const { Cell::new(None) };
+}
+
+/// Queries answered by the replica of one NUMA node
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct NodeStats {
+    pub node: usize,
+    pub queries: u64,
+    /// Queries per second since the engine was created
+    pub queries_per_second: f64,
+}
+
+struct Replica {
+    node: usize,
+    engine: OsrmEngine,
+    queries: AtomicU64,
+}
+
+/// One dataset replica per NUMA node with CPUs, each loaded by a thread pinned
+/// to its node so the kernel's first-touch policy places the replica's memory
+/// there. Queries go to the replica of the node the calling thread runs on.
+///
+/// Replicas must be process-local: with shared memory or mmap every replica
+/// maps the same pages, so `new` loads them with both turned off.
+pub struct NumaEngine {
+    replicas: Vec<Replica>,
+    /// Replica index by node id, `None` for nodes without a replica
+    replica_of_node: Vec<Option<usize>>,
+    created: Instant,
+}
+
+impl NumaEngine {
+    /// Ids of the online NUMA nodes that have CPUs, `[0]` on machines without
+    /// NUMA topology. Ids can have gaps; memory-only nodes are left out.
+    pub fn nodes() -> Vec<usize> {
+        Osrm::numa_nodes()
+    }
+
+    /// Number of nodes `new` loads a replica for
+    pub fn node_count() -> usize {
+        Self::nodes().len()
+    }
+
+    /// Loads one replica of `config`'s dataset per node of `nodes()`, in parallel
+    pub fn new(config: EngineConfig) -> Result<Self, OsrmError> {
+        let config = EngineConfig {
+            shared_memory: false,
+            mmap_memory: false,
+            ..config
+        };
+
+        let nodes = Self::nodes();
+        let engines: Vec<Result<OsrmEngine, OsrmError>> = std::thread::scope(|scope| {
+            let loaders: Vec<_> = nodes.iter()
+                .map(|&node| {
+                    let config = config.clone();
+                    scope.spawn(move || {
+                        Osrm::numa_pin_thread(node).map_err(|e| OsrmError::FfiError(e))?;
+                        OsrmEngine::new_with_config(config)
+                    })
+                })
+                .collect();
+            loaders.into_iter()
+                .map(|loader| loader.join().unwrap_or(Err(OsrmError::Initialization)))
+                .collect()
+        });
+
+        let replicas = nodes.iter()
+            .zip(engines)
+            .map(|(&node, engine)| engine.map(|engine| Replica { node, engine, queries: AtomicU64::new(0) }))
+            .collect::<Result<Vec<_>, _>>()?;
+
+        let mut replica_of_node = vec![None; nodes.iter().max().map_or(0, |&max| max + 1)];
+        for (index, &node) in nodes.iter().enumerate() {
+            replica_of_node[node] = Some(index);
+        }
+        Ok(NumaEngine { replicas, replica_of_node, created: Instant::now() })
+    }
+
+    fn replica_index(&self, node: usize) -> Option<usize> {
+        self.replica_of_node.get(node).copied().flatten()
+    }
+
+    /// Pins the calling thread to the CPUs of NUMA node `node` and routes its
+    /// queries to that node's replica. Call it from each worker at startup, e.g.
+    /// with `nodes()[worker % nodes().len()]`.
+    pub fn pin_current_thread(&self, node: usize) -> Result<(), OsrmError> {
+        if self.replica_index(node).is_none() {
+            return Err(OsrmError::ApiError(format!("No replica for NUMA node {}", node)));
+        }
+        Osrm::numa_pin_thread(node).map_err(|e| OsrmError::FfiError(e))?;
+        PINNED_NODE.with(|pinned| pinned.set(Some(node)));
+        Ok(())
+    }
+
+    /// The replica local to the calling thread: its pinned node, otherwise the
+    /// node it currently runs on, falling back to the first replica for a node
+    /// without one. Every call counts as one query for that replica.
+    pub fn engine(&self) -> &OsrmEngine {
+        let node = PINNED_NODE.with(|pinned| pinned.get())
+            .unwrap_or_else(Osrm::numa_current_node);
+        let replica = &self.replicas[self.replica_index(node).unwrap_or(0)];
+        replica.queries.fetch_add(1, Ordering::Relaxed);
+        &replica.engine
+    }
+
+    pub fn route(&self, route_request: RouteRequest) -> Result<RouteResponse, OsrmError> {
+        self.engine().route(route_request)
+    }
+
+    pub fn table(&self, table_request: TableRequest) -> Result<TableResponse, OsrmError> {
+        self.engine().table(table_request)
+    }
+
+    pub fn stats(&self) -> Vec<NodeStats> {
+        let elapsed = self.created.elapsed().as_secs_f64().max(f64::EPSILON);
+        self.replicas.iter()
+            .map(|replica| {
+                let queries = replica.queries.load(Ordering::Relaxed);
+                NodeStats { node: replica.node, queries, queries_per_second: queries as f64 / elapsed }
+            })
+            .collect()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn it_lists_only_nodes_that_can_run_a_pinned_thread() {
+        let nodes = NumaEngine::nodes();
+        assert!(!nodes.is_empty(), "Every machine has at least one node");
+        assert!(nodes.windows(2).all(|pair| pair[0] < pair[1]), "Node ids come in ascending order");
+        for &node in &nodes {
+            Osrm::numa_pin_thread(node).expect("every listed node should have CPUs to pin to");
+        }
+    }
+}
@@ -0,0 +1,88 @@
+// one_to_all.rs
+use std::marker::PhantomData;
+
+use serde::{Deserialize, Serialize};
+
+use crate::errors::OsrmError;
+use crate::osrm_engine::OsrmEngine;
+use crate::point::Point;
+use crate::OsrmChSweep;
+
+/// Durations from each source to every target, row-major
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct SweepDurations {
+    pub num_sources: usize,
+    pub num_targets: usize,
+    /// Duration of each cell in seconds, negative when unreachable
+    pub durations: Vec<f64>,
+}
+
+impl SweepDurations {
+    /// Durations from the `source`-th source to every target
+    pub fn row(&self, source: usize) -> &[f64] {
+        &self.durations[source * self.num_targets..(source + 1) * self.num_targets]
+    }
+
+    pub fn duration(&self, source: usize, target: usize) -> Option<f64> {
+        if target >= self.num_targets {
+            return None;
+        }
+        self.durations.get(source * self.num_targets + target)
+            .copied()
+            .filter(|duration| *duration >= 0.0)
+    }
+}
+
+/// Travel times from a few sources to the whole graph of a CH dataset.
+///
+/// Implements PHAST: the contracted graph is reordered once so that a query is
+/// a small upward search from the source followed by a single linear pass over
+/// all nodes, done for eight sources at a time. One pass takes about as long as
+/// reading the graph, far less than a table against every location.
+///
+/// Each sweep worker needs 64 bytes per graph node on top of the graph itself.
+/// Without an explicit `threads`, one worker per core is started, but only as
+/// many as fit in half of the currently free physical memory.
+pub struct OneToAll<'a> {
+    sweep: OsrmChSweep,
+    _engine: PhantomData<&'a OsrmEngine>,
+}
+
+impl<'a> OneToAll<'a> {
+    /// Loads the contracted graph at `base_path`, the `.osrm` path `engine` was
+    /// started with. Sources and targets are snapped by `engine`.
+    pub fn load(engine: &'a OsrmEngine, base_path: &str) -> Result<Self, OsrmError> {
+        let sweep = engine.instance()
+            .ch_sweep(base_path)
+            .map_err(|e| OsrmError::FfiError(e))?;
+        Ok(OneToAll { sweep, _engine: PhantomData })
+    }
+
+    /// Number of edge-based nodes, the targets of `durations_to_all`
+    pub fn node_count(&self) -> usize {
+        self.sweep.num_nodes()
+    }
+
+    /// Duration from each source to the start of every edge-based node of the
+    /// graph, indexed by OSRM's edge-based node id
+    pub fn durations_to_all(&self, sources: &[Point], threads: Option<i32>) -> Result<SweepDurations, OsrmError> {
+        let durations = self.sweep
+            .one_to_all(&coordinates(sources), threads)
+            .map_err(|e| OsrmError::FfiError(e))?;
+        Ok(SweepDurations { num_sources: sources.len(), num_targets: self.node_count(), durations })
+    }
+
+    /// Duration from each source to each target point. Costs one full sweep per
+    /// source, so it pays off against `OsrmEngine::table` when there are many
+    /// targets, e.g. every cell of an accessibility grid.
+    pub fn durations_to(&self, sources: &[Point], targets: &[Point], threads: Option<i32>) -> Result<SweepDurations, OsrmError> {
+        let durations = self.sweep
+            .table(&coordinates(sources), &coordinates(targets), threads)
+            .map_err(|e| OsrmError::FfiError(e))?;
+        Ok(SweepDurations { num_sources: sources.len(), num_targets: targets.len(), durations })
+    }
+}
+
+fn coordinates(points: &[Point]) -> Vec<(f64, f64)> {
+    points.iter().map(|p| (p.longitude, p.latitude)).collect()
+}
@@ -2,16 +2,27 @@
 
 
 use crate::errors::OsrmError;
-use crate::{algorithm, Osrm, EngineConfig};
-use crate::point::Point;
-use crate::route::{RouteRequest, RouteResponse, SimpleRouteResponse};
-use crate::tables::{TableRequest, TableResponse};
-use crate::trip::{TripRequest, TripResponse};
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::mpsc;
+use std::sync::{Arc, Barrier, RwLock};
+use std::time::Duration;
+
+use crate::{algorithm, CoalescingStats, Osrm, OsrmLocationSet, EngineConfig, MemoryReport, SlowQuery};
+use crate::point::{FixedPoint, Point};
+use crate::route::{AlternativesRequest, RouteMatrixRequest, RouteMatrixResponse, RouteRequest, RouteResponse, RouteSummary, SimpleRouteResponse};
+use crate::tables::{LocationTable, SparseTableRequest, SparseTableResponse, TableRequest, TableResponse};
+use crate::trip::{TripRequest, TripResponse, TripSolution, TripSolveRequest};
 use crate::r#match::{MatchRequest, MatchResponse};
 use crate::nearest::{NearestRequest, NearestResponse};
+use crate::pipeline::{ContractUpdateStats, PipelineConfig, PipelineReport, ProfileMemoStats, RunControl};
 
 pub struct OsrmEngine {
+    // Declared before `instance` so the sets are freed before the engine they point into
+    location_sets: RwLock<HashMap<String, Arc<OsrmLocationSet>>>,
     instance: Osrm,
+    // usize::MAX while heaps are kept
+    heap_release_locations: AtomicUsize,
 }
 
 impl OsrmEngine {
@@ -19,17 +30,176 @@ impl OsrmEngine {
     pub fn new(base_path: &str, algorithm : algorithm::Algorithm, max_table_size: Option<i32>) -> Result<Self, OsrmError> {
         let osrm = Osrm::new(base_path, algorithm.as_str(), max_table_size.unwrap_or(0)).map_err( |_|  OsrmError::Initialization )?;
         Ok(OsrmEngine {
+            location_sets: RwLock::new(HashMap::new()),
             instance: osrm,
+            heap_release_locations: AtomicUsize::new(usize::MAX),
         })
     }
 
     pub fn new_with_config(config: EngineConfig) -> Result<Self, OsrmError> {
         let osrm = Osrm::new_with_config(config).map_err(|_| OsrmError::Initialization)?;
         Ok(OsrmEngine {
+            location_sets: RwLock::new(HashMap::new()),
             instance: osrm,
+            heap_release_locations: AtomicUsize::new(usize::MAX),
         })
     }
 
+    pub(crate) fn instance(&self) -> &Osrm {
+        &self.instance
+    }
+
+    /// Per-component size of what an engine would load from `base_path`, to size
+    /// deployments before starting one. `disable_feature_dataset` takes the same
+    /// values as `EngineConfig::disable_feature_dataset`.
+    pub fn memory_report(
+        base_path: &str,
+        algorithm: algorithm::Algorithm,
+        disable_feature_dataset: &[String],
+    ) -> Result<MemoryReport, OsrmError> {
+        Osrm::memory_report(base_path, algorithm.as_str(), disable_feature_dataset)
+            .map_err(|e| OsrmError::FfiError(e))
+    }
+
+    /// Creates and grows the calling thread's search heaps with a route and a table
+    /// over `points`, so the first real queries on a new worker are not slowed down
+    /// by heap allocation. Call it from each worker thread at startup, e.g. in a
+    /// thread pool's start handler; points spread over the served area work best.
+    pub fn warm_current_thread(&self, points: &[Point]) -> Result<(), OsrmError> {
+        if points.len() < 2 {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        let coordinates: Vec<(f64, f64)> = points.iter()
+            .map(|p| (p.longitude, p.latitude))
+            .collect();
+        self.instance.warm_thread(&coordinates).map_err(|e| OsrmError::FfiError(e))
+    }
+
+    /// Like `warm_current_thread`, but first creates the calling thread's search
+    /// heaps with room for `node_count` graph nodes. OSRM keeps a thread's heaps
+    /// once created, so a count near the largest search the workload runs keeps
+    /// them from growing under traffic.
+    pub fn warm_current_thread_with_capacity(&self, points: &[Point], node_count: usize) -> Result<(), OsrmError> {
+        if points.len() < 2 {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        self.instance.reserve_thread_heaps(node_count).map_err(|e| OsrmError::FfiError(e))?;
+        self.warm_current_thread(points)
+    }
+
+    /// Warms `workers` threads of a pool at startup. `spawn` is called once per
+    /// worker with a job to run on the pool, e.g. `|job| pool.spawn(job)`; each job
+    /// warms its thread, with room for `node_count` nodes when given, and then
+    /// waits for the others, so no thread takes two jobs. `workers` must not
+    /// exceed the pool's thread count. Returns once every job has finished.
+    pub fn warm_workers<S>(
+        self: &Arc<Self>,
+        workers: usize,
+        points: &[Point],
+        node_count: Option<usize>,
+        mut spawn: S,
+    ) -> Result<(), OsrmError>
+    where
+        S: FnMut(Box<dyn FnOnce() + Send + 'static>),
+    {
+        if points.len() < 2 {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        let points: Arc<Vec<Point>> = Arc::new(points.to_vec());
+        let barrier = Arc::new(Barrier::new(workers));
+        let (sender, receiver) = mpsc::channel();
+
+        for _ in 0..workers {
+            let engine = Arc::clone(self);
+            let points = Arc::clone(&points);
+            let barrier = Arc::clone(&barrier);
+            let sender = sender.clone();
+            spawn(Box::new(move || {
+                let result = match node_count {
+                    Some(node_count) => engine.warm_current_thread_with_capacity(&points, node_count),
+                    None => engine.warm_current_thread(&points),
+                };
+                barrier.wait();
+                let _ = sender.send(result);
+            }));
+        }
+        drop(sender);
+
+        for _ in 0..workers {
+            receiver
+                .recv()
+                .map_err(|_| OsrmError::FfiError("A warm-up job was dropped before it ran".to_string()))??;
+        }
+        Ok(())
+    }
+
+    /// Frees the calling thread's search heaps; they are recreated by the next query
+    pub fn release_thread_heaps() {
+        Osrm::release_thread_heaps();
+    }
+
+    /// Releases the calling thread's search heaps after any table, route, match or
+    /// trip with more than `locations` coordinates, so one huge request does not
+    /// pin heap memory on that thread. `None` (the default) keeps the heaps.
+    pub fn set_heap_release_threshold(&self, locations: Option<usize>) {
+        self.heap_release_locations.store(locations.unwrap_or(usize::MAX), Ordering::Relaxed);
+    }
+
+    fn release_heaps_after(&self, num_locations: usize) {
+        if num_locations > self.heap_release_locations.load(Ordering::Relaxed) {
+            Osrm::release_thread_heaps();
+        }
+    }
+
+    /// Lets identical route and table requests that arrive while one of them is
+    /// running share its result instead of each running the query. Requests match
+    /// when every parameter is equal, coordinates at OSRM's 1e-6 degree precision;
+    /// routes with binary geometry are never shared. Off by default.
+    pub fn set_coalescing(&self, enabled: bool) {
+        self.instance.set_coalescing(enabled);
+    }
+
+    /// Counters since coalescing was last enabled, zero while it is off
+    pub fn coalescing_stats(&self) -> CoalescingStats {
+        self.instance.coalescing_stats()
+    }
+
+    /// Logs route, table, nearest and match requests that take at least
+    /// `threshold`, keeping the latest `capacity` of them; a capacity of 0 turns
+    /// the log off. Reconfiguring starts a new, empty log.
+    pub fn set_slow_query_log(&self, threshold: Duration, capacity: usize) {
+        self.instance.set_slow_query_log(threshold.as_secs_f64() * 1000.0, capacity);
+    }
+
+    /// Takes the logged slow queries out of the log, oldest first
+    pub fn drain_slow_queries(&self) -> Result<Vec<SlowQuery>, OsrmError> {
+        let lines = self.instance.drain_slow_queries().map_err(|e| OsrmError::FfiError(e))?;
+        lines.lines()
+            .map(|line| {
+                let mut query = serde_json::from_str::<SlowQuery>(line).map_err(|e| OsrmError::JsonParse(e))?;
+                query.line = line.to_string();
+                Ok(query)
+            })
+            .collect()
+    }
+
+    /// Appends the logged slow queries to a JSONL file that `examples/load_test.rs`
+    /// can replay, empties the log and returns how many were written
+    pub fn dump_slow_queries(&self, path: &str) -> Result<usize, OsrmError> {
+        self.instance.dump_slow_queries(path).map_err(|e| OsrmError::FfiError(e))
+    }
+
+    /// Slow queries overwritten by newer ones before they were drained
+    pub fn dropped_slow_queries(&self) -> u64 {
+        self.instance.dropped_slow_queries()
+    }
+
+    /// C++ allocations made by the calling thread so far. Only counted when the
+    /// crate is built with the `alloc-stats` feature, 0 otherwise.
+    pub fn thread_allocations() -> u64 {
+        Osrm::thread_allocations()
+    }
+
     pub fn table(&self, table_request: TableRequest) -> Result<TableResponse, OsrmError> {
         let coordinates = &table_request.coordinates;
         let sources_index: Vec<usize> = table_request.sources_indices.unwrap_or_else(|| (0..coordinates.len()).collect());
@@ -65,10 +235,40 @@ impl OsrmEngine {
             table_request.fallback_coordinate.as_deref(),
             table_request.scale_factor,
             table_request.snapping.as_deref(),
-        ).map_err(|e| OsrmError::FfiError(e))?;
+        );
+        self.release_heaps_after(coordinates.len());
+        let result = result.map_err(|e| OsrmError::FfiError(e))?;
+        serde_json::from_str::<TableResponse>(&result).map_err(|e| OsrmError::JsonParse(e))
+    }
+
+    /// Table over fixed-point coordinates, passed to the engine without conversion.
+    /// Sources and destinations default to all coordinates.
+    pub fn table_fixed(
+        &self,
+        coordinates: &[FixedPoint],
+        sources: Option<&[usize]>,
+        destinations: Option<&[usize]>,
+        fallback_speed: Option<f64>,
+    ) -> Result<TableResponse, OsrmError> {
+        if coordinates.is_empty() {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        let result = self.instance
+            .table_fixed(coordinates, sources, destinations, true, true, fallback_speed);
+        self.release_heaps_after(coordinates.len());
+        let result = result.map_err(|e| OsrmError::FfiError(e))?;
         serde_json::from_str::<TableResponse>(&result).map_err(|e| OsrmError::JsonParse(e))
     }
 
+    pub fn table_sparse(&self, request: &SparseTableRequest) -> Result<SparseTableResponse, OsrmError> {
+        if request.coordinates.is_empty() {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        self.instance
+            .table_sparse(&request.coordinates, &request.pattern, request.fallback_speed, request.threads)
+            .map_err(|e| OsrmError::FfiError(e))
+    }
+
     pub fn route(&self, route_request: RouteRequest) -> Result<RouteResponse, OsrmError> {
         let len = route_request.points.len();
         if len == 0 {
@@ -107,15 +307,46 @@ impl OsrmEngine {
             route_request.annotations.as_deref(),
             route_request.geometries.as_deref(),
             route_request.overview.as_deref(),
+            route_request.simplify_tolerance,
             route_request.continue_straight,
             route_request.exclude.as_deref(),
             route_request.waypoints.as_deref(),
             route_request.skip_waypoints,
-        ).map_err(|e| OsrmError::FfiError(e))?;
+        );
+        self.release_heaps_after(len);
+        let (result, binary_geometry) = result.map_err(|e| OsrmError::FfiError(e))?;
         
+        let mut route_response = serde_json::from_str::<RouteResponse>(&result).map_err(|e| OsrmError::JsonParse(e))?;
+        route_response.binary_geometry = binary_geometry;
+        Ok(route_response)
+    }
+
+    pub fn route_alternatives(&self, request: &AlternativesRequest) -> Result<RouteResponse, OsrmError> {
+        let result = self.instance.route_alternatives(
+            (request.from.longitude, request.from.latitude),
+            (request.to.longitude, request.to.latitude),
+            request.max_alternatives,
+            request.max_stretch,
+            request.max_overlap,
+            request.time_budget_ms,
+            request.threads,
+        ).map_err(|e| OsrmError::FfiError(e))?;
         serde_json::from_str::<RouteResponse>(&result).map_err(|e| OsrmError::JsonParse(e))
     }
 
+    pub fn route_matrix(&self, request: &RouteMatrixRequest) -> Result<RouteMatrixResponse, OsrmError> {
+        if request.points.len() < 2 || request.pairs.is_empty() {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        let coordinates: Vec<(f64, f64)> = request.points.iter()
+            .map(|p| (p.longitude, p.latitude))
+            .collect();
+        let routes = self.instance
+            .route_matrix(&coordinates, &request.pairs, request.annotations.as_deref(), request.threads)
+            .map_err(|e| OsrmError::FfiError(e))?;
+        Ok(RouteMatrixResponse { routes })
+    }
+
     pub fn trip(&self, trip_request: TripRequest) -> Result<TripResponse, OsrmError> {
         let len = trip_request.points.len();
         if len == 0 {
@@ -156,26 +387,137 @@ impl OsrmEngine {
             trip_request.annotations.as_deref(),
             trip_request.geometries.as_deref(),
             trip_request.overview.as_deref(),
+            trip_request.simplify_tolerance,
             trip_request.exclude.as_deref(),
-        ).map_err(|e| OsrmError::FfiError(e))?;
+        );
+        self.release_heaps_after(len);
+        let (result, binary_geometry) = result.map_err(|e| OsrmError::FfiError(e))?;
         
-        serde_json::from_str::<TripResponse>(&result).map_err(|e| OsrmError::JsonParse(e))
+        let mut trip_response = serde_json::from_str::<TripResponse>(&result).map_err(|e| OsrmError::JsonParse(e))?;
+        trip_response.binary_geometry = binary_geometry;
+        Ok(trip_response)
     }
 
-    pub fn simple_route(&self, from : Point , to : Point) -> Result<SimpleRouteResponse, OsrmError> {
-        let coordinates: Vec<(f64, f64)> = vec![(from.longitude, from.latitude), (to.longitude, to.latitude)];
-        let result = self.instance.route(&coordinates, None, None, None, true, None, None, false, None, None, None, None, false, None, None, false).map_err( |e| OsrmError::FfiError(e))?;
-        let route_response = serde_json::from_str::<RouteResponse>(&result).map_err(|e| OsrmError::JsonParse(e))?;
-        if route_response.routes.len() == 0 {
-            return Err(OsrmError::ApiError("No route were returned between those 2 points".to_owned()))
+    /// Solves a trip over many stops with one table and parallel 2-opt / Or-opt
+    /// local search, for stop counts beyond what `trip` handles well
+    pub fn trip_solve(&self, request: &TripSolveRequest) -> Result<TripSolution, OsrmError> {
+        if request.points.len() < 2 {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        let coordinates: Vec<(f64, f64)> = request.points.iter()
+            .map(|p| (p.longitude, p.latitude))
+            .collect();
+        self.instance
+            .trip_solve(&coordinates, request.roundtrip, request.time_budget_ms, request.threads)
+            .map_err(|e| OsrmError::FfiError(e))
+    }
+
+    /// Registers `points` under `name` for repeated tables and routes that refer to
+    /// them by index. The points are snapped once; with `precompute_table` the whole
+    /// set-to-set table is computed now on `threads` workers and later tables between
+    /// members are answered from memory. Registering an existing name replaces it.
+    pub fn register_locations(
+        &self,
+        name: &str,
+        points: &[Point],
+        precompute_table: bool,
+        threads: Option<i32>,
+    ) -> Result<(), OsrmError> {
+        if points.is_empty() {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        let coordinates: Vec<(f64, f64)> = points.iter()
+            .map(|p| (p.longitude, p.latitude))
+            .collect();
+        let set = self.instance
+            .register_locations(&coordinates, precompute_table, threads)
+            .map_err(|e| OsrmError::FfiError(e))?;
+        self.location_sets.write().unwrap().insert(name.to_string(), Arc::new(set));
+        Ok(())
+    }
+
+    pub fn unregister_locations(&self, name: &str) -> bool {
+        self.location_sets.write().unwrap().remove(name).is_some()
+    }
+
+    fn location_set(&self, name: &str) -> Result<Arc<OsrmLocationSet>, OsrmError> {
+        self.location_sets.read().unwrap()
+            .get(name)
+            .cloned()
+            .ok_or_else(|| OsrmError::ApiError(format!("Unknown location set {}", name)))
+    }
+
+    /// Table between members of the location set `name`. Empty `sources` or
+    /// `destinations` mean every member.
+    pub fn location_table(&self, name: &str, sources: &[usize], destinations: &[usize]) -> Result<LocationTable, OsrmError> {
+        let set = self.location_set(name)?;
+        let all: Vec<usize> = (0..set.len()).collect();
+        let sources = if sources.is_empty() { &all[..] } else { sources };
+        let destinations = if destinations.is_empty() { &all[..] } else { destinations };
+        set.table(sources, destinations).map_err(|e| OsrmError::FfiError(e))
+    }
+
+    /// Table from new points to members of the location set `name`: only the new
+    /// points are snapped. Empty `destinations` mean every member.
+    ///
+    /// MLD only: an MLD table searches forward from each new point, while a CH
+    /// table would search backward from every member again on each call, no
+    /// cheaper than `table`. CH engines get an error.
+    pub fn location_table_from(&self, name: &str, points: &[Point], destinations: &[usize]) -> Result<LocationTable, OsrmError> {
+        if points.is_empty() {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        if self.instance.is_ch() {
+            return Err(OsrmError::ApiError("location_table_from needs an MLD engine".to_string()));
+        }
+        let set = self.location_set(name)?;
+        let all: Vec<usize> = (0..set.len()).collect();
+        let destinations = if destinations.is_empty() { &all[..] } else { destinations };
+        let coordinates: Vec<(f64, f64)> = points.iter()
+            .map(|p| (p.longitude, p.latitude))
+            .collect();
+        set.table_from(&coordinates, destinations).map_err(|e| OsrmError::FfiError(e))
+    }
+
+    /// Route totals through members of the location set `name`, in the order of `ids`
+    pub fn location_route_summary(&self, name: &str, ids: &[usize], include_legs: bool) -> Result<RouteSummary, OsrmError> {
+        if ids.len() < 2 {
+            return Err(OsrmError::InvalidTableArgument);
         }
+        self.location_set(name)?
+            .route_summary(ids, include_legs)
+            .map_err(|e| OsrmError::FfiError(e))
+    }
+
+    pub fn simple_route(&self, from : Point , to : Point) -> Result<SimpleRouteResponse, OsrmError> {
+        let summary = self.route_summary(&[from, to], false)?;
         Ok(SimpleRouteResponse {
-            code: route_response.code,
-            distance : route_response.routes.first().unwrap().legs.first().unwrap().distance,
-            durations : route_response.routes.first().unwrap().legs.first().unwrap().duration
+            code: "Ok".to_owned(),
+            distance : summary.distance,
+            durations : summary.duration
         })
     }
 
+    /// Computes only the duration, distance and weight of the best route through `points`.
+    /// Guidance, geometry and waypoints are never assembled and no JSON is rendered or parsed,
+    /// which makes this the cheapest way to get travel totals.
+    pub fn route_summary(&self, points: &[Point], include_legs: bool) -> Result<RouteSummary, OsrmError> {
+        if points.len() < 2 {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        let coordinates: Vec<(f64, f64)> = points.iter()
+            .map(|p| (p.longitude, p.latitude))
+            .collect();
+        self.instance.route_summary(&coordinates, include_legs).map_err(|e| OsrmError::FfiError(e))
+    }
+
+    pub fn route_summary_fixed(&self, points: &[FixedPoint], include_legs: bool) -> Result<RouteSummary, OsrmError> {
+        if points.len() < 2 {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        self.instance.route_summary_fixed(points, include_legs).map_err(|e| OsrmError::FfiError(e))
+    }
+
     pub fn match_route(&self, match_request: MatchRequest) -> Result<MatchResponse, OsrmError> {
         let len = match_request.points.len();
         if len == 0 {
@@ -214,10 +556,15 @@ impl OsrmEngine {
             match_request.annotations.as_deref(),
             match_request.geometries.as_deref(),
             match_request.overview.as_deref(),
+            match_request.simplify_tolerance,
             match_request.exclude.as_deref(),
-        ).map_err(|e| OsrmError::FfiError(e))?;
+        );
+        self.release_heaps_after(len);
+        let (result, binary_geometry) = result.map_err(|e| OsrmError::FfiError(e))?;
         
-        serde_json::from_str::<MatchResponse>(&result).map_err(|e| OsrmError::JsonParse(e))
+        let mut match_response = serde_json::from_str::<MatchResponse>(&result).map_err(|e| OsrmError::JsonParse(e))?;
+        match_response.binary_geometry = binary_geometry;
+        Ok(match_response)
     }
 
     pub fn nearest(&self, nearest_request: NearestRequest) -> Result<NearestResponse, OsrmError> {
@@ -260,6 +607,42 @@ impl OsrmEngine {
         Osrm::contract(path, None).map_err(|e| OsrmError::ApiError(e))
     }
 
+    /// Runs the whole contraction with segment speed and turn penalty files applied,
+    /// like `osrm-contract --segment-speed-file`.
+    pub fn contract_with_updates(
+        path: &str,
+        segment_speed_files: &[String],
+        turn_penalty_files: &[String],
+        threads: Option<i32>,
+    ) -> Result<String, OsrmError> {
+        Osrm::contract_with_updates(path, segment_speed_files, turn_penalty_files, threads)
+            .map_err(|e| OsrmError::ApiError(e))
+    }
+
+    /// Applies segment speed and turn penalty files to an already contracted dataset
+    /// without running the whole contraction again. The node order of the existing
+    /// `.hsgr` is kept and only shortcuts around changed edges are repaired, in
+    /// parallel over `threads`.
+    ///
+    /// Weight decreases give the same routes as a full contraction. After increases,
+    /// a shortcut whose witness path got longer is only restored when a node next to
+    /// a changed edge uses it; pass `check_all_nodes` to search witnesses at every
+    /// node, which is slower but restores every shortcut the repair can find. If
+    /// shortcuts are still missing after 16 repair passes the call fails and
+    /// leaves the `.hsgr` untouched; [`OsrmEngine::contract_with_updates`] then
+    /// contracts from scratch. Each call starts from the original weights, so
+    /// pass all speed files that should be in effect.
+    pub fn contract_update(
+        path: &str,
+        segment_speed_files: &[String],
+        turn_penalty_files: &[String],
+        check_all_nodes: bool,
+        threads: Option<i32>,
+    ) -> Result<ContractUpdateStats, OsrmError> {
+        Osrm::contract_update(path, segment_speed_files, turn_penalty_files, check_all_nodes, threads)
+            .map_err(|e| OsrmError::ApiError(e))
+    }
+
     /// Runs the OSRM extraction process on the given input file (e.g. .osm.pbf).
     /// This is equivalent to running `osrm-extract <input_path> -p <profile_path>`.
     pub fn extract(
@@ -285,6 +668,28 @@ impl OsrmEngine {
         ).map_err(|e| OsrmError::ApiError(e))
     }
 
+    /// Same as [`OsrmEngine::extract`], but reuses the profile's result for nodes and ways
+    /// whose tag set was already processed on the same thread. Only valid for profiles
+    /// whose node and way functions depend on tags alone; nodes and ways that belong to a
+    /// relation and inputs with location-dependent data always go through the profile.
+    pub fn extract_memoized(
+        input_path: &str,
+        profile_path: &str,
+        threads: Option<i32>,
+        parse_conditionals: Option<bool>,
+        use_metadata: Option<bool>,
+        use_locations_cache: Option<bool>,
+    ) -> Result<ProfileMemoStats, OsrmError> {
+        Osrm::extract_memoized(
+            input_path,
+            profile_path,
+            threads,
+            parse_conditionals.unwrap_or(true),
+            use_metadata.unwrap_or(true),
+            use_locations_cache.unwrap_or(true)
+        ).map_err(|e| OsrmError::ApiError(e))
+    }
+
     /// Runs the OSRM partitioning process (MLD) on the given file path.
     /// This is equivalent to running `osrm-partition <path>`.
     pub fn partition(
@@ -312,6 +717,67 @@ impl OsrmEngine {
     pub fn customize(path: &str, threads: Option<i32>) -> Result<String, OsrmError> {
         Osrm::customize(path, threads).map_err(|e| OsrmError::ApiError(e))
     }
+
+    /// Runs the whole preprocessing chain for one profile: extract, then partition + customize
+    /// and/or contract. When both CH and MLD outputs are requested, customization and contraction
+    /// run concurrently on the same extract. Every stage runs under `control`.
+    pub fn pipeline(config: &PipelineConfig, control: &mut RunControl) -> Result<PipelineReport, OsrmError> {
+        Osrm::pipeline(config, control).map_err(|e| OsrmError::ApiError(e))
+    }
+
+    /// Same as [`OsrmEngine::extract`], with progress reporting, cancellation and a memory limit.
+    pub fn extract_controlled(
+        input_path: &str,
+        profile_path: &str,
+        threads: Option<i32>,
+        parse_conditionals: Option<bool>,
+        use_metadata: Option<bool>,
+        use_locations_cache: Option<bool>,
+        control: &mut RunControl,
+    ) -> Result<String, OsrmError> {
+        Osrm::extract_controlled(
+            input_path,
+            profile_path,
+            threads,
+            parse_conditionals.unwrap_or(true),
+            use_metadata.unwrap_or(true),
+            use_locations_cache.unwrap_or(true),
+            control
+        ).map_err(|e| OsrmError::ApiError(e))
+    }
+
+    /// Same as [`OsrmEngine::partition`], with progress reporting, cancellation and a memory limit.
+    pub fn partition_controlled(
+        path: &str,
+        threads: Option<i32>,
+        balance: Option<f64>,
+        boundary_factor: Option<f64>,
+        num_optimizing_cuts: Option<i32>,
+        small_component_size: Option<i32>,
+        max_cell_sizes: Option<Vec<i32>>,
+        control: &mut RunControl,
+    ) -> Result<String, OsrmError> {
+        Osrm::partition_controlled(
+            path,
+            threads,
+            balance,
+            boundary_factor,
+            num_optimizing_cuts,
+            small_component_size,
+            max_cell_sizes,
+            control
+        ).map_err(|e| OsrmError::ApiError(e))
+    }
+
+    /// Same as [`OsrmEngine::customize`], with progress reporting, cancellation and a memory limit.
+    pub fn customize_controlled(path: &str, threads: Option<i32>, control: &mut RunControl) -> Result<String, OsrmError> {
+        Osrm::customize_controlled(path, threads, control).map_err(|e| OsrmError::ApiError(e))
+    }
+
+    /// Same as [`OsrmEngine::contract`], with progress reporting, cancellation and a memory limit.
+    pub fn contract_controlled(path: &str, threads: Option<i32>, control: &mut RunControl) -> Result<String, OsrmError> {
+        Osrm::contract_controlled(path, threads, control).map_err(|e| OsrmError::ApiError(e))
+    }
 }
 
 #[cfg(test)]
@@ -320,6 +786,9 @@ mod tests {
     use crate::algorithm::Algorithm;
     use crate::route::RouteRequestBuilder;
     use crate::tables::{Point};
+    use crate::tables::SparsityPattern;
+    use crate::route::AlternativesRequest;
+    use crate::trip::TripSolveRequest;
     #[test]
     fn it_calculates_a_table_successfully() {
         // Try to load .env file, but don't fail if it doesn't exist
@@ -413,6 +882,918 @@ mod tests {
         println!("Simple route: distance={:.2} km, duration={:.2} seconds", response.distance / 1000.0, response.durations);
     }
 
+    #[test]
+    fn it_calculates_a_route_summary_successfully() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        let points = [
+            Point { longitude: 6.1319, latitude: 49.6116 }, // Luxembourg City
+            Point { longitude: 6.1063, latitude: 49.7508 }, // Ettelbruck
+            Point { longitude: 5.9675, latitude: 49.5009 }, // Esch-sur-Alzette
+        ];
+        let summary = engine.route_summary(&points, true).expect("route summary request failed");
+
+        assert_eq!(summary.legs.len(), 2, "Should have 1 leg per pair of points");
+        assert!(summary.distance > 0.0, "Distance should be positive");
+        assert!(summary.duration > 0.0, "Duration should be positive");
+        let leg_duration: f64 = summary.legs.iter().map(|l| l.duration).sum();
+        assert!((leg_duration - summary.duration).abs() < 1.0, "Legs should add up to the route duration");
+    }
+
+    #[test]
+    fn it_calculates_a_sparse_table_successfully() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        let request = SparseTableRequest {
+            coordinates: vec![
+                (6.1319, 49.6116), // Luxembourg City
+                (6.1063, 49.7508), // Ettelbruck
+                (5.9675, 49.5009), // Esch-sur-Alzette
+                (6.1296, 49.6200), // Limpertsberg
+            ],
+            pattern: SparsityPattern::KNearest(2),
+            fallback_speed: None,
+            threads: Some(2),
+        };
+        let response = engine.table_sparse(&request).expect("sparse table request failed");
+
+        assert_eq!(response.row_offsets, vec![0, 2, 4, 6, 8], "Each row should have k cells");
+        assert!(response.cell(0, 0).is_none(), "The diagonal is not part of the pattern");
+        assert!(response.cell(0, 3).is_some(), "Limpertsberg is among the nearest to Luxembourg City");
+        assert!(response.duration(0, 3).unwrap() > 0.0, "Duration should be positive");
+    }
+
+    #[test]
+    fn it_matches_a_full_table_on_every_sparse_cell() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        // More rows than fit in one batch, spread around Luxembourg City
+        let coordinates: Vec<(f64, f64)> = (0..48)
+            .map(|i| (6.08 + (i % 8) as f64 * 0.015, 49.58 + (i / 8) as f64 * 0.012))
+            .collect();
+        let request = SparseTableRequest {
+            coordinates: coordinates.clone(),
+            pattern: SparsityPattern::KNearest(5),
+            fallback_speed: None,
+            threads: Some(3),
+        };
+        let sparse = engine.table_sparse(&request).expect("sparse table request failed");
+
+        let full = engine.table(TableRequest {
+            coordinates,
+            include_duration: true,
+            include_distance: false,
+            bearings: None,
+            radiuses: None,
+            hints: None,
+            generate_hints: false,
+            sources_indices: None,
+            destinations_indices: None,
+            approaches: None,
+            fallback_speed: None,
+            fallback_coordinate: None,
+            scale_factor: None,
+            snapping: None,
+        }).expect("table request failed");
+        let durations = full.durations.expect("durations should be present");
+
+        for row in 0..48 {
+            for cell in sparse.row_offsets[row]..sparse.row_offsets[row + 1] {
+                let column = sparse.column_indices[cell];
+                match (sparse.durations[cell], durations[row][column]) {
+                    (Some(a), Some(b)) => assert!((a - b).abs() < 0.5, "Cell ({}, {}) differs: {} vs {}", row, column, a, b),
+                    (a, b) => assert_eq!(a.is_some(), b.is_some(), "Cell ({}, {}) reachability differs", row, column),
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn it_calculates_a_fixed_point_table_successfully() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        let points = [
+            FixedPoint { longitude: 6_131_900, latitude: 49_611_600 }, // Luxembourg City
+            FixedPoint { longitude: 6_106_300, latitude: 49_750_800 }, // Ettelbruck
+        ];
+        let response = engine.table_fixed(&points, None, None, None).expect("fixed-point table request failed");
+        let durations = response.durations.expect("durations should be present");
+        assert!(durations[0][1].unwrap() > 0.0, "Duration should be positive");
+
+        let out_of_range = [FixedPoint { longitude: 181_000_000, latitude: 0 }, points[0]];
+        assert!(engine.table_fixed(&out_of_range, None, None, None).is_err(), "Out of range coordinates should be rejected");
+    }
+
+    #[test]
+    fn it_reports_dataset_memory_successfully() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let full = OsrmEngine::memory_report(&path, Algorithm::MLD, &[]).expect("memory report failed");
+        assert!(full.graph_bytes > 0, "The MLD graph should be accounted for");
+        assert!(full.cell_metrics_bytes > 0, "Cell metrics should be accounted for");
+
+        let table_only = OsrmEngine::memory_report(&path, Algorithm::MLD, &["ROUTE_GEOMETRY".to_string()])
+            .expect("memory report failed");
+        assert_eq!(table_only.geometry_bytes, 0, "Disabled geometry should not be counted");
+        assert!(table_only.total_bytes < full.total_bytes, "Disabling a dataset should shrink the footprint");
+        assert!(full.total_bytes - table_only.total_bytes > full.geometry_bytes,
+                "Every file of the disabled feature should be left out, not only the geometry");
+
+        let file_index = std::fs::metadata(format!("{}.fileIndex", path)).expect("missing .fileIndex").len() as usize;
+        assert_eq!(full.file_index_bytes, file_index, "The mapped file index should be reported on its own");
+        let components = full.rtree_bytes + full.graph_bytes + full.cell_metrics_bytes + full.names_bytes
+            + full.geometry_bytes + full.other_bytes;
+        assert_eq!(components, full.total_bytes, "The file index should not be part of the total");
+    }
+
+    #[test]
+    fn it_finds_diverse_alternatives_successfully() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        let request = AlternativesRequest {
+            from: Point { longitude: 6.1319, latitude: 49.6116 }, // Luxembourg City
+            to: Point { longitude: 6.1063, latitude: 49.7508 },   // Ettelbruck
+            max_alternatives: 2,
+            max_stretch: 0.5,
+            max_overlap: 0.8,
+            time_budget_ms: Some(500.0),
+            threads: Some(4),
+        };
+        let response = engine.route_alternatives(&request).expect("alternatives request failed");
+
+        assert!(!response.routes.is_empty(), "Should at least return the fastest route");
+        assert!(response.routes.len() <= 3, "Should not exceed the requested alternatives");
+        let fastest = response.routes[0].duration;
+        assert!(response.routes.iter().all(|r| r.duration <= fastest * 1.5 + 1e-6), "Alternatives should respect the stretch limit");
+        assert!(response.routes.iter().all(|r| r.legs.len() == 1), "Routes through a via point should have a single leg");
+    }
+
+    #[test]
+    fn it_routes_a_matrix_of_pairs_like_single_routes() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        let points = vec![
+            Point { longitude: 6.1319, latitude: 49.6116 },
+            Point { longitude: 6.1063, latitude: 49.7508 },
+            Point { longitude: 6.05, latitude: 49.55 },
+        ];
+        let pairs = vec![(0, 1), (1, 0), (0, 2), (2, 1)];
+        let request = RouteMatrixRequest {
+            points: points.clone(),
+            pairs: pairs.clone(),
+            annotations: Some(vec!["duration".to_string()]),
+            threads: Some(2),
+        };
+        let response = engine.route_matrix(&request).expect("route matrix request failed");
+        assert_eq!(response.routes.len(), pairs.len());
+
+        for (route, &(from, to)) in response.routes.iter().zip(&pairs) {
+            let route = route.as_ref().expect("every pair should have a route");
+            let single = engine.route(RouteRequestBuilder::default()
+                .points(vec![points[from].clone(), points[to].clone()])
+                .build()
+                .expect("Failed to build RouteRequest"))
+                .expect("route request failed");
+            assert!((route.duration - single.routes[0].duration).abs() <= 1.0,
+                    "Pair {:?} should match a single route: {} vs {}", (from, to), route.duration, single.routes[0].duration);
+            assert!(route.geometry.coordinates.len() >= 2, "Each pair should have its geometry");
+            assert_eq!(route.geometry.legs.len(), 1);
+            let annotated: f64 = route.geometry.legs[0].durations.iter().sum();
+            assert!((annotated - route.duration).abs() <= 1.0, "Leg annotations should add up to the duration");
+        }
+    }
+
+    #[test]
+    fn it_solves_a_trip_with_local_search_successfully() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        let points: Vec<Point> = (0..12)
+            .map(|i| Point {
+                longitude: 6.05 + 0.02 * (i % 4) as f64,
+                latitude: 49.55 + 0.03 * (i / 4) as f64,
+            })
+            .collect();
+        let request = TripSolveRequest {
+            points,
+            roundtrip: true,
+            time_budget_ms: Some(200.0),
+            threads: Some(2),
+        };
+        let solution = engine.trip_solve(&request).expect("trip solve request failed");
+
+        assert_eq!(solution.order[0], 0, "Round trips start at the first stop");
+        let mut visited = solution.order.clone();
+        visited.sort();
+        assert_eq!(visited, (0..12).collect::<Vec<_>>(), "Every stop should be visited once");
+        assert_eq!(solution.legs.len(), 12, "A round trip has one leg per stop");
+        assert!(solution.duration > 0.0, "Duration should be positive");
+    }
+
+    #[test]
+    fn it_answers_tables_from_a_registered_location_set() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        let depots: Vec<Point> = (0..6)
+            .map(|i| Point {
+                longitude: 6.05 + 0.03 * (i % 3) as f64,
+                latitude: 49.55 + 0.05 * (i / 3) as f64,
+            })
+            .collect();
+        engine.register_locations("depots", &depots, true, Some(2)).expect("registering locations failed");
+
+        let cached = engine.location_table("depots", &[0, 1], &[]).expect("location table failed");
+        assert_eq!(cached.num_destinations, 6, "Empty destinations should mean every member");
+        assert_eq!(cached.duration(0, 0), Some(0.0), "A location should be zero seconds from itself");
+        assert!(cached.duration(0, 5).is_some_and(|d| d > 0.0), "Distinct depots should be reachable");
+
+        let new_source = Point { longitude: 6.1, latitude: 49.6 };
+        let from = engine.location_table_from("depots", &[new_source], &[5]).expect("location table from failed");
+        assert!(from.duration(0, 0).is_some(), "The new source should reach the depot");
+
+        let summary = engine.location_route_summary("depots", &[0, 5, 2], true).expect("location route failed");
+        assert_eq!(summary.legs.len(), 2, "Three stops make two legs");
+
+        assert!(engine.location_table("depots", &[6], &[0]).is_err(), "Unknown ids should be rejected");
+        assert!(engine.unregister_locations("depots"));
+        assert!(engine.location_table("depots", &[0], &[1]).is_err(), "Unregistered sets should be gone");
+    }
+
+    #[test]
+    fn it_logs_slow_queries_in_a_ring() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        engine.set_slow_query_log(Duration::ZERO, 4);
+
+        let request = RouteRequestBuilder::default()
+            .points(vec![Point { longitude: 6.1319, latitude: 49.6116 }, Point { longitude: 6.1063, latitude: 49.7508 }])
+            .build()
+            .expect("Failed to build RouteRequest");
+        for _ in 0..6 {
+            engine.route(request.clone()).expect("route request failed");
+        }
+
+        let queries = engine.drain_slow_queries().expect("draining the log failed");
+        assert_eq!(queries.len(), 4, "The ring keeps the latest queries");
+        assert_eq!(engine.dropped_slow_queries(), 2);
+        assert!(queries.windows(2).all(|pair| pair[0].timestamp_ms <= pair[1].timestamp_ms), "Oldest first");
+        let query = &queries[0];
+        assert_eq!(query.service, "route");
+        assert_eq!(query.num_coordinates, 2);
+        assert!(query.query_ms > 0.0 && query.query_ms <= query.total_ms);
+        let line: serde_json::Value = serde_json::from_str(&query.line).unwrap();
+        assert_eq!(line["coordinates"].as_array().map(|c| c.len()), Some(2), "The line should be replayable");
+
+        assert!(engine.drain_slow_queries().unwrap().is_empty(), "Draining empties the log");
+        engine.set_slow_query_log(Duration::ZERO, 0);
+        assert!(engine.drain_slow_queries().is_err(), "The log is off");
+    }
+
+    #[test]
+    fn it_replays_dumped_slow_queries() {
+        use crate::request_log::{parse_request, Request};
+
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        engine.set_slow_query_log(Duration::ZERO, 8);
+
+        let route = RouteRequestBuilder::default()
+            .points(vec![Point { longitude: 6.1319, latitude: 49.6116 }, Point { longitude: 6.1063, latitude: 49.7508 }])
+            .steps(true)
+            .radiuses(vec![None, Some(50.0)])
+            .build()
+            .expect("Failed to build RouteRequest");
+        engine.route(route).expect("route request failed");
+        let table = TableRequest {
+            coordinates: vec![(6.1319, 49.6116), (6.1063, 49.7508), (5.9675, 49.5009)],
+            include_duration: true,
+            include_distance: true,
+            bearings: None,
+            radiuses: None,
+            hints: None,
+            generate_hints: false,
+            sources_indices: Some(vec![0]),
+            destinations_indices: Some(vec![1, 2]),
+            approaches: None,
+            fallback_speed: Some(10.0),
+            fallback_coordinate: None,
+            scale_factor: None,
+            snapping: None,
+        };
+        engine.table(table).expect("table request failed");
+
+        let dump = std::env::temp_dir().join(format!("osrm-slow-queries-{}.jsonl", std::process::id()));
+        let _ = std::fs::remove_file(&dump);
+        assert_eq!(engine.dump_slow_queries(dump.to_str().unwrap()).expect("dumping the log failed"), 2);
+        let lines = std::fs::read_to_string(&dump).expect("dump could not be read");
+        let _ = std::fs::remove_file(&dump);
+        let requests: Vec<Request> = lines.lines()
+            .map(|line| parse_request(line).expect("a dumped line should parse"))
+            .collect();
+        assert_eq!(requests.len(), 2);
+
+        let Request::Route(route) = &requests[0] else { panic!("the route should come first") };
+        assert_eq!(route.points.len(), 2);
+        assert_eq!(route.points[1].longitude, 6.1063);
+        assert!(route.steps, "Route parameters should survive the dump");
+        assert_eq!(route.radiuses, Some(vec![None, Some(50.0)]));
+
+        let Request::Table(table) = &requests[1] else { panic!("the table should come second") };
+        assert_eq!(table.coordinates.len(), 3);
+        assert_eq!(table.sources_indices, Some(vec![0]));
+        assert_eq!(table.destinations_indices, Some(vec![1, 2]));
+        assert!(table.include_distance, "Table parameters should survive the dump");
+        assert_eq!(table.fallback_speed, Some(10.0));
+        for request in &requests {
+            request.send(&engine).expect("a dumped request should replay");
+        }
+    }
+
+    #[test]
+    fn it_tunes_partition_settings_on_copies() {
+        use crate::partition_tuning::{PartitionGrid, PartitionTuner, Workload};
+
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let work_dir = std::env::temp_dir().join(format!("osrm-partition-tuning-{}", std::process::id()));
+        let tuner = PartitionTuner::new(&path, work_dir.to_str().unwrap());
+        let grid = PartitionGrid {
+            max_cell_sizes: vec![vec![128, 4096, 65536, 2097152], vec![64, 2048, 65536, 2097152]],
+            ..Default::default()
+        };
+        let workload = Workload {
+            routes: vec![RouteRequestBuilder::default()
+                .points(vec![Point { longitude: 6.1319, latitude: 49.6116 }, Point { longitude: 6.1063, latitude: 49.7508 }])
+                .build()
+                .expect("Failed to build RouteRequest")],
+            tables: Vec::new(),
+            repetitions: 2,
+        };
+
+        let mut progress = Vec::new();
+        let report = tuner.run(&grid, &workload, |done, total, _| progress.push((done, total)))
+            .expect("tuning failed");
+        assert_eq!(progress, vec![(1, 2), (2, 2)]);
+        assert_eq!(report.candidates.len(), 2);
+        for candidate in &report.candidates {
+            assert!(candidate.error.is_none(), "{:?}", candidate.error);
+            assert!(candidate.memory.cell_metrics_bytes > 0, "The candidate should be customized");
+            assert_eq!(candidate.route.requests, 2, "Only the measured repetitions count");
+            assert_eq!(candidate.route.errors, 0);
+        }
+        assert!(!report.pareto_front().is_empty());
+        assert!(!work_dir.join("candidate-0").exists(), "Candidates are deleted once measured");
+        let _ = std::fs::remove_dir_all(&work_dir);
+    }
+
+    /// Copies every file of the dataset at `path` into a fresh temporary directory
+    fn copy_test_dataset(path: &str, name: &str) -> std::path::PathBuf {
+        let base = std::path::Path::new(path);
+        let base_name = base.file_name().and_then(|n| n.to_str()).expect("dataset path needs a file name");
+        let base_dir = base.parent().filter(|d| !d.as_os_str().is_empty()).unwrap_or(std::path::Path::new("."));
+        let dir = std::env::temp_dir().join(format!("osrm-{}-{}", name, std::process::id()));
+        std::fs::create_dir_all(&dir).expect("temporary directory could not be created");
+        for entry in std::fs::read_dir(base_dir).expect("dataset directory could not be read") {
+            let entry = entry.unwrap();
+            let file_name = entry.file_name().to_string_lossy().to_string();
+            if file_name == base_name || file_name.starts_with(&format!("{}.", base_name)) {
+                std::fs::copy(entry.path(), dir.join(&file_name)).expect("dataset file could not be copied");
+            }
+        }
+        dir.join(base_name)
+    }
+
+    /// Route duration between the two test points and a table over four points, on a freshly loaded engine
+    fn dataset_durations(path: &std::path::Path, algorithm: Algorithm) -> (f64, Vec<Vec<Option<f64>>>) {
+        let engine = OsrmEngine::new(path.to_str().unwrap(), algorithm, None).expect("Failed to initialize OSRM engine");
+        let route = engine.route(RouteRequestBuilder::default()
+            .points(vec![Point { longitude: 6.1319, latitude: 49.6116 }, Point { longitude: 6.1063, latitude: 49.7508 }])
+            .build()
+            .expect("Failed to build RouteRequest"))
+            .expect("route request failed");
+        let table = engine.table(TableRequest {
+            coordinates: vec![(6.1319, 49.6116), (6.1063, 49.7508), (6.05, 49.55), (6.11, 49.60)],
+            include_duration: true,
+            include_distance: false,
+            bearings: None,
+            radiuses: None,
+            hints: None,
+            generate_hints: false,
+            sources_indices: None,
+            destinations_indices: None,
+            approaches: None,
+            fallback_speed: None,
+            fallback_coordinate: None,
+            scale_factor: None,
+            snapping: None,
+        }).expect("table request failed");
+        (route.routes[0].duration, table.durations.expect("table should have durations"))
+    }
+
+    /// Copies the test extract input into its own temporary directory, so its
+    /// outputs do not collide with another run's; returns the `.osrm` base path
+    fn copy_test_pbf(pbf: &str, name: &str) -> (std::path::PathBuf, std::path::PathBuf) {
+        let dir = std::env::temp_dir().join(format!("osrm-{}-{}", name, std::process::id()));
+        std::fs::create_dir_all(&dir).expect("temporary directory could not be created");
+        let input = dir.join("input.osm.pbf");
+        std::fs::copy(pbf, &input).expect("input file could not be copied");
+        (input, dir.join("input.osrm"))
+    }
+
+    #[test]
+    fn it_extracts_the_same_dataset_with_memoized_profiles() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let (pbf, profile) = match (std::env::var("OSRM_TEST_PBF_PATH"), std::env::var("OSRM_TEST_PROFILE_PATH")) {
+            (Ok(pbf), Ok(profile)) => (pbf, profile),
+            _ => {
+                eprintln!("Skipping test: OSRM_TEST_PBF_PATH or OSRM_TEST_PROFILE_PATH environment variable not set");
+                return;
+            }
+        };
+        let (plain_input, plain) = copy_test_pbf(&pbf, "extract-plain");
+        let (memoized_input, memoized) = copy_test_pbf(&pbf, "extract-memoized");
+
+        OsrmEngine::extract(plain_input.to_str().unwrap(), &profile, None, None, None, None, None, None)
+            .expect("plain extraction failed");
+        let stats = OsrmEngine::extract_memoized(memoized_input.to_str().unwrap(), &profile, None, None, None, None)
+            .expect("memoized extraction failed");
+        assert!(stats.way_hits > 0, "Some ways should have been answered from the cache");
+
+        // Same partition on both, so any difference comes from the extraction
+        for path in [&plain, &memoized] {
+            OsrmEngine::partition(path.to_str().unwrap(), None, None, None, None, None, None).expect("partition failed");
+            OsrmEngine::customize(path.to_str().unwrap(), None).expect("customize failed");
+        }
+        for suffix in ["nbg_nodes", "names", "geometry"] {
+            let read = |base: &std::path::PathBuf| std::fs::read(format!("{}.{}", base.display(), suffix))
+                .expect("extracted file could not be read");
+            assert!(read(&plain) == read(&memoized), "The .osrm.{} files should be identical", suffix);
+        }
+        assert_eq!(dataset_durations(&memoized, Algorithm::MLD), dataset_durations(&plain, Algorithm::MLD),
+                   "Memoized and plain extractions should route the same");
+    }
+
+    #[test]
+    fn it_cancels_and_caps_a_running_extract() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+
+        let (pbf, profile, tools_dir) = match (std::env::var("OSRM_TEST_PBF_PATH"),
+                                               std::env::var("OSRM_TEST_PROFILE_PATH"),
+                                               std::env::var("OSRM_TOOLS_DIR")) {
+            (Ok(pbf), Ok(profile), Ok(tools_dir)) => (pbf, profile, tools_dir),
+            _ => {
+                eprintln!("Skipping test: OSRM_TEST_PBF_PATH, OSRM_TEST_PROFILE_PATH or OSRM_TOOLS_DIR environment variable not set");
+                return;
+            }
+        };
+        let (input, output) = copy_test_pbf(&pbf, "extract-cancelled");
+
+        // Cancelled as soon as the stage reports its start, i.e. while the tool runs
+        let cancel = std::sync::atomic::AtomicBool::new(false);
+        let mut cancel_on_start = |progress: &crate::pipeline::StageProgress| {
+            if progress.percent == 0.0 {
+                cancel.store(true, Ordering::Release);
+            }
+        };
+        let mut control = RunControl {
+            progress: Some(&mut cancel_on_start),
+            cancel: Some(&cancel),
+            tools_dir: Some(tools_dir.clone()),
+            ..Default::default()
+        };
+        let cancelled = OsrmEngine::extract_controlled(input.to_str().unwrap(), &profile, None, None, None, None, &mut control);
+        assert!(matches!(&cancelled, Err(OsrmError::ApiError(e)) if e.contains("Cancelled")),
+                "The extract should have been cancelled, got {:?}", cancelled);
+        assert!(!output.exists(), "A cancelled extract should not leave a dataset");
+
+        let mut control = RunControl {
+            memory_limit_bytes: Some(1 << 20),
+            tools_dir: Some(tools_dir),
+            ..Default::default()
+        };
+        let capped = OsrmEngine::extract_controlled(input.to_str().unwrap(), &profile, None, None, None, None, &mut control);
+        assert!(matches!(&capped, Err(OsrmError::ApiError(e)) if e.contains("exceeded the memory limit")),
+                "The extract should have gone over 1 MiB, got {:?}", capped);
+    }
+
+    #[test]
+    fn it_runs_controlled_stages_in_process_without_the_tools() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+
+        let (pbf, profile) = match (std::env::var("OSRM_TEST_PBF_PATH"), std::env::var("OSRM_TEST_PROFILE_PATH")) {
+            (Ok(pbf), Ok(profile)) => (pbf, profile),
+            _ => {
+                eprintln!("Skipping test: OSRM_TEST_PBF_PATH or OSRM_TEST_PROFILE_PATH environment variable not set");
+                return;
+            }
+        };
+        let (input, output) = copy_test_pbf(&pbf, "extract-in-process");
+
+        let mut percents = Vec::new();
+        let mut record = |progress: &crate::pipeline::StageProgress| percents.push(progress.percent);
+        let cancel = std::sync::atomic::AtomicBool::new(false);
+        let mut control = RunControl {
+            progress: Some(&mut record),
+            cancel: Some(&cancel),
+            tools_dir: Some("/nonexistent".to_string()),
+            ..Default::default()
+        };
+        OsrmEngine::extract_controlled(input.to_str().unwrap(), &profile, None, None, None, None, &mut control)
+            .expect("extraction without the tools should run in process");
+        drop(control);
+        assert!(output.exists(), "The in-process extract should write the dataset");
+        assert_eq!(percents.first(), Some(&0.0), "The stage should report its start");
+        assert_eq!(percents.last(), Some(&100.0), "The stage should report its end");
+    }
+
+    #[test]
+    fn it_keeps_ch_durations_when_updating_without_speed_files() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_CH") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_CH environment variable not set");
+                return;
+            }
+        };
+        let copy = copy_test_dataset(&path, "contract-update-unchanged");
+        let before = dataset_durations(&copy, Algorithm::CH);
+
+        let stats = OsrmEngine::contract_update(copy.to_str().unwrap(), &[], &[], false, None)
+            .expect("contraction update failed");
+        assert_eq!(stats.edges_changed, 0, "Without speed files no original edge changes");
+        assert_eq!(dataset_durations(&copy, Algorithm::CH), before, "Durations should not change");
+        let _ = std::fs::remove_dir_all(copy.parent().unwrap());
+    }
+
+    #[test]
+    fn it_matches_a_full_contraction_after_a_speed_update() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_CH") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_CH environment variable not set");
+                return;
+            }
+        };
+        let updated = copy_test_dataset(&path, "contract-update-speeds");
+        let contracted = copy_test_dataset(&path, "contract-update-reference");
+        let (route_before, _) = dataset_durations(&updated, Algorithm::CH);
+
+        // Slow down every segment of the route between the test points to 5 km/h
+        let engine = OsrmEngine::new(updated.to_str().unwrap(), Algorithm::CH, None).expect("Failed to initialize OSRM engine");
+        let route = engine.route(RouteRequestBuilder::default()
+            .points(vec![Point { longitude: 6.1319, latitude: 49.6116 }, Point { longitude: 6.1063, latitude: 49.7508 }])
+            .annotations(vec!["nodes".to_string()])
+            .build()
+            .expect("Failed to build RouteRequest"))
+            .expect("route request failed");
+        drop(engine);
+        let nodes = route.routes[0].legs[0].annotation.as_ref()
+            .and_then(|annotation| annotation.nodes.clone())
+            .expect("route should have node annotations");
+        let speeds: String = nodes.windows(2)
+            .map(|pair| format!("{},{},5\n{},{},5\n", pair[0], pair[1], pair[1], pair[0]))
+            .collect();
+        let speed_file = updated.parent().unwrap().join("speeds.csv");
+        std::fs::write(&speed_file, speeds).expect("speed file could not be written");
+        let speed_files = vec![speed_file.to_str().unwrap().to_string()];
+
+        let stats = OsrmEngine::contract_update(updated.to_str().unwrap(), &speed_files, &[], true, None)
+            .expect("contraction update failed");
+        assert!(stats.edges_changed > 0, "The slowed segments should change edges");
+        OsrmEngine::contract_with_updates(contracted.to_str().unwrap(), &speed_files, &[], None)
+            .expect("full contraction failed");
+
+        let (route_updated, table_updated) = dataset_durations(&updated, Algorithm::CH);
+        let (route_expected, table_expected) = dataset_durations(&contracted, Algorithm::CH);
+        assert!(route_updated > route_before, "The slowed route should take longer: {} vs {}", route_updated, route_before);
+        assert!((route_updated - route_expected).abs() <= 1.0, "Update and full contraction should agree: {} vs {}", route_updated, route_expected);
+        for (updated_row, expected_row) in table_updated.iter().zip(&table_expected) {
+            for (actual, expected) in updated_row.iter().zip(expected_row) {
+                let (actual, expected) = (actual.expect("table cell should be reachable"), expected.expect("table cell should be reachable"));
+                assert!((actual - expected).abs() <= 1.0, "Update and full contraction should agree: {} vs {}", actual, expected);
+            }
+        }
+        let _ = std::fs::remove_dir_all(updated.parent().unwrap());
+        let _ = std::fs::remove_dir_all(contracted.parent().unwrap());
+    }
+
+    #[test]
+    fn it_sweeps_one_to_all_durations_on_ch() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_CH") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_CH environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::CH, None).expect("Failed to initialize OSRM engine");
+        let sweep = crate::one_to_all::OneToAll::load(&engine, &path).expect("loading the CH graph failed");
+        assert!(sweep.node_count() > 0);
+
+        let sources = vec![Point { longitude: 6.1319, latitude: 49.6116 }, Point { longitude: 6.1063, latitude: 49.7508 }];
+        let targets: Vec<Point> = (0..6)
+            .map(|i| Point {
+                longitude: 6.05 + 0.03 * (i % 3) as f64,
+                latitude: 49.55 + 0.05 * (i / 3) as f64,
+            })
+            .collect();
+
+        let swept = sweep.durations_to(&sources, &targets, Some(2)).expect("sweep table failed");
+        let coordinates: Vec<(f64, f64)> = sources.iter().chain(targets.iter())
+            .map(|p| (p.longitude, p.latitude))
+            .collect();
+        let table = engine.table(TableRequest {
+            coordinates,
+            include_duration: true,
+            include_distance: false,
+            bearings: None,
+            radiuses: None,
+            hints: None,
+            generate_hints: false,
+            sources_indices: Some(vec![0, 1]),
+            destinations_indices: Some((2..8).collect()),
+            approaches: None,
+            fallback_speed: None,
+            fallback_coordinate: None,
+            scale_factor: None,
+            snapping: None,
+        }).expect("table request failed");
+        let durations = table.durations.unwrap();
+        for s in 0..2 {
+            for t in 0..6 {
+                let expected = durations[s][t].expect("table cell should be reachable");
+                let actual = swept.duration(s, t).expect("sweep cell should be reachable");
+                assert!((expected - actual).abs() <= 1.0, "Sweep and table should agree: {} vs {}", actual, expected);
+            }
+        }
+
+        let all = sweep.durations_to_all(&sources[..1], None).expect("one-to-all sweep failed");
+        assert_eq!(all.row(0).len(), sweep.node_count());
+        assert!(all.row(0).iter().filter(|d| **d >= 0.0).count() > sweep.node_count() / 2, "Most of the graph should be reachable");
+    }
+
+    #[test]
+    fn it_returns_binary_geometry_successfully() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+
+        let request = RouteRequestBuilder::default()
+            .points(vec![Point { longitude: 6.1319, latitude: 49.6116 }, Point { longitude: 6.1063, latitude: 49.7508 }])
+            .geometries("binary")
+            .overview("full")
+            .annotations(vec!["duration".to_string(), "nodes".to_string()])
+            .build()
+            .expect("Failed to build RouteRequest");
+        let response = engine.route(request).expect("route request failed");
+
+        let route = response.routes.first().unwrap();
+        assert!(route.geometry.is_none(), "Geometry should not be rendered as text");
+        let geometry = response.binary_geometry.expect("Binary geometry should be present");
+        assert_eq!(geometry.len(), response.routes.len(), "Should have 1 geometry per route");
+        assert!(geometry[0].coordinates.len() >= 2, "Geometry should have coordinates");
+        assert_eq!(geometry[0].legs.len(), 1, "Should have 1 leg annotation");
+        let leg = &geometry[0].legs[0];
+        assert!(!leg.durations.is_empty(), "Durations should be present");
+        assert!(leg.distances.is_empty(), "Distances were not requested");
+        assert_eq!(leg.nodes.len(), leg.durations.len() + 1, "Nodes should bound every segment");
+    }
+
+    #[test]
+    fn it_simplifies_geometry_to_a_tolerance() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        let points = vec![Point { longitude: 6.1319, latitude: 49.6116 }, Point { longitude: 6.1063, latitude: 49.7508 }];
+
+        let full = RouteRequestBuilder::default()
+            .points(points.clone())
+            .geometries("binary")
+            .overview("full")
+            .build()
+            .expect("Failed to build RouteRequest");
+        let full = engine.route(full).expect("route request failed").binary_geometry.unwrap();
+
+        let simplified = RouteRequestBuilder::default()
+            .points(points)
+            .geometries("binary")
+            .simplify_tolerance(10.0)
+            .build()
+            .expect("Failed to build RouteRequest");
+        let simplified = engine.route(simplified).expect("route request failed").binary_geometry.unwrap();
+
+        let geometry = &simplified[0];
+        assert!(geometry.coordinates.len() < full[0].coordinates.len(), "Simplification should drop points");
+        assert_eq!(geometry.coordinates.first(), full[0].coordinates.first(), "Endpoints are kept");
+        assert_eq!(geometry.coordinates.last(), full[0].coordinates.last(), "Endpoints are kept");
+        assert_eq!(geometry.significance.len(), geometry.coordinates.len(), "Every kept point has a significance");
+        assert!(geometry.coarsened(200.0).len() <= geometry.coordinates.len(), "Coarser tolerances keep fewer points");
+        assert!(geometry.coarsened(200.0).len() >= 2, "Coarsening keeps the endpoints");
+    }
+
+    #[test]
+    fn it_coalesces_identical_concurrent_routes() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine");
+        engine.set_coalescing(true);
+
+        let request = RouteRequestBuilder::default()
+            .points(vec![Point { longitude: 6.1319, latitude: 49.6116 }, Point { longitude: 6.1063, latitude: 49.7508 }])
+            .build()
+            .expect("Failed to build RouteRequest");
+        let distances: Vec<f64> = std::thread::scope(|scope| {
+            let workers: Vec<_> = (0..8)
+                .map(|_| scope.spawn(|| engine.route(request.clone()).expect("route request failed").routes[0].distance))
+                .collect();
+            workers.into_iter().map(|worker| worker.join().unwrap()).collect()
+        });
+
+        assert!(distances.windows(2).all(|pair| pair[0] == pair[1]), "Every caller gets the same route");
+        let stats = engine.coalescing_stats();
+        assert_eq!(stats.computed + stats.coalesced, 8, "Every request is counted once");
+
+        engine.set_coalescing(false);
+        assert_eq!(engine.coalescing_stats().computed, 0, "Disabling coalescing drops the counters");
+    }
+
+    #[test]
+    fn it_warms_workers_and_releases_heaps_after_large_routes() {
+        // Try to load .env file, but don't fail if it doesn't exist
+        let _ = dotenvy::dotenv();
+        
+        let path = match std::env::var("OSRM_TEST_DATA_PATH_MLD") {
+            Ok(p) => p,
+            Err(_) => {
+                eprintln!("Skipping test: OSRM_TEST_DATA_PATH_MLD environment variable not set");
+                return;
+            }
+        };
+        let engine = Arc::new(OsrmEngine::new(&*path, Algorithm::MLD, None).expect("Failed to initialize OSRM engine"));
+        let points = vec![
+            Point { longitude: 6.1319, latitude: 49.6116 },
+            Point { longitude: 6.1063, latitude: 49.7508 },
+        ];
+
+        let mut workers = Vec::new();
+        engine
+            .warm_workers(3, &points, Some(100_000), |job| workers.push(std::thread::spawn(job)))
+            .expect("warming the workers failed");
+        assert_eq!(workers.len(), 3, "One job should be spawned per worker");
+        for worker in workers {
+            worker.join().expect("warm-up job panicked");
+        }
+
+        engine.set_heap_release_threshold(Some(1));
+        let request = RouteRequestBuilder::default().points(points.clone()).build().expect("Failed to build RouteRequest");
+        let response = engine.route(request).expect("route request failed after releasing heaps");
+        assert_eq!(response.code, "Ok");
+        let request = RouteRequestBuilder::default().points(points).build().expect("Failed to build RouteRequest");
+        assert_eq!(engine.route(request).expect("route request failed on recreated heaps").code, "Ok");
+    }
+
     #[test]
     fn it_calculates_a_trip_successfully() {
         // Try to load .env file, but don't fail if it doesn't exist
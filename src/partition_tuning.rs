@@ -0,0 +1,333 @@
+// partition_tuning.rs
+use std::path::{Path, PathBuf};
+use std::time::{Duration, Instant};
+
+use serde::{Deserialize, Serialize};
+
+use crate::algorithm::Algorithm;
+use crate::errors::OsrmError;
+use crate::osrm_engine::OsrmEngine;
+use crate::route::RouteRequest;
+use crate::tables::TableRequest;
+use crate::MemoryReport;
+
+/// One combination of `osrm-partition` parameters; `None` keeps OSRM's default
+#[derive(Debug, Clone, Default, Deserialize, Serialize)]
+pub struct PartitionSettings {
+    pub balance: Option<f64>,
+    pub boundary_factor: Option<f64>,
+    pub num_optimizing_cuts: Option<i32>,
+    pub small_component_size: Option<i32>,
+    pub max_cell_sizes: Option<Vec<i32>>,
+}
+
+impl PartitionSettings {
+    /// Short form for reports, e.g. `balance=1.2 cells=128:4096:65536:2097152`
+    pub fn label(&self) -> String {
+        let mut parts = Vec::new();
+        if let Some(balance) = self.balance {
+            parts.push(format!("balance={}", balance));
+        }
+        if let Some(boundary_factor) = self.boundary_factor {
+            parts.push(format!("boundary={}", boundary_factor));
+        }
+        if let Some(cuts) = self.num_optimizing_cuts {
+            parts.push(format!("cuts={}", cuts));
+        }
+        if let Some(size) = self.small_component_size {
+            parts.push(format!("small={}", size));
+        }
+        if let Some(sizes) = &self.max_cell_sizes {
+            let sizes: Vec<String> = sizes.iter().map(|s| s.to_string()).collect();
+            parts.push(format!("cells={}", sizes.join(":")));
+        }
+        if parts.is_empty() { "defaults".to_string() } else { parts.join(" ") }
+    }
+}
+
+/// Values to try per parameter. An empty list keeps OSRM's default for that
+/// parameter; the candidates are every combination of the lists.
+#[derive(Debug, Clone, Default, Deserialize, Serialize)]
+pub struct PartitionGrid {
+    pub balance: Vec<f64>,
+    pub boundary_factor: Vec<f64>,
+    pub num_optimizing_cuts: Vec<i32>,
+    pub small_component_size: Vec<i32>,
+    pub max_cell_sizes: Vec<Vec<i32>>,
+}
+
+impl PartitionGrid {
+    pub fn settings(&self) -> Vec<PartitionSettings> {
+        fn options<T: Clone>(values: &[T]) -> Vec<Option<T>> {
+            if values.is_empty() { vec![None] } else { values.iter().cloned().map(Some).collect() }
+        }
+
+        let mut settings = Vec::new();
+        for balance in options(&self.balance) {
+            for boundary_factor in options(&self.boundary_factor) {
+                for num_optimizing_cuts in options(&self.num_optimizing_cuts) {
+                    for small_component_size in options(&self.small_component_size) {
+                        for max_cell_sizes in options(&self.max_cell_sizes) {
+                            settings.push(PartitionSettings {
+                                balance,
+                                boundary_factor,
+                                num_optimizing_cuts,
+                                small_component_size,
+                                max_cell_sizes: max_cell_sizes.clone(),
+                            });
+                        }
+                    }
+                }
+            }
+        }
+        settings
+    }
+}
+
+/// Requests that stand for the production workload. Every candidate answers all
+/// of them once unmeasured, so caches and search heaps are warm, then
+/// `repetitions` more times with each request timed on its own.
+#[derive(Debug, Clone, Default)]
+pub struct Workload {
+    pub routes: Vec<RouteRequest>,
+    pub tables: Vec<TableRequest>,
+    pub repetitions: usize,
+}
+
+/// Latency of one service over all measured repetitions
+#[derive(Debug, Clone, Default, Deserialize, Serialize)]
+pub struct LatencySummary {
+    pub requests: usize,
+    pub errors: usize,
+    pub mean_ms: f64,
+    pub p50_ms: f64,
+    pub p90_ms: f64,
+    pub p99_ms: f64,
+}
+
+impl LatencySummary {
+    fn from_latencies(mut latencies: Vec<Duration>, errors: usize) -> Self {
+        if latencies.is_empty() {
+            return LatencySummary { errors, ..Default::default() };
+        }
+        latencies.sort();
+        let ms = |d: Duration| d.as_secs_f64() * 1000.0;
+        let percentile = |p: f64| ms(latencies[((p / 100.0) * (latencies.len() - 1) as f64).round() as usize]);
+        LatencySummary {
+            requests: latencies.len(),
+            errors,
+            mean_ms: latencies.iter().map(|&d| ms(d)).sum::<f64>() / latencies.len() as f64,
+            p50_ms: percentile(50.0),
+            p90_ms: percentile(90.0),
+            p99_ms: percentile(99.0),
+        }
+    }
+}
+
+/// Cost of one partition candidate: preprocessing time, dataset size and query latency
+#[derive(Debug, Clone, Default, Deserialize, Serialize)]
+pub struct CandidateReport {
+    pub settings: PartitionSettings,
+    pub partition_ms: f64,
+    pub customize_ms: f64,
+    pub memory: MemoryReport,
+    pub route: LatencySummary,
+    pub table: LatencySummary,
+    /// Mean time to answer the whole workload once
+    pub workload_ms: f64,
+    /// Why the candidate could not be built or loaded; its other numbers are then 0
+    pub error: Option<String>,
+}
+
+impl CandidateReport {
+    fn dominates(&self, other: &CandidateReport) -> bool {
+        let costs = |c: &CandidateReport| [c.customize_ms, c.workload_ms, (c.memory.graph_bytes + c.memory.cell_metrics_bytes) as f64];
+        let (mine, theirs) = (costs(self), costs(other));
+        mine.iter().zip(&theirs).all(|(a, b)| a <= b) && mine.iter().zip(&theirs).any(|(a, b)| a < b)
+    }
+}
+
+#[derive(Debug, Clone, Default, Deserialize, Serialize)]
+pub struct TuningReport {
+    pub candidates: Vec<CandidateReport>,
+}
+
+impl TuningReport {
+    /// Candidates no other candidate beats on customize time, workload time and
+    /// MLD graph plus cell metric size at once: the settings worth choosing between
+    pub fn pareto_front(&self) -> Vec<&CandidateReport> {
+        let built: Vec<&CandidateReport> = self.candidates.iter().filter(|c| c.error.is_none()).collect();
+        built.iter()
+            .filter(|candidate| !built.iter().any(|other| other.dominates(candidate)))
+            .copied()
+            .collect()
+    }
+
+    /// One line per candidate, Pareto-optimal ones marked with `*`
+    pub fn to_table(&self) -> String {
+        let front = self.pareto_front();
+        let mut table = format!("{:<1} {:>10} {:>12} {:>10} {:>10} {:>10} {:>10} {:>12}  {}\n",
+                                "", "part. ms", "customize ms", "graph MB", "route p50", "route p99",
+                                "table p50", "workload ms", "settings");
+        for candidate in &self.candidates {
+            if let Some(error) = &candidate.error {
+                table.push_str(&format!("  {}: {}\n", candidate.settings.label(), error));
+                continue;
+            }
+            let graph_mb = (candidate.memory.graph_bytes + candidate.memory.cell_metrics_bytes) as f64 / (1024.0 * 1024.0);
+            table.push_str(&format!("{:<1} {:>10.0} {:>12.0} {:>10.1} {:>10.2} {:>10.2} {:>10.2} {:>12.2}  {}\n",
+                                    if front.iter().any(|c| std::ptr::eq(*c, candidate)) { "*" } else { "" },
+                                    candidate.partition_ms,
+                                    candidate.customize_ms,
+                                    graph_mb,
+                                    candidate.route.p50_ms,
+                                    candidate.route.p99_ms,
+                                    candidate.table.p50_ms,
+                                    candidate.workload_ms,
+                                    candidate.settings.label()));
+        }
+        table
+    }
+}
+
+/// Runs partition and customize over a grid of partition settings on copies of
+/// one extracted dataset and benchmarks a workload against each result, to pick
+/// cell sizes by measured customize time, query latency and memory instead of
+/// by OSRM's defaults.
+pub struct PartitionTuner {
+    /// Extracted `.osrm` base path; its files are copied, never modified
+    pub base_path: String,
+    /// Directory for the candidate datasets, one subdirectory each
+    pub work_dir: String,
+    /// Threads for partition and customize, hardware concurrency when unset
+    pub threads: Option<i32>,
+    /// Keep every candidate dataset instead of deleting it once benchmarked
+    pub keep_candidates: bool,
+}
+
+impl PartitionTuner {
+    pub fn new(base_path: &str, work_dir: &str) -> Self {
+        PartitionTuner {
+            base_path: base_path.to_string(),
+            work_dir: work_dir.to_string(),
+            threads: None,
+            keep_candidates: false,
+        }
+    }
+
+    /// Tunes every combination of `grid`, one candidate at a time so the
+    /// timings do not compete for cores. `progress` is called after each one.
+    pub fn run<F>(&self, grid: &PartitionGrid, workload: &Workload, mut progress: F) -> Result<TuningReport, OsrmError>
+    where
+        F: FnMut(usize, usize, &CandidateReport),
+    {
+        if workload.routes.is_empty() && workload.tables.is_empty() {
+            return Err(OsrmError::ApiError("The workload has no requests".to_string()));
+        }
+        let settings = grid.settings();
+        let total = settings.len();
+        let mut report = TuningReport { candidates: Vec::with_capacity(total) };
+        for (index, settings) in settings.into_iter().enumerate() {
+            let candidate_path = self.copy_dataset(index)?;
+            let candidate = self.evaluate(&candidate_path, settings, workload);
+            if !self.keep_candidates {
+                if let Some(dir) = candidate_path.parent() {
+                    let _ = std::fs::remove_dir_all(dir);
+                }
+            }
+            progress(index + 1, total, &candidate);
+            report.candidates.push(candidate);
+        }
+        Ok(report)
+    }
+
+    /// Copies the files of the extracted dataset into the candidate's directory.
+    /// Partitioning renumbers the edge-based graph and rewrites most of them, so
+    /// unlike time buckets nothing can be shared through hard links.
+    fn copy_dataset(&self, index: usize) -> Result<PathBuf, OsrmError> {
+        let base = Path::new(&self.base_path);
+        let base_name = base.file_name()
+            .and_then(|name| name.to_str())
+            .ok_or_else(|| OsrmError::InvalidPath(self.base_path.clone()))?;
+        let base_dir = match base.parent() {
+            Some(dir) if !dir.as_os_str().is_empty() => dir,
+            _ => Path::new("."),
+        };
+        let candidate_dir = Path::new(&self.work_dir).join(format!("candidate-{}", index));
+        let io_error = |e: std::io::Error| OsrmError::ApiError(format!("Copying the dataset failed: {}", e));
+        std::fs::create_dir_all(&candidate_dir).map_err(io_error)?;
+
+        for entry in std::fs::read_dir(base_dir).map_err(io_error)? {
+            let entry = entry.map_err(io_error)?;
+            let name = entry.file_name();
+            let Some(name) = name.to_str() else { continue };
+            if entry.file_type().map_err(io_error)?.is_file()
+                && (name == base_name || name.starts_with(&format!("{}.", base_name)))
+            {
+                std::fs::copy(entry.path(), candidate_dir.join(name)).map_err(io_error)?;
+            }
+        }
+        Ok(candidate_dir.join(base_name))
+    }
+
+    fn evaluate(&self, path: &Path, settings: PartitionSettings, workload: &Workload) -> CandidateReport {
+        let mut candidate = CandidateReport { settings, ..Default::default() };
+        if let Err(e) = self.build_and_measure(path, workload, &mut candidate) {
+            candidate.error = Some(e.to_string());
+        }
+        candidate
+    }
+
+    fn build_and_measure(&self, path: &Path, workload: &Workload, candidate: &mut CandidateReport) -> Result<(), OsrmError> {
+        let path = path.to_str().ok_or_else(|| OsrmError::InvalidPath(path.display().to_string()))?;
+        let settings = &candidate.settings;
+
+        let started = Instant::now();
+        OsrmEngine::partition(
+            path,
+            self.threads,
+            settings.balance,
+            settings.boundary_factor,
+            settings.num_optimizing_cuts,
+            settings.small_component_size,
+            settings.max_cell_sizes.clone(),
+        )?;
+        candidate.partition_ms = started.elapsed().as_secs_f64() * 1000.0;
+
+        let started = Instant::now();
+        OsrmEngine::customize(path, self.threads)?;
+        candidate.customize_ms = started.elapsed().as_secs_f64() * 1000.0;
+
+        candidate.memory = OsrmEngine::memory_report(path, Algorithm::MLD, &[])?;
+
+        let engine = OsrmEngine::new(path, Algorithm::MLD, None)?;
+        let mut route_latencies = Vec::new();
+        let mut table_latencies = Vec::new();
+        let (mut route_errors, mut table_errors) = (0, 0);
+        let repetitions = workload.repetitions.max(1);
+        // Repetition 0 only warms up
+        for repetition in 0..=repetitions {
+            for request in &workload.routes {
+                let sent = Instant::now();
+                let ok = engine.route(request.clone()).is_ok();
+                if repetition > 0 {
+                    route_latencies.push(sent.elapsed());
+                    route_errors += usize::from(!ok);
+                }
+            }
+            for request in &workload.tables {
+                let sent = Instant::now();
+                let ok = engine.table(request.clone()).is_ok();
+                if repetition > 0 {
+                    table_latencies.push(sent.elapsed());
+                    table_errors += usize::from(!ok);
+                }
+            }
+        }
+        let measured = route_latencies.iter().chain(&table_latencies).sum::<Duration>();
+        candidate.workload_ms = measured.as_secs_f64() * 1000.0 / repetitions as f64;
+        candidate.route = LatencySummary::from_latencies(route_latencies, route_errors);
+        candidate.table = LatencySummary::from_latencies(table_latencies, table_errors);
+        Ok(())
+    }
+}
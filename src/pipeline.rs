@@ -0,0 +1,178 @@
+// pipeline.rs
+use derive_builder::Builder;
+use serde::{Deserialize, Serialize};
+use std::sync::atomic::AtomicBool;
+
+/// Configuration of a full preprocessing run: extract, then partition + customize (MLD)
+/// and/or contract (CH) on the same extract.
+#[derive(Debug, Builder, Clone)]
+#[builder(setter(into, strip_option), default)]
+pub struct PipelineConfig {
+    /// OSM input file, e.g. `france-latest.osm.pbf`
+    pub input_path: String,
+    /// Lua profile used for extraction
+    pub profile_path: String,
+    /// Threads per stage, hardware concurrency when unset
+    #[builder(default)]
+    pub threads: Option<i32>,
+    /// Build the Contraction Hierarchies (`.hsgr`) output
+    #[builder(default = "false")]
+    pub build_ch: bool,
+    /// Build the Multi-Level Dijkstra (partition + customize) output
+    #[builder(default = "true")]
+    pub build_mld: bool,
+    #[builder(default = "true")]
+    pub parse_conditionals: bool,
+    #[builder(default = "true")]
+    pub use_metadata: bool,
+    #[builder(default = "true")]
+    pub use_locations_cache: bool,
+    #[builder(default)]
+    pub balance: Option<f64>,
+    #[builder(default)]
+    pub boundary_factor: Option<f64>,
+    #[builder(default)]
+    pub num_optimizing_cuts: Option<i32>,
+    #[builder(default)]
+    pub small_component_size: Option<i32>,
+    #[builder(default)]
+    pub max_cell_sizes: Option<Vec<i32>>,
+}
+
+// Same defaults as the builder, so struct-update syntax builds what the builder does
+impl Default for PipelineConfig {
+    fn default() -> Self {
+        Self {
+            input_path: String::new(),
+            profile_path: String::new(),
+            threads: None,
+            build_ch: false,
+            build_mld: true,
+            parse_conditionals: true,
+            use_metadata: true,
+            use_locations_cache: true,
+            balance: None,
+            boundary_factor: None,
+            num_optimizing_cuts: None,
+            small_component_size: None,
+            max_cell_sizes: None,
+        }
+    }
+}
+
+/// Lua profile calls saved by a memoizing extraction
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, Deserialize, Serialize)]
+pub struct ProfileMemoStats {
+    pub nodes: u64,
+    /// Nodes answered from the cache instead of the profile
+    pub node_hits: u64,
+    pub ways: u64,
+    /// Ways answered from the cache instead of the profile
+    pub way_hits: u64,
+}
+
+impl ProfileMemoStats {
+    pub fn node_hit_rate(&self) -> f64 {
+        if self.nodes == 0 { 0.0 } else { self.node_hits as f64 / self.nodes as f64 }
+    }
+
+    pub fn way_hit_rate(&self) -> f64 {
+        if self.ways == 0 { 0.0 } else { self.way_hits as f64 / self.ways as f64 }
+    }
+}
+
+/// What a partial CH re-contraction changed, summed over all exclude hierarchies
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, Deserialize, Serialize)]
+pub struct ContractUpdateStats {
+    /// Original edges of the old hierarchy whose weight or duration the update changed
+    pub edges_changed: usize,
+    /// Shortcuts added where the old witness path got longer
+    pub shortcuts_added: usize,
+    /// Edges dropped because no usable path is left behind them
+    pub edges_removed: usize,
+    /// Nodes whose witness paths were searched again
+    pub nodes_checked: usize,
+    /// Repair passes until no shortcut was missing
+    pub passes: usize,
+}
+
+/// Progress notification for a preprocessing stage
+#[derive(Debug, Clone)]
+pub struct StageProgress {
+    /// Stage name: "extract", "partition", "customize" or "contract"
+    pub stage: String,
+    /// 0 when the stage starts and 100 when it succeeds. OSRM's tools report no
+    /// progress in between, so a running stage only sends heartbeats with -1.
+    pub percent: f64,
+    /// Seconds since the stage started
+    pub elapsed_seconds: f64,
+}
+
+/// Progress, cancellation and memory controls for a preprocessing run.
+///
+/// With a `cancel` flag, memory limit or log file, stages run OSRM's command-line
+/// tools (`osrm-extract`, `osrm-partition`, `osrm-customize`, `osrm-contract`) as
+/// child processes, so cancelling or exceeding the memory limit stops the stage
+/// without affecting the calling process. The tools are found at run time in
+/// `tools_dir`, then `OSRM_TOOLS_DIR`, then the build directory of this crate, so
+/// a deployed binary needs one of the first two to point at them.
+///
+/// Without those controls, or when the tool is not found, a stage runs in the
+/// calling process like [`OsrmEngine::extract`](crate::osrm_engine::OsrmEngine::extract)
+/// and friends: progress is still reported, but `cancel` only stops stages that
+/// have not started and the memory limit and log file do not apply.
+#[derive(Default)]
+pub struct RunControl<'a> {
+    /// Called when a stage starts, finishes, and about once per second while it runs
+    pub progress: Option<&'a mut (dyn FnMut(&StageProgress) + Send)>,
+    /// Setting this flag kills the running stage; the run then fails with "Cancelled"
+    pub cancel: Option<&'a AtomicBool>,
+    /// Resident memory limit of each stage in bytes; the stage is killed and fails with
+    /// "exceeded the memory limit" instead of exhausting the host. Outside Linux this is
+    /// an address-space limit and a stage hitting it fails like any other.
+    pub memory_limit_bytes: Option<usize>,
+    /// Appends stage logs to this file instead of stderr
+    pub log_path: Option<String>,
+    /// Directory of the OSRM tools; `OSRM_TOOLS_DIR`, then the tools built with this crate when unset.
+    /// Stages fall back to running in process when the tools are not there.
+    pub tools_dir: Option<String>,
+}
+
+/// Timing and memory of a finished stage
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct StageReport {
+    pub stage: String,
+    /// Wall-clock duration of the stage in seconds
+    pub seconds: f64,
+    /// Peak resident memory of the process that ran the stage, in bytes. For a stage
+    /// run in process this is the calling process's peak so far.
+    pub peak_rss_bytes: usize,
+}
+
+/// Outcome of a preprocessing run
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct PipelineReport {
+    /// The `.osrm` path to load the engine from
+    pub base_path: String,
+    /// Stages in completion order
+    pub stages: Vec<StageReport>,
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn it_defaults_like_the_builder() {
+        let built = PipelineConfigBuilder::default().build().expect("Failed to build PipelineConfig");
+        let default = PipelineConfig::default();
+        assert_eq!(default.build_ch, built.build_ch);
+        assert_eq!(default.build_mld, built.build_mld);
+        assert_eq!(default.parse_conditionals, built.parse_conditionals);
+        assert_eq!(default.use_metadata, built.use_metadata);
+        assert_eq!(default.use_locations_cache, built.use_locations_cache);
+        assert!(default.build_mld && !default.build_ch, "MLD is built by default, CH is not");
+    }
+}
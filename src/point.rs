@@ -4,4 +4,22 @@ use derive_builder::Builder;
 pub struct Point {
     pub latitude : f64,
     pub longitude : f64,
-}
\ No newline at end of file
+}
+
+/// Coordinate in OSRM's fixed-point format (degrees * 1e6). Slices of it are
+/// passed to the engine as-is, without conversion or copying.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct FixedPoint {
+    pub longitude: i32,
+    pub latitude: i32,
+}
+
+impl From<&Point> for FixedPoint {
+    fn from(point: &Point) -> Self {
+        FixedPoint {
+            longitude: (point.longitude * 1e6).round() as i32,
+            latitude: (point.latitude * 1e6).round() as i32,
+        }
+    }
+}
@@ -0,0 +1,142 @@
+// prefork.rs
+use serde::{Deserialize, Serialize};
+
+use crate::errors::OsrmError;
+use crate::osrm_engine::OsrmEngine;
+use crate::point::Point;
+use crate::{EngineConfig, Osrm};
+
+/// Memory of the calling process by sharing state. After a fork every page
+/// inherited from the parent is shared until one side writes to it.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, Deserialize, Serialize)]
+pub struct PageReport {
+    pub rss_bytes: usize,
+    pub shared_clean_bytes: usize,
+    pub shared_dirty_bytes: usize,
+    pub private_clean_bytes: usize,
+    pub private_dirty_bytes: usize,
+    pub page_size: usize,
+}
+
+impl PageReport {
+    pub fn private_pages(&self) -> usize {
+        (self.private_clean_bytes + self.private_dirty_bytes) / self.page_size.max(1)
+    }
+}
+
+/// Pages of a freshly forked worker before and after warming up
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct SharingReport {
+    pub before: PageReport,
+    pub after: PageReport,
+    /// Pages the warm-up copied out of memory shared with the parent
+    pub pages_made_private: usize,
+}
+
+/// Pages of the calling process, Linux only
+pub fn page_report() -> Result<PageReport, OsrmError> {
+    Osrm::page_report().map_err(|e| OsrmError::FfiError(e))
+}
+
+/// Loads a dataset once and forks worker processes that share it copy-on-write.
+///
+/// The dataset is mmapped read-only from its files, so the graph, R-tree and
+/// every other dataset live in clean, file-backed pages that no worker ever
+/// copies; only per-worker search heaps and request data become private.
+/// Fork before the parent starts any thread.
+pub struct PreforkEngine {
+    engine: OsrmEngine,
+}
+
+impl PreforkEngine {
+    pub fn load(config: EngineConfig) -> Result<Self, OsrmError> {
+        let engine = OsrmEngine::new_with_config(EngineConfig {
+            shared_memory: false,
+            mmap_memory: true,
+            ..config
+        })?;
+        Ok(PreforkEngine { engine })
+    }
+
+    pub fn engine(&self) -> &OsrmEngine {
+        &self.engine
+    }
+
+    /// Forks a probe that warms up on `points` like a new worker would and
+    /// reports how many pages it made private.
+    ///
+    /// Call this before the process starts any thread, like `run`: only the
+    /// forking thread exists in the probe, so a lock another thread held at the
+    /// fork (the allocator's, TBB's) stays locked there and the probe can hang.
+    pub fn check_sharing(&self, points: &[Point]) -> Result<SharingReport, OsrmError> {
+        if points.len() < 2 {
+            return Err(OsrmError::InvalidTableArgument);
+        }
+        let coordinates: Vec<(f64, f64)> = points.iter()
+            .map(|p| (p.longitude, p.latitude))
+            .collect();
+        let (before, after) = self.engine.instance()
+            .prefork_check(&coordinates)
+            .map_err(|e| OsrmError::FfiError(e))?;
+        Ok(SharingReport {
+            before,
+            after,
+            pages_made_private: after.private_pages().saturating_sub(before.private_pages()),
+        })
+    }
+
+    /// Forks `workers` processes that each run `worker(index, engine)` and exit
+    /// with its return value, then waits for all of them and returns their exit
+    /// codes (128 + signal for workers killed by a signal, 101 for a panic).
+    /// Workers end with `_exit` after flushing stdout and stderr, so they skip
+    /// the exit handlers and destructors inherited from the parent.
+    /// If a fork fails, the workers already started are stopped with SIGTERM and
+    /// reaped before the error is returned.
+    pub fn run<F>(&self, workers: usize, worker: F) -> Result<Vec<i32>, OsrmError>
+    where
+        F: Fn(usize, &OsrmEngine) -> i32,
+    {
+        let mut pids = Vec::with_capacity(workers);
+        for index in 0..workers {
+            let pid = match Osrm::fork_worker() {
+                Ok(pid) => pid,
+                Err(e) => {
+                    for &pid in &pids {
+                        let _ = Osrm::kill_worker(pid);
+                    }
+                    for pid in pids {
+                        let _ = Osrm::wait_worker(pid);
+                    }
+                    return Err(OsrmError::FfiError(e));
+                }
+            };
+            if pid == 0 {
+                let code = std::panic::catch_unwind(std::panic::AssertUnwindSafe(|| worker(index, &self.engine)))
+                    .unwrap_or(101);
+                Osrm::exit_worker(code);
+            }
+            pids.push(pid);
+        }
+
+        pids.into_iter()
+            .map(|pid| Osrm::wait_worker(pid).map_err(|e| OsrmError::FfiError(e)))
+            .collect()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[cfg(target_os = "linux")]
+    #[test]
+    fn it_reports_the_pages_of_the_process() {
+        let report = page_report().expect("page report failed");
+        assert!(report.page_size > 0, "The page size should be known");
+        assert!(report.rss_bytes > 0, "A running process has resident pages");
+        let accounted = report.shared_clean_bytes + report.shared_dirty_bytes
+            + report.private_clean_bytes + report.private_dirty_bytes;
+        assert_eq!(accounted, report.rss_bytes, "Every resident page is either shared or private");
+    }
+}
@@ -0,0 +1,253 @@
+// request_log.rs
+//
+// JSONL request log shared by the slow-query log and the examples that replay
+// it. Each line is one request:
+//
+//   {"service": "route", "coordinates": [[2.3522, 48.8566], [5.3698, 43.2965]]}
+//   {"service": "table", "coordinates": [[...], ...], "sources": [0], "destinations": [1, 2]}
+//   {"service": "nearest", "coordinates": [[2.3522, 48.8566]], "number": 3}
+//   {"service": "match", "coordinates": [[...], ...], "timestamps": [0, 5, 10]}
+//
+// Any other request parameter can be given under its OSRM name, as in
+// {"service": "route", ..., "steps": true, "hints": ["...", null]}; bearings are
+// flat value/range pairs and negative bearings or radiuses mean none.
+// OsrmEngine::dump_slow_queries writes its slow-query log in this format with
+// every parameter of the logged request; extra fields such as the logged
+// timings are ignored.
+use serde_json::Value;
+
+use crate::errors::OsrmError;
+use crate::nearest::NearestRequest;
+use crate::osrm_engine::OsrmEngine;
+use crate::point::Point;
+use crate::r#match::MatchRequest;
+use crate::route::RouteRequest;
+use crate::tables::TableRequest;
+
+/// One parsed log line, ready to be sent any number of times
+#[derive(Debug, Clone)]
+pub enum Request {
+    Route(RouteRequest),
+    Table(TableRequest),
+    Nearest(NearestRequest),
+    Match(MatchRequest),
+}
+
+impl Request {
+    pub fn service(&self) -> &'static str {
+        match self {
+            Request::Route(_) => "route",
+            Request::Table(_) => "table",
+            Request::Nearest(_) => "nearest",
+            Request::Match(_) => "match",
+        }
+    }
+
+    /// Runs the request on `engine`, discarding the response
+    pub fn send(&self, engine: &OsrmEngine) -> Result<(), OsrmError> {
+        match self {
+            Request::Route(request) => engine.route(request.clone()).map(|_| ()),
+            Request::Table(request) => engine.table(request.clone()).map(|_| ()),
+            Request::Nearest(request) => engine.nearest(request.clone()).map(|_| ()),
+            Request::Match(request) => engine.match_route(request.clone()).map(|_| ()),
+        }
+    }
+}
+
+fn indices(line: &Value, key: &str) -> Option<Vec<usize>> {
+    line.get(key)?.as_array().map(|values| values.iter().filter_map(|v| v.as_u64().map(|i| i as usize)).collect())
+}
+
+fn numbers(line: &Value, key: &str) -> Option<Vec<f64>> {
+    line.get(key)?.as_array().map(|values| values.iter().filter_map(Value::as_f64).collect())
+}
+
+fn number(line: &Value, key: &str) -> Option<f64> {
+    line.get(key)?.as_f64()
+}
+
+fn flag(line: &Value, key: &str) -> Option<bool> {
+    line.get(key)?.as_bool()
+}
+
+fn string(line: &Value, key: &str) -> Option<String> {
+    line.get(key)?.as_str().map(str::to_string)
+}
+
+fn strings(line: &Value, key: &str) -> Option<Vec<String>> {
+    line.get(key)?.as_array().map(|values| values.iter().filter_map(|v| v.as_str().map(str::to_string)).collect())
+}
+
+/// Per-coordinate strings such as hints and approaches; null or empty means none
+fn optional_strings(line: &Value, key: &str) -> Option<Vec<Option<String>>> {
+    line.get(key)?.as_array().map(|values| {
+        values.iter().map(|v| v.as_str().filter(|s| !s.is_empty()).map(str::to_string)).collect()
+    })
+}
+
+/// Bearings are logged as flat value/range pairs, negative for none
+fn bearings(line: &Value) -> Option<Vec<Option<(i16, i16)>>> {
+    numbers(line, "bearings").map(|values| {
+        values.chunks(2)
+            .map(|pair| match pair {
+                [value, range] if *value >= 0.0 => Some((*value as i16, *range as i16)),
+                _ => None,
+            })
+            .collect()
+    })
+}
+
+/// Radiuses are logged negative for none
+fn radiuses(line: &Value) -> Option<Vec<Option<f64>>> {
+    numbers(line, "radiuses").map(|values| values.into_iter().map(|r| Some(r).filter(|r| *r >= 0.0)).collect())
+}
+
+/// Parses one log line; fields missing from it keep the defaults of the request types
+pub fn parse_request(line: &str) -> Result<Request, String> {
+    let line: Value = serde_json::from_str(line).map_err(|e| e.to_string())?;
+    let coordinates: Vec<(f64, f64)> = line["coordinates"]
+        .as_array()
+        .ok_or("missing coordinates")?
+        .iter()
+        .map(|pair| match (pair[0].as_f64(), pair[1].as_f64()) {
+            (Some(lon), Some(lat)) => Ok((lon, lat)),
+            _ => Err("coordinates must be [longitude, latitude] pairs".to_string()),
+        })
+        .collect::<Result<_, _>>()?;
+    let points = || coordinates.iter().map(|&(longitude, latitude)| Point { longitude, latitude }).collect::<Vec<_>>();
+
+    match line["service"].as_str().ok_or("missing service")? {
+        "route" => Ok(Request::Route(RouteRequest {
+            points: points(),
+            bearings: bearings(&line),
+            radiuses: radiuses(&line),
+            hints: optional_strings(&line, "hints"),
+            generate_hints: flag(&line, "generate_hints").unwrap_or(true),
+            approaches: optional_strings(&line, "approaches"),
+            snapping: string(&line, "snapping"),
+            steps: flag(&line, "steps").unwrap_or(false),
+            alternatives: number(&line, "alternatives").map(|n| n as i32).filter(|n| *n > 0),
+            annotations: strings(&line, "annotations"),
+            geometries: string(&line, "geometries"),
+            overview: string(&line, "overview"),
+            simplify_tolerance: number(&line, "simplify_tolerance"),
+            continue_straight: flag(&line, "continue_straight").unwrap_or(false),
+            exclude: strings(&line, "exclude"),
+            waypoints: indices(&line, "waypoints"),
+            skip_waypoints: flag(&line, "skip_waypoints").unwrap_or(false),
+        })),
+        "table" => Ok(Request::Table(TableRequest {
+            coordinates: coordinates.clone(),
+            include_duration: flag(&line, "durations").unwrap_or(true),
+            include_distance: flag(&line, "distances").unwrap_or(false),
+            bearings: bearings(&line),
+            radiuses: radiuses(&line),
+            hints: optional_strings(&line, "hints"),
+            generate_hints: flag(&line, "generate_hints").unwrap_or(false),
+            sources_indices: indices(&line, "sources"),
+            destinations_indices: indices(&line, "destinations"),
+            approaches: optional_strings(&line, "approaches"),
+            fallback_speed: number(&line, "fallback_speed"),
+            fallback_coordinate: string(&line, "fallback_coordinate"),
+            scale_factor: number(&line, "scale_factor"),
+            snapping: string(&line, "snapping"),
+        })),
+        "nearest" => {
+            let mut request = NearestRequest::new(points().into_iter().next().ok_or("nearest needs a coordinate")?);
+            request.number = number(&line, "number").map(|n| n as i32).or(request.number);
+            request.bearings = bearings(&line);
+            request.radiuses = radiuses(&line);
+            request.hints = optional_strings(&line, "hints");
+            request.generate_hints = flag(&line, "generate_hints").unwrap_or(request.generate_hints);
+            request.approaches = optional_strings(&line, "approaches");
+            request.snapping = string(&line, "snapping");
+            Ok(Request::Nearest(request))
+        }
+        "match" => Ok(Request::Match(MatchRequest {
+            points: points(),
+            timestamps: numbers(&line, "timestamps").map(|ts| ts.into_iter().map(|t| t as u32).collect()),
+            radiuses: radiuses(&line),
+            bearings: bearings(&line),
+            hints: optional_strings(&line, "hints"),
+            generate_hints: flag(&line, "generate_hints").unwrap_or(false),
+            approaches: optional_strings(&line, "approaches"),
+            gaps: string(&line, "gaps"),
+            tidy: flag(&line, "tidy").unwrap_or(false),
+            waypoints: indices(&line, "waypoints"),
+            snapping: string(&line, "snapping"),
+            steps: flag(&line, "steps").unwrap_or(false),
+            annotations: strings(&line, "annotations"),
+            geometries: string(&line, "geometries"),
+            overview: string(&line, "overview"),
+            simplify_tolerance: number(&line, "simplify_tolerance"),
+            exclude: strings(&line, "exclude"),
+        })),
+        other => Err(format!("unknown service {}", other)),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn it_parses_a_route_line() {
+        let line = r#"{"service": "route", "coordinates": [[6.1319, 49.6116], [6.1063, 49.7508]],
+                       "steps": true, "hints": ["abc", null], "bearings": [90, 20, -1, 0], "radiuses": [-1, 25.0],
+                       "alternatives": 2, "waypoints": [0, 1], "total_ms": 12.5}"#;
+        let Ok(Request::Route(request)) = parse_request(line) else { panic!("expected a route request") };
+        assert_eq!(request.points.len(), 2);
+        assert_eq!(request.points[1].latitude, 49.7508);
+        assert!(request.steps);
+        assert_eq!(request.hints, Some(vec![Some("abc".to_string()), None]));
+        assert_eq!(request.bearings, Some(vec![Some((90, 20)), None]));
+        assert_eq!(request.radiuses, Some(vec![None, Some(25.0)]));
+        assert_eq!(request.alternatives, Some(2));
+        assert_eq!(request.waypoints, Some(vec![0, 1]));
+        assert!(request.generate_hints, "Missing fields keep the request defaults");
+    }
+
+    #[test]
+    fn it_parses_a_table_line() {
+        let line = r#"{"service": "table", "coordinates": [[6.13, 49.61], [6.10, 49.75], [6.05, 49.55]],
+                       "sources": [0], "destinations": [1, 2], "distances": true, "fallback_speed": 10.0}"#;
+        let Ok(Request::Table(request)) = parse_request(line) else { panic!("expected a table request") };
+        assert_eq!(request.coordinates, vec![(6.13, 49.61), (6.10, 49.75), (6.05, 49.55)]);
+        assert_eq!(request.sources_indices, Some(vec![0]));
+        assert_eq!(request.destinations_indices, Some(vec![1, 2]));
+        assert!(request.include_duration && request.include_distance);
+        assert_eq!(request.fallback_speed, Some(10.0));
+    }
+
+    #[test]
+    fn it_parses_a_nearest_line() {
+        let line = r#"{"service": "nearest", "coordinates": [[6.1319, 49.6116]], "number": 3}"#;
+        let Ok(Request::Nearest(request)) = parse_request(line) else { panic!("expected a nearest request") };
+        assert_eq!(request.coordinate.longitude, 6.1319);
+        assert_eq!(request.number, Some(3));
+
+        let line = r#"{"service": "nearest", "coordinates": [[6.1319, 49.6116]]}"#;
+        let Ok(Request::Nearest(request)) = parse_request(line) else { panic!("expected a nearest request") };
+        assert_eq!(request.number, Some(1), "A missing number keeps the default");
+    }
+
+    #[test]
+    fn it_parses_a_match_line() {
+        let line = r#"{"service": "match", "coordinates": [[6.13, 49.61], [6.131, 49.611], [6.132, 49.612]],
+                       "timestamps": [0, 5, 10], "gaps": "ignore", "tidy": true}"#;
+        let Ok(Request::Match(request)) = parse_request(line) else { panic!("expected a match request") };
+        assert_eq!(request.points.len(), 3);
+        assert_eq!(request.timestamps, Some(vec![0, 5, 10]));
+        assert_eq!(request.gaps.as_deref(), Some("ignore"));
+        assert!(request.tidy);
+    }
+
+    #[test]
+    fn it_rejects_malformed_lines() {
+        assert!(parse_request("not json").is_err());
+        assert!(parse_request(r#"{"service": "route"}"#).is_err(), "Coordinates are required");
+        assert!(parse_request(r#"{"service": "trip", "coordinates": [[6.13, 49.61]]}"#).is_err(), "Unknown service");
+        assert!(parse_request(r#"{"service": "route", "coordinates": [[6.13]]}"#).is_err(), "Pairs are required");
+        assert!(parse_request(r#"{"service": "nearest", "coordinates": []}"#).is_err(), "Nearest needs a coordinate");
+    }
+}
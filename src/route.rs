@@ -3,6 +3,7 @@ use crate::point::Point;
 use serde::{Deserialize, Serialize};
 use serde_json::Value;
 use crate::waypoints::Waypoint;
+use crate::geometry::RouteGeometry;
 
 #[derive(Debug, Builder, Clone, Default)]
 #[builder(setter(into, strip_option), default)]
@@ -31,6 +32,10 @@ pub struct RouteRequest {
     pub geometries: Option<String>,
     #[builder(default)]
     pub overview: Option<String>,
+    /// Simplifies the overview geometry to this tolerance in meters instead of OSRM's
+    /// zoom-based simplification
+    #[builder(default)]
+    pub simplify_tolerance: Option<f64>,
     #[builder(default = "false")]
     pub continue_straight: bool,
     #[builder(default)]
@@ -49,6 +54,79 @@ pub struct SimpleRouteResponse {
     pub distance: f64,
 }
 
+/// Totals of the best route, read directly from the engine without JSON
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct RouteSummary {
+    /// Total duration in seconds
+    pub duration: f64,
+    /// Total distance in meters
+    pub distance: f64,
+    /// Total weight of the route
+    pub weight: f64,
+    /// Per-leg totals, empty unless legs were requested
+    pub legs: Vec<LegSummary>,
+}
+
+/// Totals of a single leg between two consecutive waypoints
+#[derive(Debug, Clone, Copy, Deserialize, Serialize)]
+pub struct LegSummary {
+    /// Leg duration in seconds
+    pub duration: f64,
+    /// Leg distance in meters
+    pub distance: f64,
+}
+
+/// Routes with geometry between many origin-destination pairs over one set of
+/// locations, each location snapped once
+#[derive(Debug, Builder, Clone, Default)]
+#[builder(setter(into, strip_option), default)]
+pub struct RouteMatrixRequest {
+    pub points: Vec<Point>,
+    /// `(origin, destination)` indices into `points`
+    pub pairs: Vec<(usize, usize)>,
+    /// Leg annotations to return, e.g. `["duration", "nodes"]`
+    pub annotations: Option<Vec<String>>,
+    /// Worker threads, hardware concurrency when unset
+    pub threads: Option<i32>,
+}
+
+/// Alternative routes between two points, searched concurrently and filtered for diversity
+#[derive(Debug, Builder, Clone)]
+#[builder(setter(into, strip_option))]
+pub struct AlternativesRequest {
+    pub from: Point,
+    pub to: Point,
+    /// Alternatives to return besides the fastest route
+    #[builder(default = "3")]
+    pub max_alternatives: usize,
+    /// How much slower than the fastest route an alternative may be, 0.3 = 30%
+    #[builder(default = "0.3")]
+    pub max_stretch: f64,
+    /// Largest share of its distance an alternative may share with each kept route
+    #[builder(default = "0.6")]
+    pub max_overlap: f64,
+    /// Milliseconds to wait for candidates besides the fastest route; those not finished by then are left out
+    #[builder(default)]
+    pub time_budget_ms: Option<f64>,
+    /// Worker threads, hardware concurrency when unset
+    #[builder(default)]
+    pub threads: Option<i32>,
+}
+
+/// Route of one origin-destination pair
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct PairRoute {
+    pub duration: f64,
+    pub distance: f64,
+    pub geometry: RouteGeometry,
+}
+
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct RouteMatrixResponse {
+    /// One entry per requested pair, `None` when the pair has no route
+    pub routes: Vec<Option<PairRoute>>,
+}
+
 #[derive(Debug, Deserialize, Serialize)]
 #[allow(dead_code)]
 pub struct RouteResponse {
@@ -56,6 +134,9 @@ pub struct RouteResponse {
     pub routes: Vec<Route>,
     #[serde(skip_serializing_if = "Option::is_none", default)]
     pub waypoints: Option<Vec<Waypoint>>,
+    /// Typed geometry and annotations per route when `geometries` is `"binary"`
+    #[serde(skip)]
+    pub binary_geometry: Option<Vec<RouteGeometry>>,
 }
 
 #[derive(Debug, Deserialize, Serialize)]
@@ -53,3 +53,108 @@ pub struct TableRequest{
     #[builder(default)]
     pub snapping: Option<String>,
 }
+
+/// Cells to compute in a sparse table
+#[derive(Debug, Clone)]
+pub enum SparsityPattern {
+    /// The k nearest coordinates of each row by great-circle distance
+    KNearest(usize),
+    /// Explicit cells in compressed sparse row form: the columns of row `i` are
+    /// `column_indices[row_offsets[i]..row_offsets[i + 1]]`
+    Cells {
+        row_offsets: Vec<usize>,
+        column_indices: Vec<usize>,
+    },
+}
+
+impl Default for SparsityPattern {
+    fn default() -> Self {
+        SparsityPattern::KNearest(20)
+    }
+}
+
+/// Square duration/distance table over `coordinates` where only the cells of
+/// `pattern` are routed, e.g. for vehicle routing problems that only ever
+/// consider nearby stops.
+#[derive(Debug, Builder, Clone, Default)]
+#[builder(setter(into, strip_option), default)]
+pub struct SparseTableRequest {
+    pub coordinates: Vec<(f64, f64)>,
+    pub pattern: SparsityPattern,
+    /// Fills unreachable cells with the crow-fly distance driven at this speed (m/s)
+    pub fallback_speed: Option<f64>,
+    /// Worker threads, hardware concurrency when unset
+    pub threads: Option<i32>,
+}
+
+/// Sparse table in compressed sparse row form
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct SparseTableResponse {
+    pub row_offsets: Vec<usize>,
+    pub column_indices: Vec<usize>,
+    /// Duration of each cell in seconds, `None` when unreachable
+    pub durations: Vec<Option<f64>>,
+    /// Distance of each cell in meters, `None` when unreachable
+    pub distances: Vec<Option<f64>>,
+    /// Whether each cell was filled from the crow-fly fallback
+    pub estimated: Vec<bool>,
+}
+
+impl SparseTableResponse {
+    /// Index of the cell (source, destination) when it is part of the pattern
+    pub fn cell(&self, source: usize, destination: usize) -> Option<usize> {
+        let begin = *self.row_offsets.get(source)?;
+        let end = *self.row_offsets.get(source + 1)?;
+        self.column_indices[begin..end]
+            .iter()
+            .position(|&column| column == destination)
+            .map(|offset| begin + offset)
+    }
+
+    pub fn duration(&self, source: usize, destination: usize) -> Option<f64> {
+        self.cell(source, destination).and_then(|cell| self.durations[cell])
+    }
+
+    pub fn distance(&self, source: usize, destination: usize) -> Option<f64> {
+        self.cell(source, destination).and_then(|cell| self.distances[cell])
+    }
+}
+
+/// Dense table between location set ids, row-major over the requested
+/// sources and destinations
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct LocationTable {
+    pub num_sources: usize,
+    pub num_destinations: usize,
+    /// Duration of each cell in seconds, `None` when unreachable
+    pub durations: Vec<Option<f64>>,
+    /// Distance of each cell in meters, `None` when unreachable
+    pub distances: Vec<Option<f64>>,
+}
+
+impl LocationTable {
+    pub(crate) fn from_raw(num_sources: usize, num_destinations: usize, durations: Vec<f64>, distances: Vec<f64>) -> Self {
+        let cells = |values: Vec<f64>| values.into_iter().map(|v| if v < 0.0 { None } else { Some(v) }).collect();
+        LocationTable {
+            num_sources,
+            num_destinations,
+            durations: cells(durations),
+            distances: cells(distances),
+        }
+    }
+
+    /// Duration from the `source`-th requested source to the `destination`-th requested destination
+    pub fn duration(&self, source: usize, destination: usize) -> Option<f64> {
+        if destination >= self.num_destinations {
+            return None;
+        }
+        self.durations.get(source * self.num_destinations + destination).copied().flatten()
+    }
+
+    pub fn distance(&self, source: usize, destination: usize) -> Option<f64> {
+        if destination >= self.num_destinations {
+            return None;
+        }
+        self.distances.get(source * self.num_destinations + destination).copied().flatten()
+    }
+}
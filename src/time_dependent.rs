@@ -0,0 +1,123 @@
+// time_dependent.rs
+use crate::errors::OsrmError;
+use crate::osrm_engine::OsrmEngine;
+use crate::route::{RouteRequest, RouteResponse};
+use crate::tables::{TableRequest, TableResponse};
+use crate::{EngineConfig, Osrm};
+
+const SECONDS_PER_DAY: u32 = 24 * 60 * 60;
+
+/// A traffic profile valid from `start_second` (seconds after midnight) until the
+/// start of the next bucket, wrapping around midnight.
+#[derive(Debug, Clone)]
+pub struct TimeBucket {
+    /// Name of the bucket, e.g. "peak"
+    pub name: String,
+    /// Seconds after midnight at which this bucket starts
+    pub start_second: u32,
+    /// `.osrm` path of the bucket's dataset, see `TimeDependentEngine::prepare_bucket`
+    pub path: String,
+}
+
+/// MLD engines over one graph customized with different traffic profiles, selected
+/// by departure time. Bucket datasets hard-link every file that customization does
+/// not rewrite and are loaded with mmap, so the graph, R-tree, names and guidance
+/// data share page cache between buckets; only metrics and weights are per bucket.
+pub struct TimeDependentEngine {
+    /// Sorted by start second
+    buckets: Vec<(TimeBucket, OsrmEngine)>,
+}
+
+impl TimeDependentEngine {
+    /// Creates the dataset of one bucket at `bucket_path` from the customized MLD
+    /// dataset at `base_path`, customized with the given segment speed files.
+    pub fn prepare_bucket(
+        base_path: &str,
+        bucket_path: &str,
+        segment_speed_files: &[String],
+        threads: Option<i32>,
+    ) -> Result<String, OsrmError> {
+        Osrm::prepare_time_bucket(base_path, bucket_path, segment_speed_files, threads)
+            .map_err(|e| OsrmError::ApiError(e))
+    }
+
+    pub fn new(buckets: Vec<TimeBucket>) -> Result<Self, OsrmError> {
+        if buckets.is_empty() {
+            return Err(OsrmError::Initialization);
+        }
+        let mut engines = Vec::with_capacity(buckets.len());
+        for bucket in buckets {
+            let engine = OsrmEngine::new_with_config(EngineConfig {
+                algorithm: Some("MLD".to_string()),
+                shared_memory: false,
+                mmap_memory: true,
+                path: Some(bucket.path.clone()),
+                ..Default::default()
+            })?;
+            engines.push((bucket, engine));
+        }
+        engines.sort_by_key(|(bucket, _)| bucket.start_second);
+        Ok(TimeDependentEngine { buckets: engines })
+    }
+
+    /// The bucket in effect at `departure_second` (seconds after midnight)
+    pub fn bucket(&self, departure_second: u32) -> &TimeBucket {
+        &self.buckets[self.index(departure_second)].0
+    }
+
+    /// The engine of the bucket in effect at `departure_second`
+    pub fn engine(&self, departure_second: u32) -> &OsrmEngine {
+        &self.buckets[self.index(departure_second)].1
+    }
+
+    pub fn route(&self, departure_second: u32, route_request: RouteRequest) -> Result<RouteResponse, OsrmError> {
+        self.engine(departure_second).route(route_request)
+    }
+
+    pub fn table(&self, departure_second: u32, table_request: TableRequest) -> Result<TableResponse, OsrmError> {
+        self.engine(departure_second).table(table_request)
+    }
+
+    fn index(&self, departure_second: u32) -> usize {
+        bucket_index(&self.buckets, departure_second)
+    }
+}
+
+/// Position of the bucket in effect at `departure_second` in `buckets`, sorted by start second
+fn bucket_index<T>(buckets: &[(TimeBucket, T)], departure_second: u32) -> usize {
+    let second = departure_second % SECONDS_PER_DAY;
+    // Before the first start the last bucket of the previous day still applies
+    match buckets.partition_point(|(bucket, _)| bucket.start_second <= second) {
+        0 => buckets.len() - 1,
+        n => n - 1,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn buckets_starting_at(starts: &[u32]) -> Vec<(TimeBucket, ())> {
+        starts.iter()
+            .map(|&start_second| (TimeBucket { name: start_second.to_string(), start_second, path: String::new() }, ()))
+            .collect()
+    }
+
+    #[test]
+    fn it_selects_the_bucket_in_effect_at_departure() {
+        let buckets = buckets_starting_at(&[6 * 3600, 7 * 3600, 19 * 3600]);
+        assert_eq!(bucket_index(&buckets, 6 * 3600), 0, "A bucket applies from its own start");
+        assert_eq!(bucket_index(&buckets, 7 * 3600 - 1), 0);
+        assert_eq!(bucket_index(&buckets, 8 * 3600), 1);
+        assert_eq!(bucket_index(&buckets, 23 * 3600), 2);
+    }
+
+    #[test]
+    fn it_wraps_the_last_bucket_around_midnight() {
+        let buckets = buckets_starting_at(&[6 * 3600, 19 * 3600]);
+        assert_eq!(bucket_index(&buckets, 0), 1, "Before the first start the previous evening still applies");
+        assert_eq!(bucket_index(&buckets, 6 * 3600 - 1), 1);
+        assert_eq!(bucket_index(&buckets, SECONDS_PER_DAY + 6 * 3600), 0, "Departures past midnight wrap to the next day");
+        assert_eq!(bucket_index(&buckets_starting_at(&[0]), 12 * 3600), 0, "A single bucket applies all day");
+    }
+}
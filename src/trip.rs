@@ -3,6 +3,8 @@ use serde::{Deserialize, Serialize};
 use crate::point::Point;
 use crate::route::Route;
 use crate::waypoints::Waypoint;
+use crate::geometry::RouteGeometry;
+use crate::route::LegSummary;
 
 #[derive(Debug, Builder, Default)]
 #[builder(setter(into, strip_option), default)]
@@ -35,6 +37,10 @@ pub struct TripRequest {
     pub geometries: Option<String>,
     #[builder(default)]
     pub overview: Option<String>,
+    /// Simplifies the overview geometry to this tolerance in meters instead of OSRM's
+    /// zoom-based simplification
+    #[builder(default)]
+    pub simplify_tolerance: Option<f64>,
     #[builder(default)]
     pub exclude: Option<Vec<String>>,
 }
@@ -45,4 +51,34 @@ pub struct TripResponse {
     pub code: String,
     pub trips: Vec<Route>,
     pub waypoints: Vec<Waypoint>,
+    /// Typed geometry and annotations per trip when `geometries` is `"binary"`
+    #[serde(skip)]
+    pub binary_geometry: Option<Vec<RouteGeometry>>,
+}
+
+/// Trip over many stops solved with a single table and parallel local search
+#[derive(Debug, Builder, Clone, Default)]
+#[builder(setter(into, strip_option), default)]
+pub struct TripSolveRequest {
+    pub points: Vec<Point>,
+    /// Return to the first stop; otherwise the trip ends at the last stop
+    #[builder(default = "true")]
+    pub roundtrip: bool,
+    /// Search time in milliseconds, including the table; unset stops at the first local optimum
+    pub time_budget_ms: Option<f64>,
+    /// Worker threads, hardware concurrency when unset
+    pub threads: Option<i32>,
+}
+
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct TripSolution {
+    /// Indices into the request points in visiting order, starting with 0
+    pub order: Vec<usize>,
+    /// Legs between consecutive stops, including the return leg of round trips.
+    /// Unreachable legs have negative values.
+    pub legs: Vec<LegSummary>,
+    /// Total duration in seconds
+    pub duration: f64,
+    /// Total distance in meters
+    pub distance: f64,
 }
@@ -8,171 +8,4021 @@
 #include <osrm/trip_parameters.hpp>
 #include <osrm/match_parameters.hpp>
 #include <osrm/nearest_parameters.hpp>
+#include <engine/search_engine_data.hpp>
+#include <engine/polyline_compressor.hpp>
 #include <contractor/contractor.hpp>
 #include <contractor/contractor_config.hpp>
+#include <contractor/contracted_metric.hpp>
+#include <contractor/files.hpp>
+#include <contractor/query_graph.hpp>
+#include <updater/updater.hpp>
 #include <customizer/customizer.hpp>
 #include <customizer/customizer_config.hpp>
 #include <partitioner/partitioner.hpp>
 #include <partitioner/partitioner_config.hpp>
 #include <storage/io_config.hpp>
+#include <storage/storage.hpp>
+#include <storage/storage_config.hpp>
 #include <extractor/extractor.hpp>
 #include <extractor/extractor_config.hpp>
+#include <extractor/files.hpp>
+#include <extractor/profile_properties.hpp>
 #include <extractor/scripting_environment_lua.hpp>
+#include <extractor/extraction_relation.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/way.hpp>
+#include <tbb/enumerable_thread_specific.h>
 
 #include <string>
 #include <iostream>
 #include <cstdlib>
 #include <cstring>
+#include <cstdio>
 #include <filesystem>
+#include <fstream>
 #include <thread>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <limits>
+#include <optional>
+#include <memory>
+#include <queue>
+#include <set>
+#include <unordered_set>
+#include <unordered_map>
+#include <random>
+#include <new>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+namespace {
+
+    // Typed geometry and annotation arrays lifted out of a route-like result.
+    // Coordinates are lon/lat pairs; annotation arrays are concatenated over all legs.
+    struct BinaryGeometry {
+        std::vector<size_t> coordinate_offsets{0};
+        std::vector<double> coordinates;
+        std::vector<size_t> leg_offsets{0};
+        std::vector<size_t> annotation_offsets{0};
+        std::vector<double> durations;
+        std::vector<double> distances;
+        std::vector<double> speeds;
+        std::vector<size_t> node_offsets{0};
+        std::vector<uint64_t> nodes;
+        std::vector<double> significance;
+    };
 
-extern "C" {
+    template <typename T>
+    void append_numbers(const osrm::json::Object& object, const char* key, std::vector<T>& out) {
+        const auto it = object.values.find(key);
+        if (it == object.values.end()) {
+            return;
+        }
+        for (const auto& value : std::get<osrm::json::Array>(it->second).values) {
+            out.push_back(static_cast<T>(std::get<osrm::json::Number>(value).value));
+        }
+    }
 
-    struct OSRM_Result {
-        int code;
-        char* message;
+    // Moves the GeoJSON geometry and the leg annotations of every entry in
+    // result[routes_key] into typed arrays and erases them from the result,
+    // so they are neither rendered to text nor parsed again on the Rust side.
+    void take_binary_geometry(osrm::json::Object& result, const char* routes_key, BinaryGeometry& out) {
+        auto& routes = std::get<osrm::json::Array>(result.values.at(routes_key)).values;
+        for (auto& route_value : routes) {
+            auto& route = std::get<osrm::json::Object>(route_value);
+
+            const auto geometry = route.values.find("geometry");
+            if (geometry != route.values.end()) {
+                const auto& line = std::get<osrm::json::Object>(geometry->second);
+                const auto& positions = std::get<osrm::json::Array>(line.values.at("coordinates")).values;
+                out.coordinates.reserve(out.coordinates.size() + positions.size() * 2);
+                for (const auto& position : positions) {
+                    const auto& lon_lat = std::get<osrm::json::Array>(position).values;
+                    out.coordinates.push_back(std::get<osrm::json::Number>(lon_lat[0]).value);
+                    out.coordinates.push_back(std::get<osrm::json::Number>(lon_lat[1]).value);
+                }
+                route.values.erase(geometry);
+            }
+            out.coordinate_offsets.push_back(out.coordinates.size() / 2);
+
+            for (auto& leg_value : std::get<osrm::json::Array>(route.values.at("legs")).values) {
+                auto& leg = std::get<osrm::json::Object>(leg_value);
+                const auto annotation = leg.values.find("annotation");
+                if (annotation != leg.values.end()) {
+                    auto& fields = std::get<osrm::json::Object>(annotation->second);
+                    append_numbers(fields, "duration", out.durations);
+                    append_numbers(fields, "distance", out.distances);
+                    append_numbers(fields, "speed", out.speeds);
+                    append_numbers(fields, "nodes", out.nodes);
+                    // Weights, datasources and metadata stay in the JSON annotation
+                    for (const char* lifted : {"duration", "distance", "speed", "nodes"}) {
+                        fields.values.erase(lifted);
+                    }
+                    if (fields.values.empty()) {
+                        leg.values.erase(annotation);
+                    }
+                }
+                out.annotation_offsets.push_back(
+                    std::max({out.durations.size(), out.distances.size(), out.speeds.size()}));
+                out.node_offsets.push_back(out.nodes.size());
+            }
+            out.leg_offsets.push_back(out.annotation_offsets.size() - 1);
+        }
+    }
+
+    // Route annotations from their API names; "true" or "all" selects all of them
+    void set_route_annotations(osrm::RouteParameters& params,
+                               const char* const* annotations, size_t num_annotations) {
+        if (num_annotations > 0 && annotations != nullptr) {
+            params.annotations = true;
+            params.annotations_type = osrm::RouteParameters::AnnotationsType::None;
+        
+            for (size_t i = 0; i < num_annotations; ++i) {
+                if (annotations[i] != nullptr) {
+                    std::string annotation_str(annotations[i]);
+                    if (annotation_str == "true" || annotation_str == "all") {
+                        params.annotations_type = osrm::RouteParameters::AnnotationsType::All;
+                        break;
+                    } else if (annotation_str == "nodes") {
+                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
+                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Nodes));
+                    } else if (annotation_str == "distance") {
+                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
+                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Distance));
+                    } else if (annotation_str == "duration") {
+                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
+                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Duration));
+                    } else if (annotation_str == "datasources") {
+                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
+                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Datasources));
+                    } else if (annotation_str == "weight") {
+                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
+                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Weight));
+                    } else if (annotation_str == "speed") {
+                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
+                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Speed));
+                    }
+                }
+            }
+        } else {
+            params.annotations = false;
+        }
+    }
+
+    // Nearest candidates looked at when the closest one lies in a tiny component
+    constexpr unsigned SNAP_CANDIDATES = 10;
+
+    // Snaps every coordinate once with a Nearest query and returns the hints, so
+    // queries over subsets of the locations skip the R-tree lookup. Like route
+    // and table snapping, a snap into a tiny component is replaced by the
+    // nearest candidate in a bigger one. Locations that could not be snapped get
+    // no hint and are snapped per query.
+    std::vector<std::optional<osrm::engine::Hint>> snap_once(osrm::OSRM* osrm_ptr,
+                                                             const double* coordinates,
+                                                             size_t n) {
+        std::vector<std::optional<osrm::engine::Hint>> hints(n);
+        const auto nearest = [&](size_t i, unsigned number) -> std::optional<osrm::engine::Hint> {
+            osrm::NearestParameters params;
+            params.coordinates.push_back({
+                osrm::util::FloatLongitude{coordinates[i * 2]},
+                osrm::util::FloatLatitude{coordinates[i * 2 + 1]}
+            });
+            params.number_of_results = number;
+            params.generate_hints = true;
+
+            osrm::json::Object result;
+            if (osrm_ptr->Nearest(params, result) != osrm::Status::Ok) {
+                return std::nullopt;
+            }
+            for (const auto& waypoint : std::get<osrm::json::Array>(result.values.at("waypoints")).values) {
+                const auto& fields = std::get<osrm::json::Object>(waypoint);
+                auto hint = osrm::engine::Hint::FromBase64(std::get<osrm::json::String>(fields.values.at("hint")).value);
+                const bool tiny = std::any_of(hint.segment_hints.begin(), hint.segment_hints.end(),
+                                              [](const auto& segment) { return segment.phantom.component.is_tiny; });
+                if (!tiny) {
+                    return hint;
+                }
+            }
+            return std::nullopt;
+        };
+
+        for (size_t i = 0; i < n; ++i) {
+            try {
+                hints[i] = nearest(i, 1);
+                if (!hints[i]) {
+                    hints[i] = nearest(i, SNAP_CANDIDATES);
+                }
+            } catch (const std::exception&) {
+                hints[i].reset();
+            }
+        }
+        return hints;
+    }
+
+    // Appends one extracted geometry after another, shifting its offsets
+    void append_binary_geometry(BinaryGeometry& out, const BinaryGeometry& part) {
+        const size_t coordinate_base = out.coordinates.size() / 2;
+        const size_t leg_base = out.annotation_offsets.size() - 1;
+        const size_t annotation_base = out.annotation_offsets.back();
+        const size_t node_base = out.node_offsets.back();
+
+        out.coordinates.insert(out.coordinates.end(), part.coordinates.begin(), part.coordinates.end());
+        out.durations.insert(out.durations.end(), part.durations.begin(), part.durations.end());
+        out.distances.insert(out.distances.end(), part.distances.begin(), part.distances.end());
+        out.speeds.insert(out.speeds.end(), part.speeds.begin(), part.speeds.end());
+        out.nodes.insert(out.nodes.end(), part.nodes.begin(), part.nodes.end());
+        for (size_t i = 1; i < part.coordinate_offsets.size(); ++i) {
+            out.coordinate_offsets.push_back(coordinate_base + part.coordinate_offsets[i]);
+        }
+        for (size_t i = 1; i < part.leg_offsets.size(); ++i) {
+            out.leg_offsets.push_back(leg_base + part.leg_offsets[i]);
+        }
+        for (size_t i = 1; i < part.annotation_offsets.size(); ++i) {
+            out.annotation_offsets.push_back(annotation_base + part.annotation_offsets[i]);
+            out.node_offsets.push_back(node_base + part.node_offsets[i]);
+        }
+    }
+
+    // One route found while searching for alternatives, with the OSM segments it
+    // uses so overlap between routes can be measured
+    struct AlternativeCandidate {
+        osrm::json::Object route;
+        double duration = 0;
+        double distance = 0;
+        std::vector<std::pair<uint64_t, double>> segments; // (segment key, meters)
     };
 
-    struct OSRM_Config {
-        const char* algorithm;
-        bool shared_memory;
-        const char* dataset_name;
-        bool mmap_memory;
-        const char* path;
-        int disable_feature_dataset_flags; // Bitfield: 1=ROUTE_STEPS, 2=ROUTE_GEOMETRY
-        int max_locations_trip;
-        int max_locations_viaroute;
-        int max_locations_distance_table;
-        int max_locations_map_matching;
-        double max_radius_map_matching;
-        int max_results_nearest;
-        int max_alternatives;
-        double default_radius;
+    uint64_t segment_key(uint64_t from, uint64_t to) {
+        return from * 0x9E3779B97F4A7C15ull ^ to;
+    }
+
+    // Moves every route of a result into candidates, recording its segments from
+    // the node and distance annotations, which are then dropped from the route
+    void take_candidates(osrm::json::Object& result, std::vector<AlternativeCandidate>& out) {
+        for (auto& route_value : std::get<osrm::json::Array>(result.values.at("routes")).values) {
+            AlternativeCandidate candidate;
+            candidate.route = std::move(std::get<osrm::json::Object>(route_value));
+            candidate.duration = std::get<osrm::json::Number>(candidate.route.values.at("duration")).value;
+            candidate.distance = std::get<osrm::json::Number>(candidate.route.values.at("distance")).value;
+
+            for (auto& leg_value : std::get<osrm::json::Array>(candidate.route.values.at("legs")).values) {
+                auto& leg = std::get<osrm::json::Object>(leg_value);
+                const auto annotation = leg.values.find("annotation");
+                if (annotation == leg.values.end()) {
+                    continue;
+                }
+                std::vector<uint64_t> nodes;
+                std::vector<double> distances;
+                const auto& fields = std::get<osrm::json::Object>(annotation->second);
+                append_numbers(fields, "nodes", nodes);
+                append_numbers(fields, "distance", distances);
+                for (size_t i = 0; i + 1 < nodes.size() && i < distances.size(); ++i) {
+                    candidate.segments.emplace_back(segment_key(nodes[i], nodes[i + 1]), distances[i]);
+                }
+                leg.values.erase(annotation);
+            }
+            out.push_back(std::move(candidate));
+        }
+    }
+
+    // Share of the candidate's distance on segments of an accepted route
+    double overlap_with(const AlternativeCandidate& candidate, const std::unordered_set<uint64_t>& accepted) {
+        if (candidate.distance <= 0) {
+            return 1.0;
+        }
+        double shared = 0;
+        for (const auto& [key, meters] : candidate.segments) {
+            if (accepted.count(key)) {
+                shared += meters;
+            }
+        }
+        return shared / candidate.distance;
+    }
+
+    // State of one alternatives search, shared with the background workers so it
+    // outlives a call that returned when its time budget ran out. Candidate 0 is
+    // the fastest route, 1 is OSRM's alternative search and the rest go through
+    // the via points.
+    struct AlternativesSearch {
+        osrm::OSRM* osrm = nullptr;
+        double from_lon = 0, from_lat = 0, to_lon = 0, to_lat = 0;
+        size_t max_alternatives = 0;
+        std::vector<std::pair<double, double>> vias;
+
+        std::atomic<size_t> next{1};
+        std::atomic<bool> expired{false};
+        std::mutex mutex;
+        std::condition_variable done;
+        std::vector<std::vector<AlternativeCandidate>> found;
+        std::vector<char> finished;
+        size_t num_finished = 0;
     };
 
-    void* osrm_create_with_config(const OSRM_Config* user_config) {
-        try {
-            osrm::EngineConfig config;
-            
-            // Set algorithm
-            if (user_config->algorithm != nullptr) {
-                if (strcmp(user_config->algorithm, "CH") == 0) {
-                    config.algorithm = osrm::EngineConfig::Algorithm::CH;
-                } else if (strcmp(user_config->algorithm, "MLD") == 0) {
-                    config.algorithm = osrm::EngineConfig::Algorithm::MLD;
-                } else {
-                    config.algorithm = osrm::EngineConfig::Algorithm::MLD;
+    // Background searches still using each instance; osrm_destroy waits for them
+    std::mutex background_search_mutex;
+    std::condition_variable background_search_done;
+    std::unordered_map<const void*, size_t> background_searches;
+
+    void begin_background_search(const void* instance) {
+        std::lock_guard<std::mutex> lock(background_search_mutex);
+        ++background_searches[instance];
+    }
+
+    void end_background_search(const void* instance) {
+        std::lock_guard<std::mutex> lock(background_search_mutex);
+        if (--background_searches[instance] == 0) {
+            background_searches.erase(instance);
+            background_search_done.notify_all();
+        }
+    }
+
+    void wait_for_background_searches(const void* instance) {
+        std::unique_lock<std::mutex> lock(background_search_mutex);
+        background_search_done.wait(lock, [&] { return background_searches.count(instance) == 0; });
+    }
+
+    osrm::Status route_alternative_candidate(const AlternativesSearch& search, size_t c, osrm::json::Object& result) {
+        const bool via = c >= 2;
+        osrm::RouteParameters params;
+        params.coordinates.push_back({osrm::util::FloatLongitude{search.from_lon}, osrm::util::FloatLatitude{search.from_lat}});
+        if (via) {
+            params.coordinates.push_back({osrm::util::FloatLongitude{search.vias[c - 2].first},
+                                          osrm::util::FloatLatitude{search.vias[c - 2].second}});
+        }
+        params.coordinates.push_back({osrm::util::FloatLongitude{search.to_lon}, osrm::util::FloatLatitude{search.to_lat}});
+        params.alternatives = c == 1;
+        params.number_of_alternatives = c == 1 ? static_cast<unsigned>(search.max_alternatives) : 0;
+        params.annotations = true;
+        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
+            static_cast<int>(osrm::RouteParameters::AnnotationsType::Nodes) |
+            static_cast<int>(osrm::RouteParameters::AnnotationsType::Distance));
+        params.overview = osrm::RouteParameters::OverviewType::Full;
+        params.generate_hints = false;
+        params.skip_waypoints = c > 0;
+        if (via) {
+            // The via point passes through without a leg of its own, so every
+            // route has one leg like the primary ones, and no u-turn there,
+            // which would only add a spur
+            params.waypoints = {0, 2};
+            params.continue_straight = true;
+        }
+        return search.osrm->Route(params, result);
+    }
+
+    // Background worker: routes candidates until none are left or the caller
+    // stopped waiting, then releases its hold on the engine
+    void run_alternative_candidates(std::shared_ptr<AlternativesSearch> search) {
+        const size_t num_candidates = search->found.size();
+        for (size_t c = search->next++; c < num_candidates && !search->expired; c = search->next++) {
+            std::vector<AlternativeCandidate> candidates;
+            // OSRM's alternative search adds nothing when no alternative is wanted
+            if (c != 1 || search->max_alternatives > 0) {
+                try {
+                    osrm::json::Object result;
+                    if (route_alternative_candidate(*search, c, result) == osrm::Status::Ok) {
+                        take_candidates(result, candidates);
+                    }
+                } catch (const std::exception&) {
+                    // A candidate that fails contributes no routes
+                    candidates.clear();
                 }
             }
-            
-            // Set storage configuration
-            config.use_shared_memory = user_config->shared_memory;
-            
-            // Note: memory_file is a path, not a boolean. If mmap_memory is true,
-            // set it to the same path as storage_config
-            if (user_config->dataset_name != nullptr && strlen(user_config->dataset_name) > 0) {
-                config.dataset_name = std::string(user_config->dataset_name);
+
+            std::lock_guard<std::mutex> lock(search->mutex);
+            if (!search->expired) {
+                search->found[c] = std::move(candidates);
+                search->finished[c] = 1;
             }
-            
-            if (user_config->path != nullptr && strlen(user_config->path) > 0) {
-                std::string path_str(user_config->path);
-                config.storage_config = {path_str};
-                
-                // If mmap_memory is enabled, set memory_file to the path
-                if (user_config->mmap_memory) {
-                    config.memory_file = path_str;
+            ++search->num_finished;
+            search->done.notify_all();
+        }
+        end_background_search(search->osrm);
+    }
+
+    // Trip local search works on a path whose first and last entries are fixed;
+    // for round trips the last entry repeats the first. Costs are an n x n
+    // row-major duration matrix and may be asymmetric.
+    double path_cost(const std::vector<double>& costs, size_t n, const std::vector<size_t>& path) {
+        double total = 0;
+        for (size_t k = 0; k + 1 < path.size(); ++k) {
+            total += costs[path[k] * n + path[k + 1]];
+        }
+        return total;
+    }
+
+    // Applies the first improving segment reversal. Forward and backward prefix
+    // sums give the cost of a reversed segment in O(1) despite asymmetry.
+    bool improve_two_opt(const std::vector<double>& costs, size_t n, std::vector<size_t>& path) {
+        const size_t length = path.size();
+        if (length < 4) {
+            return false;
+        }
+        std::vector<double> forward(length, 0), backward(length, 0);
+        for (size_t k = 0; k + 1 < length; ++k) {
+            forward[k + 1] = forward[k] + costs[path[k] * n + path[k + 1]];
+            backward[k + 1] = backward[k] + costs[path[k + 1] * n + path[k]];
+        }
+        const auto c = [&](size_t a, size_t b) { return costs[path[a] * n + path[b]]; };
+        for (size_t i = 1; i + 2 < length; ++i) {
+            for (size_t j = i + 1; j + 1 < length; ++j) {
+                const double delta = c(i - 1, j) + c(i, j + 1) - c(i - 1, i) - c(j, j + 1)
+                                   + (backward[j] - backward[i]) - (forward[j] - forward[i]);
+                if (delta < -1e-9) {
+                    std::reverse(path.begin() + i, path.begin() + j + 1);
+                    return true;
                 }
             }
-            
-            // Note: load_steps and load_geometry don't exist in OSRM v6.0.0
-            // The disable_feature_dataset option is not supported in this version
-            // These features may be available in newer OSRM versions
-            
-            // Set max locations
-            if (user_config->max_locations_trip > 0) {
-                config.max_locations_trip = user_config->max_locations_trip;
+        }
+        return false;
+    }
+
+    // Applies the first improving move of a run of 1 to 3 stops to another position
+    bool improve_or_opt(const std::vector<double>& costs, size_t n, std::vector<size_t>& path) {
+        const size_t length = path.size();
+        const auto c = [&](size_t a, size_t b) { return costs[path[a] * n + path[b]]; };
+        for (size_t run = 1; run <= 3; ++run) {
+            for (size_t i = 1; i + run < length; ++i) {
+                const size_t last = i + run - 1;
+                const double removed = c(i - 1, i) + c(last, last + 1) - c(i - 1, last + 1);
+                for (size_t k = 0; k + 1 < length; ++k) {
+                    if (k + 1 >= i && k <= last) {
+                        continue;
+                    }
+                    const double delta = c(k, i) + c(last, k + 1) - c(k, k + 1) - removed;
+                    if (delta < -1e-9) {
+                        if (k > last) {
+                            std::rotate(path.begin() + i, path.begin() + last + 1, path.begin() + k + 1);
+                        } else {
+                            std::rotate(path.begin() + k + 1, path.begin() + i, path.begin() + last + 1);
+                        }
+                        return true;
+                    }
+                }
             }
-            if (user_config->max_locations_viaroute > 0) {
-                config.max_locations_viaroute = user_config->max_locations_viaroute;
+        }
+        return false;
+    }
+
+    void local_search(const std::vector<double>& costs, size_t n, std::vector<size_t>& path,
+                      std::chrono::steady_clock::time_point deadline) {
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (!improve_two_opt(costs, n, path) && !improve_or_opt(costs, n, path)) {
+                return;
             }
-            if (user_config->max_locations_distance_table > 0) {
-                config.max_locations_distance_table = user_config->max_locations_distance_table;
+        }
+    }
+
+    // Random double-bridge kick on the movable part of the path
+    void double_bridge(std::vector<size_t>& path, std::mt19937& rng) {
+        const size_t interior = path.size() - 2;
+        if (interior < 8) {
+            return;
+        }
+        std::uniform_int_distribution<size_t> pick(1, interior - 1);
+        size_t cuts[3] = {pick(rng), pick(rng), pick(rng)};
+        std::sort(cuts, cuts + 3);
+        if (cuts[0] == cuts[1] || cuts[1] == cuts[2]) {
+            return;
+        }
+        // A B C D -> A C B D over the interior
+        std::rotate(path.begin() + 1 + cuts[0], path.begin() + 1 + cuts[1], path.begin() + 1 + cuts[2]);
+    }
+
+    // Limits of one osrm_table_sparse batch: rows, and distinct columns over them
+    constexpr size_t SPARSE_BATCH_ROWS = 32;
+    constexpr size_t SPARSE_BATCH_COLUMNS = 256;
+
+    // Same mean earth radius as OSRM's coordinate calculations
+    constexpr double EARTH_RADIUS_METERS = 6372797.560856;
+
+    // Great-circle distances in meters from one point to `count` points given as
+    // structure-of-arrays radians, with the cosines of the latitudes precomputed
+    void haversine_row(double lat, double lon,
+                       const double* lats, const double* lons, const double* cos_lats,
+                       size_t count, double* out) {
+        const double cos_lat = std::cos(lat);
+        for (size_t j = 0; j < count; ++j) {
+            const double sin_dlat = std::sin((lats[j] - lat) * 0.5);
+            const double sin_dlon = std::sin((lons[j] - lon) * 0.5);
+            const double a = sin_dlat * sin_dlat + cos_lat * cos_lats[j] * sin_dlon * sin_dlon;
+            out[j] = 2.0 * EARTH_RADIUS_METERS * std::asin(std::sqrt(std::min(a, 1.0)));
+        }
+    }
+
+    // Douglas-Peucker over lon/lat pairs with a tolerance in meters, measured in a
+    // local equirectangular projection. Fills the indices of the kept points and,
+    // for each, the largest tolerance at which it would still be kept (infinity
+    // for the endpoints), so coarser geometries follow by filtering on it.
+    void simplify_line(const std::vector<double>& lon_lat,
+                       double tolerance,
+                       std::vector<size_t>& kept,
+                       std::vector<double>& significance) {
+        const size_t n = lon_lat.size() / 2;
+        kept.clear();
+        significance.clear();
+        if (n <= 2) {
+            for (size_t i = 0; i < n; ++i) {
+                kept.push_back(i);
+                significance.push_back(std::numeric_limits<double>::infinity());
             }
-            if (user_config->max_locations_map_matching > 0) {
-                config.max_locations_map_matching = user_config->max_locations_map_matching;
+            return;
+        }
+
+        const double meters_per_degree = EARTH_RADIUS_METERS * M_PI / 180.0;
+        const double x_scale = meters_per_degree * std::cos(lon_lat[1] * M_PI / 180.0);
+        std::vector<double> x(n), y(n);
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = lon_lat[i * 2] * x_scale;
+            y[i] = lon_lat[i * 2 + 1] * meters_per_degree;
+        }
+
+        std::vector<double> point_significance(n, -1.0);
+        point_significance.front() = point_significance.back() = std::numeric_limits<double>::infinity();
+
+        // Spans still to split, with the significance of the point that created them
+        struct Span { size_t first, last; double parent; };
+        std::vector<Span> spans{{0, n - 1, std::numeric_limits<double>::infinity()}};
+        while (!spans.empty()) {
+            const Span span = spans.back();
+            spans.pop_back();
+
+            const double dx = x[span.last] - x[span.first];
+            const double dy = y[span.last] - y[span.first];
+            const double length_sq = dx * dx + dy * dy;
+            double farthest = -1.0;
+            size_t split = span.first;
+            for (size_t i = span.first + 1; i < span.last; ++i) {
+                double px = x[i] - x[span.first];
+                double py = y[i] - y[span.first];
+                if (length_sq > 0) {
+                    const double t = std::clamp((px * dx + py * dy) / length_sq, 0.0, 1.0);
+                    px -= t * dx;
+                    py -= t * dy;
+                }
+                const double distance_sq = px * px + py * py;
+                if (distance_sq > farthest) {
+                    farthest = distance_sq;
+                    split = i;
+                }
+            }
+
+            const double deviation = std::sqrt(farthest);
+            if (split == span.first || deviation <= tolerance) {
+                continue;
+            }
+            // A point never outlives the point whose split produced its span
+            point_significance[split] = std::min(deviation, span.parent);
+            spans.push_back({span.first, split, point_significance[split]});
+            spans.push_back({split, span.last, point_significance[split]});
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            if (point_significance[i] >= 0) {
+                kept.push_back(i);
+                significance.push_back(point_significance[i]);
+            }
+        }
+    }
+
+    // Re-encodes a GeoJSON line geometry in the requested format
+    osrm::json::Value encode_line(const std::vector<osrm::util::Coordinate>& line,
+                                  osrm::RouteParameters::GeometriesType format) {
+        if (format == osrm::RouteParameters::GeometriesType::Polyline) {
+            return osrm::json::String(osrm::engine::encodePolyline<100000>(line.begin(), line.end()));
+        }
+        if (format == osrm::RouteParameters::GeometriesType::Polyline6) {
+            return osrm::json::String(osrm::engine::encodePolyline<1000000>(line.begin(), line.end()));
+        }
+        osrm::json::Array coordinates;
+        coordinates.values.reserve(line.size());
+        for (const auto& coordinate : line) {
+            osrm::json::Array position;
+            position.values.push_back(osrm::json::Number(static_cast<double>(osrm::util::toFloating(coordinate.lon))));
+            position.values.push_back(osrm::json::Number(static_cast<double>(osrm::util::toFloating(coordinate.lat))));
+            coordinates.values.push_back(std::move(position));
+        }
+        osrm::json::Object geojson;
+        geojson.values["type"] = osrm::json::String("LineString");
+        geojson.values["coordinates"] = std::move(coordinates);
+        return geojson;
+    }
+
+    std::vector<double> geojson_positions(const osrm::json::Value& geometry) {
+        std::vector<double> lon_lat;
+        const auto& line = std::get<osrm::json::Object>(geometry);
+        const auto& positions = std::get<osrm::json::Array>(line.values.at("coordinates")).values;
+        lon_lat.reserve(positions.size() * 2);
+        for (const auto& position : positions) {
+            const auto& pair = std::get<osrm::json::Array>(position).values;
+            lon_lat.push_back(std::get<osrm::json::Number>(pair[0]).value);
+            lon_lat.push_back(std::get<osrm::json::Number>(pair[1]).value);
+        }
+        return lon_lat;
+    }
+
+    // Simplifies the full GeoJSON overview of every entry in result[routes_key]
+    // to `tolerance` meters and writes it back in `format`. Step geometries are
+    // only re-encoded. The significance of every kept point is appended to
+    // `significance` when given.
+    void simplify_geometries(osrm::json::Object& result,
+                             const char* routes_key,
+                             double tolerance,
+                             osrm::RouteParameters::GeometriesType format,
+                             std::vector<double>* significance) {
+        const auto to_coordinates = [](const std::vector<double>& lon_lat, const std::vector<size_t>* indices) {
+            std::vector<osrm::util::Coordinate> line;
+            const size_t count = indices ? indices->size() : lon_lat.size() / 2;
+            line.reserve(count);
+            for (size_t k = 0; k < count; ++k) {
+                const size_t i = indices ? (*indices)[k] : k;
+                line.push_back({osrm::util::FloatLongitude{lon_lat[i * 2]}, osrm::util::FloatLatitude{lon_lat[i * 2 + 1]}});
+            }
+            return line;
+        };
+
+        std::vector<size_t> kept;
+        std::vector<double> kept_significance;
+        for (auto& route_value : std::get<osrm::json::Array>(result.values.at(routes_key)).values) {
+            auto& route = std::get<osrm::json::Object>(route_value);
+
+            const auto geometry = route.values.find("geometry");
+            if (geometry != route.values.end()) {
+                const auto lon_lat = geojson_positions(geometry->second);
+                simplify_line(lon_lat, tolerance, kept, kept_significance);
+                geometry->second = encode_line(to_coordinates(lon_lat, &kept), format);
+                if (significance) {
+                    significance->insert(significance->end(), kept_significance.begin(), kept_significance.end());
+                }
+            }
+
+            if (format == osrm::RouteParameters::GeometriesType::GeoJSON) {
+                continue;
+            }
+            for (auto& leg_value : std::get<osrm::json::Array>(route.values.at("legs")).values) {
+                auto& leg = std::get<osrm::json::Object>(leg_value);
+                const auto steps = leg.values.find("steps");
+                if (steps == leg.values.end()) {
+                    continue;
+                }
+                for (auto& step_value : std::get<osrm::json::Array>(steps->second).values) {
+                    auto& step = std::get<osrm::json::Object>(step_value);
+                    const auto step_geometry = step.values.find("geometry");
+                    if (step_geometry != step.values.end()) {
+                        step_geometry->second = encode_line(to_coordinates(geojson_positions(step_geometry->second), nullptr), format);
+                    }
+                }
+            }
+        }
+    }
+
+    // Validates packed fixed-point [lon, lat] pairs (degrees * 1e6, OSRM's
+    // COORDINATE_PRECISION) and appends them without a float round trip. The
+    // range check is a branch-free reduction so it vectorizes; the offending
+    // index is only searched for once the batch is known to be invalid.
+    bool append_fixed_coordinates(std::vector<osrm::util::Coordinate>& out,
+                                  const int32_t* coordinates, size_t count, std::string& error) {
+        constexpr int32_t MAX_LON = 180 * 1000000;
+        constexpr int32_t MAX_LAT = 90 * 1000000;
+
+        int32_t invalid = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const int32_t lon = coordinates[i * 2];
+            const int32_t lat = coordinates[i * 2 + 1];
+            invalid |= (lon < -MAX_LON) | (lon > MAX_LON) | (lat < -MAX_LAT) | (lat > MAX_LAT);
+        }
+
+        if (invalid) {
+            for (size_t i = 0; i < count; ++i) {
+                const int32_t lon = coordinates[i * 2];
+                const int32_t lat = coordinates[i * 2 + 1];
+                if (lon < -MAX_LON || lon > MAX_LON || lat < -MAX_LAT || lat > MAX_LAT) {
+                    error = "Coordinate " + std::to_string(i) + " is out of range";
+                    return false;
+                }
+            }
+        }
+
+        out.reserve(out.size() + count);
+        for (size_t i = 0; i < count; ++i) {
+            out.emplace_back(osrm::util::FixedLongitude{coordinates[i * 2]},
+                             osrm::util::FixedLatitude{coordinates[i * 2 + 1]});
+        }
+        return true;
+    }
+
+    // Rendered responses are the largest single buffer of a request. Each thread
+    // renders into the same string so it keeps its capacity across requests
+    // instead of regrowing from empty; oversized buffers are released.
+    constexpr size_t MAX_RETAINED_RENDER_BYTES = 16 * 1024 * 1024;
+
+    std::string& render_buffer() {
+        thread_local std::string buffer;
+        if (buffer.capacity() > MAX_RETAINED_RENDER_BYTES) {
+            std::string().swap(buffer);
+        }
+        buffer.clear();
+        return buffer;
+    }
+
+    // Resident set high-water mark of a rusage sample in bytes
+    size_t peak_rss_bytes(const struct rusage& usage) {
+#ifdef __APPLE__
+        return static_cast<size_t>(usage.ru_maxrss);
+#else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+    }
+
+    // Current resident set of another process in bytes, 0 where /proc is unavailable
+    size_t resident_bytes(pid_t pid) {
+#ifdef __linux__
+        std::ifstream statm("/proc/" + std::to_string(pid) + "/statm");
+        size_t total_pages = 0;
+        size_t resident_pages = 0;
+        if (statm >> total_pages >> resident_pages) {
+            return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        }
+#else
+        (void)pid;
+#endif
+        return 0;
+    }
+
+    // Results of a memoizing extraction on one of its worker threads
+    struct ProfileMemo {
+        std::unordered_map<std::string, osrm::extractor::ExtractionNode> nodes;
+        std::unordered_map<std::string, osrm::extractor::ExtractionWay> ways;
+    };
+
+    // Entries per cache and thread before it is dropped and refilled
+    constexpr size_t MAX_PROFILE_MEMO_ENTRIES = 1 << 20;
+
+    std::string tag_set_key(const osmium::TagList& tags) {
+        std::string key;
+        for (const auto& tag : tags) {
+            key += tag.key();
+            key += '\0';
+            key += tag.value();
+            key += '\0';
+        }
+        return key;
+    }
+
+    // Scripting environment that answers nodes and ways whose tag set was seen
+    // before on the same thread from a cache and hands only the rest, plus every
+    // relation, to the Lua profile. This assumes the profile's node and way
+    // functions depend on tags alone, so nodes and ways that are members of a
+    // relation (which the profile sees through `relations`) and datasets with
+    // location-dependent data always go to the profile.
+    // The caches belong to the environment, one per worker thread, and are
+    // freed with it at the end of the run.
+    class MemoizingScriptingEnvironment final : public osrm::extractor::ScriptingEnvironment {
+      public:
+        explicit MemoizingScriptingEnvironment(osrm::extractor::ScriptingEnvironment& inner)
+            : inner(inner) {}
+
+        const osrm::extractor::ProfileProperties& GetProfileProperties() override { return inner.GetProfileProperties(); }
+        std::vector<std::string> GetNameSuffixList() override { return inner.GetNameSuffixList(); }
+        std::vector<std::vector<std::string>> GetExcludableClasses() override { return inner.GetExcludableClasses(); }
+        std::vector<std::string> GetClassNames() override { return inner.GetClassNames(); }
+        std::vector<std::string> GetRestrictions() override { return inner.GetRestrictions(); }
+        std::vector<std::string> GetRelations() override { return inner.GetRelations(); }
+        void ProcessTurn(osrm::extractor::ExtractionTurn& turn) override { inner.ProcessTurn(turn); }
+        void ProcessSegment(osrm::extractor::ExtractionSegment& segment) override { inner.ProcessSegment(segment); }
+        bool HasLocationDependentData() const override { return inner.HasLocationDependentData(); }
+
+        void ProcessElements(const osmium::memory::Buffer& buffer,
+                             const osrm::extractor::RestrictionParser& restriction_parser,
+                             const osrm::extractor::ManeuverOverrideRelationParser& maneuver_override_parser,
+                             const osrm::extractor::ExtractionRelationContainer& relations,
+                             std::vector<std::pair<const osmium::Node&, osrm::extractor::ExtractionNode>>& resulting_nodes,
+                             std::vector<std::pair<const osmium::Way&, osrm::extractor::ExtractionWay>>& resulting_ways,
+                             std::vector<osrm::extractor::InputTurnRestriction>& resulting_restrictions,
+                             std::vector<osrm::extractor::InputManeuverOverride>& resulting_maneuver_overrides) override {
+            if (inner.HasLocationDependentData()) {
+                inner.ProcessElements(buffer, restriction_parser, maneuver_override_parser, relations,
+                                      resulting_nodes, resulting_ways, resulting_restrictions, resulting_maneuver_overrides);
+                return;
+            }
+
+            auto& profile_memo = memos.local();
+
+            // Cached results are taken in buffer order; misses go to the profile in a smaller buffer
+            struct Entry {
+                const osmium::OSMObject* object;
+                std::string key;
+                bool hit;
+                bool cacheable;
+            };
+            std::vector<Entry> node_entries;
+            std::vector<Entry> way_entries;
+            std::vector<osrm::extractor::ExtractionNode> node_hits;
+            std::vector<osrm::extractor::ExtractionWay> way_hits;
+            osmium::memory::Buffer misses{buffer.committed(), osmium::memory::Buffer::auto_grow::yes};
+
+            for (auto item = buffer.begin<osmium::OSMEntity>(); item != buffer.end<osmium::OSMEntity>(); ++item) {
+                switch (item->type()) {
+                case osmium::item_type::node: {
+                    const auto& node = static_cast<const osmium::Node&>(*item);
+                    const bool in_relation = !relations.GetRelations(
+                        osrm::extractor::ExtractionRelation::OsmIDTyped(node.id(), osmium::item_type::node)).empty();
+                    std::string key = in_relation ? std::string() : tag_set_key(node.tags());
+                    const auto cached = in_relation ? profile_memo.nodes.end() : profile_memo.nodes.find(key);
+                    if (cached != profile_memo.nodes.end()) {
+                        node_hits.push_back(cached->second);
+                        node_entries.push_back({&node, std::move(key), true, true});
+                    } else {
+                        misses.add_item(node);
+                        misses.commit();
+                        node_entries.push_back({&node, std::move(key), false, !in_relation});
+                    }
+                    break;
+                }
+                case osmium::item_type::way: {
+                    const auto& way = static_cast<const osmium::Way&>(*item);
+                    const bool in_relation = !relations.GetRelations(
+                        osrm::extractor::ExtractionRelation::OsmIDTyped(way.id(), osmium::item_type::way)).empty();
+                    std::string key = in_relation ? std::string() : tag_set_key(way.tags());
+                    const auto cached = in_relation ? profile_memo.ways.end() : profile_memo.ways.find(key);
+                    if (cached != profile_memo.ways.end()) {
+                        way_hits.push_back(cached->second);
+                        way_entries.push_back({&way, std::move(key), true, true});
+                    } else {
+                        misses.add_item(way);
+                        misses.commit();
+                        way_entries.push_back({&way, std::move(key), false, !in_relation});
+                    }
+                    break;
+                }
+                case osmium::item_type::relation:
+                    misses.add_item(*item);
+                    misses.commit();
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            std::vector<std::pair<const osmium::Node&, osrm::extractor::ExtractionNode>> miss_nodes;
+            std::vector<std::pair<const osmium::Way&, osrm::extractor::ExtractionWay>> miss_ways;
+            inner.ProcessElements(misses, restriction_parser, maneuver_override_parser, relations,
+                                  miss_nodes, miss_ways, resulting_restrictions, resulting_maneuver_overrides);
+
+            const size_t node_misses = node_entries.size() - node_hits.size();
+            const size_t way_misses = way_entries.size() - way_hits.size();
+            if (miss_nodes.size() != node_misses || miss_ways.size() != way_misses) {
+                // The profile skipped or added objects, so results cannot be matched up
+                resulting_restrictions.clear();
+                resulting_maneuver_overrides.clear();
+                inner.ProcessElements(buffer, restriction_parser, maneuver_override_parser, relations,
+                                      resulting_nodes, resulting_ways, resulting_restrictions, resulting_maneuver_overrides);
+                return;
+            }
+
+            if (profile_memo.nodes.size() > MAX_PROFILE_MEMO_ENTRIES) {
+                profile_memo.nodes.clear();
+            }
+            if (profile_memo.ways.size() > MAX_PROFILE_MEMO_ENTRIES) {
+                profile_memo.ways.clear();
+            }
+
+            size_t next_hit = 0;
+            size_t next_miss = 0;
+            for (auto& entry : node_entries) {
+                const auto& node = static_cast<const osmium::Node&>(*entry.object);
+                if (entry.hit) {
+                    resulting_nodes.emplace_back(node, std::move(node_hits[next_hit++]));
+                } else {
+                    auto& result = miss_nodes[next_miss++].second;
+                    if (entry.cacheable) {
+                        profile_memo.nodes.emplace(std::move(entry.key), result);
+                    }
+                    resulting_nodes.emplace_back(node, std::move(result));
+                }
+            }
+
+            next_hit = 0;
+            next_miss = 0;
+            for (auto& entry : way_entries) {
+                const auto& way = static_cast<const osmium::Way&>(*entry.object);
+                if (entry.hit) {
+                    resulting_ways.emplace_back(way, std::move(way_hits[next_hit++]));
+                } else {
+                    auto& result = miss_ways[next_miss++].second;
+                    if (entry.cacheable) {
+                        profile_memo.ways.emplace(std::move(entry.key), result);
+                    }
+                    resulting_ways.emplace_back(way, std::move(result));
+                }
+            }
+
+            nodes += node_entries.size();
+            node_hits_total += node_hits.size();
+            ways += way_entries.size();
+            way_hits_total += way_hits.size();
+        }
+
+        osrm::extractor::ScriptingEnvironment& inner;
+        tbb::enumerable_thread_specific<ProfileMemo> memos;
+        std::atomic<uint64_t> nodes{0};
+        std::atomic<uint64_t> node_hits_total{0};
+        std::atomic<uint64_t> ways{0};
+        std::atomic<uint64_t> way_hits_total{0};
+    };
+
+    // Parses a sysfs cpu or node list such as "0-15,32-47"
+    std::vector<size_t> parse_sysfs_list(const std::string& list) {
+        std::vector<size_t> values;
+        size_t pos = 0;
+        while (pos < list.size()) {
+            size_t end = list.find(',', pos);
+            if (end == std::string::npos) {
+                end = list.size();
+            }
+            const std::string range = list.substr(pos, end - pos);
+            const size_t dash = range.find('-');
+            try {
+                const size_t first = std::stoul(range.substr(0, dash));
+                const size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+                for (size_t value = first; value <= last; ++value) {
+                    values.push_back(value);
+                }
+            } catch (const std::exception&) {
+                // Trailing newline or empty list
+            }
+            pos = end + 1;
+        }
+        return values;
+    }
+
+    std::string read_sysfs_line(const std::string& path) {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    // Locations snapped once and addressed by index afterwards. Tables and
+    // routes against the set reuse the hints instead of snapping again, and a
+    // precomputed set-to-set table is served from memory without any search.
+    struct LocationSet {
+        osrm::OSRM* osrm;
+        std::vector<osrm::util::Coordinate> coordinates;
+        std::vector<std::optional<osrm::engine::Hint>> hints;
+        // Row-major set-to-set durations and distances, -1 when unreachable, empty unless precomputed
+        std::vector<double> durations;
+        std::vector<double> distances;
+    };
+
+    // Runs a table and copies it row-major into the output buffers, -1 for unreachable cells
+    bool read_table(osrm::OSRM* osrm_ptr,
+                    const osrm::TableParameters& params,
+                    size_t num_sources,
+                    size_t num_destinations,
+                    double* durations,
+                    double* distances,
+                    std::string& error) {
+        osrm::json::Object result;
+        if (osrm_ptr->Table(params, result) != osrm::Status::Ok) {
+            try {
+                error = std::get<osrm::util::json::String>(result.values.at("message")).value;
+            } catch (const std::exception& e) {
+                error = "Unknown OSRM error";
+            }
+            return false;
+        }
+
+        try {
+            const auto& duration_rows = std::get<osrm::json::Array>(result.values.at("durations")).values;
+            const auto& distance_rows = std::get<osrm::json::Array>(result.values.at("distances")).values;
+            for (size_t s = 0; s < num_sources; ++s) {
+                const auto& duration_row = std::get<osrm::json::Array>(duration_rows.at(s)).values;
+                const auto& distance_row = std::get<osrm::json::Array>(distance_rows.at(s)).values;
+                for (size_t d = 0; d < num_destinations; ++d) {
+                    const auto& duration = duration_row.at(d);
+                    const auto& distance = distance_row.at(d);
+                    durations[s * num_destinations + d] = std::holds_alternative<osrm::json::Number>(duration)
+                        ? std::get<osrm::json::Number>(duration).value : -1.0;
+                    distances[s * num_destinations + d] = std::holds_alternative<osrm::json::Number>(distance)
+                        ? std::get<osrm::json::Number>(distance).value : -1.0;
+                }
+            }
+        } catch (const std::exception& e) {
+            error = std::string("Failed to read the table: ") + e.what();
+            return false;
+        }
+        return true;
+    }
+
+    // Validates location ids against a set, filling error when one is out of range
+    bool check_location_ids(const LocationSet& set, const size_t* ids, size_t count, std::string& error) {
+        for (size_t i = 0; i < count; ++i) {
+            if (ids[i] >= set.coordinates.size()) {
+                error = "Location id " + std::to_string(ids[i]) + " is not part of the location set";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Byte key of a request's parameters for coalescing. Coordinates are keyed at
+    // OSRM's fixed-point precision, so differences OSRM would round away still
+    // coalesce; every variable-length field is prefixed with its length.
+    class RequestKey {
+      public:
+        RequestKey(const void* instance, const char* service) {
+            value(instance);
+            text(service);
+        }
+
+        template <typename T>
+        void value(const T& v) {
+            bytes.append(reinterpret_cast<const char*>(&v), sizeof(T));
+        }
+
+        template <typename T>
+        void values(const T* data, size_t count) {
+            value(data ? count : size_t{0});
+            if (data) {
+                bytes.append(reinterpret_cast<const char*>(data), sizeof(T) * count);
+            }
+        }
+
+        void coordinates(const double* lon_lat, size_t count) {
+            value(count);
+            for (size_t i = 0; i < count * 2; ++i) {
+                value(static_cast<int32_t>(std::lround(lon_lat[i] * 1e6)));
+            }
+        }
+
+        void text(const char* str) {
+            const size_t length = str ? strlen(str) : std::numeric_limits<size_t>::max();
+            value(length);
+            if (str) {
+                bytes.append(str, length);
+            }
+        }
+
+        void texts(const char* const* strs, size_t count) {
+            value(strs ? count : size_t{0});
+            for (size_t i = 0; strs && i < count; ++i) {
+                text(strs[i]);
+            }
+        }
+
+        std::string bytes;
+    };
+
+    // A request being computed; concurrent identical requests wait for its result
+    struct InFlightRequest {
+        std::mutex mutex;
+        std::condition_variable finished;
+        bool done = false;
+        int code = 0;
+        std::string message;
+    };
+
+    struct CoalescingState {
+        std::atomic<uint64_t> computed{0};
+        std::atomic<uint64_t> coalesced{0};
+        std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<InFlightRequest>> in_flight;
+    };
+
+    // Instances with coalescing enabled. As with the slow-query log, the count
+    // lets requests skip the lock entirely while no instance coalesces.
+    std::shared_mutex coalescing_mutex;
+    std::unordered_map<const void*, std::shared_ptr<CoalescingState>> coalescing_states;
+    std::atomic<size_t> coalescing_count{0};
+
+    std::shared_ptr<CoalescingState> coalescing_state(const void* instance) {
+        if (coalescing_count.load(std::memory_order_relaxed) == 0) {
+            return nullptr;
+        }
+        std::shared_lock<std::shared_mutex> lock(coalescing_mutex);
+        const auto it = coalescing_states.find(instance);
+        return it == coalescing_states.end() ? nullptr : it->second;
+    }
+
+    // One JSON object per line in the request log format of src/request_log.rs.
+    // Every parameter the entry point received is written, as it was passed
+    // over the FFI (bearings as flat value/range pairs, -1 for none), so the
+    // load test parses a logged query back into the same request.
+    class JsonLine {
+      public:
+        explicit JsonLine(const char* service) {
+            text = "{";
+            key("service");
+            quote(service);
+        }
+
+        JsonLine& coordinates(const double* lon_lat, size_t count) {
+            key("coordinates");
+            text += '[';
+            for (size_t i = 0; i < count; ++i) {
+                char pair[64];
+                snprintf(pair, sizeof(pair), "%s[%.6f,%.6f]", i ? "," : "", lon_lat[i * 2], lon_lat[i * 2 + 1]);
+                text += pair;
+            }
+            text += ']';
+            return *this;
+        }
+
+        template <typename T>
+        JsonLine& numbers(const char* name, const T* values, size_t count) {
+            if (values && count > 0) {
+                key(name);
+                text += '[';
+                for (size_t i = 0; i < count; ++i) {
+                    if (i) {
+                        text += ',';
+                    }
+                    append_number(static_cast<double>(values[i]));
+                }
+                text += ']';
+            }
+            return *this;
+        }
+
+        JsonLine& number(const char* name, double value) {
+            key(name);
+            append_number(value);
+            return *this;
+        }
+
+        JsonLine& flag(const char* name, bool value) {
+            key(name);
+            text += value ? "true" : "false";
+            return *this;
+        }
+
+        JsonLine& string(const char* name, const char* value) {
+            if (value) {
+                key(name);
+                quote(value);
+            }
+            return *this;
+        }
+
+        JsonLine& strings(const char* name, const char* const* values, size_t count) {
+            if (values && count > 0) {
+                key(name);
+                text += '[';
+                for (size_t i = 0; i < count; ++i) {
+                    if (i) {
+                        text += ',';
+                    }
+                    if (values[i]) {
+                        quote(values[i]);
+                    } else {
+                        text += "null";
+                    }
+                }
+                text += ']';
+            }
+            return *this;
+        }
+
+        std::string finish() {
+            return text + "}";
+        }
+
+      private:
+        void key(const char* name) {
+            if (text.size() > 1) {
+                text += ',';
+            }
+            quote(name);
+            text += ':';
+        }
+
+        void quote(const char* value) {
+            text += '"';
+            for (const char* c = value; *c; ++c) {
+                if (*c == '"' || *c == '\\') {
+                    text += '\\';
+                    text += *c;
+                } else if (static_cast<unsigned char>(*c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+                    text += escaped;
+                } else {
+                    text += *c;
+                }
+            }
+            text += '"';
+        }
+
+        void append_number(double value) {
+            char number[32];
+            snprintf(number, sizeof(number), "%.15g", value);
+            text += number;
+        }
+
+        std::string text;
+    };
+
+    struct SlowQuery {
+        uint64_t sequence;
+        std::string line;
+    };
+
+    // Ring of the most recent slow queries. Writers claim a slot with one atomic
+    // increment and swap their entry in; draining swaps entries out, so every
+    // entry has exactly one owner and neither side ever blocks the other.
+    struct SlowQueryLog {
+        SlowQueryLog(double threshold_ms, size_t capacity)
+            : threshold_ms(threshold_ms), capacity(capacity), slots(new std::atomic<SlowQuery*>[capacity]) {
+            for (size_t i = 0; i < capacity; ++i) {
+                slots[i].store(nullptr);
+            }
+        }
+
+        ~SlowQueryLog() {
+            for (size_t i = 0; i < capacity; ++i) {
+                delete slots[i].load();
+            }
+        }
+
+        void record(std::string line) {
+            const uint64_t sequence = next++;
+            auto* entry = new SlowQuery{sequence, std::move(line)};
+            if (auto* overwritten = slots[sequence % capacity].exchange(entry, std::memory_order_acq_rel)) {
+                ++dropped;
+                delete overwritten;
+            }
+        }
+
+        // Takes every logged query out of the ring, oldest first
+        std::vector<std::unique_ptr<SlowQuery>> drain() {
+            std::vector<std::unique_ptr<SlowQuery>> entries;
+            for (size_t i = 0; i < capacity; ++i) {
+                if (auto* entry = slots[i].exchange(nullptr, std::memory_order_acq_rel)) {
+                    entries.emplace_back(entry);
+                }
+            }
+            std::sort(entries.begin(), entries.end(),
+                      [](const auto& a, const auto& b) { return a->sequence < b->sequence; });
+            return entries;
+        }
+
+        const double threshold_ms;
+        const size_t capacity;
+        std::unique_ptr<std::atomic<SlowQuery*>[]> slots;
+        std::atomic<uint64_t> next{0};
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    // Instances with a slow-query log. The count lets requests skip the lookup
+    // entirely while no instance has one. Once any instance has a log, every
+    // request of every instance takes the shared lock for the lookup; readers
+    // never wait for each other, but they all update the lock's one cache line,
+    // which shows on many-core servers at high request rates.
+    std::shared_mutex slow_query_mutex;
+    std::unordered_map<const void*, std::shared_ptr<SlowQueryLog>> slow_query_logs;
+    std::atomic<size_t> slow_query_log_count{0};
+
+    std::shared_ptr<SlowQueryLog> slow_query_log(const void* instance) {
+        if (slow_query_log_count.load(std::memory_order_relaxed) == 0) {
+            return nullptr;
+        }
+        std::shared_lock<std::shared_mutex> lock(slow_query_mutex);
+        const auto it = slow_query_logs.find(instance);
+        return it == slow_query_logs.end() ? nullptr : it->second;
+    }
+
+    void remove_slow_query_log(const void* instance) {
+        std::unique_lock<std::shared_mutex> lock(slow_query_mutex);
+        slow_query_log_count -= slow_query_logs.erase(instance);
+    }
+
+    // Start and end of the OSRM call inside a request; what comes before is
+    // parameter setup, what comes after is rendering
+    struct QueryPhases {
+        void query_started() {
+            if (enabled) {
+                query_start = std::chrono::steady_clock::now();
+            }
+        }
+
+        void query_finished() {
+            if (enabled) {
+                query_end = std::chrono::steady_clock::now();
+            }
+        }
+
+        bool enabled = false;
+        std::chrono::steady_clock::time_point query_start;
+        std::chrono::steady_clock::time_point query_end;
+    };
+
+    // Times a request from construction to destruction and logs it when it took
+    // longer than the instance's threshold. `parameters` returns the request as a
+    // JsonLine and only runs for requests that are logged.
+    template <typename Parameters>
+    class SlowQueryTimer : public QueryPhases {
+      public:
+        SlowQueryTimer(const void* instance, size_t num_coordinates, Parameters parameters)
+            : log(slow_query_log(instance)), num_coordinates(num_coordinates), parameters(std::move(parameters)) {
+            if (log) {
+                enabled = true;
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~SlowQueryTimer() {
+            if (!log) {
+                return;
+            }
+            const auto end = std::chrono::steady_clock::now();
+            const auto ms = [](auto from, auto to) {
+                return std::chrono::duration<double, std::milli>(to - from).count();
+            };
+            const double total_ms = ms(start, end);
+            if (total_ms < log->threshold_ms) {
+                return;
+            }
+
+            // Requests answered by another caller's coalesced query never ran one
+            const bool ran_query = query_end != std::chrono::steady_clock::time_point{};
+            try {
+                JsonLine line = parameters();
+                line.number("timestamp_ms", static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                std::chrono::system_clock::now().time_since_epoch()).count()))
+                    .number("num_coordinates", static_cast<double>(num_coordinates))
+                    .number("total_ms", total_ms)
+                    .number("setup_ms", ran_query ? ms(start, query_start) : 0.0)
+                    .number("query_ms", ran_query ? ms(query_start, query_end) : 0.0)
+                    .number("render_ms", ran_query ? ms(query_end, end) : 0.0);
+                log->record(line.finish());
+            } catch (...) {
+                // Logging must never fail the request it logs
+            }
+        }
+
+      private:
+        std::shared_ptr<SlowQueryLog> log;
+        size_t num_coordinates;
+        Parameters parameters;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // Sweep lanes per batch, one source each; eight int32 lanes fill a 256-bit register
+    constexpr size_t SWEEP_LANES = 8;
+    constexpr int32_t SWEEP_UNREACHED = std::numeric_limits<int32_t>::max() / 2;
+
+    struct SweepEdge {
+        uint32_t other;  // position of the edge's other end
+        int32_t weight;
+        int32_t duration;
+    };
+
+    // CH graph laid out for PHAST: positions order the edge-based nodes so that
+    // the upper end of every edge comes before its lower end. Upward edges drive
+    // the per-source searches, downward edges are pulled by their lower end in a
+    // single linear pass.
+    struct ChSweep {
+        osrm::OSRM* osrm;
+        size_t num_nodes = 0;
+        std::vector<uint32_t> node_at;      // position -> edge-based node
+        std::vector<uint32_t> position_of;  // edge-based node -> position
+        std::vector<size_t> up_offsets;
+        std::vector<SweepEdge> up_edges;
+        std::vector<size_t> down_offsets;
+        std::vector<SweepEdge> down_edges;
+    };
+
+    struct SweepSeed {
+        uint32_t position;
+        int32_t weight;
+        int32_t duration;
+    };
+
+    // Reads the contracted graph of the profile's weight. A metric holds one
+    // hierarchy per exclude combination, told apart by edge filters; filter 0 is
+    // the one without exclusions.
+    osrm::contractor::ContractedMetric read_ch_metric(const osrm::storage::StorageConfig& storage_config,
+                                                      std::string& weight_name,
+                                                      std::uint32_t& connectivity_checksum) {
+        osrm::extractor::ProfileProperties properties;
+        osrm::extractor::files::readProfileProperties(storage_config.GetPath(".osrm.properties"), properties);
+        weight_name = properties.GetWeightName();
+
+        // readGraph only reads the metrics already present in the map
+        std::unordered_map<std::string, osrm::contractor::ContractedMetric> metrics;
+        metrics[weight_name];
+        osrm::contractor::files::readGraph(storage_config.GetPath(".osrm.hsgr"), metrics, connectivity_checksum);
+        return std::move(metrics[weight_name]);
+    }
+
+    bool in_unfiltered_hierarchy(const osrm::contractor::ContractedMetric& metric, size_t edge) {
+        return metric.edge_filter.empty() || metric.edge_filter[0][edge];
+    }
+
+    // Reads a contracted graph and orders its unfiltered hierarchy top-down. OSRM
+    // stores each CH edge at its lower-ranked end, so the stored edges form a DAG
+    // pointing upwards and Kahn's algorithm over it yields a valid sweep order.
+    bool load_ch_sweep(const osrm::storage::StorageConfig& storage_config, ChSweep& sweep, std::string& error) {
+        std::string weight_name;
+        std::uint32_t connectivity_checksum = 0;
+        const auto metric = read_ch_metric(storage_config, weight_name, connectivity_checksum);
+        const auto& graph = metric.graph;
+        const size_t n = graph.GetNumberOfNodes();
+        if (n == 0) {
+            error = "No contracted graph for the " + weight_name + " weight";
+            return false;
+        }
+
+        // Upward edges left to place per node, and the lower ends of the edges into each node
+        std::vector<uint32_t> pending(n, 0);
+        std::vector<size_t> lower_offsets(n + 1, 0);
+        for (uint32_t v = 0; v < n; ++v) {
+            for (auto e = graph.BeginEdges(v); e < graph.EndEdges(v); ++e) {
+                const auto w = graph.GetTarget(e);
+                if (w != v && in_unfiltered_hierarchy(metric, e)) {
+                    ++pending[v];
+                    ++lower_offsets[w + 1];
+                }
+            }
+        }
+        std::partial_sum(lower_offsets.begin(), lower_offsets.end(), lower_offsets.begin());
+        std::vector<uint32_t> lower(lower_offsets.back());
+        std::vector<size_t> fill(lower_offsets.begin(), lower_offsets.end() - 1);
+        for (uint32_t v = 0; v < n; ++v) {
+            for (auto e = graph.BeginEdges(v); e < graph.EndEdges(v); ++e) {
+                const auto w = graph.GetTarget(e);
+                if (w != v && in_unfiltered_hierarchy(metric, e)) {
+                    lower[fill[w]++] = v;
+                }
+            }
+        }
+
+        sweep.node_at.clear();
+        sweep.node_at.reserve(n);
+        for (uint32_t v = 0; v < n; ++v) {
+            if (pending[v] == 0) {
+                sweep.node_at.push_back(v);
+            }
+        }
+        for (size_t head = 0; head < sweep.node_at.size(); ++head) {
+            const auto w = sweep.node_at[head];
+            for (size_t i = lower_offsets[w]; i < lower_offsets[w + 1]; ++i) {
+                if (--pending[lower[i]] == 0) {
+                    sweep.node_at.push_back(lower[i]);
+                }
+            }
+        }
+        if (sweep.node_at.size() != n) {
+            error = "The contracted graph is not a contraction hierarchy";
+            return false;
+        }
+
+        sweep.num_nodes = n;
+        sweep.position_of.assign(n, 0);
+        for (uint32_t p = 0; p < n; ++p) {
+            sweep.position_of[sweep.node_at[p]] = p;
+        }
+
+        sweep.up_offsets.assign(1, 0);
+        sweep.down_offsets.assign(1, 0);
+        for (uint32_t p = 0; p < n; ++p) {
+            const auto v = sweep.node_at[p];
+            for (auto e = graph.BeginEdges(v); e < graph.EndEdges(v); ++e) {
+                const auto w = graph.GetTarget(e);
+                if (w == v || !in_unfiltered_hierarchy(metric, e)) {
+                    continue;
+                }
+                const auto& data = graph.GetEdgeData(e);
+                const SweepEdge edge{sweep.position_of[w],
+                                     static_cast<int32_t>(data.weight),
+                                     static_cast<int32_t>(data.duration)};
+                if (data.forward) {
+                    sweep.up_edges.push_back(edge);
+                }
+                if (data.backward) {
+                    sweep.down_edges.push_back(edge);
+                }
+            }
+            sweep.up_offsets.push_back(sweep.up_edges.size());
+            sweep.down_offsets.push_back(sweep.down_edges.size());
+        }
+        return true;
+    }
+
+    // PHAST for up to SWEEP_LANES sources: a small upward Dijkstra per lane, then
+    // one pass over all positions in which every downward edge updates all lanes
+    // at once. Leaves weights and durations (deciseconds) per position and lane.
+    void run_ch_sweep(const ChSweep& sweep,
+                      const std::vector<std::vector<SweepSeed>>& lanes,
+                      std::vector<int32_t>& weights,
+                      std::vector<int32_t>& durations) {
+        const size_t n = sweep.num_nodes;
+        weights.assign(n * SWEEP_LANES, SWEEP_UNREACHED);
+        durations.assign(n * SWEEP_LANES, 0);
+
+        using QueueEntry = std::pair<int32_t, uint32_t>;
+        std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+        for (size_t lane = 0; lane < lanes.size(); ++lane) {
+            for (const auto& seed : lanes[lane]) {
+                const size_t cell = seed.position * SWEEP_LANES + lane;
+                if (seed.weight < weights[cell]) {
+                    weights[cell] = seed.weight;
+                    durations[cell] = seed.duration;
+                    queue.emplace(seed.weight, seed.position);
+                }
+            }
+            while (!queue.empty()) {
+                const auto [weight, position] = queue.top();
+                queue.pop();
+                if (weight > weights[position * SWEEP_LANES + lane]) {
+                    continue;
+                }
+                const int32_t duration = durations[position * SWEEP_LANES + lane];
+                for (size_t i = sweep.up_offsets[position]; i < sweep.up_offsets[position + 1]; ++i) {
+                    const auto& edge = sweep.up_edges[i];
+                    const size_t cell = edge.other * SWEEP_LANES + lane;
+                    if (weight + edge.weight < weights[cell]) {
+                        weights[cell] = weight + edge.weight;
+                        durations[cell] = duration + edge.duration;
+                        queue.emplace(weight + edge.weight, edge.other);
+                    }
+                }
+            }
+        }
+
+        // Every downward edge comes from an earlier position, whose lanes are final
+        for (size_t position = 0; position < n; ++position) {
+            int32_t* __restrict lane_weights = weights.data() + position * SWEEP_LANES;
+            int32_t* __restrict lane_durations = durations.data() + position * SWEEP_LANES;
+            for (size_t i = sweep.down_offsets[position]; i < sweep.down_offsets[position + 1]; ++i) {
+                const auto& edge = sweep.down_edges[i];
+                const int32_t* __restrict from_weights = weights.data() + edge.other * SWEEP_LANES;
+                const int32_t* __restrict from_durations = durations.data() + edge.other * SWEEP_LANES;
+                for (size_t lane = 0; lane < SWEEP_LANES; ++lane) {
+                    const int32_t candidate = from_weights[lane] + edge.weight;
+                    const bool better = candidate < lane_weights[lane];
+                    lane_weights[lane] = better ? candidate : lane_weights[lane];
+                    lane_durations[lane] = better ? from_durations[lane] + edge.duration : lane_durations[lane];
+                }
+            }
+        }
+    }
+
+    // Snaps coordinates to the sweep's graph: all candidate phantom nodes of each
+    bool snap_for_sweep(const ChSweep& sweep,
+                        const double* coordinates,
+                        size_t n,
+                        std::vector<std::vector<osrm::engine::PhantomNode>>& phantoms,
+                        std::string& error) {
+        const auto hints = snap_once(sweep.osrm, coordinates, n);
+        phantoms.assign(n, {});
+        for (size_t i = 0; i < n; ++i) {
+            if (!hints[i] || hints[i]->segment_hints.empty()) {
+                error = "Could not snap coordinate " + std::to_string(i);
+                return false;
+            }
+            for (const auto& segment : hints[i]->segment_hints) {
+                const auto& phantom = segment.phantom;
+                if ((phantom.forward_segment_id.enabled && phantom.forward_segment_id.id >= sweep.num_nodes) ||
+                    (phantom.reverse_segment_id.enabled && phantom.reverse_segment_id.id >= sweep.num_nodes)) {
+                    error = "The contracted graph does not match the engine's dataset";
+                    return false;
+                }
+                phantoms[i].push_back(phantom);
+            }
+        }
+        return true;
+    }
+
+    std::vector<SweepSeed> sweep_seeds(const ChSweep& sweep, const std::vector<osrm::engine::PhantomNode>& phantoms) {
+        std::vector<SweepSeed> seeds;
+        for (const auto& phantom : phantoms) {
+            if (phantom.IsValidForwardSource()) {
+                seeds.push_back({sweep.position_of[phantom.forward_segment_id.id],
+                                 -static_cast<int32_t>(phantom.GetForwardWeightPlusOffset()),
+                                 -static_cast<int32_t>(phantom.GetForwardDuration())});
+            }
+            if (phantom.IsValidReverseSource()) {
+                seeds.push_back({sweep.position_of[phantom.reverse_segment_id.id],
+                                 -static_cast<int32_t>(phantom.GetReverseWeightPlusOffset()),
+                                 -static_cast<int32_t>(phantom.GetReverseDuration())});
+            }
+        }
+        return seeds;
+    }
+
+    // Duration in seconds from a lane's source to the best of a target's phantom
+    // nodes, -1 when unreachable. A target behind the source on the source's own
+    // segment comes out negative; reaching it needs a loop the sweep does not
+    // track, so such candidates are skipped.
+    double sweep_target_duration(const ChSweep& sweep,
+                                 const std::vector<int32_t>& weights,
+                                 const std::vector<int32_t>& durations,
+                                 size_t lane,
+                                 const std::vector<osrm::engine::PhantomNode>& phantoms) {
+        int32_t best_weight = SWEEP_UNREACHED;
+        int32_t best_duration = 0;
+        const auto consider = [&](uint32_t node, int32_t weight, int32_t duration) {
+            const size_t cell = sweep.position_of[node] * SWEEP_LANES + lane;
+            if (weights[cell] >= SWEEP_UNREACHED) {
+                return;
+            }
+            const int32_t total = weights[cell] + weight;
+            if (total >= 0 && total < best_weight) {
+                best_weight = total;
+                best_duration = durations[cell] + duration;
+            }
+        };
+        for (const auto& phantom : phantoms) {
+            if (phantom.IsValidForwardTarget()) {
+                consider(phantom.forward_segment_id.id,
+                         static_cast<int32_t>(phantom.GetForwardWeightPlusOffset()),
+                         static_cast<int32_t>(phantom.GetForwardDuration()));
+            }
+            if (phantom.IsValidReverseTarget()) {
+                consider(phantom.reverse_segment_id.id,
+                         static_cast<int32_t>(phantom.GetReverseWeightPlusOffset()),
+                         static_cast<int32_t>(phantom.GetReverseDuration()));
+            }
+        }
+        return best_weight < SWEEP_UNREACHED ? std::max(0, best_duration) / 10.0 : -1.0;
+    }
+
+    // Workers a sweep starts when no thread count is given: one per core, but
+    // their buffers (2 * SWEEP_LANES int32 per node each) stay within half of
+    // the physical memory that is currently free
+    size_t default_sweep_workers(size_t num_nodes) {
+#ifdef _SC_AVPHYS_PAGES
+        const long pages = sysconf(_SC_AVPHYS_PAGES);
+#else
+        const long pages = sysconf(_SC_PHYS_PAGES);
+#endif
+        const long page_size = sysconf(_SC_PAGESIZE);
+        const size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+        if (pages <= 0 || page_size <= 0 || num_nodes == 0) {
+            return cores;
+        }
+        const size_t budget = static_cast<size_t>(pages) * static_cast<size_t>(page_size) / 2;
+        const size_t per_worker = num_nodes * 2 * SWEEP_LANES * sizeof(int32_t);
+        return std::clamp<size_t>(budget / per_worker, 1, cores);
+    }
+
+    // Sweeps all sources in batches of SWEEP_LANES on up to `threads` workers and
+    // hands each finished batch (index of its first source, weights, durations) to `read`
+    bool run_ch_sweep_batches(const ChSweep& sweep,
+                              const std::vector<std::vector<SweepSeed>>& sources,
+                              int threads,
+                              const std::function<void(size_t, const std::vector<int32_t>&, const std::vector<int32_t>&)>& read,
+                              std::string& error) {
+        const size_t num_batches = (sources.size() + SWEEP_LANES - 1) / SWEEP_LANES;
+        const size_t num_workers = std::max<size_t>(1, std::min<size_t>(
+            threads > 0 ? static_cast<size_t>(threads) : default_sweep_workers(sweep.num_nodes), num_batches));
+
+        std::atomic<size_t> next_batch{0};
+        std::mutex error_mutex;
+
+        auto worker = [&] {
+            // Two int32 per lane and graph node, so each worker holds 64 bytes per node
+            std::vector<int32_t> weights;
+            std::vector<int32_t> durations;
+            try {
+                for (size_t b = next_batch++; b < num_batches; b = next_batch++) {
+                    const size_t begin = b * SWEEP_LANES;
+                    const size_t end = std::min(sources.size(), begin + SWEEP_LANES);
+                    const std::vector<std::vector<SweepSeed>> lanes(sources.begin() + begin, sources.begin() + end);
+                    run_ch_sweep(sweep, lanes, weights, durations);
+                    read(begin, weights, durations);
+                }
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (error.empty()) {
+                    error = e.what();
+                }
+                next_batch = num_batches;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < num_workers; ++i) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : workers) {
+            thread.join();
+        }
+        return error.empty();
+    }
+
+    // Weights of a CH graph are kept within int32; anything at or above this is
+    // an unusable edge, e.g. a road closed by a speed update
+    constexpr int32_t REPAIR_INFINITY = std::numeric_limits<int32_t>::max() / 2;
+    // Settled nodes after which a witness search gives up and keeps the shortcut
+    constexpr size_t WITNESS_SETTLE_LIMIT = 2000;
+    constexpr size_t REPAIR_MAX_PASSES = 16;
+
+    // A directed CH edge stored at its lower-ranked end
+    struct RepairEdge {
+        uint32_t target;  // the higher end
+        bool up;          // travels lower -> higher; otherwise higher -> lower
+        bool shortcut;
+        uint32_t turn_id; // turn of an original edge, middle node of a shortcut
+        int32_t weight;
+        int32_t duration;
+        float distance;
+        int32_t previous_weight;  // weight before this pass, to find what changed
+    };
+
+    // Updated original edge-based edge, sorted by (from, to)
+    struct OriginalEdge {
+        uint32_t from;
+        uint32_t to;
+        uint32_t turn_id;
+        int32_t weight;
+        int32_t duration;
+        float distance;
+    };
+
+    struct MissingShortcut {
+        uint32_t lower;
+        uint32_t target;
+        bool up;
+        uint32_t middle;
+        int32_t weight;
+        int32_t duration;
+        float distance;
+    };
+
+    // One hierarchy of a CH metric in CSR form by lower end, edges of a node
+    // sorted by (target, up). `rank` is a contraction order consistent with the
+    // edges; it stays fixed while shortcuts are repaired.
+    struct RepairGraph {
+        size_t num_nodes = 0;
+        std::vector<size_t> offsets;
+        std::vector<RepairEdge> edges;
+        std::vector<uint32_t> rank;
+        // Edges into each node from lower nodes, as (lower node, edge index)
+        std::vector<size_t> in_offsets;
+        std::vector<std::pair<uint32_t, size_t>> in_edges;
+    };
+
+    const OriginalEdge* find_original(const std::vector<OriginalEdge>& originals, uint32_t from, uint32_t to) {
+        const auto it = std::lower_bound(originals.begin(), originals.end(), std::make_pair(from, to),
+                                         [](const OriginalEdge& e, const std::pair<uint32_t, uint32_t>& key) {
+                                             return std::tie(e.from, e.to) < std::tie(key.first, key.second);
+                                         });
+        return it != originals.end() && it->from == from && it->to == to ? &*it : nullptr;
+    }
+
+    RepairEdge* find_repair_edge(RepairGraph& graph, uint32_t lower, uint32_t target, bool up) {
+        const auto begin = graph.edges.begin() + graph.offsets[lower];
+        const auto end = graph.edges.begin() + graph.offsets[lower + 1];
+        const auto it = std::lower_bound(begin, end, std::make_pair(target, up),
+                                         [](const RepairEdge& e, const std::pair<uint32_t, bool>& key) {
+                                             return std::tie(e.target, e.up) < std::tie(key.first, key.second);
+                                         });
+        return it != end && it->target == target && it->up == up ? &*it : nullptr;
+    }
+
+    // Rebuilds the CSR after edges were added, in `edges_by_node` order
+    void index_repair_graph(RepairGraph& graph, std::vector<std::vector<RepairEdge>>& edges_by_node) {
+        graph.offsets.assign(1, 0);
+        graph.edges.clear();
+        for (auto& node_edges : edges_by_node) {
+            std::sort(node_edges.begin(), node_edges.end(), [](const RepairEdge& a, const RepairEdge& b) {
+                return std::tie(a.target, a.up) < std::tie(b.target, b.up);
+            });
+            graph.edges.insert(graph.edges.end(), node_edges.begin(), node_edges.end());
+            graph.offsets.push_back(graph.edges.size());
+        }
+
+        graph.in_offsets.assign(graph.num_nodes + 1, 0);
+        for (const auto& edge : graph.edges) {
+            ++graph.in_offsets[edge.target + 1];
+        }
+        std::partial_sum(graph.in_offsets.begin(), graph.in_offsets.end(), graph.in_offsets.begin());
+        graph.in_edges.resize(graph.edges.size());
+        std::vector<size_t> fill(graph.in_offsets.begin(), graph.in_offsets.end() - 1);
+        for (uint32_t v = 0; v < graph.num_nodes; ++v) {
+            for (size_t i = graph.offsets[v]; i < graph.offsets[v + 1]; ++i) {
+                graph.in_edges[fill[graph.edges[i].target]++] = {v, i};
+            }
+        }
+    }
+
+    // Splits the edges of one exclude hierarchy into directed edges and ranks its nodes
+    bool load_repair_graph(const osrm::contractor::ContractedMetric& metric,
+                           size_t filter,
+                           RepairGraph& graph,
+                           std::string& error) {
+        const auto& query_graph = metric.graph;
+        graph.num_nodes = query_graph.GetNumberOfNodes();
+
+        std::vector<std::vector<RepairEdge>> edges_by_node(graph.num_nodes);
+        for (uint32_t v = 0; v < graph.num_nodes; ++v) {
+            for (auto e = query_graph.BeginEdges(v); e < query_graph.EndEdges(v); ++e) {
+                if (!metric.edge_filter.empty() && !metric.edge_filter[filter][e]) {
+                    continue;
+                }
+                const auto w = query_graph.GetTarget(e);
+                const auto& data = query_graph.GetEdgeData(e);
+                RepairEdge edge{w, true, static_cast<bool>(data.shortcut), static_cast<uint32_t>(data.turn_id),
+                                static_cast<int32_t>(data.weight), static_cast<int32_t>(data.duration),
+                                static_cast<float>(data.distance), static_cast<int32_t>(data.weight)};
+                // Loops only need one direction
+                if (data.forward || (w == v && data.backward)) {
+                    edges_by_node[v].push_back(edge);
+                }
+                if (data.backward && w != v) {
+                    edge.up = false;
+                    edges_by_node[v].push_back(edge);
+                }
+            }
+        }
+
+        // The contractor keeps a shortcut next to an original edge between the
+        // same nodes; only the better of the two can be on a shortest path
+        for (auto& node_edges : edges_by_node) {
+            std::sort(node_edges.begin(), node_edges.end(), [](const RepairEdge& a, const RepairEdge& b) {
+                return std::tie(a.target, a.up, a.weight) < std::tie(b.target, b.up, b.weight);
+            });
+            node_edges.erase(std::unique(node_edges.begin(), node_edges.end(),
+                                         [](const RepairEdge& a, const RepairEdge& b) {
+                                             return a.target == b.target && a.up == b.up;
+                                         }),
+                             node_edges.end());
+        }
+        std::vector<uint32_t> lower_neighbours(graph.num_nodes, 0);
+        for (uint32_t v = 0; v < graph.num_nodes; ++v) {
+            for (const auto& edge : edges_by_node[v]) {
+                lower_neighbours[edge.target] += edge.target != v;
+            }
+        }
+
+        // Kahn's algorithm bottom-up: a node is ranked once all lower neighbours are
+        graph.rank.assign(graph.num_nodes, 0);
+        std::vector<uint32_t> order;
+        order.reserve(graph.num_nodes);
+        for (uint32_t v = 0; v < graph.num_nodes; ++v) {
+            if (lower_neighbours[v] == 0) {
+                order.push_back(v);
+            }
+        }
+        for (size_t head = 0; head < order.size(); ++head) {
+            const auto v = order[head];
+            graph.rank[v] = static_cast<uint32_t>(head);
+            for (const auto& edge : edges_by_node[v]) {
+                if (edge.target != v && --lower_neighbours[edge.target] == 0) {
+                    order.push_back(edge.target);
+                }
+            }
+        }
+        if (order.size() != graph.num_nodes) {
+            error = "The contracted graph is not a contraction hierarchy";
+            return false;
+        }
+
+        index_repair_graph(graph, edges_by_node);
+        return true;
+    }
+
+    // Looks for a path from `from` to `to` of at most `limit` over nodes ranked
+    // above `via_rank`, i.e. the graph that remained when the middle node was contracted
+    bool has_witness(const RepairGraph& graph, uint32_t from, uint32_t to, uint32_t via_rank, int32_t limit) {
+        using QueueEntry = std::pair<int32_t, uint32_t>;
+        std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+        std::unordered_map<uint32_t, int32_t> distances;
+        distances[from] = 0;
+        queue.emplace(0, from);
+
+        size_t settled = 0;
+        while (!queue.empty()) {
+            const auto [distance, node] = queue.top();
+            queue.pop();
+            if (distance > distances[node]) {
+                continue;
+            }
+            if (node == to) {
+                return true;
+            }
+            if (++settled > WITNESS_SETTLE_LIMIT) {
+                return false;
+            }
+
+            const auto relax = [&](uint32_t next, int32_t weight) {
+                if (graph.rank[next] <= via_rank || weight >= REPAIR_INFINITY) {
+                    return;
+                }
+                const int32_t candidate = distance + weight;
+                if (candidate > limit) {
+                    return;
+                }
+                const auto it = distances.find(next);
+                if (it == distances.end() || candidate < it->second) {
+                    distances[next] = candidate;
+                    queue.emplace(candidate, next);
+                }
+            };
+            for (size_t i = graph.offsets[node]; i < graph.offsets[node + 1]; ++i) {
+                const auto& edge = graph.edges[i];
+                if (edge.up && edge.target != node) {
+                    relax(edge.target, edge.weight);
+                }
+            }
+            for (size_t i = graph.in_offsets[node]; i < graph.in_offsets[node + 1]; ++i) {
+                const auto& [lower, index] = graph.in_edges[i];
+                const auto& edge = graph.edges[index];
+                if (!edge.up && lower != node) {
+                    relax(lower, edge.weight);
+                }
+            }
+        }
+        return false;
+    }
+
+    // Runs `work(item)` for every item on up to `threads` workers. The first
+    // exception stops the remaining items and is rethrown on the calling thread
+    template <typename Work>
+    void parallel_for(size_t count, int threads, const Work& work) {
+        const size_t num_workers = std::max<size_t>(1, std::min<size_t>(
+            threads > 0 ? static_cast<size_t>(threads) : std::thread::hardware_concurrency(), count / 64 + 1));
+        std::atomic<size_t> next{0};
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        auto worker = [&] {
+            try {
+                for (size_t i = next++; i < count; i = next++) {
+                    work(i);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = count;
+            }
+        };
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < num_workers; ++i) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : workers) {
+            thread.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    struct RepairCounts {
+        size_t edges_changed = 0;
+        size_t shortcuts_added = 0;
+        size_t edges_removed = 0;
+        size_t nodes_checked = 0;
+        size_t passes = 0;
+    };
+
+    // Re-contracts one hierarchy in its existing node order. Every pass recomputes
+    // all edge weights from the updated original edges bottom-up, each edge as
+    // the best of its original edge and its triangles through lower nodes; nodes
+    // of one level only write edges of higher nodes, so a level runs in parallel.
+    // Where a triangle has no edge to relax, the original contraction found a
+    // witness path. Those are searched again only at nodes whose edges changed,
+    // or at every node with `check_all_nodes`, and a shortcut is added where the
+    // witness is gone. Passes repeat until no shortcut is added; a hierarchy
+    // that still misses shortcuts after REPAIR_MAX_PASSES is an error.
+    bool repair_hierarchy(RepairGraph& graph,
+                          const std::vector<OriginalEdge>& originals,
+                          const std::vector<int32_t>& node_weights,
+                          bool check_all_nodes,
+                          int threads,
+                          RepairCounts& counts,
+                          std::string& error) {
+        const size_t n = graph.num_nodes;
+        std::vector<std::mutex> locks(4096);
+        bool first_pass = true;
+
+        for (size_t pass = 0; pass < REPAIR_MAX_PASSES; ++pass) {
+            ++counts.passes;
+
+            // Start every edge from its original edge, if the graph has one
+            for (uint32_t v = 0; v < n; ++v) {
+                for (size_t i = graph.offsets[v]; i < graph.offsets[v + 1]; ++i) {
+                    auto& edge = graph.edges[i];
+                    const auto* original = edge.target == v ? nullptr
+                        : edge.up ? find_original(originals, v, edge.target)
+                                  : find_original(originals, edge.target, v);
+                    // Original edges of the file whose weight the update changed
+                    if (first_pass && !edge.shortcut && edge.target != v) {
+                        counts.edges_changed += !original || original->weight != edge.previous_weight ||
+                                                original->duration != edge.duration;
+                    }
+                    if (original && original->weight < REPAIR_INFINITY) {
+                        edge.shortcut = false;
+                        edge.turn_id = original->turn_id;
+                        edge.weight = std::max(original->weight, 1);
+                        edge.duration = original->duration;
+                        edge.distance = original->distance;
+                    } else {
+                        edge.weight = REPAIR_INFINITY;
+                    }
+                }
+            }
+
+            // Levels: a node comes after all of its lower neighbours
+            std::vector<uint32_t> by_rank(n);
+            for (uint32_t v = 0; v < n; ++v) {
+                by_rank[graph.rank[v]] = v;
+            }
+            std::vector<uint32_t> level(n, 0);
+            uint32_t num_levels = 0;
+            for (const auto v : by_rank) {
+                num_levels = std::max(num_levels, level[v] + 1);
+                for (size_t i = graph.offsets[v]; i < graph.offsets[v + 1]; ++i) {
+                    if (graph.edges[i].target != v) {
+                        level[graph.edges[i].target] = std::max(level[graph.edges[i].target], level[v] + 1);
+                    }
+                }
+            }
+            std::vector<std::vector<uint32_t>> levels(num_levels);
+            for (uint32_t v = 0; v < n; ++v) {
+                levels[level[v]].push_back(v);
+            }
+
+            std::mutex missing_mutex;
+            std::vector<MissingShortcut> missing;
+            std::atomic<size_t> nodes_checked{0};
+
+            for (const auto& nodes : levels) {
+                parallel_for(nodes.size(), threads, [&](size_t index) {
+                    const uint32_t v = nodes[index];
+                    const size_t begin = graph.offsets[v];
+                    const size_t end = graph.offsets[v + 1];
+
+                    // All lower nodes are done, so the edges of v are final
+                    bool changed = check_all_nodes;
+                    for (size_t i = begin; i < end && !changed; ++i) {
+                        changed = graph.edges[i].weight != graph.edges[i].previous_weight;
+                    }
+                    if (changed) {
+                        ++nodes_checked;
+                    }
+
+                    std::vector<MissingShortcut> node_missing;
+                    for (size_t i = begin; i < end; ++i) {
+                        const auto& in = graph.edges[i];
+                        if (in.up || in.target == v || in.weight >= REPAIR_INFINITY) {
+                            continue;
+                        }
+                        for (size_t j = begin; j < end; ++j) {
+                            const auto& out = graph.edges[j];
+                            if (!out.up || out.target == v || out.weight >= REPAIR_INFINITY) {
+                                continue;
+                            }
+                            const uint32_t a = in.target;
+                            const uint32_t b = out.target;
+                            const int64_t weight = static_cast<int64_t>(in.weight) + out.weight;
+                            if (weight >= REPAIR_INFINITY) {
+                                continue;
+                            }
+
+                            const uint32_t lower = (a == b || graph.rank[a] < graph.rank[b]) ? a : b;
+                            const uint32_t target = lower == a ? b : a;
+                            const bool up = lower == a;
+                            const MissingShortcut shortcut{lower, target, up, v, static_cast<int32_t>(weight),
+                                                           in.duration + out.duration, in.distance + out.distance};
+
+                            if (auto* edge = find_repair_edge(graph, lower, target, a == b || up)) {
+                                std::lock_guard<std::mutex> lock(locks[lower % locks.size()]);
+                                if (shortcut.weight < edge->weight) {
+                                    edge->shortcut = true;
+                                    edge->turn_id = v;
+                                    edge->weight = shortcut.weight;
+                                    edge->duration = shortcut.duration;
+                                    edge->distance = shortcut.distance;
+                                }
+                            } else if (a == b) {
+                                // A U-turn loop, needed where it beats the node's own weight
+                                if (changed && shortcut.weight < node_weights[a]) {
+                                    node_missing.push_back(shortcut);
+                                }
+                            } else if (changed) {
+                                node_missing.push_back(shortcut);
+                            }
+                        }
+                    }
+                    if (!node_missing.empty()) {
+                        std::lock_guard<std::mutex> lock(missing_mutex);
+                        missing.insert(missing.end(), node_missing.begin(), node_missing.end());
+                    }
+                });
+            }
+            counts.nodes_checked += nodes_checked;
+
+            // Witness searches read edges of higher nodes, so they wait until every
+            // level is done; loops need none
+            std::vector<char> needed(missing.size(), 1);
+            parallel_for(missing.size(), threads, [&](size_t i) {
+                const auto& shortcut = missing[i];
+                if (shortcut.lower != shortcut.target) {
+                    const uint32_t from = shortcut.up ? shortcut.lower : shortcut.target;
+                    const uint32_t to = shortcut.up ? shortcut.target : shortcut.lower;
+                    needed[i] = !has_witness(graph, from, to, graph.rank[shortcut.middle], shortcut.weight);
+                }
+            });
+            size_t kept = 0;
+            for (size_t i = 0; i < missing.size(); ++i) {
+                if (needed[i]) {
+                    missing[kept++] = missing[i];
+                }
+            }
+            missing.resize(kept);
+
+            first_pass = false;
+            for (auto& edge : graph.edges) {
+                edge.previous_weight = edge.weight;
+            }
+            if (missing.empty()) {
+                for (const auto& edge : graph.edges) {
+                    counts.edges_removed += edge.weight >= REPAIR_INFINITY;
+                }
+                return true;
+            }
+            if (pass + 1 == REPAIR_MAX_PASSES) {
+                error = "The contracted graph still missed " + std::to_string(missing.size()) +
+                        " shortcuts after " + std::to_string(REPAIR_MAX_PASSES) +
+                        " repair passes, run a full contraction instead";
+                return false;
+            }
+
+            // Several middle nodes can ask for the same shortcut; keep the best
+            std::sort(missing.begin(), missing.end(), [](const MissingShortcut& a, const MissingShortcut& b) {
+                return std::tie(a.lower, a.target, a.up, a.weight) < std::tie(b.lower, b.target, b.up, b.weight);
+            });
+            std::vector<std::vector<RepairEdge>> edges_by_node(n);
+            for (uint32_t v = 0; v < n; ++v) {
+                edges_by_node[v].assign(graph.edges.begin() + graph.offsets[v], graph.edges.begin() + graph.offsets[v + 1]);
+            }
+            for (size_t i = 0; i < missing.size(); ++i) {
+                const auto& shortcut = missing[i];
+                if (i > 0 && missing[i - 1].lower == shortcut.lower && missing[i - 1].target == shortcut.target &&
+                    missing[i - 1].up == shortcut.up) {
+                    continue;
+                }
+                // New edges never match previous_weight, so their lower end is checked next pass
+                edges_by_node[shortcut.lower].push_back({shortcut.target, shortcut.up || shortcut.lower == shortcut.target,
+                                                         true, shortcut.middle, shortcut.weight, shortcut.duration,
+                                                         shortcut.distance, REPAIR_INFINITY});
+                ++counts.shortcuts_added;
+            }
+            index_repair_graph(graph, edges_by_node);
+        }
+        return false;
+    }
+
+    // Merges the repaired hierarchies back into one graph with edge filters:
+    // edges equal in every hierarchy are stored once, and the two directions of
+    // an edge share one entry where their data is equal
+    osrm::contractor::ContractedMetric merge_repaired_hierarchies(const std::vector<RepairGraph>& hierarchies,
+                                                                  size_t num_nodes,
+                                                                  bool filtered) {
+        struct MergedEdge {
+            uint32_t source;
+            uint32_t target;
+            bool shortcut;
+            uint32_t turn_id;
+            int32_t weight;
+            int32_t duration;
+            float distance;
+            bool up;
+            uint32_t filters;
+
+            auto key() const { return std::tie(source, target, shortcut, turn_id, weight, duration, distance); }
+        };
+
+        std::vector<MergedEdge> edges;
+        for (size_t f = 0; f < hierarchies.size(); ++f) {
+            const auto& graph = hierarchies[f];
+            for (uint32_t v = 0; v < graph.num_nodes; ++v) {
+                for (size_t i = graph.offsets[v]; i < graph.offsets[v + 1]; ++i) {
+                    const auto& edge = graph.edges[i];
+                    if (edge.weight < REPAIR_INFINITY) {
+                        edges.push_back({v, edge.target, edge.shortcut, edge.turn_id, edge.weight, edge.duration,
+                                         edge.distance, edge.up, 1u << f});
+                    }
+                }
+            }
+        }
+
+        // Same edge in several hierarchies
+        std::sort(edges.begin(), edges.end(), [](const MergedEdge& a, const MergedEdge& b) {
+            return std::make_tuple(a.key(), a.up) < std::make_tuple(b.key(), b.up);
+        });
+        size_t kept = 0;
+        for (size_t i = 0; i < edges.size(); ++i) {
+            if (kept > 0 && edges[kept - 1].key() == edges[i].key() && edges[kept - 1].up == edges[i].up) {
+                edges[kept - 1].filters |= edges[i].filters;
+            } else {
+                edges[kept++] = edges[i];
+            }
+        }
+        edges.resize(kept);
+
+        std::vector<osrm::contractor::QueryEdge> query_edges;
+        std::vector<uint32_t> query_filters;
+        for (size_t i = 0; i < edges.size(); ++i) {
+            const auto& edge = edges[i];
+            const bool loop = edge.source == edge.target;
+            bool forward = edge.up || loop;
+            bool backward = !edge.up || loop;
+            // Sorted with up after down, so a matching pair is adjacent
+            if (!loop && !edge.up && i + 1 < edges.size() && edges[i + 1].key() == edge.key() &&
+                edges[i + 1].up && edges[i + 1].filters == edge.filters) {
+                forward = true;
+                ++i;
+            }
+
+            osrm::contractor::QueryEdge query_edge;
+            query_edge.source = edge.source;
+            query_edge.target = edge.target;
+            query_edge.data.turn_id = edge.turn_id;
+            query_edge.data.shortcut = edge.shortcut;
+            query_edge.data.weight = static_cast<decltype(query_edge.data.weight)>(edge.weight);
+            query_edge.data.duration = static_cast<decltype(query_edge.data.duration)>(edge.duration);
+            query_edge.data.distance = static_cast<decltype(query_edge.data.distance)>(edge.distance);
+            query_edge.data.forward = forward;
+            query_edge.data.backward = backward;
+            query_edges.push_back(query_edge);
+            query_filters.push_back(edge.filters);
+        }
+
+        // The static graph wants its edges grouped by source
+        std::vector<size_t> order(query_edges.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return std::tie(query_edges[a].source, query_edges[a].target) <
+                   std::tie(query_edges[b].source, query_edges[b].target);
+        });
+        std::vector<osrm::contractor::QueryEdge> sorted_edges;
+        sorted_edges.reserve(order.size());
+        for (const auto i : order) {
+            sorted_edges.push_back(query_edges[i]);
+        }
+
+        osrm::contractor::ContractedMetric metric;
+        metric.graph = osrm::contractor::QueryGraph(static_cast<uint32_t>(num_nodes), sorted_edges);
+        if (filtered) {
+            metric.edge_filter.resize(hierarchies.size());
+            for (size_t f = 0; f < hierarchies.size(); ++f) {
+                metric.edge_filter[f].resize(sorted_edges.size());
+                for (size_t e = 0; e < order.size(); ++e) {
+                    metric.edge_filter[f][e] = (query_filters[order[e]] >> f) & 1;
+                }
+            }
+        }
+        return metric;
+    }
+
+    template <typename T>
+    T* copy_array(const std::vector<T>& values) {
+        if (values.empty()) {
+            return nullptr;
+        }
+        T* array = new T[values.size()];
+        std::copy(values.begin(), values.end(), array);
+        return array;
+    }
+
+}
+
+#ifdef OSRM_BINDING_ALLOC_STATS
+// Counting replacements of the global allocation functions, built with the
+// `alloc-stats` feature so benchmarks can report allocations per request
+namespace {
+    thread_local uint64_t thread_allocations = 0;
+}
+
+void* operator new(size_t size) {
+    ++thread_allocations;
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+#endif
+
+extern "C" {
+
+    struct OSRM_Result {
+        int code;
+        char* message;
+    };
+
+    struct OSRM_Config {
+        const char* algorithm;
+        bool shared_memory;
+        const char* dataset_name;
+        bool mmap_memory;
+        const char* path;
+        int disable_feature_dataset_flags; // Bitfield: 1=ROUTE_STEPS, 2=ROUTE_GEOMETRY
+        int max_locations_trip;
+        int max_locations_viaroute;
+        int max_locations_distance_table;
+        int max_locations_map_matching;
+        double max_radius_map_matching;
+        int max_results_nearest;
+        int max_alternatives;
+        double default_radius;
+    };
+
+    // Plain-number route totals filled by osrm_route_summary.
+    // Leg arrays are only allocated when legs are requested.
+    struct OSRM_RouteSummary {
+        double duration;
+        double distance;
+        double weight;
+        size_t num_legs;
+        double* leg_durations;
+        double* leg_distances;
+    };
+
+    void osrm_free_route_summary(OSRM_RouteSummary* summary) {
+        if (summary) {
+            delete[] summary->leg_durations;
+            delete[] summary->leg_distances;
+            summary->leg_durations = nullptr;
+            summary->leg_distances = nullptr;
+            summary->num_legs = 0;
+        }
+    }
+
+    // Geometry and annotations of every route/trip/matching as typed arrays,
+    // filled when `geometries` is "binary". Offsets arrays have one extra
+    // trailing entry; an annotation pointer is null when it was not requested.
+    struct OSRM_Geometry {
+        size_t num_routes;
+        size_t* coordinate_offsets; // num_routes + 1, in lon/lat pairs
+        double* coordinates;        // lon/lat pairs
+        size_t* leg_offsets;        // num_routes + 1, index into the leg offsets below
+        size_t num_legs;
+        size_t* annotation_offsets; // num_legs + 1, index into durations/distances/speeds
+        double* durations;
+        double* distances;
+        double* speeds;
+        size_t* node_offsets;       // num_legs + 1, index into nodes
+        uint64_t* nodes;
+        double* significance;       // per coordinate, only with a simplification tolerance
+    };
+
+    void osrm_free_geometry(OSRM_Geometry* geometry) {
+        if (geometry) {
+            delete[] geometry->coordinate_offsets;
+            delete[] geometry->coordinates;
+            delete[] geometry->leg_offsets;
+            delete[] geometry->annotation_offsets;
+            delete[] geometry->durations;
+            delete[] geometry->distances;
+            delete[] geometry->speeds;
+            delete[] geometry->node_offsets;
+            delete[] geometry->nodes;
+            delete[] geometry->significance;
+            *geometry = {};
+        }
+    }
+
+    static void fill_geometry(const BinaryGeometry& source, OSRM_Geometry* target) {
+        target->num_routes = source.coordinate_offsets.size() - 1;
+        target->coordinate_offsets = copy_array(source.coordinate_offsets);
+        target->coordinates = copy_array(source.coordinates);
+        target->leg_offsets = copy_array(source.leg_offsets);
+        target->num_legs = source.annotation_offsets.size() - 1;
+        target->annotation_offsets = copy_array(source.annotation_offsets);
+        target->durations = copy_array(source.durations);
+        target->distances = copy_array(source.distances);
+        target->speeds = copy_array(source.speeds);
+        target->node_offsets = copy_array(source.node_offsets);
+        target->nodes = copy_array(source.nodes);
+        target->significance = copy_array(source.significance);
+    }
+
+    // Called at the start (0%) and successful end (100%) of every preprocessing stage.
+    // OSRM's tools do not report progress, so there are no percentages in between:
+    // while a stage runs the callback gets a heartbeat with percent -1 about once
+    // per second. Elapsed time is counted from the start of the stage. Calls are
+    // serialized even when stages run concurrently.
+    typedef void (*OSRM_ProgressCallback)(const char* stage, double percent, double elapsed_seconds, void* user_data);
+
+    // Controls for a preprocessing run. A stage with a cancel flag, memory limit
+    // or log file runs as OSRM's own tool (osrm-extract, osrm-partition,
+    // osrm-customize, osrm-contract) in a child process, which is what makes it
+    // cancellable and memory-capped: OSRM's stages cannot be interrupted from the
+    // inside. The tools are looked up at run time, so deployed binaries need them
+    // in tools_dir or $OSRM_TOOLS_DIR unless the build's own are still in place.
+    // Stages needing none of these controls, or whose tool cannot be found, run
+    // in process instead; there a cancel flag only stops the stages not yet
+    // started and the memory limit and log file are not applied. A controlled
+    // run fails with code 2 when cancelled and code 3 when it went over the
+    // memory limit.
+    struct OSRM_RunControl {
+        OSRM_ProgressCallback progress;
+        void* user_data;
+        const bool* cancel_requested; // polled; set to true to kill the running stage
+        size_t memory_limit_bytes;    // resident memory cap of the stage, 0 = unlimited
+        const char* log_path;         // appends stage logs here instead of stderr
+        const char* tools_dir;        // directory of the OSRM tools; $OSRM_TOOLS_DIR, then the build's own when null
+    };
+
+    struct OSRM_PipelineConfig {
+        const char* input_path;
+        const char* profile_path;
+        int threads;
+        bool build_ch;
+        bool build_mld;
+        bool parse_conditionals;
+        bool use_metadata;
+        bool use_locations_cache;
+        double balance;
+        double boundary_factor;
+        int num_optimizing_cuts;
+        int small_component_size;
+        const int* max_cell_sizes;
+        size_t num_max_cell_sizes;
+    };
+
+    struct OSRM_StageReport {
+        const char* stage;
+        double seconds;
+        size_t peak_rss_bytes; // peak RSS of the process that ran the stage
+    };
+
+    // One entry per stage that ran, in completion order: extract, partition, customize, contract
+    struct OSRM_PipelineReport {
+        size_t num_stages;
+        OSRM_StageReport stages[4];
+    };
+
+    static OSRM_Result make_result(int code, const std::string& text) {
+        char* msg = new char[text.length() + 1];
+        strcpy(msg, text.c_str());
+        return {code, msg};
+    }
+
+    // Directory of the OSRM tools a controlled stage runs
+    static std::string stage_tools_dir(const OSRM_RunControl* control) {
+        if (control && control->tools_dir) {
+            return control->tools_dir;
+        }
+        if (const char* dir = std::getenv("OSRM_TOOLS_DIR")) {
+            return dir;
+        }
+#ifdef OSRM_BINDING_TOOLS_DIR
+        return OSRM_BINDING_TOOLS_DIR;
+#else
+        return "";
+#endif
+    }
+
+    // Whether a stage runs as a separate tool process: only a child can be
+    // killed on cancellation, capped in memory or have its output redirected,
+    // and only when the tool is there
+    static bool runs_as_tool(const OSRM_RunControl* control, const std::string& tool) {
+        const bool needed = control && (control->cancel_requested || control->memory_limit_bytes > 0 || control->log_path);
+        return needed && access(tool.c_str(), X_OK) == 0;
+    }
+
+    // Runs a stage on a thread of this process, sending heartbeats from the
+    // caller while it works. The peak RSS is that of the whole process so far.
+    static OSRM_Result run_stage_in_process(const char* stage,
+                                            const OSRM_RunControl* control,
+                                            const std::function<OSRM_Result()>& run,
+                                            size_t* peak_rss) {
+        const auto stage_start = std::chrono::steady_clock::now();
+        const auto notify = [&](double percent) {
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - stage_start).count();
+            if (control && control->progress) control->progress(stage, percent, elapsed, control->user_data);
+        };
+        notify(0.0);
+
+        OSRM_Result result = {1, nullptr};
+        std::atomic<bool> finished{false};
+        const auto body = [&] {
+            try {
+                result = run();
+            } catch (const std::exception& e) {
+                result = make_result(1, e.what());
+            }
+            finished = true;
+        };
+        std::thread worker;
+        try {
+            worker = std::thread(body);
+        } catch (const std::exception&) {
+            body();
+        }
+        auto last_heartbeat = std::chrono::steady_clock::now();
+        while (!finished) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (std::chrono::steady_clock::now() - last_heartbeat >= std::chrono::seconds(1)) {
+                last_heartbeat = std::chrono::steady_clock::now();
+                notify(-1.0);
+            }
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+
+        if (peak_rss) {
+            struct rusage usage {};
+            getrusage(RUSAGE_SELF, &usage);
+            *peak_rss = peak_rss_bytes(usage);
+        }
+        if (result.code == 0) {
+            notify(100.0);
+        }
+        return result;
+    }
+
+    static std::string stage_tool(const OSRM_RunControl* control, const std::string& name) {
+        const std::string tools_dir = stage_tools_dir(control);
+        return tools_dir.empty() ? name : tools_dir + "/" + name;
+    }
+
+    // Runs one OSRM tool as a child process while polling for cancellation and,
+    // on Linux, for the child's resident memory. Stages that need no child, or
+    // whose tool is missing, run `in_process` instead. `command` is the tool name
+    // followed by its arguments. The child is started with fork and exec only:
+    // everything it needs is prepared before the fork, and it calls nothing but
+    // async-signal-safe functions until exec, so threads of the calling process
+    // (TBB workers, a concurrently running stage) cannot leave it deadlocked.
+    // The child's peak RSS is stored in `peak_rss` when given.
+    static OSRM_Result run_controlled_stage(const char* stage,
+                                            const OSRM_RunControl* control,
+                                            const std::vector<std::string>& command,
+                                            const std::function<OSRM_Result()>& in_process,
+                                            size_t* peak_rss) {
+        const auto stage_start = std::chrono::steady_clock::now();
+        const auto elapsed = [&] {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - stage_start).count();
+        };
+        const auto cancelled = [&] {
+            return control && control->cancel_requested &&
+                   __atomic_load_n(control->cancel_requested, __ATOMIC_ACQUIRE);
+        };
+        const auto notify = [&](double percent) {
+            if (control && control->progress) control->progress(stage, percent, elapsed(), control->user_data);
+        };
+
+        if (cancelled()) {
+            return make_result(2, "Cancelled");
+        }
+
+        const std::string tool = stage_tool(control, command[0]);
+        if (!runs_as_tool(control, tool)) {
+            return run_stage_in_process(stage, control, in_process, peak_rss);
+        }
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>(tool.c_str()));
+        for (size_t i = 1; i < command.size(); ++i) {
+            argv.push_back(const_cast<char*>(command[i].c_str()));
+        }
+        argv.push_back(nullptr);
+
+        int log_fd = -1;
+        if (control && control->log_path) {
+            log_fd = open(control->log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (log_fd < 0) {
+                return make_result(1, std::string("Cannot open stage log: ") + strerror(errno));
+            }
+        }
+#ifndef __linux__
+        // Without /proc the limit falls back to an address-space cap set in the child
+        struct rlimit limit {};
+        limit.rlim_cur = control ? control->memory_limit_bytes : 0;
+        limit.rlim_max = limit.rlim_cur;
+#endif
+
+        std::cout.flush();
+        std::cerr.flush();
+        const pid_t pid = fork();
+        if (pid < 0) {
+            if (log_fd >= 0) close(log_fd);
+            return make_result(1, std::string("Failed to start stage: ") + strerror(errno));
+        }
+
+        if (pid == 0) {
+            if (log_fd >= 0) {
+                dup2(log_fd, STDOUT_FILENO);
+                dup2(log_fd, STDERR_FILENO);
+            }
+#ifndef __linux__
+            if (limit.rlim_cur > 0) {
+                setrlimit(RLIMIT_AS, &limit);
+            }
+#endif
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+
+        if (log_fd >= 0) {
+            close(log_fd);
+        }
+        notify(0.0);
+
+        // Kills the child for a reason of our own and reaps it
+        const auto stop = [&](int code, const std::string& message) {
+            kill(pid, SIGKILL);
+            int ignored = 0;
+            struct rusage usage {};
+            while (wait4(pid, &ignored, 0, &usage) < 0 && errno == EINTR) {}
+            if (peak_rss) {
+                *peak_rss = peak_rss_bytes(usage);
+            }
+            return make_result(code, message);
+        };
+
+        int status = 0;
+        struct rusage usage {};
+        auto last_heartbeat = std::chrono::steady_clock::now();
+        while (true) {
+            const pid_t done = wait4(pid, &status, WNOHANG, &usage);
+            if (done == pid) {
+                break;
+            }
+            if (done < 0 && errno != EINTR) {
+                return stop(1, std::string("Failed to wait for stage: ") + strerror(errno));
+            }
+
+            if (cancelled()) {
+                return stop(2, "Cancelled");
+            }
+            if (control && control->memory_limit_bytes > 0 && resident_bytes(pid) > control->memory_limit_bytes) {
+                return stop(3, std::string(stage) + " exceeded the memory limit of " +
+                               std::to_string(control->memory_limit_bytes) + " bytes");
+            }
+
+            if (std::chrono::steady_clock::now() - last_heartbeat >= std::chrono::seconds(1)) {
+                last_heartbeat = std::chrono::steady_clock::now();
+                notify(-1.0);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        if (peak_rss) {
+            *peak_rss = peak_rss_bytes(usage);
+        }
+
+        if (WIFSIGNALED(status)) {
+            return make_result(1, std::string(stage) + " terminated by signal " + std::to_string(WTERMSIG(status)));
+        }
+        const int code = WEXITSTATUS(status);
+        if (code == 127) {
+            return make_result(1, "Could not start " + tool);
+        }
+        if (code != 0) {
+            return make_result(1, std::string(stage) + " failed with exit code " + std::to_string(code) +
+                                  (control && control->log_path ? ", see " + std::string(control->log_path) : ""));
+        }
+        notify(100.0);
+        return make_result(0, std::string(stage) + " successful");
+    }
+
+    static std::vector<std::string> extract_command(const char* input_path,
+                                                    const char* profile_path,
+                                                    int threads,
+                                                    bool parse_conditionals,
+                                                    bool use_metadata,
+                                                    bool use_locations_cache) {
+        std::vector<std::string> command = {"osrm-extract", input_path, "-p", profile_path};
+        if (threads > 0) {
+            command.insert(command.end(), {"-t", std::to_string(threads)});
+        }
+        if (parse_conditionals) command.push_back("--parse-conditional-restrictions");
+        if (use_metadata) command.push_back("--with-osm-metadata");
+        if (!use_locations_cache) command.push_back("--disable-location-cache");
+        return command;
+    }
+
+    static std::vector<std::string> partition_command(const char* base_path,
+                                                      int threads,
+                                                      double balance,
+                                                      double boundary_factor,
+                                                      int num_optimizing_cuts,
+                                                      int small_component_size,
+                                                      const int* max_cell_sizes,
+                                                      size_t num_max_cell_sizes) {
+        std::vector<std::string> command = {"osrm-partition", base_path};
+        if (threads > 0) command.insert(command.end(), {"-t", std::to_string(threads)});
+        if (balance > 0) command.insert(command.end(), {"--balance", std::to_string(balance)});
+        if (boundary_factor > 0) command.insert(command.end(), {"--boundary", std::to_string(boundary_factor)});
+        if (num_optimizing_cuts > 0) command.insert(command.end(), {"--optimizing-cuts", std::to_string(num_optimizing_cuts)});
+        if (small_component_size > 0) {
+            command.insert(command.end(), {"--small-component-size", std::to_string(small_component_size)});
+        }
+        if (max_cell_sizes != nullptr && num_max_cell_sizes > 0) {
+            std::string sizes;
+            for (size_t i = 0; i < num_max_cell_sizes; ++i) {
+                sizes += (i > 0 ? "," : "") + std::to_string(max_cell_sizes[i]);
+            }
+            command.insert(command.end(), {"--max-cell-sizes", sizes});
+        }
+        return command;
+    }
+
+    static std::vector<std::string> threaded_command(const char* tool, const char* base_path, int threads) {
+        std::vector<std::string> command = {tool, base_path};
+        if (threads > 0) {
+            command.insert(command.end(), {"-t", std::to_string(threads)});
+        }
+        return command;
+    }
+
+    // Lets concurrently running stages share one caller callback
+    struct SerializedProgress {
+        const OSRM_RunControl* control = nullptr;
+        std::mutex mutex;
+    };
+
+    static void serialized_progress(const char* stage, double percent, double elapsed_seconds, void* user_data) {
+        auto* serialized = static_cast<SerializedProgress*>(user_data);
+        std::lock_guard<std::mutex> lock(serialized->mutex);
+        serialized->control->progress(stage, percent, elapsed_seconds, serialized->control->user_data);
+    }
+
+    // Compressed sparse row matrix filled by osrm_table_sparse. Unreachable
+    // cells are -1 unless a fallback speed turned them into crow-fly estimates.
+    struct OSRM_SparseMatrix {
+        size_t num_rows;
+        size_t num_cells;
+        size_t* row_offsets;    // num_rows + 1
+        size_t* column_indices; // num_cells
+        double* durations;      // num_cells, seconds
+        double* distances;      // num_cells, meters
+        uint8_t* estimated;     // num_cells, 1 when the cell is a crow-fly estimate
+    };
+
+    void osrm_free_sparse_matrix(OSRM_SparseMatrix* matrix) {
+        if (matrix) {
+            delete[] matrix->row_offsets;
+            delete[] matrix->column_indices;
+            delete[] matrix->durations;
+            delete[] matrix->distances;
+            delete[] matrix->estimated;
+            *matrix = {};
+        }
+    }
+
+    // Bytes of the datasets an engine loads, by component. The file sizes of what
+    // storage loads for the enabled features are an upper bound on what the
+    // engine holds; the file index is memory-mapped and paged in on demand, so it
+    // is reported on its own and left out of the total.
+    struct OSRM_MemoryReport {
+        size_t rtree_bytes;        // .ramIndex
+        size_t graph_bytes;        // .hsgr, or .mldgr with .cells and .partition
+        size_t cell_metrics_bytes; // .cell_metrics
+        size_t names_bytes;        // .names
+        size_t geometry_bytes;     // .geometry
+        size_t other_bytes;        // every other dataset the engine loads
+        size_t total_bytes;
+        size_t file_index_bytes;   // .fileIndex, mapped rather than loaded
+    };
+
+    // Per-pair totals of osrm_route_matrix; -1 for pairs without a route
+    struct OSRM_RouteMatrix {
+        size_t num_pairs;
+        double* durations;
+        double* distances;
+    };
+
+    void osrm_free_route_matrix(OSRM_RouteMatrix* matrix) {
+        if (matrix) {
+            delete[] matrix->durations;
+            delete[] matrix->distances;
+            *matrix = {};
+        }
+    }
+
+    // Stop order and legs of a solved trip. Legs follow the order and include the
+    // return to the first stop for round trips; unreachable legs are -1.
+    struct OSRM_TripSolution {
+        size_t num_stops;
+        size_t* order;
+        size_t num_legs;
+        double* leg_durations;
+        double* leg_distances;
+        double duration;
+        double distance;
+    };
+
+    void osrm_free_trip_solution(OSRM_TripSolution* solution) {
+        if (solution) {
+            delete[] solution->order;
+            delete[] solution->leg_durations;
+            delete[] solution->leg_distances;
+            *solution = {};
+        }
+    }
+
+    void* osrm_create_with_config(const OSRM_Config* user_config) {
+        try {
+            osrm::EngineConfig config;
+            
+            // Set algorithm
+            if (user_config->algorithm != nullptr) {
+                if (strcmp(user_config->algorithm, "CH") == 0) {
+                    config.algorithm = osrm::EngineConfig::Algorithm::CH;
+                } else if (strcmp(user_config->algorithm, "MLD") == 0) {
+                    config.algorithm = osrm::EngineConfig::Algorithm::MLD;
+                } else {
+                    config.algorithm = osrm::EngineConfig::Algorithm::MLD;
+                }
+            }
+            
+            // Set storage configuration
+            config.use_shared_memory = user_config->shared_memory;
+            
+            // Note: memory_file is a path, not a boolean. If mmap_memory is true,
+            // set it to the same path as storage_config
+            if (user_config->dataset_name != nullptr && strlen(user_config->dataset_name) > 0) {
+                config.dataset_name = std::string(user_config->dataset_name);
+            }
+            
+            // Feature datasets the engine should not load. With shared memory
+            // the datastore decides what is loaded, so this only affects
+            // process-local and mmap storage.
+            std::set<osrm::storage::FeatureDataset> disabled_datasets;
+            if (user_config->disable_feature_dataset_flags & 1) {
+                disabled_datasets.insert(osrm::storage::FeatureDataset::ROUTE_STEPS);
+            }
+            if (user_config->disable_feature_dataset_flags & 2) {
+                disabled_datasets.insert(osrm::storage::FeatureDataset::ROUTE_GEOMETRY);
+            }
+
+            if (user_config->path != nullptr && strlen(user_config->path) > 0) {
+                std::string path_str(user_config->path);
+                config.storage_config = osrm::storage::StorageConfig(path_str, disabled_datasets);
+                
+                // If mmap_memory is enabled, set memory_file to the path
+                if (user_config->mmap_memory) {
+                    config.memory_file = path_str;
+                }
+            }
+            
+            // Set max locations
+            if (user_config->max_locations_trip > 0) {
+                config.max_locations_trip = user_config->max_locations_trip;
+            }
+            if (user_config->max_locations_viaroute > 0) {
+                config.max_locations_viaroute = user_config->max_locations_viaroute;
+            }
+            if (user_config->max_locations_distance_table > 0) {
+                config.max_locations_distance_table = user_config->max_locations_distance_table;
+            }
+            if (user_config->max_locations_map_matching > 0) {
+                config.max_locations_map_matching = user_config->max_locations_map_matching;
+            }
+            
+            // Set max radius and results
+            if (user_config->max_radius_map_matching > 0) {
+                config.max_radius_map_matching = user_config->max_radius_map_matching;
+            }
+            if (user_config->max_results_nearest > 0) {
+                config.max_results_nearest = user_config->max_results_nearest;
+            }
+            if (user_config->max_alternatives > 0) {
+                config.max_alternatives = user_config->max_alternatives;
+            }
+            if (user_config->default_radius > 0) {
+                config.default_radius = user_config->default_radius;
+            }
+
+            return new osrm::OSRM(config);
+        } catch (const std::exception& e) {
+            std::cerr << "Fail to create an OSRM instance: " << e.what() << std::endl;
+            return nullptr;
+        }
+    }
+
+    // Backward compatibility function
+    void* osrm_create(const char* base_path, const char* algorithm, int max_table_size) {
+        OSRM_Config config = {};
+        config.algorithm = algorithm;
+        config.shared_memory = false;
+        config.dataset_name = nullptr;
+        config.mmap_memory = false;
+        config.path = base_path;
+        config.disable_feature_dataset_flags = 0;
+        config.max_locations_trip = 0;
+        config.max_locations_viaroute = 0;
+        config.max_locations_distance_table = max_table_size;
+        config.max_locations_map_matching = 0;
+        config.max_radius_map_matching = 0;
+        config.max_results_nearest = 0;
+        config.max_alternatives = 0;
+        config.default_radius = 0;
+        
+        return osrm_create_with_config(&config);
+    }
+
+    void osrm_destroy(void* osrm_instance) {
+        if (osrm_instance) {
+            {
+                std::unique_lock<std::shared_mutex> lock(coalescing_mutex);
+                coalescing_count -= coalescing_states.erase(osrm_instance);
+            }
+            remove_slow_query_log(osrm_instance);
+            wait_for_background_searches(osrm_instance);
+            delete static_cast<osrm::OSRM*>(osrm_instance);
+        }
+    }
+
+    // Single-flight execution for instances with coalescing enabled: the first
+    // caller with a given key computes, identical requests arriving meanwhile
+    // wait for it and get copies of its result instead of computing again. The
+    // callables are template parameters so an uncoalesced request allocates
+    // nothing for them.
+    extern "C++" {
+    template <typename MakeKey, typename Compute>
+    static OSRM_Result coalesce(const void* instance, const MakeKey& make_key, const Compute& compute) {
+        const auto state = coalescing_state(instance);
+        if (!state) {
+            return compute();
+        }
+
+        const std::string key = make_key().bytes;
+        std::shared_ptr<InFlightRequest> request;
+        bool leader = false;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            auto& slot = state->in_flight[key];
+            if (!slot) {
+                slot = std::make_shared<InFlightRequest>();
+                leader = true;
+            }
+            request = slot;
+        }
+
+        if (leader) {
+            OSRM_Result result;
+            try {
+                result = compute();
+            } catch (const std::exception& e) {
+                result = make_result(1, e.what());
+            } catch (...) {
+                result = make_result(1, "Unknown OSRM error");
+            }
+            {
+                std::lock_guard<std::mutex> lock(request->mutex);
+                request->code = result.code;
+                request->message = result.message ? result.message : "";
+                request->done = true;
+            }
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->in_flight.erase(key);
+            }
+            request->finished.notify_all();
+            ++state->computed;
+            return result;
+        }
+
+        ++state->coalesced;
+        std::unique_lock<std::mutex> lock(request->mutex);
+        request->finished.wait(lock, [&] { return request->done; });
+        return make_result(request->code, request->message);
+    }
+    }
+
+    // Enables or disables coalescing of identical concurrent route and table
+    // requests on an instance
+    void osrm_set_coalescing(void* osrm_instance, bool enabled) {
+        std::unique_lock<std::shared_mutex> lock(coalescing_mutex);
+        if (enabled) {
+            auto& state = coalescing_states[osrm_instance];
+            if (!state) {
+                state = std::make_shared<CoalescingState>();
+                ++coalescing_count;
+            }
+        } else {
+            coalescing_count -= coalescing_states.erase(osrm_instance);
+        }
+    }
+
+    // Requests computed by a first caller and requests answered with its result
+    struct OSRM_CoalescingStats {
+        uint64_t computed;
+        uint64_t coalesced;
+    };
+
+    void osrm_coalescing_stats(void* osrm_instance, OSRM_CoalescingStats* stats) {
+        const auto state = coalescing_state(osrm_instance);
+        stats->computed = state ? state->computed.load() : 0;
+        stats->coalesced = state ? state->coalesced.load() : 0;
+    }
+
+    // Logs route, table, nearest and match requests on an instance that take at
+    // least threshold_ms, keeping the latest `capacity`; capacity 0 turns it off.
+    // Reconfiguring starts a new, empty log.
+    void osrm_set_slow_query_log(void* osrm_instance, double threshold_ms, size_t capacity) {
+        std::unique_lock<std::shared_mutex> lock(slow_query_mutex);
+        slow_query_log_count -= slow_query_logs.erase(osrm_instance);
+        if (capacity > 0) {
+            slow_query_logs.emplace(osrm_instance, std::make_shared<SlowQueryLog>(threshold_ms, capacity));
+            ++slow_query_log_count;
+        }
+    }
+
+    // Takes the logged queries out of the log, oldest first, as JSONL in the message
+    OSRM_Result osrm_slow_query_log_drain(void* osrm_instance) {
+        const auto log = slow_query_log(osrm_instance);
+        if (!log) {
+            return make_result(1, "Slow-query log is not enabled");
+        }
+
+        std::string lines;
+        for (const auto& entry : log->drain()) {
+            lines += entry->line;
+            lines += '\n';
+        }
+        return make_result(0, lines);
+    }
+
+    // Appends the logged queries to a JSONL file, oldest first, and empties the log
+    OSRM_Result osrm_slow_query_log_dump(void* osrm_instance, const char* path, size_t* count) {
+        const auto log = slow_query_log(osrm_instance);
+        if (!log) {
+            return make_result(1, "Slow-query log is not enabled");
+        }
+
+        std::ofstream file(path, std::ios::app);
+        if (!file) {
+            return make_result(1, std::string("Could not open ") + path);
+        }
+        const auto entries = log->drain();
+        for (const auto& entry : entries) {
+            file << entry->line << '\n';
+        }
+        file.flush();
+        if (!file) {
+            return make_result(1, std::string("Could not write ") + path);
+        }
+        *count = entries.size();
+        return make_result(0, "Ok");
+    }
+
+    // Slow queries overwritten before they were drained
+    uint64_t osrm_slow_query_log_dropped(void* osrm_instance) {
+        const auto log = slow_query_log(osrm_instance);
+        return log ? log->dropped.load() : 0;
+    }
+
+    // Runs a table query and renders the response
+    static OSRM_Result run_table(osrm::OSRM* osrm_ptr, const osrm::TableParameters& params, QueryPhases* phases = nullptr) {
+        osrm::json::Object result;
+        if (phases) {
+            phases->query_started();
+        }
+        const auto status = osrm_ptr->Table(params, result);
+        if (phases) {
+            phases->query_finished();
+        }
+
+        std::string& result_str = render_buffer();
+        int code;
+
+        if (status == osrm::Status::Ok) {
+            code = 0;
+            osrm::util::json::render(result_str, result);
+        } else {
+            code = 1;
+            try {
+                result_str = std::get<osrm::util::json::String>(result.values.at("message")).value;
+            } catch (const std::exception& e) {
+                result_str = "Unknown OSRM error";
+            }
+        }
+
+        char* message = new char[result_str.length() + 1];
+        strcpy(message, result_str.c_str());
+
+        return {code, message};
+    }
+
+    OSRM_Result osrm_table(void* osrm_instance,
+                          const double* coordinates,
+                          size_t num_coordinates,
+                          const size_t* sources,
+                          size_t num_sources,
+                          const size_t* destinations,
+                          size_t num_destinations,
+                          bool include_duration,
+                          bool include_distance,
+                          const double* bearings,
+                          size_t num_bearings,
+                          const double* radiuses,
+                          size_t num_radiuses,
+                          const char** hints,
+                          size_t num_hints,
+                          bool generate_hints,
+                          const char** approaches,
+                          size_t num_approaches,
+                          double fallback_speed,
+                          const char* fallback_coordinate,
+                          double scale_factor,
+                          const char* snapping) {
+
+        if (!osrm_instance) {
+            const char* err = "OSRM instance not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+
+        SlowQueryTimer timer(osrm_instance, num_coordinates, [&] {
+            JsonLine line("table");
+            line.coordinates(coordinates, num_coordinates)
+                .numbers("sources", sources, num_sources)
+                .numbers("destinations", destinations, num_destinations)
+                .flag("durations", include_duration)
+                .flag("distances", include_distance)
+                .numbers("bearings", bearings, num_bearings * 2)
+                .numbers("radiuses", radiuses, num_radiuses)
+                .strings("hints", hints, num_hints)
+                .flag("generate_hints", generate_hints)
+                .strings("approaches", approaches, num_approaches)
+                .string("fallback_coordinate", fallback_coordinate)
+                .string("snapping", snapping);
+            if (fallback_speed > 0) {
+                line.number("fallback_speed", fallback_speed);
+            }
+            if (scale_factor > 0) {
+                line.number("scale_factor", scale_factor);
+            }
+            return line;
+        });
+
+        osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
+        osrm::TableParameters params;
+
+        for (size_t i = 0; i < num_coordinates; ++i) {
+            params.coordinates.push_back({
+                osrm::util::FloatLongitude{coordinates[i * 2]},
+                osrm::util::FloatLatitude{coordinates[i * 2 + 1]}
+            });
+        }
+
+        if (num_sources > 0) {
+            params.sources.assign(sources, sources + num_sources);
+        }
+
+        if (num_destinations > 0) {
+            params.destinations.assign(destinations, destinations + num_destinations);
+        }
+
+        // Set annotations based on the flags
+        if (include_duration && include_distance) {
+            params.annotations = osrm::TableParameters::AnnotationsType::All;
+        } else if (include_duration) {
+            params.annotations = osrm::TableParameters::AnnotationsType::Duration;
+        } else if (include_distance) {
+            params.annotations = osrm::TableParameters::AnnotationsType::Distance;
+        } else {
+            params.annotations = osrm::TableParameters::AnnotationsType::None;
+        }
+
+        // Set bearings
+        if (num_bearings > 0 && bearings != nullptr) {
+            for (size_t i = 0; i < num_bearings; ++i) {
+                if (bearings[i * 2] >= 0) {  // Check for valid bearing
+                    params.bearings.push_back(osrm::engine::Bearing{
+                        static_cast<short>(bearings[i * 2]),
+                        static_cast<short>(bearings[i * 2 + 1])
+                    });
+                } else {
+                    params.bearings.push_back(std::nullopt);
+                }
+            }
+        }
+
+        // Set radiuses
+        if (num_radiuses > 0 && radiuses != nullptr) {
+            for (size_t i = 0; i < num_radiuses; ++i) {
+                if (radiuses[i] >= 0) {
+                    params.radiuses.push_back(radiuses[i]);
+                } else {
+                    params.radiuses.push_back(std::nullopt);
+                }
+            }
+        }
+
+        // Set hints
+        if (num_hints > 0 && hints != nullptr) {
+            for (size_t i = 0; i < num_hints; ++i) {
+                if (hints[i] != nullptr && strlen(hints[i]) > 0) {
+                    params.hints.push_back(osrm::engine::Hint::FromBase64(hints[i]));
+                } else {
+                    params.hints.push_back(std::nullopt);
+                }
+            }
+        }
+
+        // Set generate_hints
+        params.generate_hints = generate_hints;
+
+        // Set approaches
+        if (num_approaches > 0 && approaches != nullptr) {
+            for (size_t i = 0; i < num_approaches; ++i) {
+                if (approaches[i] != nullptr) {
+                    std::string approach_str(approaches[i]);
+                    if (approach_str == "curb") {
+                        params.approaches.push_back(osrm::engine::Approach::CURB);
+                    } else if (approach_str == "opposite") {
+                        params.approaches.push_back(osrm::engine::Approach::OPPOSITE);
+                    } else {
+                        params.approaches.push_back(osrm::engine::Approach::UNRESTRICTED);
+                    }
+                } else {
+                    params.approaches.push_back(std::nullopt);
+                }
+            }
+        }
+
+        // Set fallback_speed
+        if (fallback_speed > 0) {
+            params.fallback_speed = fallback_speed;
+        }
+
+        // Set fallback_coordinate
+        if (fallback_coordinate != nullptr) {
+            std::string fallback_str(fallback_coordinate);
+            if (fallback_str == "snapped") {
+                params.fallback_coordinate_type = osrm::TableParameters::FallbackCoordinateType::Snapped;
+            } else {
+                params.fallback_coordinate_type = osrm::TableParameters::FallbackCoordinateType::Input;
+            }
+        }
+
+        // Set scale_factor
+        if (scale_factor > 0) {
+            params.scale_factor = scale_factor;
+        }
+
+        // Set snapping
+        if (snapping != nullptr) {
+            std::string snapping_str(snapping);
+            if (snapping_str == "any") {
+                params.snapping = osrm::TableParameters::SnappingType::Any;
+            } else {
+                params.snapping = osrm::TableParameters::SnappingType::Default;
+            }
+        }
+
+        const auto key = [&] {
+            RequestKey key(osrm_instance, "table");
+            key.coordinates(coordinates, num_coordinates);
+            key.values(sources, num_sources);
+            key.values(destinations, num_destinations);
+            key.value(include_duration);
+            key.value(include_distance);
+            key.values(bearings, num_bearings * 2);
+            key.values(radiuses, num_radiuses);
+            key.texts(hints, num_hints);
+            key.value(generate_hints);
+            key.texts(approaches, num_approaches);
+            key.value(fallback_speed);
+            key.text(fallback_coordinate);
+            key.value(scale_factor);
+            key.text(snapping);
+            return key;
+        };
+        return coalesce(osrm_instance, key, [&] { return run_table(osrm_ptr, params, &timer); });
+    }
+
+    // Compact table over packed fixed-point [lon, lat] pairs (degrees * 1e6), for
+    // large batches marshalled straight from caller memory
+    OSRM_Result osrm_table_fixed(void* osrm_instance,
+                                 const int32_t* coordinates,
+                                 size_t num_coordinates,
+                                 const size_t* sources,
+                                 size_t num_sources,
+                                 const size_t* destinations,
+                                 size_t num_destinations,
+                                 bool include_duration,
+                                 bool include_distance,
+                                 double fallback_speed) {
+        if (!osrm_instance) {
+            const char* err = "OSRM instance not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+
+        osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
+        osrm::TableParameters params;
+
+        std::string error;
+        if (!append_fixed_coordinates(params.coordinates, coordinates, num_coordinates, error)) {
+            char* msg = new char[error.length() + 1];
+            strcpy(msg, error.c_str());
+            return {1, msg};
+        }
+
+        if (num_sources > 0) {
+            params.sources.assign(sources, sources + num_sources);
+        }
+
+        if (num_destinations > 0) {
+            params.destinations.assign(destinations, destinations + num_destinations);
+        }
+
+        if (include_duration && include_distance) {
+            params.annotations = osrm::TableParameters::AnnotationsType::All;
+        } else if (include_duration) {
+            params.annotations = osrm::TableParameters::AnnotationsType::Duration;
+        } else if (include_distance) {
+            params.annotations = osrm::TableParameters::AnnotationsType::Distance;
+        } else {
+            params.annotations = osrm::TableParameters::AnnotationsType::None;
+        }
+
+        if (fallback_speed > 0) {
+            params.fallback_speed = fallback_speed;
+        }
+
+        return run_table(osrm_ptr, params);
+    }
+
+    // Square matrix over `coordinates` where only the cells of a sparsity pattern are
+    // returned. The pattern is either given in CSR form (row_offsets/column_indices)
+    // or, when row_offsets is null, built from the k nearest coordinates of each row
+    // by great-circle distance. Locations are snapped once; nearby rows are batched
+    // into many-to-many queries over the union of their columns, one batch per
+    // worker thread at a time.
+    OSRM_Result osrm_table_sparse(void* osrm_instance,
+                                  const double* coordinates,
+                                  size_t num_coordinates,
+                                  const size_t* row_offsets,
+                                  const size_t* column_indices,
+                                  size_t k_nearest,
+                                  double fallback_speed,
+                                  int threads,
+                                  OSRM_SparseMatrix* matrix) {
+        if (!osrm_instance) {
+            const char* err = "OSRM instance not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (!matrix) {
+            const char* err = "Matrix output cannot be null";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (!row_offsets && k_nearest == 0) {
+            const char* err = "Either a sparsity pattern or k_nearest is required";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+
+        *matrix = {};
+        osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
+        const size_t n = num_coordinates;
+
+        // Structure-of-arrays radians for the lower bound computation
+        std::vector<double> lats(n), lons(n), cos_lats(n);
+        for (size_t i = 0; i < n; ++i) {
+            lons[i] = coordinates[i * 2] * M_PI / 180.0;
+            lats[i] = coordinates[i * 2 + 1] * M_PI / 180.0;
+            cos_lats[i] = std::cos(lats[i]);
+        }
+
+        // Build or copy the sparsity pattern
+        std::vector<size_t> offsets{0};
+        std::vector<size_t> columns;
+        if (row_offsets) {
+            offsets.assign(row_offsets, row_offsets + n + 1);
+            for (size_t i = 0; i < n; ++i) {
+                if (offsets[i + 1] < offsets[i]) {
+                    const char* err = "Row offsets must be non-decreasing";
+                    char* msg = new char[strlen(err) + 1];
+                    strcpy(msg, err);
+                    return {1, msg};
+                }
+            }
+            columns.assign(column_indices, column_indices + offsets[n]);
+            for (const auto column : columns) {
+                if (column >= n) {
+                    const char* err = "Column index out of range";
+                    char* msg = new char[strlen(err) + 1];
+                    strcpy(msg, err);
+                    return {1, msg};
+                }
+            }
+        } else {
+            const size_t k = std::min(k_nearest, n > 0 ? n - 1 : 0);
+            std::vector<double> row(n);
+            std::vector<size_t> order(n);
+            columns.reserve(n * k);
+            for (size_t i = 0; i < n; ++i) {
+                haversine_row(lats[i], lons[i], lats.data(), lons.data(), cos_lats.data(), n, row.data());
+                row[i] = std::numeric_limits<double>::infinity();
+                std::iota(order.begin(), order.end(), 0);
+                std::nth_element(order.begin(), order.begin() + k, order.end(),
+                                 [&](size_t a, size_t b) { return row[a] < row[b]; });
+                std::sort(order.begin(), order.begin() + k);
+                columns.insert(columns.end(), order.begin(), order.begin() + k);
+                offsets.push_back(columns.size());
+            }
+        }
+
+        // Snap every location once; the batch queries reuse the hints
+        const auto hints = snap_once(osrm_ptr, coordinates, n);
+
+        // Rows in Z-order of their coordinates, so consecutive rows are close and
+        // share most destinations. Consecutive rows are cut into batches whose
+        // destination union stays small; one many-to-many per batch then costs
+        // one search per row plus one per destination of the union, instead of
+        // one plus k per row.
+        const auto z_order = [&](size_t i) {
+            const auto quantize = [](double value, double min, double range) {
+                return static_cast<uint32_t>(std::clamp((value - min) / range, 0.0, 1.0) * 65535.0);
+            };
+            const auto lon = quantize(coordinates[i * 2], -180.0, 360.0);
+            const auto lat = quantize(coordinates[i * 2 + 1], -90.0, 180.0);
+            uint64_t code = 0;
+            for (int bit = 0; bit < 16; ++bit) {
+                code |= static_cast<uint64_t>((lon >> bit) & 1) << (2 * bit);
+                code |= static_cast<uint64_t>((lat >> bit) & 1) << (2 * bit + 1);
+            }
+            return code;
+        };
+        std::vector<uint64_t> codes(n);
+        for (size_t i = 0; i < n; ++i) {
+            codes[i] = z_order(i);
+        }
+        std::vector<size_t> row_order;
+        for (size_t i = 0; i < n; ++i) {
+            if (offsets[i + 1] > offsets[i]) {
+                row_order.push_back(i);
+            }
+        }
+        std::stable_sort(row_order.begin(), row_order.end(),
+                         [&](size_t a, size_t b) { return codes[a] < codes[b]; });
+
+        std::vector<size_t> batches{0};
+        {
+            std::vector<size_t> batch_columns;
+            for (size_t i = 0; i < row_order.size(); ++i) {
+                const size_t r = row_order[i];
+                std::vector<size_t> merged = batch_columns;
+                merged.insert(merged.end(), columns.begin() + offsets[r], columns.begin() + offsets[r + 1]);
+                std::sort(merged.begin(), merged.end());
+                merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+                const size_t batch_rows = i - batches.back();
+                if (batch_rows > 0 &&
+                    (batch_rows >= SPARSE_BATCH_ROWS || merged.size() > SPARSE_BATCH_COLUMNS)) {
+                    batches.push_back(i);
+                    batch_columns.assign(columns.begin() + offsets[r], columns.begin() + offsets[r + 1]);
+                    std::sort(batch_columns.begin(), batch_columns.end());
+                    batch_columns.erase(std::unique(batch_columns.begin(), batch_columns.end()), batch_columns.end());
+                } else {
+                    batch_columns = std::move(merged);
+                }
+            }
+            if (batches.back() != row_order.size()) {
+                batches.push_back(row_order.size());
+            }
+        }
+        const size_t num_batches = batches.size() - 1;
+
+        const size_t num_cells = columns.size();
+        std::vector<double> durations(num_cells, -1.0);
+        std::vector<double> distances(num_cells, -1.0);
+        std::vector<uint8_t> estimated(num_cells, 0);
+
+        std::atomic<size_t> next_batch{0};
+        std::mutex error_mutex;
+        std::string error;
+
+        auto worker = [&] {
+            try {
+                std::vector<double> lower_bounds;
+                std::vector<size_t> union_columns;
+                for (size_t b = next_batch++; b < num_batches; b = next_batch++) {
+                    const size_t first = batches[b];
+                    const size_t last = batches[b + 1];
+
+                    union_columns.clear();
+                    for (size_t i = first; i < last; ++i) {
+                        const size_t r = row_order[i];
+                        union_columns.insert(union_columns.end(),
+                                             columns.begin() + offsets[r], columns.begin() + offsets[r + 1]);
+                    }
+                    std::sort(union_columns.begin(), union_columns.end());
+                    union_columns.erase(std::unique(union_columns.begin(), union_columns.end()), union_columns.end());
+
+                    osrm::TableParameters params;
+                    const auto add_location = [&](size_t location) {
+                        params.coordinates.push_back({
+                            osrm::util::FloatLongitude{coordinates[location * 2]},
+                            osrm::util::FloatLatitude{coordinates[location * 2 + 1]}
+                        });
+                        params.hints.push_back(hints[location]);
+                    };
+                    for (size_t i = first; i < last; ++i) {
+                        add_location(row_order[i]);
+                        params.sources.push_back(i - first);
+                    }
+                    for (size_t j = 0; j < union_columns.size(); ++j) {
+                        add_location(union_columns[j]);
+                        params.destinations.push_back(last - first + j);
+                    }
+                    params.annotations = osrm::TableParameters::AnnotationsType::All;
+                    params.generate_hints = false;
+
+                    osrm::json::Object result;
+                    if (osrm_ptr->Table(params, result) != osrm::Status::Ok) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (error.empty()) {
+                            try {
+                                error = std::get<osrm::util::json::String>(result.values.at("message")).value;
+                            } catch (const std::exception& e) {
+                                error = "Unknown OSRM error";
+                            }
+                        }
+                        next_batch = num_batches;
+                        return;
+                    }
+
+                    const auto& duration_rows = std::get<osrm::json::Array>(result.values.at("durations")).values;
+                    const auto& distance_rows = std::get<osrm::json::Array>(result.values.at("distances")).values;
+
+                    for (size_t i = first; i < last; ++i) {
+                        const size_t r = row_order[i];
+                        const auto& duration_row = std::get<osrm::json::Array>(duration_rows.at(i - first)).values;
+                        const auto& distance_row = std::get<osrm::json::Array>(distance_rows.at(i - first)).values;
+
+                        bool row_has_gaps = false;
+                        for (size_t cell = offsets[r]; cell < offsets[r + 1]; ++cell) {
+                            const size_t j = std::lower_bound(union_columns.begin(), union_columns.end(), columns[cell]) -
+                                             union_columns.begin();
+                            const auto& duration = duration_row.at(j);
+                            const auto& distance = distance_row.at(j);
+                            if (std::holds_alternative<osrm::json::Number>(duration)) {
+                                durations[cell] = std::get<osrm::json::Number>(duration).value;
+                            } else {
+                                row_has_gaps = true;
+                            }
+                            if (std::holds_alternative<osrm::json::Number>(distance)) {
+                                distances[cell] = std::get<osrm::json::Number>(distance).value;
+                            }
+                        }
+
+                        // Unreachable cells fall back to the crow-fly lower bound
+                        if (row_has_gaps && fallback_speed > 0) {
+                            lower_bounds.resize(n);
+                            haversine_row(lats[r], lons[r], lats.data(), lons.data(), cos_lats.data(), n, lower_bounds.data());
+                            for (size_t cell = offsets[r]; cell < offsets[r + 1]; ++cell) {
+                                if (durations[cell] < 0) {
+                                    distances[cell] = lower_bounds[columns[cell]];
+                                    durations[cell] = distances[cell] / fallback_speed;
+                                    estimated[cell] = 1;
+                                }
+                            }
+                        }
+                    }
+                }
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (error.empty()) {
+                    error = e.what();
+                }
+                next_batch = num_batches;
+            }
+        };
+
+        const size_t num_workers = std::max<size_t>(1, std::min<size_t>(
+            threads > 0 ? static_cast<size_t>(threads) : std::thread::hardware_concurrency(), num_batches));
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < num_workers; ++i) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : workers) {
+            thread.join();
+        }
+
+        if (!error.empty()) {
+            char* msg = new char[error.length() + 1];
+            strcpy(msg, error.c_str());
+            return {1, msg};
+        }
+
+        matrix->num_rows = n;
+        matrix->num_cells = num_cells;
+        matrix->row_offsets = copy_array(offsets);
+        matrix->column_indices = copy_array(columns);
+        matrix->durations = copy_array(durations);
+        matrix->distances = copy_array(distances);
+        matrix->estimated = copy_array(estimated);
+
+        const char* success = "Ok";
+        char* msg = new char[strlen(success) + 1];
+        strcpy(msg, success);
+        return {0, msg};
+    }
+
+    // Routes with full geometry for many origin-destination pairs over a shared set
+    // of locations. Every location is snapped once and the hints are reused by all
+    // pairs; pairs are grouped by origin so each worker thread runs the queries of
+    // one origin back to back on warm heaps. Geometry i belongs to pair i and is
+    // empty for pairs without a route.
+    OSRM_Result osrm_route_matrix(void* osrm_instance,
+                                  const double* coordinates,
+                                  size_t num_coordinates,
+                                  const size_t* pair_sources,
+                                  const size_t* pair_destinations,
+                                  size_t num_pairs,
+                                  const char* const* annotations,
+                                  size_t num_annotations,
+                                  int threads,
+                                  OSRM_RouteMatrix* matrix,
+                                  OSRM_Geometry* geometry) {
+        if (!osrm_instance) {
+            const char* err = "OSRM instance not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (!matrix || !geometry) {
+            const char* err = "Matrix and geometry outputs cannot be null";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        for (size_t i = 0; i < num_pairs; ++i) {
+            if (pair_sources[i] >= num_coordinates || pair_destinations[i] >= num_coordinates) {
+                const char* err = "Pair index out of range";
+                char* msg = new char[strlen(err) + 1];
+                strcpy(msg, err);
+                return {1, msg};
+            }
+        }
+
+        *matrix = {};
+        *geometry = {};
+        osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
+
+        const auto hints = snap_once(osrm_ptr, coordinates, num_coordinates);
+
+        // Pair indices ordered by origin, cut into one work item per origin
+        std::vector<size_t> order(num_pairs);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [&](size_t a, size_t b) { return pair_sources[a] < pair_sources[b]; });
+        std::vector<size_t> groups{0};
+        for (size_t i = 1; i < num_pairs; ++i) {
+            if (pair_sources[order[i]] != pair_sources[order[i - 1]]) {
+                groups.push_back(i);
+            }
+        }
+        groups.push_back(num_pairs);
+
+        std::vector<double> durations(num_pairs, -1.0);
+        std::vector<double> distances(num_pairs, -1.0);
+        std::vector<BinaryGeometry> parts(num_pairs);
+
+        std::atomic<size_t> next_group{0};
+        std::mutex error_mutex;
+        std::string error;
+
+        auto worker = [&] {
+            try {
+                for (size_t g = next_group++; g + 1 < groups.size(); g = next_group++) {
+                    for (size_t i = groups[g]; i < groups[g + 1]; ++i) {
+                        const size_t pair = order[i];
+                        const size_t from = pair_sources[pair];
+                        const size_t to = pair_destinations[pair];
+
+                        osrm::RouteParameters params;
+                        params.coordinates.push_back({
+                            osrm::util::FloatLongitude{coordinates[from * 2]},
+                            osrm::util::FloatLatitude{coordinates[from * 2 + 1]}
+                        });
+                        params.coordinates.push_back({
+                            osrm::util::FloatLongitude{coordinates[to * 2]},
+                            osrm::util::FloatLatitude{coordinates[to * 2 + 1]}
+                        });
+                        params.hints = {hints[from], hints[to]};
+                        set_route_annotations(params, annotations, num_annotations);
+                        params.geometries = osrm::RouteParameters::GeometriesType::GeoJSON;
+                        params.overview = osrm::RouteParameters::OverviewType::Full;
+                        params.generate_hints = false;
+                        params.skip_waypoints = true;
+
+                        osrm::json::Object result;
+                        if (osrm_ptr->Route(params, result) != osrm::Status::Ok) {
+                            std::string code;
+                            try {
+                                code = std::get<osrm::util::json::String>(result.values.at("code")).value;
+                            } catch (const std::exception& e) {
+                                code.clear();
+                            }
+                            // Unroutable pairs stay empty; anything else fails the whole call
+                            if (code != "NoRoute" && code != "NoSegment") {
+                                std::lock_guard<std::mutex> lock(error_mutex);
+                                if (error.empty()) {
+                                    try {
+                                        error = std::get<osrm::util::json::String>(result.values.at("message")).value;
+                                    } catch (const std::exception& e) {
+                                        error = "Unknown OSRM error";
+                                    }
+                                }
+                                return;
+                            }
+                            parts[pair].coordinate_offsets.push_back(0);
+                            parts[pair].leg_offsets.push_back(0);
+                            continue;
+                        }
+
+                        auto& routes = std::get<osrm::json::Array>(result.values.at("routes")).values;
+                        const auto& route = std::get<osrm::json::Object>(routes.at(0));
+                        durations[pair] = std::get<osrm::json::Number>(route.values.at("duration")).value;
+                        distances[pair] = std::get<osrm::json::Number>(route.values.at("distance")).value;
+                        routes.resize(1);
+                        take_binary_geometry(result, "routes", parts[pair]);
+                    }
+                }
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (error.empty()) {
+                    error = e.what();
+                }
+                next_group = groups.size();
+            }
+        };
+
+        const size_t num_groups = groups.size() - 1;
+        const size_t num_workers = std::max<size_t>(1, std::min<size_t>(
+            threads > 0 ? static_cast<size_t>(threads) : std::thread::hardware_concurrency(), num_groups));
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < num_workers; ++i) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : workers) {
+            thread.join();
+        }
+
+        if (!error.empty()) {
+            char* msg = new char[error.length() + 1];
+            strcpy(msg, error.c_str());
+            return {1, msg};
+        }
+
+        BinaryGeometry merged;
+        for (const auto& part : parts) {
+            append_binary_geometry(merged, part);
+        }
+
+        matrix->num_pairs = num_pairs;
+        matrix->durations = copy_array(durations);
+        matrix->distances = copy_array(distances);
+        fill_geometry(merged, geometry);
+
+        const char* success = "Ok";
+        char* msg = new char[strlen(success) + 1];
+        strcpy(msg, success);
+        return {0, msg};
+    }
+
+    // Alternative routes from OSRM's own alternative search, widened with routes
+    // through via points spread around the straight line between the endpoints.
+    // The fastest route is searched on the calling thread while the other
+    // candidates run on background workers. A candidate is kept when it is at
+    // most (1 + max_stretch) times slower than the fastest route and shares at
+    // most max_overlap of its distance with every route kept before it. Once
+    // time_budget_ms has passed (0 = no budget) the call returns the best routes
+    // found so far without waiting for candidates still being searched.
+    OSRM_Result osrm_route_alternatives(void* osrm_instance,
+                                        const double* coordinates,
+                                        size_t max_alternatives,
+                                        double max_stretch,
+                                        double max_overlap,
+                                        double time_budget_ms,
+                                        int threads) {
+        if (!osrm_instance) {
+            const char* err = "OSRM instance not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (!coordinates) {
+            return make_result(1, "Coordinates cannot be null");
+        }
+
+        const auto started = std::chrono::steady_clock::now();
+        const auto search = std::make_shared<AlternativesSearch>();
+        search->osrm = static_cast<osrm::OSRM*>(osrm_instance);
+        search->from_lon = coordinates[0];
+        search->from_lat = coordinates[1];
+        search->to_lon = coordinates[2];
+        search->to_lat = coordinates[3];
+        search->max_alternatives = max_alternatives;
+
+        // Via points at growing perpendicular offsets, nearest to the direct line
+        // first. The offsets are taken in a local equirectangular projection, so
+        // they stay perpendicular and in proportion to the trip at any latitude
+        const double meters_per_degree = EARTH_RADIUS_METERS * M_PI / 180.0;
+        const double x_scale = meters_per_degree * std::cos((search->from_lat + search->to_lat) * 0.5 * M_PI / 180.0);
+        const double dx = (search->to_lon - search->from_lon) * x_scale;
+        const double dy = (search->to_lat - search->from_lat) * meters_per_degree;
+        for (const double offset : {0.1, -0.1, 0.2, -0.2, 0.3, -0.3, 0.4, -0.4}) {
+            for (const double along : {0.5, 0.33, 0.67}) {
+                search->vias.emplace_back(search->from_lon + (dx * along - dy * offset) / x_scale,
+                                          search->from_lat + (dy * along + dx * offset) / meters_per_degree);
+            }
+        }
+        const size_t num_candidates = search->vias.size() + 2;
+        search->found.resize(num_candidates);
+        search->finished.assign(num_candidates, 0);
+
+        // Background workers take candidates 1.. and hold the engine until they
+        // stop, so osrm_destroy waits for searches that outlived their call
+        const size_t num_workers = std::max<size_t>(1, std::min<size_t>(
+            threads > 0 ? static_cast<size_t>(threads) : std::thread::hardware_concurrency(), num_candidates - 1));
+        size_t spawned = 0;
+        for (size_t i = 0; i < num_workers; ++i) {
+            begin_background_search(osrm_instance);
+            try {
+                std::thread(run_alternative_candidates, search).detach();
+                ++spawned;
+            } catch (const std::exception&) {
+                end_background_search(osrm_instance);
+            }
+        }
+
+        osrm::json::Object primary;
+        const auto primary_status = route_alternative_candidate(*search, 0, primary);
+        if (primary_status != osrm::Status::Ok) {
+            search->expired = true;
+            std::string result_str;
+            try {
+                result_str = std::get<osrm::util::json::String>(primary.values.at("message")).value;
+            } catch (const std::exception& e) {
+                result_str = "Unknown OSRM error";
+            }
+            char* msg = new char[result_str.length() + 1];
+            strcpy(msg, result_str.c_str());
+            return {1, msg};
+        }
+
+        std::vector<std::vector<AlternativeCandidate>> found(num_candidates);
+        try {
+            take_candidates(primary, found[0]);
+        } catch (const std::exception& e) {
+            search->expired = true;
+            return make_result(1, std::string("Failed to read the fastest route: ") + e.what());
+        }
+
+        if (spawned == 0) {
+            // No thread could be started, so the other candidates run here
+            begin_background_search(osrm_instance);
+            run_alternative_candidates(search);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(search->mutex);
+            const auto all_finished = [&] { return search->num_finished + 1 == num_candidates; };
+            if (time_budget_ms > 0) {
+                search->done.wait_until(lock, started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                              std::chrono::duration<double, std::milli>(time_budget_ms)),
+                                        all_finished);
+            } else {
+                search->done.wait(lock, all_finished);
+            }
+            search->expired = true;
+            for (size_t c = 1; c < num_candidates; ++c) {
+                if (search->finished[c]) {
+                    found[c] = std::move(search->found[c]);
+                }
+            }
+        }
+
+        std::vector<AlternativeCandidate*> ranked;
+        for (auto& candidates : found) {
+            for (auto& candidate : candidates) {
+                ranked.push_back(&candidate);
             }
-            
-            // Set max radius and results
-            if (user_config->max_radius_map_matching > 0) {
-                config.max_radius_map_matching = user_config->max_radius_map_matching;
+        }
+        std::stable_sort(ranked.begin(), ranked.end(),
+                         [](const auto* a, const auto* b) { return a->duration < b->duration; });
+
+        osrm::json::Array routes;
+        std::vector<std::unordered_set<uint64_t>> accepted;
+        const double fastest = ranked.empty() ? 0 : ranked.front()->duration;
+        for (auto* candidate : ranked) {
+            if (accepted.size() > max_alternatives) {
+                break;
             }
-            if (user_config->max_results_nearest > 0) {
-                config.max_results_nearest = user_config->max_results_nearest;
+            if (!accepted.empty() && candidate->duration > fastest * (1 + max_stretch)) {
+                break;
             }
-            if (user_config->max_alternatives > 0) {
-                config.max_alternatives = user_config->max_alternatives;
+            const bool diverse = std::all_of(accepted.begin(), accepted.end(), [&](const auto& segments) {
+                return overlap_with(*candidate, segments) <= max_overlap;
+            });
+            if (!diverse) {
+                continue;
             }
-            if (user_config->default_radius > 0) {
-                config.default_radius = user_config->default_radius;
+            std::unordered_set<uint64_t> segments;
+            for (const auto& segment : candidate->segments) {
+                segments.insert(segment.first);
             }
-
-            return new osrm::OSRM(config);
-        } catch (const std::exception& e) {
-            std::cerr << "Fail to create an OSRM instance: " << e.what() << std::endl;
-            return nullptr;
+            accepted.push_back(std::move(segments));
+            routes.values.push_back(std::move(candidate->route));
         }
-    }
-
-    // Backward compatibility function
-    void* osrm_create(const char* base_path, const char* algorithm, int max_table_size) {
-        OSRM_Config config = {};
-        config.algorithm = algorithm;
-        config.shared_memory = false;
-        config.dataset_name = nullptr;
-        config.mmap_memory = false;
-        config.path = base_path;
-        config.disable_feature_dataset_flags = 0;
-        config.max_locations_trip = 0;
-        config.max_locations_viaroute = 0;
-        config.max_locations_distance_table = max_table_size;
-        config.max_locations_map_matching = 0;
-        config.max_radius_map_matching = 0;
-        config.max_results_nearest = 0;
-        config.max_alternatives = 0;
-        config.default_radius = 0;
-        
-        return osrm_create_with_config(&config);
-    }
 
-    void osrm_destroy(void* osrm_instance) {
-        if (osrm_instance) {
-            delete static_cast<osrm::OSRM*>(osrm_instance);
+        osrm::json::Object response;
+        response.values["code"] = osrm::json::String{"Ok"};
+        response.values["routes"] = std::move(routes);
+        const auto waypoints = primary.values.find("waypoints");
+        if (waypoints != primary.values.end()) {
+            response.values["waypoints"] = std::move(waypoints->second);
         }
-    }
 
-    OSRM_Result osrm_table(void* osrm_instance,
-                          const double* coordinates,
-                          size_t num_coordinates,
-                          const size_t* sources,
-                          size_t num_sources,
-                          const size_t* destinations,
-                          size_t num_destinations,
-                          bool include_duration,
-                          bool include_distance,
-                          const double* bearings,
-                          size_t num_bearings,
-                          const double* radiuses,
-                          size_t num_radiuses,
-                          const char** hints,
-                          size_t num_hints,
-                          bool generate_hints,
-                          const char** approaches,
-                          size_t num_approaches,
-                          double fallback_speed,
-                          const char* fallback_coordinate,
-                          double scale_factor,
-                          const char* snapping) {
+        std::string& result_str = render_buffer();
+        osrm::util::json::render(result_str, response);
+        char* message = new char[result_str.length() + 1];
+        strcpy(message, result_str.c_str());
+        return {0, message};
+    }
 
+    OSRM_Result osrm_route(void* osrm_instance,
+                           const double* coordinates,
+                           size_t num_coordinates,
+                           const double* bearings,
+                           size_t num_bearings,
+                           const double* radiuses,
+                           size_t num_radiuses,
+                           const char* const* hints,
+                           size_t num_hints,
+                           bool generate_hints,
+                           const char* const* approaches,
+                           size_t num_approaches,
+                           const char* snapping,
+                           bool steps,
+                           int alternatives,
+                           const char* const* annotations,
+                           size_t num_annotations,
+                           const char* geometries,
+                           const char* overview,
+                           double simplify_tolerance,
+                           bool continue_straight,
+                           const char* const* exclude,
+                           size_t num_exclude,
+                           const size_t* waypoints,
+                           size_t num_waypoints,
+                           bool skip_waypoints,
+                           OSRM_Geometry* geometry)
+    {
         if (!osrm_instance) {
             const char* err = "OSRM instance not found";
             char* msg = new char[strlen(err) + 1];
@@ -180,8 +4030,32 @@ extern "C" {
             return {1, msg};
         }
 
+        SlowQueryTimer timer(osrm_instance, num_coordinates, [&] {
+            JsonLine line("route");
+            line.coordinates(coordinates, num_coordinates)
+                .numbers("bearings", bearings, num_bearings * 2)
+                .numbers("radiuses", radiuses, num_radiuses)
+                .strings("hints", hints, num_hints)
+                .flag("generate_hints", generate_hints)
+                .strings("approaches", approaches, num_approaches)
+                .string("snapping", snapping)
+                .flag("steps", steps)
+                .number("alternatives", alternatives)
+                .strings("annotations", annotations, num_annotations)
+                .string("geometries", geometries)
+                .string("overview", overview)
+                .flag("continue_straight", continue_straight)
+                .strings("exclude", exclude, num_exclude)
+                .numbers("waypoints", waypoints, num_waypoints)
+                .flag("skip_waypoints", skip_waypoints);
+            if (simplify_tolerance > 0) {
+                line.number("simplify_tolerance", simplify_tolerance);
+            }
+            return line;
+        });
+
         osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
-        osrm::TableParameters params;
+        osrm::RouteParameters params;
 
         for (size_t i = 0; i < num_coordinates; ++i) {
             params.coordinates.push_back({
@@ -190,57 +4064,44 @@ extern "C" {
             });
         }
 
-        if (num_sources > 0) {
-            params.sources.assign(sources, sources + num_sources);
-        }
-
-        if (num_destinations > 0) {
-            params.destinations.assign(destinations, destinations + num_destinations);
-        }
-
-        // Set annotations based on the flags
-        if (include_duration && include_distance) {
-            params.annotations = osrm::TableParameters::AnnotationsType::All;
-        } else if (include_duration) {
-            params.annotations = osrm::TableParameters::AnnotationsType::Duration;
-        } else if (include_distance) {
-            params.annotations = osrm::TableParameters::AnnotationsType::Distance;
-        } else {
-            params.annotations = osrm::TableParameters::AnnotationsType::None;
-        }
-
-        // Set bearings
+        // Set bearings - must match coordinates count if provided
         if (num_bearings > 0 && bearings != nullptr) {
-            for (size_t i = 0; i < num_bearings; ++i) {
-                if (bearings[i * 2] >= 0) {  // Check for valid bearing
-                    params.bearings.push_back(osrm::engine::Bearing{
-                        static_cast<short>(bearings[i * 2]),
-                        static_cast<short>(bearings[i * 2 + 1])
-                    });
-                } else {
-                    params.bearings.push_back(std::nullopt);
+            if (num_bearings == num_coordinates) {
+                for (size_t i = 0; i < num_bearings; ++i) {
+                    if (bearings[i * 2] >= 0) {
+                        params.bearings.push_back(osrm::engine::Bearing{
+                            static_cast<short>(bearings[i * 2]),
+                            static_cast<short>(bearings[i * 2 + 1])
+                        });
+                    } else {
+                        params.bearings.push_back(std::nullopt);
+                    }
                 }
             }
         }
 
-        // Set radiuses
+        // Set radiuses - must match coordinates count if provided
         if (num_radiuses > 0 && radiuses != nullptr) {
-            for (size_t i = 0; i < num_radiuses; ++i) {
-                if (radiuses[i] >= 0) {
-                    params.radiuses.push_back(radiuses[i]);
-                } else {
-                    params.radiuses.push_back(std::nullopt);
+            if (num_radiuses == num_coordinates) {
+                for (size_t i = 0; i < num_radiuses; ++i) {
+                    if (radiuses[i] >= 0) {
+                        params.radiuses.push_back(radiuses[i]);
+                    } else {
+                        params.radiuses.push_back(std::nullopt);
+                    }
                 }
             }
         }
 
-        // Set hints
+        // Set hints - must match coordinates count if provided
         if (num_hints > 0 && hints != nullptr) {
-            for (size_t i = 0; i < num_hints; ++i) {
-                if (hints[i] != nullptr && strlen(hints[i]) > 0) {
-                    params.hints.push_back(osrm::engine::Hint::FromBase64(hints[i]));
-                } else {
-                    params.hints.push_back(std::nullopt);
+            if (num_hints == num_coordinates) {
+                for (size_t i = 0; i < num_hints; ++i) {
+                    if (hints[i] != nullptr && strlen(hints[i]) > 0) {
+                        params.hints.push_back(osrm::engine::Hint::FromBase64(hints[i]));
+                    } else {
+                        params.hints.push_back(std::nullopt);
+                    }
                 }
             }
         }
@@ -248,103 +4109,261 @@ extern "C" {
         // Set generate_hints
         params.generate_hints = generate_hints;
 
-        // Set approaches
+        // Set approaches - must match coordinates count if provided
         if (num_approaches > 0 && approaches != nullptr) {
-            for (size_t i = 0; i < num_approaches; ++i) {
-                if (approaches[i] != nullptr) {
-                    std::string approach_str(approaches[i]);
-                    if (approach_str == "curb") {
-                        params.approaches.push_back(osrm::engine::Approach::CURB);
-                    } else if (approach_str == "opposite") {
-                        params.approaches.push_back(osrm::engine::Approach::OPPOSITE);
+            if (num_approaches == num_coordinates) {
+                for (size_t i = 0; i < num_approaches; ++i) {
+                    if (approaches[i] != nullptr) {
+                        std::string approach_str(approaches[i]);
+                        if (approach_str == "curb") {
+                            params.approaches.push_back(osrm::engine::Approach::CURB);
+                        } else if (approach_str == "opposite") {
+                            params.approaches.push_back(osrm::engine::Approach::OPPOSITE);
+                        } else {
+                            params.approaches.push_back(osrm::engine::Approach::UNRESTRICTED);
+                        }
                     } else {
-                        params.approaches.push_back(osrm::engine::Approach::UNRESTRICTED);
+                        params.approaches.push_back(std::nullopt);
                     }
-                } else {
-                    params.approaches.push_back(std::nullopt);
                 }
             }
         }
 
-        // Set fallback_speed
-        if (fallback_speed > 0) {
-            params.fallback_speed = fallback_speed;
+        // Set snapping
+        if (snapping != nullptr) {
+            std::string snapping_str(snapping);
+            if (snapping_str == "any") {
+                params.snapping = osrm::RouteParameters::SnappingType::Any;
+            } else {
+                params.snapping = osrm::RouteParameters::SnappingType::Default;
+            }
         }
 
-        // Set fallback_coordinate
-        if (fallback_coordinate != nullptr) {
-            std::string fallback_str(fallback_coordinate);
-            if (fallback_str == "snapped") {
-                params.fallback_coordinate_type = osrm::TableParameters::FallbackCoordinateType::Snapped;
+        // Set steps
+        params.steps = steps;
+
+        // Set alternatives
+        if (alternatives > 0) {
+            params.alternatives = true;
+            params.number_of_alternatives = alternatives;
+        } else {
+            params.alternatives = false;
+        }
+
+        // Set annotations
+        set_route_annotations(params, annotations, num_annotations);
+
+        // Set geometries ("binary" is served from GeoJSON coordinates and never rendered)
+        bool binary_geometry = false;
+        if (geometries != nullptr) {
+            std::string geometries_str(geometries);
+            if (geometries_str == "polyline") {
+                params.geometries = osrm::RouteParameters::GeometriesType::Polyline;
+            } else if (geometries_str == "polyline6") {
+                params.geometries = osrm::RouteParameters::GeometriesType::Polyline6;
+            } else if (geometries_str == "geojson") {
+                params.geometries = osrm::RouteParameters::GeometriesType::GeoJSON;
+            } else if (geometries_str == "binary" && geometry != nullptr) {
+                params.geometries = osrm::RouteParameters::GeometriesType::GeoJSON;
+                binary_geometry = true;
             } else {
-                params.fallback_coordinate_type = osrm::TableParameters::FallbackCoordinateType::Input;
+                params.geometries = osrm::RouteParameters::GeometriesType::Polyline;
+            }
+        }
+
+        // Set overview
+        if (overview != nullptr) {
+            std::string overview_str(overview);
+            if (overview_str == "simplified") {
+                params.overview = osrm::RouteParameters::OverviewType::Simplified;
+            } else if (overview_str == "full") {
+                params.overview = osrm::RouteParameters::OverviewType::Full;
+            } else if (overview_str == "false") {
+                params.overview = osrm::RouteParameters::OverviewType::False;
+            } else {
+                params.overview = osrm::RouteParameters::OverviewType::Simplified;
+            }
+        }
+
+        // A simplification tolerance replaces OSRM's zoom-based overview: the full
+        // geometry is fetched as GeoJSON, simplified here and re-encoded
+        const auto output_geometries = params.geometries;
+        const bool simplify = simplify_tolerance > 0 && params.overview != osrm::RouteParameters::OverviewType::False;
+        if (simplify) {
+            params.overview = osrm::RouteParameters::OverviewType::Full;
+            params.geometries = osrm::RouteParameters::GeometriesType::GeoJSON;
+        }
+
+        // Set continue_straight
+        params.continue_straight = continue_straight;
+
+        // Set exclude
+        if (num_exclude > 0 && exclude != nullptr) {
+            for (size_t i = 0; i < num_exclude; ++i) {
+                if (exclude[i] != nullptr) {
+                    params.exclude.push_back(std::string(exclude[i]));
+                }
             }
         }
 
-        // Set scale_factor
-        if (scale_factor > 0) {
-            params.scale_factor = scale_factor;
+        // Set waypoints
+        if (num_waypoints > 0 && waypoints != nullptr) {
+            for (size_t i = 0; i < num_waypoints; ++i) {
+                params.waypoints.push_back(waypoints[i]);
+            }
         }
 
-        // Set snapping
-        if (snapping != nullptr) {
-            std::string snapping_str(snapping);
-            if (snapping_str == "any") {
-                params.snapping = osrm::TableParameters::SnappingType::Any;
+        // Set skip_waypoints
+        params.skip_waypoints = skip_waypoints;
+
+        const auto compute = [&]() -> OSRM_Result {
+            osrm::json::Object result;
+            timer.query_started();
+            const auto status = osrm_ptr->Route(params, result);
+            timer.query_finished();
+
+            std::string& result_str = render_buffer();
+            int code;
+
+            if (status == osrm::Status::Ok) {
+                // The JSON accessors throw on an unexpected result shape, which must not
+                // escape this extern "C" function
+                try {
+                    BinaryGeometry buffers;
+                    if (simplify) {
+                        simplify_geometries(result, "routes", simplify_tolerance, output_geometries,
+                                            binary_geometry ? &buffers.significance : nullptr);
+                    }
+                    if (binary_geometry) {
+                        take_binary_geometry(result, "routes", buffers);
+                        fill_geometry(buffers, geometry);
+                    }
+                    osrm::util::json::render(result_str, result);
+                    code = 0;
+                } catch (const std::exception& e) {
+                    result_str = std::string("Failed to convert the routes geometry: ") + e.what();
+                    code = 1;
+                }
             } else {
-                params.snapping = osrm::TableParameters::SnappingType::Default;
+                code = 1;
+                try {
+                    result_str = std::get<osrm::util::json::String>(result.values.at("message")).value;
+                } catch (const std::exception& e) {
+                    result_str = "Unknown OSRM error";
+                }
             }
+
+            char* message = new char[result_str.length() + 1];
+            strcpy(message, result_str.c_str());
+
+            return {code, message};
+        };
+
+        // Binary geometry goes into the caller's own buffers, so it is never shared
+        if (binary_geometry) {
+            return compute();
         }
 
+        const auto key = [&] {
+            RequestKey key(osrm_instance, "route");
+            key.coordinates(coordinates, num_coordinates);
+            key.values(bearings, num_bearings * 2);
+            key.values(radiuses, num_radiuses);
+            key.texts(hints, num_hints);
+            key.value(generate_hints);
+            key.texts(approaches, num_approaches);
+            key.text(snapping);
+            key.value(steps);
+            key.value(alternatives);
+            key.texts(annotations, num_annotations);
+            key.text(geometries);
+            key.text(overview);
+            key.value(simplify_tolerance);
+            key.value(continue_straight);
+            key.texts(exclude, num_exclude);
+            key.values(waypoints, num_waypoints);
+            key.value(skip_waypoints);
+            return key;
+        };
+        return coalesce(osrm_instance, key, compute);
+    }
+
+    // Runs a route for totals only and reads them out of the result object
+    static OSRM_Result summarize_route(osrm::OSRM* osrm_ptr,
+                                       osrm::RouteParameters& params,
+                                       bool include_legs,
+                                       OSRM_RouteSummary* summary)
+    {
+        // Only the totals are read back, so skip everything the route plugin
+        // would otherwise assemble: guidance, geometry, annotations, hints and waypoints
+        params.steps = false;
+        params.alternatives = false;
+        params.annotations = false;
+        params.overview = osrm::RouteParameters::OverviewType::False;
+        params.generate_hints = false;
+        params.skip_waypoints = true;
+
         osrm::json::Object result;
-        const auto status = osrm_ptr->Table(params, result);
+        const auto status = osrm_ptr->Route(params, result);
 
         std::string result_str;
-        int code;
 
-        if (status == osrm::Status::Ok) {
-            code = 0;
-            osrm::util::json::render(result_str, result);
-        } else {
-            code = 1;
+        if (status != osrm::Status::Ok) {
             try {
                 result_str = std::get<osrm::util::json::String>(result.values.at("message")).value;
             } catch (const std::exception& e) {
                 result_str = "Unknown OSRM error";
             }
+            char* msg = new char[result_str.length() + 1];
+            strcpy(msg, result_str.c_str());
+            return {1, msg};
         }
 
-    char* message = new char[result_str.length() + 1];
-    strcpy(message, result_str.c_str());
+        // Read the numbers straight out of the result object instead of rendering it
+        try {
+            const auto& routes = std::get<osrm::json::Array>(result.values.at("routes")).values;
+            if (routes.empty()) {
+                const char* err = "No route were returned between those points";
+                char* msg = new char[strlen(err) + 1];
+                strcpy(msg, err);
+                return {1, msg};
+            }
+
+            const auto& route = std::get<osrm::json::Object>(routes.front());
+            summary->duration = std::get<osrm::json::Number>(route.values.at("duration")).value;
+            summary->distance = std::get<osrm::json::Number>(route.values.at("distance")).value;
+            summary->weight = std::get<osrm::json::Number>(route.values.at("weight")).value;
+
+            if (include_legs) {
+                const auto& legs = std::get<osrm::json::Array>(route.values.at("legs")).values;
+                summary->num_legs = legs.size();
+                summary->leg_durations = new double[legs.size()];
+                summary->leg_distances = new double[legs.size()];
+                for (size_t i = 0; i < legs.size(); ++i) {
+                    const auto& leg = std::get<osrm::json::Object>(legs[i]);
+                    summary->leg_durations[i] = std::get<osrm::json::Number>(leg.values.at("duration")).value;
+                    summary->leg_distances[i] = std::get<osrm::json::Number>(leg.values.at("distance")).value;
+                }
+            }
+        } catch (const std::exception& e) {
+            osrm_free_route_summary(summary);
+            std::string what = e.what();
+            char* msg = new char[what.length() + 1];
+            strcpy(msg, what.c_str());
+            return {1, msg};
+        }
 
-    return {code, message};
+        const char* success = "Ok";
+        char* msg = new char[strlen(success) + 1];
+        strcpy(msg, success);
+        return {0, msg};
     }
 
-    OSRM_Result osrm_route(void* osrm_instance,
-                           const double* coordinates,
-                           size_t num_coordinates,
-                           const double* bearings,
-                           size_t num_bearings,
-                           const double* radiuses,
-                           size_t num_radiuses,
-                           const char* const* hints,
-                           size_t num_hints,
-                           bool generate_hints,
-                           const char* const* approaches,
-                           size_t num_approaches,
-                           const char* snapping,
-                           bool steps,
-                           int alternatives,
-                           const char* const* annotations,
-                           size_t num_annotations,
-                           const char* geometries,
-                           const char* overview,
-                           bool continue_straight,
-                           const char* const* exclude,
-                           size_t num_exclude,
-                           const size_t* waypoints,
-                           size_t num_waypoints,
-                           bool skip_waypoints)
+    OSRM_Result osrm_route_summary(void* osrm_instance,
+                                   const double* coordinates,
+                                   size_t num_coordinates,
+                                   bool include_legs,
+                                   OSRM_RouteSummary* summary)
     {
         if (!osrm_instance) {
             const char* err = "OSRM instance not found";
@@ -352,6 +4371,14 @@ extern "C" {
             strcpy(msg, err);
             return {1, msg};
         }
+        if (!summary) {
+            const char* err = "Summary output cannot be null";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+
+        *summary = {};
 
         osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
         osrm::RouteParameters params;
@@ -363,200 +4390,592 @@ extern "C" {
             });
         }
 
-        // Set bearings - must match coordinates count if provided
-        if (num_bearings > 0 && bearings != nullptr) {
-            if (num_bearings == num_coordinates) {
-                for (size_t i = 0; i < num_bearings; ++i) {
-                    if (bearings[i * 2] >= 0) {
-                        params.bearings.push_back(osrm::engine::Bearing{
-                            static_cast<short>(bearings[i * 2]),
-                            static_cast<short>(bearings[i * 2 + 1])
-                        });
-                    } else {
-                        params.bearings.push_back(std::nullopt);
-                    }
-                }
-            }
+        return summarize_route(osrm_ptr, params, include_legs, summary);
+    }
+
+    // Same as osrm_route_summary with packed fixed-point [lon, lat] pairs (degrees * 1e6)
+    OSRM_Result osrm_route_summary_fixed(void* osrm_instance,
+                                         const int32_t* coordinates,
+                                         size_t num_coordinates,
+                                         bool include_legs,
+                                         OSRM_RouteSummary* summary)
+    {
+        if (!osrm_instance) {
+            const char* err = "OSRM instance not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (!summary) {
+            const char* err = "Summary output cannot be null";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
         }
 
-        // Set radiuses - must match coordinates count if provided
-        if (num_radiuses > 0 && radiuses != nullptr) {
-            if (num_radiuses == num_coordinates) {
-                for (size_t i = 0; i < num_radiuses; ++i) {
-                    if (radiuses[i] >= 0) {
-                        params.radiuses.push_back(radiuses[i]);
-                    } else {
-                        params.radiuses.push_back(std::nullopt);
+        *summary = {};
+
+        osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
+        osrm::RouteParameters params;
+
+        std::string error;
+        if (!append_fixed_coordinates(params.coordinates, coordinates, num_coordinates, error)) {
+            char* msg = new char[error.length() + 1];
+            strcpy(msg, error.c_str());
+            return {1, msg};
+        }
+
+        return summarize_route(osrm_ptr, params, include_legs, summary);
+    }
+
+    // Registers locations for repeated tables and routes: they are snapped once
+    // and, with precompute_table, the whole set-to-set table is computed up front
+    // on worker threads so later tables between members need no search at all.
+    OSRM_Result osrm_location_set_create(void* osrm_instance,
+                                         const double* coordinates,
+                                         size_t num_coordinates,
+                                         bool precompute_table,
+                                         int threads,
+                                         void** location_set)
+    {
+        if (!osrm_instance) {
+            const char* err = "OSRM instance not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (num_coordinates == 0 || !location_set) {
+            const char* err = "A location set needs at least one coordinate";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+
+        osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
+        auto set = std::make_unique<LocationSet>();
+        set->osrm = osrm_ptr;
+        for (size_t i = 0; i < num_coordinates; ++i) {
+            set->coordinates.push_back({
+                osrm::util::FloatLongitude{coordinates[i * 2]},
+                osrm::util::FloatLatitude{coordinates[i * 2 + 1]}
+            });
+        }
+        set->hints = snap_once(osrm_ptr, coordinates, num_coordinates);
+
+        if (precompute_table) {
+            const size_t n = num_coordinates;
+            set->durations.assign(n * n, -1.0);
+            set->distances.assign(n * n, -1.0);
+
+            // Each worker takes a block of source rows against every member, so
+            // the backward searches are shared by all rows of a block
+            const size_t num_workers = std::max<size_t>(1, std::min<size_t>(
+                threads > 0 ? static_cast<size_t>(threads) : std::thread::hardware_concurrency(), n));
+            const size_t block_size = (n + num_workers - 1) / num_workers;
+
+            std::atomic<size_t> next_block{0};
+            std::mutex error_mutex;
+            std::string error;
+
+            const size_t num_blocks = (n + block_size - 1) / block_size;
+            auto fail = [&](const std::string& block_error) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (error.empty()) {
+                    error = block_error;
+                }
+                next_block = num_blocks;
+            };
+
+            auto worker = [&] {
+                try {
+                    for (size_t b = next_block++; b < num_blocks; b = next_block++) {
+                        const size_t begin = b * block_size;
+                        const size_t end = std::min(n, begin + block_size);
+
+                        osrm::TableParameters params;
+                        params.coordinates = set->coordinates;
+                        params.hints = set->hints;
+                        for (size_t s = begin; s < end; ++s) {
+                            params.sources.push_back(s);
+                        }
+                        params.annotations = osrm::TableParameters::AnnotationsType::All;
+                        params.generate_hints = false;
+
+                        std::string block_error;
+                        if (!read_table(osrm_ptr, params, end - begin, n,
+                                        set->durations.data() + begin * n,
+                                        set->distances.data() + begin * n,
+                                        block_error)) {
+                            fail(block_error);
+                            return;
+                        }
                     }
+                } catch (const std::exception& e) {
+                    fail(e.what());
                 }
+            };
+
+            std::vector<std::thread> workers;
+            for (size_t i = 1; i < num_workers; ++i) {
+                workers.emplace_back(worker);
+            }
+            worker();
+            for (auto& thread : workers) {
+                thread.join();
+            }
+
+            if (!error.empty()) {
+                char* msg = new char[error.length() + 1];
+                strcpy(msg, error.c_str());
+                return {1, msg};
             }
         }
 
-        // Set hints - must match coordinates count if provided
-        if (num_hints > 0 && hints != nullptr) {
-            if (num_hints == num_coordinates) {
-                for (size_t i = 0; i < num_hints; ++i) {
-                    if (hints[i] != nullptr && strlen(hints[i]) > 0) {
-                        params.hints.push_back(osrm::engine::Hint::FromBase64(hints[i]));
-                    } else {
-                        params.hints.push_back(std::nullopt);
+        *location_set = set.release();
+
+        const char* ok = "Ok";
+        char* msg = new char[strlen(ok) + 1];
+        strcpy(msg, ok);
+        return {0, msg};
+    }
+
+    void osrm_location_set_destroy(void* location_set) {
+        delete static_cast<LocationSet*>(location_set);
+    }
+
+    // Table between members of a location set, written row-major into the
+    // caller's buffers (num_sources * num_destinations cells, -1 when unreachable)
+    OSRM_Result osrm_location_set_table(void* location_set,
+                                        const size_t* sources,
+                                        size_t num_sources,
+                                        const size_t* destinations,
+                                        size_t num_destinations,
+                                        double* durations,
+                                        double* distances)
+    {
+        if (!location_set) {
+            const char* err = "Location set not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (!durations || !distances) {
+            return make_result(1, "Table outputs cannot be null");
+        }
+
+        const auto& set = *static_cast<LocationSet*>(location_set);
+        std::string error;
+        if (check_location_ids(set, sources, num_sources, error) &&
+            check_location_ids(set, destinations, num_destinations, error)) {
+            if (!set.durations.empty()) {
+                const size_t n = set.coordinates.size();
+                for (size_t s = 0; s < num_sources; ++s) {
+                    for (size_t d = 0; d < num_destinations; ++d) {
+                        durations[s * num_destinations + d] = set.durations[sources[s] * n + destinations[d]];
+                        distances[s * num_destinations + d] = set.distances[sources[s] * n + destinations[d]];
                     }
                 }
+            } else {
+                osrm::TableParameters params;
+                for (size_t s = 0; s < num_sources; ++s) {
+                    params.coordinates.push_back(set.coordinates[sources[s]]);
+                    params.hints.push_back(set.hints[sources[s]]);
+                    params.sources.push_back(s);
+                }
+                for (size_t d = 0; d < num_destinations; ++d) {
+                    params.coordinates.push_back(set.coordinates[destinations[d]]);
+                    params.hints.push_back(set.hints[destinations[d]]);
+                    params.destinations.push_back(num_sources + d);
+                }
+                params.annotations = osrm::TableParameters::AnnotationsType::All;
+                params.generate_hints = false;
+                read_table(set.osrm, params, num_sources, num_destinations, durations, distances, error);
             }
         }
 
-        // Set generate_hints
-        params.generate_hints = generate_hints;
+        if (!error.empty()) {
+            char* msg = new char[error.length() + 1];
+            strcpy(msg, error.c_str());
+            return {1, msg};
+        }
 
-        // Set approaches - must match coordinates count if provided
-        if (num_approaches > 0 && approaches != nullptr) {
-            if (num_approaches == num_coordinates) {
-                for (size_t i = 0; i < num_approaches; ++i) {
-                    if (approaches[i] != nullptr) {
-                        std::string approach_str(approaches[i]);
-                        if (approach_str == "curb") {
-                            params.approaches.push_back(osrm::engine::Approach::CURB);
-                        } else if (approach_str == "opposite") {
-                            params.approaches.push_back(osrm::engine::Approach::OPPOSITE);
-                        } else {
-                            params.approaches.push_back(osrm::engine::Approach::UNRESTRICTED);
-                        }
-                    } else {
-                        params.approaches.push_back(std::nullopt);
-                    }
-                }
+        const char* ok = "Ok";
+        char* msg = new char[strlen(ok) + 1];
+        strcpy(msg, ok);
+        return {0, msg};
+    }
+
+    // Table from new, unregistered sources to members of a location set. Only
+    // the new sources are snapped; the members reuse their stored hints. Meant
+    // for MLD, whose table searches forward from each source only; on CH every
+    // call would repeat the backward search of each destination, so the Rust
+    // side refuses CH instances.
+    OSRM_Result osrm_location_set_table_from(void* location_set,
+                                             const double* coordinates,
+                                             size_t num_coordinates,
+                                             const size_t* destinations,
+                                             size_t num_destinations,
+                                             double* durations,
+                                             double* distances)
+    {
+        if (!location_set) {
+            const char* err = "Location set not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (!durations || !distances) {
+            return make_result(1, "Table outputs cannot be null");
+        }
+
+        const auto& set = *static_cast<LocationSet*>(location_set);
+        std::string error;
+        if (check_location_ids(set, destinations, num_destinations, error)) {
+            osrm::TableParameters params;
+            for (size_t s = 0; s < num_coordinates; ++s) {
+                params.coordinates.push_back({
+                    osrm::util::FloatLongitude{coordinates[s * 2]},
+                    osrm::util::FloatLatitude{coordinates[s * 2 + 1]}
+                });
+                params.hints.push_back(std::nullopt);
+                params.sources.push_back(s);
             }
+            for (size_t d = 0; d < num_destinations; ++d) {
+                params.coordinates.push_back(set.coordinates[destinations[d]]);
+                params.hints.push_back(set.hints[destinations[d]]);
+                params.destinations.push_back(num_coordinates + d);
+            }
+            params.annotations = osrm::TableParameters::AnnotationsType::All;
+            params.generate_hints = false;
+            read_table(set.osrm, params, num_coordinates, num_destinations, durations, distances, error);
         }
 
-        // Set snapping
-        if (snapping != nullptr) {
-            std::string snapping_str(snapping);
-            if (snapping_str == "any") {
-                params.snapping = osrm::RouteParameters::SnappingType::Any;
-            } else {
-                params.snapping = osrm::RouteParameters::SnappingType::Default;
+        if (!error.empty()) {
+            char* msg = new char[error.length() + 1];
+            strcpy(msg, error.c_str());
+            return {1, msg};
+        }
+
+        const char* ok = "Ok";
+        char* msg = new char[strlen(ok) + 1];
+        strcpy(msg, ok);
+        return {0, msg};
+    }
+
+    // Route summary through members of a location set, in the order of ids
+    OSRM_Result osrm_location_set_route_summary(void* location_set,
+                                                const size_t* ids,
+                                                size_t num_ids,
+                                                bool include_legs,
+                                                OSRM_RouteSummary* summary)
+    {
+        if (!location_set) {
+            const char* err = "Location set not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (!summary) {
+            return make_result(1, "Summary output cannot be null");
+        }
+
+        *summary = {};
+
+        const auto& set = *static_cast<LocationSet*>(location_set);
+        std::string error;
+        if (!check_location_ids(set, ids, num_ids, error)) {
+            char* msg = new char[error.length() + 1];
+            strcpy(msg, error.c_str());
+            return {1, msg};
+        }
+
+        osrm::RouteParameters params;
+        for (size_t i = 0; i < num_ids; ++i) {
+            params.coordinates.push_back(set.coordinates[ids[i]]);
+            params.hints.push_back(set.hints[ids[i]]);
+        }
+
+        return summarize_route(set.osrm, params, include_legs, summary);
+    }
+
+    // Loads the CH graph of `base_path` (the .osrm path the instance was started
+    // with) for one-to-all sweeps; sources and targets are snapped by the instance
+    OSRM_Result osrm_ch_sweep_create(void* osrm_instance, const char* base_path, void** sweep) {
+        if (!osrm_instance) {
+            return make_result(1, "OSRM instance not found");
+        }
+        if (!base_path || !sweep) {
+            return make_result(1, "A one-to-all sweep needs the dataset path");
+        }
+
+        auto loaded = std::make_unique<ChSweep>();
+        loaded->osrm = static_cast<osrm::OSRM*>(osrm_instance);
+        std::string error;
+        try {
+            const osrm::storage::StorageConfig storage_config(base_path);
+            if (!load_ch_sweep(storage_config, *loaded, error)) {
+                return make_result(1, error);
             }
+        } catch (const std::exception& e) {
+            return make_result(1, e.what());
         }
 
-        // Set steps
-        params.steps = steps;
+        *sweep = loaded.release();
+        return make_result(0, "Ok");
+    }
 
-        // Set alternatives
-        if (alternatives > 0) {
-            params.alternatives = true;
-            params.number_of_alternatives = alternatives;
-        } else {
-            params.alternatives = false;
-        }
+    void osrm_ch_sweep_destroy(void* sweep) {
+        delete static_cast<ChSweep*>(sweep);
+    }
 
-        // Set annotations
-        if (num_annotations > 0 && annotations != nullptr) {
-            params.annotations = true;
-            params.annotations_type = osrm::RouteParameters::AnnotationsType::None;
-            
-            for (size_t i = 0; i < num_annotations; ++i) {
-                if (annotations[i] != nullptr) {
-                    std::string annotation_str(annotations[i]);
-                    if (annotation_str == "true" || annotation_str == "all") {
-                        params.annotations_type = osrm::RouteParameters::AnnotationsType::All;
-                        break;
-                    } else if (annotation_str == "nodes") {
-                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
-                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Nodes));
-                    } else if (annotation_str == "distance") {
-                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
-                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Distance));
-                    } else if (annotation_str == "duration") {
-                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
-                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Duration));
-                    } else if (annotation_str == "datasources") {
-                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
-                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Datasources));
-                    } else if (annotation_str == "weight") {
-                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
-                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Weight));
-                    } else if (annotation_str == "speed") {
-                        params.annotations_type = static_cast<osrm::RouteParameters::AnnotationsType>(
-                            static_cast<int>(params.annotations_type) | static_cast<int>(osrm::RouteParameters::AnnotationsType::Speed));
-                    }
-                }
-            }
-        } else {
-            params.annotations = false;
+    // Edge-based nodes of the graph, the row length of osrm_ch_sweep_one_to_all
+    size_t osrm_ch_sweep_node_count(void* sweep) {
+        return sweep ? static_cast<ChSweep*>(sweep)->num_nodes : 0;
+    }
+
+    // Duration in seconds from each source to the start of every edge-based node,
+    // written row-major into the caller's buffer (num_sources * node count cells,
+    // -1 when unreachable, 0 for the nodes a source is on)
+    OSRM_Result osrm_ch_sweep_one_to_all(void* sweep,
+                                         const double* sources,
+                                         size_t num_sources,
+                                         int threads,
+                                         double* durations) {
+        if (!sweep) {
+            return make_result(1, "One-to-all sweep not found");
         }
+        const auto& ch = *static_cast<ChSweep*>(sweep);
 
-        // Set geometries
-        if (geometries != nullptr) {
-            std::string geometries_str(geometries);
-            if (geometries_str == "polyline") {
-                params.geometries = osrm::RouteParameters::GeometriesType::Polyline;
-            } else if (geometries_str == "polyline6") {
-                params.geometries = osrm::RouteParameters::GeometriesType::Polyline6;
-            } else if (geometries_str == "geojson") {
-                params.geometries = osrm::RouteParameters::GeometriesType::GeoJSON;
-            } else {
-                params.geometries = osrm::RouteParameters::GeometriesType::Polyline;
-            }
+        std::vector<std::vector<osrm::engine::PhantomNode>> source_phantoms;
+        std::string error;
+        if (!snap_for_sweep(ch, sources, num_sources, source_phantoms, error)) {
+            return make_result(1, error);
+        }
+        std::vector<std::vector<SweepSeed>> seeds;
+        for (const auto& phantoms : source_phantoms) {
+            seeds.push_back(sweep_seeds(ch, phantoms));
         }
 
-        // Set overview
-        if (overview != nullptr) {
-            std::string overview_str(overview);
-            if (overview_str == "simplified") {
-                params.overview = osrm::RouteParameters::OverviewType::Simplified;
-            } else if (overview_str == "full") {
-                params.overview = osrm::RouteParameters::OverviewType::Full;
-            } else if (overview_str == "false") {
-                params.overview = osrm::RouteParameters::OverviewType::False;
-            } else {
-                params.overview = osrm::RouteParameters::OverviewType::Simplified;
+        const size_t n = ch.num_nodes;
+        const auto read = [&](size_t first, const std::vector<int32_t>& weights, const std::vector<int32_t>& lane_durations) {
+            const size_t lanes = std::min(SWEEP_LANES, num_sources - first);
+            for (size_t p = 0; p < n; ++p) {
+                const size_t node = ch.node_at[p];
+                for (size_t lane = 0; lane < lanes; ++lane) {
+                    const size_t cell = p * SWEEP_LANES + lane;
+                    durations[(first + lane) * n + node] = weights[cell] >= SWEEP_UNREACHED
+                        ? -1.0
+                        : std::max(0, lane_durations[cell]) / 10.0;
+                }
             }
+        };
+        if (!run_ch_sweep_batches(ch, seeds, threads, read, error)) {
+            return make_result(1, error);
         }
+        return make_result(0, "Ok");
+    }
 
-        // Set continue_straight
-        params.continue_straight = continue_straight;
+    // Durations in seconds from each source to each target coordinate, row-major
+    // into the caller's buffer (num_sources * num_targets cells, -1 when
+    // unreachable). Every source costs one full sweep however few targets there are.
+    OSRM_Result osrm_ch_sweep_table(void* sweep,
+                                    const double* sources,
+                                    size_t num_sources,
+                                    const double* targets,
+                                    size_t num_targets,
+                                    int threads,
+                                    double* durations) {
+        if (!sweep) {
+            return make_result(1, "One-to-all sweep not found");
+        }
+        const auto& ch = *static_cast<ChSweep*>(sweep);
+
+        std::vector<std::vector<osrm::engine::PhantomNode>> source_phantoms;
+        std::vector<std::vector<osrm::engine::PhantomNode>> target_phantoms;
+        std::string error;
+        if (!snap_for_sweep(ch, sources, num_sources, source_phantoms, error) ||
+            !snap_for_sweep(ch, targets, num_targets, target_phantoms, error)) {
+            return make_result(1, error);
+        }
+        std::vector<std::vector<SweepSeed>> seeds;
+        for (const auto& phantoms : source_phantoms) {
+            seeds.push_back(sweep_seeds(ch, phantoms));
+        }
 
-        // Set exclude
-        if (num_exclude > 0 && exclude != nullptr) {
-            for (size_t i = 0; i < num_exclude; ++i) {
-                if (exclude[i] != nullptr) {
-                    params.exclude.push_back(std::string(exclude[i]));
+        const auto read = [&](size_t first, const std::vector<int32_t>& weights, const std::vector<int32_t>& lane_durations) {
+            const size_t lanes = std::min(SWEEP_LANES, num_sources - first);
+            for (size_t lane = 0; lane < lanes; ++lane) {
+                for (size_t t = 0; t < num_targets; ++t) {
+                    durations[(first + lane) * num_targets + t] =
+                        sweep_target_duration(ch, weights, lane_durations, lane, target_phantoms[t]);
                 }
             }
+        };
+        if (!run_ch_sweep_batches(ch, seeds, threads, read, error)) {
+            return make_result(1, error);
         }
+        return make_result(0, "Ok");
+    }
 
-        // Set waypoints
-        if (num_waypoints > 0 && waypoints != nullptr) {
-            for (size_t i = 0; i < num_waypoints; ++i) {
-                params.waypoints.push_back(waypoints[i]);
-            }
+    // Trip solver for large stop counts: one table, then iterated 2-opt / Or-opt
+    // local search on every worker thread from different starting tours until
+    // time_budget_ms runs out (0 = stop at the first local optimum). The best
+    // tour of all workers wins. Round trips start and end at the first stop;
+    // otherwise the trip runs from the first to the last stop.
+    OSRM_Result osrm_trip_solve(void* osrm_instance,
+                                const double* coordinates,
+                                size_t num_coordinates,
+                                bool roundtrip,
+                                double time_budget_ms,
+                                int threads,
+                                OSRM_TripSolution* solution) {
+        if (!osrm_instance) {
+            const char* err = "OSRM instance not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (!solution || num_coordinates < 2) {
+            const char* err = "A trip needs at least 2 coordinates and a solution output";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
         }
 
-        // Set skip_waypoints
-        params.skip_waypoints = skip_waypoints;
-
-        osrm::json::Object result;
-        const auto status = osrm_ptr->Route(params, result);
+        *solution = {};
+        osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
+        const size_t n = num_coordinates;
+        const auto started = std::chrono::steady_clock::now();
 
-        std::string result_str;
-        int code;
+        osrm::TableParameters params;
+        for (size_t i = 0; i < n; ++i) {
+            params.coordinates.push_back({
+                osrm::util::FloatLongitude{coordinates[i * 2]},
+                osrm::util::FloatLatitude{coordinates[i * 2 + 1]}
+            });
+        }
+        params.annotations = osrm::TableParameters::AnnotationsType::All;
+        params.generate_hints = false;
 
-        if (status == osrm::Status::Ok) {
-            code = 0;
-            osrm::util::json::render(result_str, result);
-        } else {
-            code = 1;
+        osrm::json::Object result;
+        if (osrm_ptr->Table(params, result) != osrm::Status::Ok) {
+            std::string result_str;
             try {
                 result_str = std::get<osrm::util::json::String>(result.values.at("message")).value;
             } catch (const std::exception& e) {
                 result_str = "Unknown OSRM error";
             }
+            char* msg = new char[result_str.length() + 1];
+            strcpy(msg, result_str.c_str());
+            return {1, msg};
         }
 
-        char* message = new char[result_str.length() + 1];
-        strcpy(message, result_str.c_str());
+        // Unreachable pairs get a cost no real tour reaches, so they are avoided
+        constexpr double UNREACHABLE_COST = 1e9;
+        std::vector<double> durations(n * n, -1.0), distances(n * n, -1.0), costs(n * n, UNREACHABLE_COST);
+        const auto& duration_rows = std::get<osrm::json::Array>(result.values.at("durations")).values;
+        const auto& distance_rows = std::get<osrm::json::Array>(result.values.at("distances")).values;
+        for (size_t i = 0; i < n; ++i) {
+            const auto& duration_row = std::get<osrm::json::Array>(duration_rows[i]).values;
+            const auto& distance_row = std::get<osrm::json::Array>(distance_rows[i]).values;
+            for (size_t j = 0; j < n; ++j) {
+                if (std::holds_alternative<osrm::json::Number>(duration_row[j])) {
+                    durations[i * n + j] = std::get<osrm::json::Number>(duration_row[j]).value;
+                    costs[i * n + j] = durations[i * n + j];
+                }
+                if (std::holds_alternative<osrm::json::Number>(distance_row[j])) {
+                    distances[i * n + j] = std::get<osrm::json::Number>(distance_row[j]).value;
+                }
+            }
+        }
 
-        return {code, message};
+        // Nearest-neighbour starting tour between the fixed endpoints
+        std::vector<size_t> initial{0};
+        {
+            std::vector<bool> visited(n, false);
+            visited[0] = true;
+            if (!roundtrip) {
+                visited[n - 1] = true;
+            }
+            for (size_t step = 0; step < (roundtrip ? n - 1 : n - 2); ++step) {
+                const size_t from = initial.back();
+                size_t best = n;
+                for (size_t j = 0; j < n; ++j) {
+                    if (!visited[j] && (best == n || costs[from * n + j] < costs[from * n + best])) {
+                        best = j;
+                    }
+                }
+                visited[best] = true;
+                initial.push_back(best);
+            }
+            initial.push_back(roundtrip ? 0 : n - 1);
+        }
+
+        const auto deadline = time_budget_ms > 0
+            ? started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                  std::chrono::duration<double, std::milli>(time_budget_ms))
+            : std::chrono::steady_clock::time_point::max();
+
+        const size_t num_workers = std::max<size_t>(1,
+            threads > 0 ? static_cast<size_t>(threads) : std::thread::hardware_concurrency());
+        std::vector<std::vector<size_t>> best_paths(num_workers);
+
+        auto worker = [&](size_t w) {
+            std::mt19937 rng(static_cast<unsigned>(w + 1));
+            std::vector<size_t> path = initial;
+            for (size_t kick = 0; kick < w; ++kick) {
+                double_bridge(path, rng);
+            }
+            local_search(costs, n, path, deadline);
+
+            std::vector<size_t> best = path;
+            double best_cost = path_cost(costs, n, best);
+            // Tours with fewer than 8 movable stops are too short to kick
+            const bool can_kick = path.size() >= 10;
+            while (can_kick && time_budget_ms > 0 && std::chrono::steady_clock::now() < deadline) {
+                path = best;
+                double_bridge(path, rng);
+                local_search(costs, n, path, deadline);
+                const double cost = path_cost(costs, n, path);
+                if (cost < best_cost - 1e-9) {
+                    best = path;
+                    best_cost = cost;
+                }
+            }
+            best_paths[w] = std::move(best);
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t w = 1; w < num_workers; ++w) {
+            workers.emplace_back(worker, w);
+        }
+        worker(0);
+        for (auto& thread : workers) {
+            thread.join();
+        }
+
+        const auto& best = *std::min_element(best_paths.begin(), best_paths.end(),
+            [&](const auto& a, const auto& b) { return path_cost(costs, n, a) < path_cost(costs, n, b); });
+
+        solution->num_stops = n;
+        solution->order = new size_t[n];
+        std::copy(best.begin(), best.begin() + n, solution->order);
+        solution->num_legs = best.size() - 1;
+        solution->leg_durations = new double[solution->num_legs];
+        solution->leg_distances = new double[solution->num_legs];
+        for (size_t k = 0; k + 1 < best.size(); ++k) {
+            const double duration = durations[best[k] * n + best[k + 1]];
+            const double distance = distances[best[k] * n + best[k + 1]];
+            solution->leg_durations[k] = duration;
+            solution->leg_distances[k] = distance;
+            solution->duration += std::max(duration, 0.0);
+            solution->distance += std::max(distance, 0.0);
+        }
+
+        const char* success = "Ok";
+        char* msg = new char[strlen(success) + 1];
+        strcpy(msg, success);
+        return {0, msg};
     }
 
     OSRM_Result osrm_trip(void* osrm_instance,
@@ -580,8 +4999,10 @@ extern "C" {
                           size_t num_annotations,
                           const char* geometries,
                           const char* overview,
+                          double simplify_tolerance,
                           const char* const* exclude,
-                          size_t num_exclude)
+                          size_t num_exclude,
+                          OSRM_Geometry* geometry)
     {
 
             if (!osrm_instance) {
@@ -738,7 +5159,8 @@ extern "C" {
                 params.annotations = false;
             }
 
-            // Set geometries
+            // Set geometries ("binary" is served from GeoJSON coordinates and never rendered)
+            bool binary_geometry = false;
             if (geometries != nullptr) {
                 std::string geom_str(geometries);
                 if (geom_str == "polyline") {
@@ -747,6 +5169,9 @@ extern "C" {
                     params.geometries = osrm::RouteParameters::GeometriesType::Polyline6;
                 } else if (geom_str == "geojson") {
                     params.geometries = osrm::RouteParameters::GeometriesType::GeoJSON;
+                } else if (geom_str == "binary" && geometry != nullptr) {
+                    params.geometries = osrm::RouteParameters::GeometriesType::GeoJSON;
+                    binary_geometry = true;
                 }
             }
 
@@ -762,6 +5187,14 @@ extern "C" {
                 }
             }
 
+            // Simplification tolerance, see osrm_route
+            const auto output_geometries = params.geometries;
+            const bool simplify = simplify_tolerance > 0 && params.overview != osrm::RouteParameters::OverviewType::False;
+            if (simplify) {
+                params.overview = osrm::RouteParameters::OverviewType::Full;
+                params.geometries = osrm::RouteParameters::GeometriesType::GeoJSON;
+            }
+
             // Set exclude
             if (num_exclude > 0 && exclude != nullptr) {
                 for (size_t i = 0; i < num_exclude; ++i) {
@@ -774,12 +5207,28 @@ extern "C" {
             osrm::json::Object result;
             const auto status = osrm_ptr->Trip(params, result);
 
-            std::string result_str;
+            std::string& result_str = render_buffer();
             int code;
 
             if (status == osrm::Status::Ok) {
-                code = 0;
-                osrm::util::json::render(result_str, result);
+                // The JSON accessors throw on an unexpected result shape, which must not
+                // escape this extern "C" function
+                try {
+                    BinaryGeometry buffers;
+                    if (simplify) {
+                        simplify_geometries(result, "trips", simplify_tolerance, output_geometries,
+                                            binary_geometry ? &buffers.significance : nullptr);
+                    }
+                    if (binary_geometry) {
+                        take_binary_geometry(result, "trips", buffers);
+                        fill_geometry(buffers, geometry);
+                    }
+                    osrm::util::json::render(result_str, result);
+                    code = 0;
+                } catch (const std::exception& e) {
+                    result_str = std::string("Failed to convert the trips geometry: ") + e.what();
+                    code = 1;
+                }
             } else {
                 code = 1;
                 try {
@@ -819,8 +5268,10 @@ extern "C" {
                            size_t num_annotations,
                            const char* geometries,
                            const char* overview,
+                           double simplify_tolerance,
                            const char* const* exclude,
-                           size_t num_exclude)
+                           size_t num_exclude,
+                           OSRM_Geometry* geometry)
     {
         if (!osrm_instance) {
             const char* err = "OSRM instance not found";
@@ -829,6 +5280,30 @@ extern "C" {
             return {1, msg};
         }
 
+        SlowQueryTimer timer(osrm_instance, num_coordinates, [&] {
+            JsonLine line("match");
+            line.coordinates(coordinates, num_coordinates)
+                .numbers("timestamps", timestamps, num_timestamps)
+                .numbers("radiuses", radiuses, num_radiuses)
+                .numbers("bearings", bearings, num_bearings * 2)
+                .strings("hints", hints, num_hints)
+                .flag("generate_hints", generate_hints)
+                .strings("approaches", approaches, num_approaches)
+                .string("gaps", gaps)
+                .flag("tidy", tidy)
+                .numbers("waypoints", waypoints, num_waypoints)
+                .string("snapping", snapping)
+                .flag("steps", steps)
+                .strings("annotations", annotations, num_annotations)
+                .string("geometries", geometries)
+                .string("overview", overview)
+                .strings("exclude", exclude, num_exclude);
+            if (simplify_tolerance > 0) {
+                line.number("simplify_tolerance", simplify_tolerance);
+            }
+            return line;
+        });
+
         osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
         osrm::MatchParameters params;
 
@@ -985,7 +5460,8 @@ extern "C" {
             params.annotations = false;
         }
 
-        // Set geometries
+        // Set geometries ("binary" is served from GeoJSON coordinates and never rendered)
+        bool binary_geometry = false;
         if (geometries != nullptr) {
             std::string geometries_str(geometries);
             if (geometries_str == "polyline") {
@@ -994,6 +5470,9 @@ extern "C" {
                 params.geometries = osrm::MatchParameters::GeometriesType::Polyline6;
             } else if (geometries_str == "geojson") {
                 params.geometries = osrm::MatchParameters::GeometriesType::GeoJSON;
+            } else if (geometries_str == "binary" && geometry != nullptr) {
+                params.geometries = osrm::MatchParameters::GeometriesType::GeoJSON;
+                binary_geometry = true;
             } else {
                 params.geometries = osrm::MatchParameters::GeometriesType::Polyline;
             }
@@ -1013,6 +5492,14 @@ extern "C" {
             }
         }
 
+        // Simplification tolerance, see osrm_route
+        const auto output_geometries = params.geometries;
+        const bool simplify = simplify_tolerance > 0 && params.overview != osrm::MatchParameters::OverviewType::False;
+        if (simplify) {
+            params.overview = osrm::MatchParameters::OverviewType::Full;
+            params.geometries = osrm::MatchParameters::GeometriesType::GeoJSON;
+        }
+
         // Set exclude
         if (num_exclude > 0 && exclude != nullptr) {
             for (size_t i = 0; i < num_exclude; ++i) {
@@ -1023,14 +5510,32 @@ extern "C" {
         }
 
         osrm::json::Object result;
+        timer.query_started();
         const auto status = osrm_ptr->Match(params, result);
+        timer.query_finished();
 
-        std::string result_str;
+        std::string& result_str = render_buffer();
         int code;
 
         if (status == osrm::Status::Ok) {
-            code = 0;
-            osrm::util::json::render(result_str, result);
+            // The JSON accessors throw on an unexpected result shape, which must not
+            // escape this extern "C" function
+            try {
+                BinaryGeometry buffers;
+                if (simplify) {
+                    simplify_geometries(result, "matchings", simplify_tolerance, output_geometries,
+                                        binary_geometry ? &buffers.significance : nullptr);
+                }
+                if (binary_geometry) {
+                    take_binary_geometry(result, "matchings", buffers);
+                    fill_geometry(buffers, geometry);
+                }
+                osrm::util::json::render(result_str, result);
+                code = 0;
+            } catch (const std::exception& e) {
+                result_str = std::string("Failed to convert the matchings geometry: ") + e.what();
+                code = 1;
+            }
         } else {
             code = 1;
             try {
@@ -1069,6 +5574,19 @@ extern "C" {
             return {1, msg};
         }
 
+        SlowQueryTimer timer(osrm_instance, num_coordinates, [&] {
+            JsonLine line("nearest");
+            line.coordinates(coordinates, num_coordinates)
+                .number("number", number)
+                .numbers("bearings", bearings, num_bearings * 2)
+                .numbers("radiuses", radiuses, num_radiuses)
+                .strings("hints", hints, num_hints)
+                .flag("generate_hints", generate_hints)
+                .strings("approaches", approaches, num_approaches)
+                .string("snapping", snapping);
+            return line;
+        });
+
         osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
         osrm::NearestParameters params;
 
@@ -1161,9 +5679,11 @@ extern "C" {
         }
 
         osrm::json::Object result;
+        timer.query_started();
         const auto status = osrm_ptr->Nearest(params, result);
+        timer.query_finished();
 
-        std::string result_str;
+        std::string& result_str = render_buffer();
         int code;
 
         if (status == osrm::Status::Ok) {
@@ -1228,15 +5748,182 @@ extern "C" {
         }
     }
 
-    OSRM_Result osrm_run_extract(
+    // Contracts from scratch with segment speed and turn penalty updates
+    // applied, like osrm-contract --segment-speed-file/--turn-penalty-file
+    OSRM_Result osrm_run_contract_with_updates(const char* base_path,
+                                               const char* const* segment_speed_files,
+                                               size_t num_segment_speed_files,
+                                               const char* const* turn_penalty_files,
+                                               size_t num_turn_penalty_files,
+                                               int threads) {
+        if (!base_path) {
+            return make_result(1, "Path cannot be null");
+        }
+
+        try {
+            osrm::contractor::ContractorConfig config;
+            config.base_path = std::filesystem::path(base_path);
+            config.UseDefaultOutputNames(config.base_path);
+            config.requested_num_threads = threads > 0 ? threads : std::thread::hardware_concurrency();
+            for (size_t i = 0; i < num_segment_speed_files; ++i) {
+                config.updater_config.segment_speed_lookup_paths.push_back(segment_speed_files[i]);
+            }
+            for (size_t i = 0; i < num_turn_penalty_files; ++i) {
+                config.updater_config.turn_penalty_lookup_paths.push_back(turn_penalty_files[i]);
+            }
+
+            osrm::contractor::Contractor contractor(config);
+            const int ret = contractor.Run();
+            if (ret != 0) {
+                return make_result(ret, "Contractor run returned non-zero code");
+            }
+            return make_result(0, "Contraction successful");
+        } catch (const std::exception& e) {
+            return make_result(1, e.what());
+        }
+    }
+
+    // What a partial re-contraction changed in the hierarchy, summed over its
+    // exclude hierarchies
+    struct OSRM_ContractUpdateStats {
+        size_t edges_changed;
+        size_t shortcuts_added;
+        size_t edges_removed;
+        size_t nodes_checked;
+        size_t passes;
+    };
+
+    // Applies segment speed and turn penalty updates to an existing .hsgr
+    // without contracting again: the node order of the old hierarchy is kept
+    // and only the shortcuts around changed edges are repaired
+    OSRM_Result osrm_run_contract_update(const char* base_path,
+                                         const char* const* segment_speed_files,
+                                         size_t num_segment_speed_files,
+                                         const char* const* turn_penalty_files,
+                                         size_t num_turn_penalty_files,
+                                         bool check_all_nodes,
+                                         int threads,
+                                         OSRM_ContractUpdateStats* stats) {
+        if (!base_path) {
+            return make_result(1, "Path cannot be null");
+        }
+
+        try {
+            osrm::contractor::ContractorConfig config;
+            config.base_path = std::filesystem::path(base_path);
+            config.UseDefaultOutputNames(config.base_path);
+            config.requested_num_threads = threads > 0 ? threads : std::thread::hardware_concurrency();
+            for (size_t i = 0; i < num_segment_speed_files; ++i) {
+                config.updater_config.segment_speed_lookup_paths.push_back(segment_speed_files[i]);
+            }
+            for (size_t i = 0; i < num_turn_penalty_files; ++i) {
+                config.updater_config.turn_penalty_lookup_paths.push_back(turn_penalty_files[i]);
+            }
+
+            std::vector<osrm::extractor::EdgeBasedEdge> edge_based_edges;
+            std::vector<EdgeWeight> updated_node_weights;
+            std::uint32_t connectivity_checksum = 0;
+            osrm::updater::Updater updater(config.updater_config);
+            updater.LoadAndUpdateEdgeExpandedGraph(edge_based_edges, updated_node_weights, connectivity_checksum);
+
+            // The contractor marks nodes it must not use with the top bit
+            std::vector<int32_t> node_weights(updated_node_weights.size());
+            for (size_t i = 0; i < node_weights.size(); ++i) {
+                const auto weight = static_cast<int32_t>(updated_node_weights[i]);
+                node_weights[i] = weight < 0 ? REPAIR_INFINITY : weight;
+            }
+
+            std::vector<OriginalEdge> originals;
+            originals.reserve(edge_based_edges.size());
+            for (const auto& edge : edge_based_edges) {
+                const OriginalEdge original{edge.source, edge.target, static_cast<uint32_t>(edge.data.turn_id),
+                                            std::max(static_cast<int32_t>(edge.data.weight), 1),
+                                            static_cast<int32_t>(edge.data.duration),
+                                            static_cast<float>(edge.data.distance)};
+                if (edge.data.forward) {
+                    originals.push_back(original);
+                }
+                if (edge.data.backward) {
+                    originals.push_back({edge.target, edge.source, original.turn_id, original.weight,
+                                         original.duration, original.distance});
+                }
+            }
+            // Parallel edges: only the best one can be part of a shortest path
+            std::sort(originals.begin(), originals.end(), [](const OriginalEdge& a, const OriginalEdge& b) {
+                return std::tie(a.from, a.to, a.weight) < std::tie(b.from, b.to, b.weight);
+            });
+            originals.erase(std::unique(originals.begin(), originals.end(),
+                                        [](const OriginalEdge& a, const OriginalEdge& b) {
+                                            return a.from == b.from && a.to == b.to;
+                                        }),
+                            originals.end());
+
+            const osrm::storage::StorageConfig storage_config(base_path);
+            std::string weight_name;
+            std::uint32_t old_checksum = 0;
+            const auto metric = read_ch_metric(storage_config, weight_name, old_checksum);
+            const size_t num_nodes = metric.graph.GetNumberOfNodes();
+            if (num_nodes == 0) {
+                return make_result(1, "No contracted graph for the " + weight_name + " weight");
+            }
+            if (old_checksum != connectivity_checksum) {
+                return make_result(1, "The contracted graph was built from a different edge-based graph");
+            }
+            if (metric.edge_filter.size() > 32) {
+                return make_result(1, "Too many exclude hierarchies");
+            }
+
+            RepairCounts counts;
+            std::vector<RepairGraph> hierarchies(std::max<size_t>(metric.edge_filter.size(), 1));
+            for (size_t f = 0; f < hierarchies.size(); ++f) {
+                std::string error;
+                if (!load_repair_graph(metric, f, hierarchies[f], error) ||
+                    !repair_hierarchy(hierarchies[f], originals, node_weights, check_all_nodes,
+                                      config.requested_num_threads, counts, error)) {
+                    return make_result(1, error);
+                }
+            }
+
+            std::unordered_map<std::string, osrm::contractor::ContractedMetric> metrics;
+            metrics[weight_name] = merge_repaired_hierarchies(hierarchies, num_nodes, !metric.edge_filter.empty());
+
+            // Replace the old file only once the new one is complete
+            const std::string hsgr_path = storage_config.GetPath(".osrm.hsgr").string();
+            osrm::contractor::files::writeGraph(hsgr_path + ".tmp", metrics, connectivity_checksum);
+            std::filesystem::rename(hsgr_path + ".tmp", hsgr_path);
+
+            if (stats) {
+                stats->edges_changed = counts.edges_changed;
+                stats->shortcuts_added = counts.shortcuts_added;
+                stats->edges_removed = counts.edges_removed;
+                stats->nodes_checked = counts.nodes_checked;
+                stats->passes = counts.passes;
+            }
+            return make_result(0, "Contraction update successful");
+        } catch (const std::exception& e) {
+            return make_result(1, e.what());
+        }
+    }
+
+    // Objects the Lua profile was asked about during a memoizing extraction,
+    // and how many of them were answered from the per-thread cache instead
+    struct OSRM_ProfileMemoStats {
+        uint64_t nodes;
+        uint64_t node_hits;
+        uint64_t ways;
+        uint64_t way_hits;
+    };
+
+    // Extraction shared by osrm_run_extract and osrm_run_extract_memoized;
+    // memoizes profile results when memo_stats is given
+    static OSRM_Result run_extract(
         const char* input_path,
         const char* profile_path,
         int threads,
-        bool generate_edge_based_graph,
-        bool generate_node_based_graph,
         bool parse_conditionals,
         bool use_metadata,
-        bool use_locations_cache
+        bool use_locations_cache,
+        OSRM_ProfileMemoStats* memo_stats
     ) {
         if (!input_path) {
             const char* err = "Input path cannot be null";
@@ -1280,7 +5967,17 @@ extern "C" {
                 config.location_dependent_data_paths
             );
 
-            int ret = extractor.run(scripting_environment);
+            int ret;
+            if (memo_stats) {
+                MemoizingScriptingEnvironment memoizing_environment(scripting_environment);
+                ret = extractor.run(memoizing_environment);
+                memo_stats->nodes = memoizing_environment.nodes;
+                memo_stats->node_hits = memoizing_environment.node_hits_total;
+                memo_stats->ways = memoizing_environment.ways;
+                memo_stats->way_hits = memoizing_environment.way_hits_total;
+            } else {
+                ret = extractor.run(scripting_environment);
+            }
 
             if (ret != 0) {
                 const char* err = "Extraction run returned non-zero code";
@@ -1294,12 +5991,43 @@ extern "C" {
             strcpy(msg, success);
             return {0, msg};
 
-        } catch (const std::exception& e) {
-            std::string what = e.what();
-            char* msg = new char[what.length() + 1];
-            strcpy(msg, what.c_str());
-            return {1, msg};
-        }
+        } catch (const std::exception& e) {
+            std::string what = e.what();
+            char* msg = new char[what.length() + 1];
+            strcpy(msg, what.c_str());
+            return {1, msg};
+        }
+    }
+
+    OSRM_Result osrm_run_extract(
+        const char* input_path,
+        const char* profile_path,
+        int threads,
+        bool generate_edge_based_graph,
+        bool generate_node_based_graph,
+        bool parse_conditionals,
+        bool use_metadata,
+        bool use_locations_cache
+    ) {
+        return run_extract(input_path, profile_path, threads, parse_conditionals,
+                           use_metadata, use_locations_cache, nullptr);
+    }
+
+    // Extraction that hashes the tag set of each node and way and reuses the
+    // profile's result for tag sets already seen on the same thread, cutting
+    // the time spent in Lua on inputs where many objects share identical tags
+    OSRM_Result osrm_run_extract_memoized(
+        const char* input_path,
+        const char* profile_path,
+        int threads,
+        bool parse_conditionals,
+        bool use_metadata,
+        bool use_locations_cache,
+        OSRM_ProfileMemoStats* stats
+    ) {
+        OSRM_ProfileMemoStats ignored {};
+        return run_extract(input_path, profile_path, threads, parse_conditionals,
+                           use_metadata, use_locations_cache, stats ? stats : &ignored);
     }
 
     OSRM_Result osrm_run_partition(
@@ -1411,9 +6139,779 @@ extern "C" {
         }
     }
 
+    // Builds the dataset of one departure-time bucket next to an MLD base dataset.
+    // Files that customization rewrites are copied; every other dataset file is
+    // hard-linked, so engines loading several buckets with mmap share those pages.
+    // The copy is then customized with the bucket's segment speed files.
+    OSRM_Result osrm_prepare_time_bucket(const char* base_path,
+                                         const char* bucket_path,
+                                         const char* const* segment_speed_files,
+                                         size_t num_segment_speed_files,
+                                         int threads) {
+        if (!base_path || !bucket_path) {
+            const char* err = "Paths cannot be null";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+
+        try {
+            namespace fs = std::filesystem;
+            const fs::path base(base_path);
+            const fs::path bucket(bucket_path);
+            const std::string base_name = base.filename().string();
+
+            // Every bucket file is removed before it is linked or copied, so a bucket
+            // resolving to the base itself would delete the base dataset
+            if (fs::weakly_canonical(base) == fs::weakly_canonical(bucket)) {
+                return make_result(1, "The bucket path must differ from the base path");
+            }
+            const fs::path base_dir = base.parent_path().empty() ? fs::path(".") : base.parent_path();
+            std::vector<std::pair<fs::path, fs::path>> files;
+            for (const auto& entry : fs::directory_iterator(base_dir)) {
+                const std::string name = entry.path().filename().string();
+                if (!entry.is_regular_file() || name.rfind(base_name + ".", 0) != 0) {
+                    continue;
+                }
+                const fs::path target = bucket.string() + name.substr(base_name.size());
+                if (fs::weakly_canonical(entry.path()) == fs::weakly_canonical(target)) {
+                    return make_result(1, target.string() + " is the base file " + entry.path().string());
+                }
+                files.emplace_back(entry.path(), target);
+            }
+
+            if (!bucket.parent_path().empty()) {
+                fs::create_directories(bucket.parent_path());
+            }
+
+            // Outputs of the customizer and its traffic updater
+            const std::set<std::string> rewritten = {
+                ".cell_metrics", ".mldgr", ".geometry", ".datasource_names",
+                ".turn_weight_penalties", ".turn_duration_penalties", ".enw"};
+
+            for (const auto& [source, target] : files) {
+                const std::string suffix = source.filename().string().substr(base_name.size());
+                fs::remove(target);
+                if (rewritten.count(suffix)) {
+                    fs::copy_file(source, target);
+                } else {
+                    std::error_code ec;
+                    fs::create_hard_link(source, target, ec);
+                    if (ec) {
+                        // Different filesystem: fall back to a private copy
+                        fs::copy_file(source, target);
+                    }
+                }
+            }
+
+            osrm::customizer::CustomizationConfig config;
+            config.base_path = bucket;
+            config.UseDefaultOutputNames(config.base_path);
+            config.requested_num_threads = threads > 0 ? threads : std::thread::hardware_concurrency();
+            for (size_t i = 0; i < num_segment_speed_files; ++i) {
+                config.updater_config.segment_speed_lookup_paths.push_back(segment_speed_files[i]);
+            }
+
+            osrm::customizer::Customizer customizer;
+            int ret = customizer.Run(config);
+
+            if (ret != 0) {
+                const char* err = "Customize run returned non-zero code";
+                char* msg = new char[strlen(err) + 1];
+                strcpy(msg, err);
+                return {ret, msg};
+            }
+
+            char* msg = new char[strlen(bucket_path) + 1];
+            strcpy(msg, bucket_path);
+            return {0, msg};
+
+        } catch (const std::exception& e) {
+            std::string what = e.what();
+            char* msg = new char[what.length() + 1];
+            strcpy(msg, what.c_str());
+            return {1, msg};
+        }
+    }
+
+    OSRM_Result osrm_memory_report(const char* base_path,
+                                   const char* algorithm,
+                                   int disable_feature_dataset_flags,
+                                   OSRM_MemoryReport* report) {
+        if (!base_path || !report) {
+            const char* err = "Base path and report cannot be null";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+
+        *report = {};
+        const bool mld = !algorithm || strcmp(algorithm, "CH") != 0;
+
+        // Disabled datasets go to the storage config, which then leaves out every
+        // file those features need
+        std::set<osrm::storage::FeatureDataset> disabled_datasets;
+        if (disable_feature_dataset_flags & 1) {
+            disabled_datasets.insert(osrm::storage::FeatureDataset::ROUTE_STEPS);
+        }
+        if (disable_feature_dataset_flags & 2) {
+            disabled_datasets.insert(osrm::storage::FeatureDataset::ROUTE_GEOMETRY);
+        }
+
+        try {
+            const osrm::storage::StorageConfig storage_config(base_path, disabled_datasets);
+            if (!storage_config.IsValid()) {
+                const char* err = "Required dataset files are missing";
+                char* msg = new char[strlen(err) + 1];
+                strcpy(msg, err);
+                return {1, msg};
+            }
+
+            const auto file_size = [](const std::filesystem::path& path) -> size_t {
+                std::error_code ec;
+                const auto size = std::filesystem::file_size(path, ec);
+                return ec ? 0 : static_cast<size_t>(size);
+            };
+
+            // Storage knows which files each feature dataset needs, so take its file
+            // lists instead of repeating them here
+            osrm::storage::Storage storage(storage_config);
+            auto files = storage.GetStaticFiles();
+            const auto updatable_files = storage.GetUpdatableFiles();
+            files.insert(files.end(), updatable_files.begin(), updatable_files.end());
+
+            const auto ends_with = [](const std::string& name, const std::string& suffix) {
+                return name.size() >= suffix.size() &&
+                       name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+            };
+
+            for (const auto& [required, path] : files) {
+                std::error_code ec;
+                if (!std::filesystem::exists(path, ec)) {
+                    continue;
+                }
+                const auto name = path.filename().string();
+                const bool mld_file = ends_with(name, ".osrm.mldgr") || ends_with(name, ".osrm.cells") ||
+                                      ends_with(name, ".osrm.partition") ||
+                                      ends_with(name, ".osrm.cell_metrics");
+                const bool ch_file = ends_with(name, ".osrm.hsgr");
+                if ((mld && ch_file) || (!mld && mld_file)) {
+                    continue;
+                }
+
+                size_t* component = &report->other_bytes;
+                if (ends_with(name, ".osrm.ramIndex")) {
+                    component = &report->rtree_bytes;
+                } else if (ends_with(name, ".osrm.cell_metrics")) {
+                    component = &report->cell_metrics_bytes;
+                } else if (mld_file || ch_file) {
+                    component = &report->graph_bytes;
+                } else if (ends_with(name, ".osrm.names")) {
+                    component = &report->names_bytes;
+                } else if (ends_with(name, ".osrm.geometry")) {
+                    component = &report->geometry_bytes;
+                }
+                const auto size = file_size(path);
+                *component += size;
+                report->total_bytes += size;
+            }
+
+            // The file index is not part of storage's file lists: it stays on disk
+            // and is mapped by the engine
+            const auto file_index = storage_config.GetPath(".osrm.fileIndex");
+            std::error_code ec;
+            if (std::filesystem::exists(file_index, ec)) {
+                report->file_index_bytes = file_size(file_index);
+            }
+        } catch (const std::exception& e) {
+            std::string what = e.what();
+            char* msg = new char[what.length() + 1];
+            strcpy(msg, what.c_str());
+            return {1, msg};
+        }
+
+        const char* success = "Ok";
+        char* msg = new char[strlen(success) + 1];
+        strcpy(msg, success);
+        return {0, msg};
+    }
+
+    // Runs a route between the first and last coordinate and a table over all of
+    // them on the calling thread, so OSRM creates and grows that thread's search
+    // heaps before real traffic arrives. Coordinates spread over the served area
+    // grow the heaps further.
+    OSRM_Result osrm_warm_thread(void* osrm_instance,
+                                 const double* coordinates,
+                                 size_t num_coordinates) {
+        if (!osrm_instance) {
+            const char* err = "OSRM instance not found";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (num_coordinates < 2) {
+            const char* err = "Warming up needs at least 2 coordinates";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+
+        osrm::OSRM* osrm_ptr = static_cast<osrm::OSRM*>(osrm_instance);
+
+        osrm::RouteParameters route_params;
+        route_params.coordinates.push_back({
+            osrm::util::FloatLongitude{coordinates[0]},
+            osrm::util::FloatLatitude{coordinates[1]}
+        });
+        route_params.coordinates.push_back({
+            osrm::util::FloatLongitude{coordinates[(num_coordinates - 1) * 2]},
+            osrm::util::FloatLatitude{coordinates[(num_coordinates - 1) * 2 + 1]}
+        });
+        route_params.overview = osrm::RouteParameters::OverviewType::False;
+        route_params.generate_hints = false;
+        route_params.skip_waypoints = true;
+
+        osrm::TableParameters table_params;
+        for (size_t i = 0; i < num_coordinates; ++i) {
+            table_params.coordinates.push_back({
+                osrm::util::FloatLongitude{coordinates[i * 2]},
+                osrm::util::FloatLatitude{coordinates[i * 2 + 1]}
+            });
+        }
+        table_params.generate_hints = false;
+
+        // Unroutable warm-up points still size the heaps, so only hard failures count
+        osrm::json::Object route_result;
+        osrm::json::Object table_result;
+        const auto route_status = osrm_ptr->Route(route_params, route_result);
+        const auto table_status = osrm_ptr->Table(table_params, table_result);
+        if (route_status != osrm::Status::Ok && table_status != osrm::Status::Ok) {
+            std::string result_str;
+            try {
+                result_str = std::get<osrm::util::json::String>(table_result.values.at("message")).value;
+            } catch (const std::exception& e) {
+                result_str = "Unknown OSRM error";
+            }
+            char* msg = new char[result_str.length() + 1];
+            strcpy(msg, result_str.c_str());
+            return {1, msg};
+        }
+
+        const char* success = "Ok";
+        char* msg = new char[strlen(success) + 1];
+        strcpy(msg, success);
+        return {0, msg};
+    }
+
+    // Frees the calling thread's search heaps. OSRM clears but never shrinks
+    // them, so one oversized query would otherwise pin its memory for the life
+    // of the thread; the next query recreates them at the dataset's size.
+    void osrm_release_thread_heaps() {
+        using CH = osrm::engine::SearchEngineData<osrm::engine::routing_algorithms::ch::Algorithm>;
+        using MLD = osrm::engine::SearchEngineData<osrm::engine::routing_algorithms::mld::Algorithm>;
+
+        CH::forward_heap_1.reset();
+        CH::reverse_heap_1.reset();
+        CH::forward_heap_2.reset();
+        CH::reverse_heap_2.reset();
+        CH::forward_heap_3.reset();
+        CH::reverse_heap_3.reset();
+        CH::many_to_many_heap.reset();
+
+        MLD::forward_heap_1.reset();
+        MLD::reverse_heap_1.reset();
+        MLD::many_to_many_heap.reset();
+        MLD::map_matching_forward_heap_1.reset();
+        MLD::map_matching_reverse_heap_1.reset();
+    }
+
+    // Recreates the calling thread's search heaps for the algorithm with room for
+    // `node_count` nodes. OSRM only sizes heaps when a thread has none and clears
+    // existing ones for later queries, so a worker reserved here starts at this
+    // size instead of growing into it under traffic.
+    OSRM_Result osrm_reserve_thread_heaps(const char* algorithm, size_t node_count) {
+        if (node_count == 0) {
+            return make_result(1, "Node count must be positive");
+        }
+        const auto nodes = static_cast<unsigned>(
+            std::min<size_t>(node_count, std::numeric_limits<unsigned>::max()));
+
+        try {
+            osrm_release_thread_heaps();
+            if (algorithm && strcmp(algorithm, "CH") != 0) {
+                osrm::engine::SearchEngineData<osrm::engine::routing_algorithms::mld::Algorithm> heaps;
+                heaps.InitializeOrClearFirstThreadLocalStorage(nodes, nodes);
+                heaps.InitializeOrClearManyToManyThreadLocalStorage(nodes, nodes);
+                heaps.InitializeOrClearMapMatchingThreadLocalStorage(nodes, nodes);
+            } else {
+                osrm::engine::SearchEngineData<osrm::engine::routing_algorithms::ch::Algorithm> heaps;
+                heaps.InitializeOrClearFirstThreadLocalStorage(nodes);
+                heaps.InitializeOrClearSecondThreadLocalStorage(nodes);
+                heaps.InitializeOrClearThirdThreadLocalStorage(nodes);
+                heaps.InitializeOrClearManyToManyThreadLocalStorage(nodes);
+            }
+        } catch (const std::exception& e) {
+            osrm_release_thread_heaps();
+            return make_result(1, e.what());
+        }
+        return make_result(0, "Ok");
+    }
+
+    // Online NUMA nodes that have CPUs, in id order. Node ids can be sparse and
+    // memory-only nodes cannot run a pinned thread, so only these get replicas.
+    // Writes up to `capacity` ids and returns how many there are; machines (or
+    // platforms) without NUMA topology report node 0 alone.
+    size_t osrm_numa_nodes(size_t* nodes, size_t capacity) {
+        std::vector<size_t> with_cpus;
+#ifdef __linux__
+        for (const size_t node : parse_sysfs_list(read_sysfs_line("/sys/devices/system/node/online"))) {
+            const auto cpus = parse_sysfs_list(read_sysfs_line(
+                "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+            if (!cpus.empty()) {
+                with_cpus.push_back(node);
+            }
+        }
+#endif
+        if (with_cpus.empty()) {
+            with_cpus.push_back(0);
+        }
+        for (size_t i = 0; nodes && i < std::min(capacity, with_cpus.size()); ++i) {
+            nodes[i] = with_cpus[i];
+        }
+        return with_cpus.size();
+    }
+
+    // NUMA node of the CPU the calling thread is running on, 0 when unknown
+    size_t osrm_numa_current_node() {
+#ifdef __linux__
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+            return node;
+        }
+#endif
+        return 0;
+    }
+
+    // Restricts the calling thread to the CPUs of one NUMA node. Memory the
+    // thread touches first is then allocated on that node by the kernel's
+    // default first-touch policy, which is how per-node replicas end up local.
+    OSRM_Result osrm_numa_pin_thread(size_t node) {
+        std::string error;
+#ifdef __linux__
+        const auto cpus = parse_sysfs_list(read_sysfs_line(
+            "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+        if (cpus.empty()) {
+            error = "NUMA node " + std::to_string(node) + " has no CPUs";
+        } else {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (const size_t cpu : cpus) {
+                if (cpu < CPU_SETSIZE) {
+                    CPU_SET(cpu, &set);
+                }
+            }
+            if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+                error = std::string("sched_setaffinity failed: ") + strerror(errno);
+            }
+        }
+#else
+        if (node != 0) {
+            error = "Thread pinning is only supported on Linux";
+        }
+#endif
+
+        if (!error.empty()) {
+            char* msg = new char[error.length() + 1];
+            strcpy(msg, error.c_str());
+            return {1, msg};
+        }
+
+        const char* ok = "Ok";
+        char* msg = new char[strlen(ok) + 1];
+        strcpy(msg, ok);
+        return {0, msg};
+    }
+
+    // Memory of the calling process by sharing state, from /proc/self/smaps_rollup.
+    // After a fork every page inherited from the parent counts as shared until
+    // one side writes to it; private pages are the copy-on-write cost.
+    struct OSRM_PageReport {
+        size_t rss_bytes;
+        size_t shared_clean_bytes;
+        size_t shared_dirty_bytes;
+        size_t private_clean_bytes;
+        size_t private_dirty_bytes;
+        size_t page_size;
+    };
+
+    OSRM_Result osrm_page_report(OSRM_PageReport* report) {
+        if (!report) {
+            return make_result(1, "Page report not provided");
+        }
+        *report = OSRM_PageReport{};
+        report->page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+        std::ifstream rollup("/proc/self/smaps_rollup");
+        if (!rollup) {
+            return make_result(1, "Page sharing can only be inspected on Linux 4.14 or newer");
+        }
+
+        const std::pair<const char*, size_t*> fields[] = {
+            {"Rss:", &report->rss_bytes},
+            {"Shared_Clean:", &report->shared_clean_bytes},
+            {"Shared_Dirty:", &report->shared_dirty_bytes},
+            {"Private_Clean:", &report->private_clean_bytes},
+            {"Private_Dirty:", &report->private_dirty_bytes},
+        };
+        std::string line;
+        while (std::getline(rollup, line)) {
+            for (const auto& [name, value] : fields) {
+                if (line.rfind(name, 0) == 0) {
+                    // Values are reported in kB
+                    *value = std::stoull(line.substr(strlen(name))) * 1024;
+                }
+            }
+        }
+        return make_result(0, "Ok");
+    }
+
+    // Forks a worker sharing the loaded dataset copy-on-write. Returns the
+    // child's pid in the parent and 0 in the child, like fork itself. Must be
+    // called before the process starts any thread.
+    OSRM_Result osrm_fork_worker(int* pid) {
+        if (!pid) {
+            return make_result(1, "Worker pid output cannot be null");
+        }
+        std::cout.flush();
+        std::cerr.flush();
+        const pid_t child = fork();
+        if (child < 0) {
+            return make_result(1, std::string("Failed to fork worker: ") + strerror(errno));
+        }
+        *pid = static_cast<int>(child);
+        return make_result(0, "Ok");
+    }
+
+    // Waits for a forked worker and stores its exit code, or 128 + signal
+    OSRM_Result osrm_wait_worker(int pid, int* exit_code) {
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) {
+                return make_result(1, std::string("Failed to wait for worker: ") + strerror(errno));
+            }
+        }
+        *exit_code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+        return make_result(0, "Ok");
+    }
+
+    // Ends a forked worker with `code` after flushing its output. _exit skips the
+    // exit handlers and static destructors the worker inherited from the parent,
+    // which would otherwise tear down state the parent still owns (TBB, the
+    // engine's datasets) from inside the child.
+    void osrm_exit_worker(int code) {
+        std::cout.flush();
+        std::cerr.flush();
+        std::fflush(nullptr);
+        _exit(code);
+    }
+
+    // Asks a forked worker to stop with SIGTERM; reap it with osrm_wait_worker
+    OSRM_Result osrm_kill_worker(int pid) {
+        if (kill(static_cast<pid_t>(pid), SIGTERM) != 0 && errno != ESRCH) {
+            return make_result(1, std::string("Failed to stop worker: ") + strerror(errno));
+        }
+        return make_result(0, "Ok");
+    }
+
+    // Forks a probe that warms up on `coordinates` like a fresh worker would and
+    // reports its pages before and after, so the pages a worker copies out of
+    // the shared dataset can be measured without touching the real workers.
+    OSRM_Result osrm_prefork_check(void* osrm_instance,
+                                   const double* coordinates,
+                                   size_t num_coordinates,
+                                   OSRM_PageReport* before,
+                                   OSRM_PageReport* after) {
+        if (!osrm_instance) {
+            return make_result(1, "OSRM instance not found");
+        }
+        if (!before || !after) {
+            return make_result(1, "Page report outputs cannot be null");
+        }
+
+        int pipe_fds[2];
+        if (pipe(pipe_fds) != 0) {
+            return make_result(1, std::string("Failed to create probe pipe: ") + strerror(errno));
+        }
+
+        std::cout.flush();
+        std::cerr.flush();
+        const pid_t pid = fork();
+        if (pid < 0) {
+            close(pipe_fds[0]);
+            close(pipe_fds[1]);
+            return make_result(1, std::string("Failed to fork probe: ") + strerror(errno));
+        }
+
+        if (pid == 0) {
+            close(pipe_fds[0]);
+            OSRM_PageReport reports[2] {};
+            OSRM_Result first = osrm_page_report(&reports[0]);
+            OSRM_Result warm = osrm_warm_thread(osrm_instance, coordinates, num_coordinates);
+            OSRM_Result second = osrm_page_report(&reports[1]);
+            const bool ok = first.code == 0 && warm.code == 0 && second.code == 0;
+            if (ok) {
+                const char* data = reinterpret_cast<const char*>(reports);
+                size_t remaining = sizeof(reports);
+                while (remaining > 0) {
+                    const ssize_t written = write(pipe_fds[1], data, remaining);
+                    if (written <= 0 && errno != EINTR) break;
+                    if (written > 0) {
+                        data += written;
+                        remaining -= static_cast<size_t>(written);
+                    }
+                }
+            }
+            _exit(ok ? 0 : 1);
+        }
+
+        close(pipe_fds[1]);
+        OSRM_PageReport reports[2] {};
+        char* data = reinterpret_cast<char*>(reports);
+        size_t received = 0;
+        while (received < sizeof(reports)) {
+            const ssize_t n = read(pipe_fds[0], data + received, sizeof(reports) - received);
+            if (n > 0) {
+                received += static_cast<size_t>(n);
+            } else if (n == 0 || errno != EINTR) {
+                break;
+            }
+        }
+        close(pipe_fds[0]);
+
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+
+        if (received < sizeof(reports)) {
+            return make_result(1, "Prefork probe failed to warm up or to read its page report");
+        }
+        *before = reports[0];
+        *after = reports[1];
+        return make_result(0, "Ok");
+    }
+
+    // Operator new calls made by the calling thread so far, 0 unless built with
+    // the `alloc-stats` feature
+    uint64_t osrm_thread_allocations() {
+#ifdef OSRM_BINDING_ALLOC_STATS
+        return thread_allocations;
+#else
+        return 0;
+#endif
+    }
+
     void osrm_free_string(char* s) {
         if (s) {
             delete[] s;
         }
     }
+
+    OSRM_Result osrm_run_pipeline(const OSRM_PipelineConfig* pipeline_config,
+                                  const OSRM_RunControl* control,
+                                  OSRM_PipelineReport* report) {
+        if (!pipeline_config || !pipeline_config->input_path) {
+            const char* err = "Input path cannot be null";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (!pipeline_config->profile_path) {
+            const char* err = "Profile path cannot be null";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+        if (!pipeline_config->build_ch && !pipeline_config->build_mld) {
+            const char* err = "Pipeline needs at least one of CH or MLD outputs";
+            char* msg = new char[strlen(err) + 1];
+            strcpy(msg, err);
+            return {1, msg};
+        }
+
+        if (report) {
+            *report = {};
+        }
+
+        // The later stages take the .osrm base path the extractor derives from the input
+        osrm::extractor::ExtractorConfig naming;
+        naming.UseDefaultOutputNames(std::filesystem::path(pipeline_config->input_path));
+        const std::string osrm_path = naming.base_path.string() + ".osrm";
+
+        // Stages may report from two threads at once when CH and MLD build concurrently
+        SerializedProgress serialized;
+        serialized.control = control;
+        OSRM_RunControl stage_control = control ? *control : OSRM_RunControl{};
+        if (control && control->progress) {
+            stage_control.progress = serialized_progress;
+            stage_control.user_data = &serialized;
+        }
+
+        std::mutex report_mutex;
+
+        // Runs one stage and records its timing and peak memory
+        auto run_stage = [&](const char* stage,
+                             const std::vector<std::string>& command,
+                             const std::function<OSRM_Result()>& in_process) {
+            const auto stage_start = std::chrono::steady_clock::now();
+            size_t stage_peak_rss = 0;
+            OSRM_Result result = run_controlled_stage(stage, &stage_control, command, in_process, &stage_peak_rss);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - stage_start).count();
+            {
+                std::lock_guard<std::mutex> lock(report_mutex);
+                if (report && report->num_stages < 4) {
+                    report->stages[report->num_stages++] = {stage, seconds, stage_peak_rss};
+                }
+            }
+            return result;
+        };
+
+        const auto& c = *pipeline_config;
+        OSRM_Result extract_result = run_stage("extract",
+                                               extract_command(c.input_path, c.profile_path, c.threads,
+                                                               c.parse_conditionals, c.use_metadata,
+                                                               c.use_locations_cache),
+                                               [&] {
+                                                   return run_extract(c.input_path, c.profile_path, c.threads,
+                                                                      c.parse_conditionals, c.use_metadata,
+                                                                      c.use_locations_cache, nullptr);
+                                               });
+        if (extract_result.code != 0) {
+            return extract_result;
+        }
+        osrm_free_string(extract_result.message);
+
+        // Partitioning renumbers the edge-based graph on disk, so it has to finish
+        // before contraction reads it. Customization and contraction only read the
+        // renumbered graph and write disjoint outputs, so they run side by side.
+        if (c.build_mld) {
+            OSRM_Result partition_result = run_stage("partition",
+                                                     partition_command(osrm_path.c_str(), c.threads, c.balance,
+                                                                       c.boundary_factor, c.num_optimizing_cuts,
+                                                                       c.small_component_size, c.max_cell_sizes,
+                                                                       c.num_max_cell_sizes),
+                                                     [&] {
+                                                         return osrm_run_partition(osrm_path.c_str(), c.threads, c.balance,
+                                                                                   c.boundary_factor, c.num_optimizing_cuts,
+                                                                                   c.small_component_size, c.max_cell_sizes,
+                                                                                   c.num_max_cell_sizes);
+                                                     });
+            if (partition_result.code != 0) {
+                return partition_result;
+            }
+            osrm_free_string(partition_result.message);
+        }
+
+        // Stages running in process share its memory, so they only run side by
+        // side as separate tool processes
+        OSRM_Result contract_result = {0, nullptr};
+        const auto contract = [&] {
+            contract_result = run_stage("contract", threaded_command("osrm-contract", osrm_path.c_str(), c.threads),
+                                        [&] { return osrm_run_contract(osrm_path.c_str(), c.threads); });
+        };
+        std::thread contract_thread;
+        if (c.build_ch && runs_as_tool(&stage_control, stage_tool(&stage_control, "osrm-contract"))) {
+            contract_thread = std::thread(contract);
+        }
+
+        OSRM_Result customize_result = {0, nullptr};
+        if (c.build_mld) {
+            customize_result = run_stage("customize", threaded_command("osrm-customize", osrm_path.c_str(), c.threads),
+                                         [&] { return osrm_run_customize(osrm_path.c_str(), c.threads); });
+        }
+
+        if (contract_thread.joinable()) {
+            contract_thread.join();
+        } else if (c.build_ch && customize_result.code == 0) {
+            contract();
+        }
+
+        if (customize_result.code != 0) {
+            osrm_free_string(contract_result.message);
+            return customize_result;
+        }
+        if (contract_result.code != 0) {
+            osrm_free_string(customize_result.message);
+            return contract_result;
+        }
+        osrm_free_string(customize_result.message);
+        osrm_free_string(contract_result.message);
+
+        // On success the message carries the .osrm path to load the engine from
+        char* msg = new char[osrm_path.length() + 1];
+        strcpy(msg, osrm_path.c_str());
+        return {0, msg};
+    }
+
+    OSRM_Result osrm_run_extract_controlled(
+        const char* input_path,
+        const char* profile_path,
+        int threads,
+        bool parse_conditionals,
+        bool use_metadata,
+        bool use_locations_cache,
+        const OSRM_RunControl* control
+    ) {
+        if (!input_path || !profile_path) {
+            return make_result(1, "Paths cannot be null");
+        }
+        return run_controlled_stage("extract", control,
+                                    extract_command(input_path, profile_path, threads,
+                                                    parse_conditionals, use_metadata, use_locations_cache),
+                                    [&] {
+                                        return run_extract(input_path, profile_path, threads, parse_conditionals,
+                                                           use_metadata, use_locations_cache, nullptr);
+                                    },
+                                    nullptr);
+    }
+
+    OSRM_Result osrm_run_partition_controlled(
+        const char* base_path,
+        int threads,
+        double balance,
+        double boundary_factor,
+        int num_optimizing_cuts,
+        int small_component_size,
+        const int* max_cell_sizes,
+        size_t num_max_cell_sizes,
+        const OSRM_RunControl* control
+    ) {
+        if (!base_path) {
+            return make_result(1, "Path cannot be null");
+        }
+        return run_controlled_stage("partition", control,
+                                    partition_command(base_path, threads, balance, boundary_factor, num_optimizing_cuts,
+                                                      small_component_size, max_cell_sizes, num_max_cell_sizes),
+                                    [&] {
+                                        return osrm_run_partition(base_path, threads, balance, boundary_factor,
+                                                                  num_optimizing_cuts, small_component_size,
+                                                                  max_cell_sizes, num_max_cell_sizes);
+                                    },
+                                    nullptr);
+    }
+
+    OSRM_Result osrm_run_customize_controlled(const char* base_path, int threads, const OSRM_RunControl* control) {
+        if (!base_path) {
+            return make_result(1, "Path cannot be null");
+        }
+        return run_controlled_stage("customize", control, threaded_command("osrm-customize", base_path, threads),
+                                    [&] { return osrm_run_customize(base_path, threads); }, nullptr);
+    }
+
+    OSRM_Result osrm_run_contract_controlled(const char* base_path, int threads, const OSRM_RunControl* control) {
+        if (!base_path) {
+            return make_result(1, "Path cannot be null");
+        }
+        return run_controlled_stage("contract", control, threaded_command("osrm-contract", base_path, threads),
+                                    [&] { return osrm_run_contract(base_path, threads); }, nullptr);
+    }
 }